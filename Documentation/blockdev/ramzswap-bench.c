@@ -0,0 +1,277 @@
+/*
+ * ramzswap-bench.c - compare the compressors of a ramzswap device
+ *
+ * For each compressor given with -c, the device is reset, set to that
+ * compressor and a disk size of -s MB, and initialized.  Then -s MB of
+ * sample data are written to it page by page with O_DIRECT, as swap
+ * writeout does, and read back and checked.  The write and read
+ * throughput and the compression ratio from RZSIO_GET_STATS are
+ * printed for each compressor.
+ *
+ * The sample data is taken from -f <file>, repeated as needed; a dump of
+ * the heap of a real application (e.g. from /proc/<pid>/mem) gives the
+ * most representative ratios.  Without -f a mix of zero, text-like and
+ * random pages is generated.
+ *
+ * The device must not be in use as swap.  It is reset again at the end.
+ *
+ * Build: gcc -O2 -Wall -I<kernel>/drivers/staging/ramzswap \
+ *            -o ramzswap-bench ramzswap-bench.c
+ *
+ * Usage: ramzswap-bench [-c lzo,deflate,...] [-s MB] [-f file]
+ *                       /dev/ramzswap<N>
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+#include "ramzswap_ioctl.h"
+
+static const char *dev;
+static long page_size;
+static size_t nr_pages;
+static char *data;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void gen_data(void)
+{
+	static const char *words[] = {
+		"the ", "swap ", "page ", "android ", "0x00000000 ",
+		"activity ", "null ", "com.android.", "\n", "    ",
+	};
+	size_t i, j;
+
+	srand(1);
+	for (i = 0; i < nr_pages; i++) {
+		char *p = data + i * page_size;
+
+		switch (i % 8) {
+		case 0:
+			/* zero filled, not compressed at all */
+			memset(p, 0, page_size);
+			break;
+		case 1:
+			/* incompressible */
+			for (j = 0; j < page_size; j++)
+				p[j] = rand();
+			break;
+		case 2:
+		case 3:
+		case 4:
+			/* text-like */
+			for (j = 0; j < page_size; ) {
+				const char *w = words[rand() % 10];
+				size_t len = strlen(w);
+
+				if (len > page_size - j)
+					len = page_size - j;
+				memcpy(p + j, w, len);
+				j += len;
+			}
+			break;
+		default:
+			/* pointer-like words, mostly small values */
+			for (j = 0; j < page_size; j += 4)
+				*(u32 *)(p + j) = rand() % 7 ?
+					rand() % 256 : 0x40000000 + rand();
+			break;
+		}
+	}
+}
+
+static void read_data(const char *name)
+{
+	size_t len = nr_pages * page_size, done = 0;
+	ssize_t n;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		perror(name);
+		exit(1);
+	}
+	while (done < len) {
+		n = read(fd, data + done, len - done);
+		if (n < 0) {
+			perror(name);
+			exit(1);
+		}
+		if (n == 0) {
+			if (!done) {
+				fprintf(stderr, "%s is empty\n", name);
+				exit(1);
+			}
+			/* repeat the file */
+			memcpy(data + done, data, len - done < done ?
+			       len - done : done);
+			done += len - done < done ? len - done : done;
+			continue;
+		}
+		done += n;
+	}
+	close(fd);
+}
+
+static int setup(const char *comp, size_t disksize_kb)
+{
+	char name[MAX_COMPRESSOR_NAME_LEN];
+	int fd;
+
+	fd = open(dev, O_RDWR);
+	if (fd < 0) {
+		perror(dev);
+		exit(1);
+	}
+	if (ioctl(fd, RZSIO_RESET)) {
+		perror("RZSIO_RESET");
+		exit(1);
+	}
+	memset(name, 0, sizeof(name));
+	strncpy(name, comp, sizeof(name) - 1);
+	if (ioctl(fd, RZSIO_SET_COMPRESSOR, name)) {
+		fprintf(stderr, "%s: %s\n", comp, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (ioctl(fd, RZSIO_SET_DISKSIZE_KB, &disksize_kb) ||
+	    ioctl(fd, RZSIO_INIT)) {
+		perror("RZSIO_SET_DISKSIZE_KB/RZSIO_INIT");
+		exit(1);
+	}
+	return fd;
+}
+
+static void bench(const char *comp)
+{
+	struct ramzswap_ioctl_stats st;
+	double t, t_write, t_read;
+	size_t i, mb;
+	char *buf;
+	int fd, dfd;
+
+	/* page 0 is left alone, it holds the swap header */
+	fd = setup(comp, (nr_pages + 1) * page_size / 1024);
+	if (fd < 0)
+		return;
+
+	dfd = open(dev, O_RDWR | O_DIRECT);
+	if (dfd < 0) {
+		perror(dev);
+		exit(1);
+	}
+	if (posix_memalign((void **)&buf, page_size, page_size)) {
+		perror("posix_memalign");
+		exit(1);
+	}
+
+	t = now();
+	for (i = 0; i < nr_pages; i++) {
+		memcpy(buf, data + i * page_size, page_size);
+		if (pwrite(dfd, buf, page_size, (i + 1) * page_size) !=
+		    page_size) {
+			perror("write");
+			exit(1);
+		}
+	}
+	t_write = now() - t;
+
+	t = now();
+	for (i = 0; i < nr_pages; i++) {
+		if (pread(dfd, buf, page_size, (i + 1) * page_size) !=
+		    page_size) {
+			perror("read");
+			exit(1);
+		}
+		if (memcmp(buf, data + i * page_size, page_size)) {
+			fprintf(stderr, "%s: page %zu corrupted\n", comp, i + 1);
+			exit(1);
+		}
+	}
+	t_read = now() - t;
+
+	if (ioctl(fd, RZSIO_GET_STATS, &st)) {
+		perror("RZSIO_GET_STATS");
+		exit(1);
+	}
+
+	mb = nr_pages * page_size >> 20;
+	printf("%-12s write %8.1f MB/s  read %8.1f MB/s  "
+	       "compressed %6.1f%%  memory %llu KB  incompressible %u%%\n",
+	       comp, mb / t_write, mb / t_read,
+	       st.orig_data_size ?
+	       100.0 * st.compr_data_size / st.orig_data_size : 0.0,
+	       (unsigned long long)st.mem_used_total >> 10,
+	       st.pages_expand_pct);
+
+	free(buf);
+	close(dfd);
+	ioctl(fd, RZSIO_RESET);
+	close(fd);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c lzo,deflate,...] [-s MB] [-f file] "
+		"/dev/ramzswap<N>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char *comps = strdup("lzo,deflate"), *comp, *file = NULL;
+	int size_mb = 64, c;
+
+	while ((c = getopt(argc, argv, "c:s:f:")) != -1) {
+		switch (c) {
+		case 'c':
+			comps = optarg;
+			break;
+		case 's':
+			size_mb = atoi(optarg);
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || size_mb < 1)
+		usage(argv[0]);
+	dev = argv[optind];
+
+	page_size = sysconf(_SC_PAGESIZE);
+	nr_pages = ((size_t)size_mb << 20) / page_size;
+	data = malloc(nr_pages * page_size);
+	if (!data) {
+		perror("malloc");
+		return 1;
+	}
+	if (file)
+		read_data(file);
+	else
+		gen_data();
+
+	printf("%zu pages of %s\n", nr_pages, file ? file : "generated data");
+	for (comp = strtok(comps, ","); comp; comp = strtok(NULL, ","))
+		bench(comp);
+	return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ * memcg-lmk-test.c - memory cgroup pressure notification and lowmemorykiller
+ *
+ * Sets up two memory cgroups the way an Android userspace would:
+ *
+ *   <mnt>/lmktest_fg   unlimited, one foreground task (oom_adj 0)
+ *   <mnt>/lmktest_bg   limited, background tasks (oom_adj 6 and up)
+ *
+ * and registers an eventfd on memory.pressure_eventfd of both.  The
+ * background tasks then grow past the limit of their cgroup while the
+ * foreground one keeps touching its memory.  The test checks that:
+ *
+ *   - the background cgroup's eventfd is signalled, the foreground's not
+ *   - background tasks get killed and the foreground task survives
+ *   - a registration whose eventfd is closed by its only owner is dropped
+ *     (memory.pressure_eventfd counts down again)
+ *
+ * Kills may come from the lowmemorykiller's per-cgroup thresholds or, if
+ * those are not crossed first, from the memcg OOM killer; with
+ * lowmemorykiller.debug_level=2 the kernel log tells which.
+ *
+ * Build: gcc -O2 -Wall -o memcg-lmk-test memcg-lmk-test.c
+ *
+ * Usage: memcg-lmk-test [-l limit MB] [-n tasks] [-s task MB]
+ *                       [-t seconds] <memory cgroup mount>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MB		(1024 * 1024)
+
+static int limit_mb = 32;
+static int nr_tasks = 8;
+static int task_mb = 8;
+static int seconds = 30;
+static const char *mnt;
+static char fg_dir[256], bg_dir[256];
+
+static int write_file(const char *dir, const char *name, const char *fmt, ...)
+{
+	char path[512], buf[64];
+	va_list ap;
+	int fd, len, ret = 0;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_WRONLY);
+	if (fd < 0 || write(fd, buf, len) != len)
+		ret = -1;
+	if (fd >= 0)
+		close(fd);
+	return ret;
+}
+
+static long read_file(const char *dir, const char *name)
+{
+	char path[512], buf[64];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = 0;
+	return strtol(buf, NULL, 0);
+}
+
+static int register_eventfd(const char *dir)
+{
+	int efd = eventfd(0, 0);
+
+	if (efd < 0 || write_file(dir, "memory.pressure_eventfd", "%d", efd)) {
+		fprintf(stderr, "%s: cannot register eventfd: %s\n", dir,
+			strerror(errno));
+		exit(1);
+	}
+	return efd;
+}
+
+/* Join @dir, then touch @mb of memory, @step_mb at a time, forever */
+static void task(const char *dir, int oom_adj, int mb, int step_mb)
+{
+	char *mem;
+	int i, done;
+
+	if (write_file(dir, "tasks", "%d", getpid()) ||
+	    write_file("/proc/self", "oom_adj", "%d", oom_adj))
+		_exit(2);
+
+	mem = mmap(NULL, (size_t)mb * MB, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		_exit(2);
+
+	for (done = step_mb; ; done += step_mb) {
+		if (done > mb)
+			done = mb;
+		for (i = 0; i < done * MB; i += 4096)
+			mem[i]++;
+		usleep(100000);
+	}
+}
+
+/* Registration from a process that exits must not outlive its eventfd */
+static int check_reaped(const char *dir)
+{
+	long before = read_file(dir, "memory.pressure_eventfd");
+	long count;
+	pid_t pid;
+	int i;
+
+	pid = fork();
+	if (pid == 0) {
+		register_eventfd(dir);
+		_exit(0);
+	}
+	waitpid(pid, NULL, 0);
+
+	/* the entry is freed from a work item */
+	for (i = 0; i < 50; i++) {
+		count = read_file(dir, "memory.pressure_eventfd");
+		if (count == before)
+			return 0;
+		usleep(100000);
+	}
+	fprintf(stderr, "%ld eventfds registered after exit, %ld before\n",
+		count, before);
+	return -1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-l limit MB] [-n tasks] [-s task MB] "
+		"[-t seconds] <memory cgroup mount>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int bg_efd, fg_efd, killed = 0, fail = 0;
+	unsigned long long bg_events = 0, fg_events = 0, n;
+	pid_t fg, *bg;
+	time_t end;
+	int i, c, status;
+
+	while ((c = getopt(argc, argv, "l:n:s:t:")) != -1) {
+		switch (c) {
+		case 'l':
+			limit_mb = atoi(optarg);
+			break;
+		case 'n':
+			nr_tasks = atoi(optarg);
+			break;
+		case 's':
+			task_mb = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || limit_mb < 1 || nr_tasks < 1 ||
+	    task_mb < 1 || nr_tasks * task_mb <= limit_mb)
+		usage(argv[0]);
+	mnt = argv[optind];
+
+	snprintf(fg_dir, sizeof(fg_dir), "%s/lmktest_fg", mnt);
+	snprintf(bg_dir, sizeof(bg_dir), "%s/lmktest_bg", mnt);
+	if ((mkdir(fg_dir, 0755) && errno != EEXIST) ||
+	    (mkdir(bg_dir, 0755) && errno != EEXIST)) {
+		perror("mkdir");
+		return 1;
+	}
+	if (write_file(bg_dir, "memory.limit_in_bytes", "%lld",
+		       (long long)limit_mb * MB)) {
+		perror("memory.limit_in_bytes");
+		return 1;
+	}
+
+	if (check_reaped(bg_dir)) {
+		fprintf(stderr, "FAIL: closed eventfd not unregistered\n");
+		fail = 1;
+	}
+
+	bg_efd = register_eventfd(bg_dir);
+	fg_efd = register_eventfd(fg_dir);
+
+	fg = fork();
+	if (fg == 0)
+		task(fg_dir, 0, task_mb, task_mb);
+
+	bg = calloc(nr_tasks, sizeof(*bg));
+	for (i = 0; i < nr_tasks; i++) {
+		bg[i] = fork();
+		if (bg[i] == 0)
+			task(bg_dir, 6 + i % 10, task_mb, 1);
+	}
+
+	end = time(NULL) + seconds;
+	while (time(NULL) < end) {
+		struct pollfd pfd[2] = {
+			{ .fd = bg_efd, .events = POLLIN },
+			{ .fd = fg_efd, .events = POLLIN },
+		};
+		pid_t pid;
+
+		if (poll(pfd, 2, 100) > 0) {
+			if ((pfd[0].revents & POLLIN) &&
+			    read(bg_efd, &n, sizeof(n)) == sizeof(n))
+				bg_events += n;
+			if ((pfd[1].revents & POLLIN) &&
+			    read(fg_efd, &n, sizeof(n)) == sizeof(n))
+				fg_events += n;
+		}
+
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			if (pid == fg) {
+				fprintf(stderr, "FAIL: foreground task died\n");
+				fail = 1;
+				fg = 0;
+			} else if (WIFSIGNALED(status) &&
+				   WTERMSIG(status) == SIGKILL) {
+				killed++;
+			}
+		}
+	}
+
+	if (fg)
+		kill(fg, SIGKILL);
+	for (i = 0; i < nr_tasks; i++)
+		kill(bg[i], SIGKILL);
+	while (wait(NULL) > 0)
+		;
+
+	printf("%d background tasks of %d MB, limit %d MB, %d s: "
+	       "%d killed, %llu pressure events (%llu foreground)\n",
+	       nr_tasks, task_mb, limit_mb, seconds, killed, bg_events,
+	       fg_events);
+
+	if (!bg_events) {
+		fprintf(stderr, "FAIL: no pressure event for %s\n", bg_dir);
+		fail = 1;
+	}
+	if (fg_events) {
+		fprintf(stderr, "FAIL: pressure event for %s\n", fg_dir);
+		fail = 1;
+	}
+	if (!killed) {
+		fprintf(stderr, "FAIL: no background task killed\n");
+		fail = 1;
+	}
+
+	close(bg_efd);
+	close(fg_efd);
+	/* the tasks are gone; wait for their charges to go too */
+	sleep(1);
+	if (rmdir(fg_dir) || rmdir(bg_dir))
+		perror("rmdir");
+
+	if (!fail)
+		printf("OK\n");
+	return fail;
+}
@@ -0,0 +1,174 @@
+/*
+ * ecryptfs-bench.c - eCryptfs page encryption and decryption benchmark
+ *
+ * Times the access patterns that take different paths through the page
+ * crypto of eCryptfs:
+ *
+ *   append   small writes at the end of the file, each fsynced, so the
+ *            tail page is re-encrypted again and again (the IVs of the
+ *            most recent page are cached, this is the hit case)
+ *   scatter  page sized writes at random pages, each fsynced (every
+ *            write misses the IV cache)
+ *   seqread  reading the file through, after dropping the page cache,
+ *            so readahead decrypts batches of pages (->readpages)
+ *   randread reading random pages, after dropping the page cache, one
+ *            page at a time (->readpage)
+ *
+ * Run it in a directory of an eCryptfs mount, e.g. over tmpfs to leave
+ * the lower device out of it, and compare kernels or ciphers.  Dropping
+ * the page cache needs root; without it the read numbers mostly measure
+ * the page cache.
+ *
+ * Build: gcc -O2 -Wall -o ecryptfs-bench ecryptfs-bench.c
+ *
+ * Usage: ecryptfs-bench [-s file MB] [-a append bytes] [-n writes]
+ *                       <directory on eCryptfs>
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int file_mb = 16;
+static int append_bytes = 256;
+static int nr_writes = 1000;
+static long page_size;
+static char *buf;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1)
+		fprintf(stderr, "warning: cannot drop the page cache\n");
+	if (fd >= 0)
+		close(fd);
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok) {
+		perror(what);
+		exit(1);
+	}
+}
+
+static void report(const char *name, double t, long long bytes, long ops)
+{
+	printf("%-9s %9.3f s  %8.2f MB/s  %9.1f us/op\n", name, t,
+	       bytes / 1048576.0 / t, t * 1e6 / ops);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-s file MB] [-a append bytes] "
+		"[-n writes] <directory on eCryptfs>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	long nr_pages, i;
+	char path[512];
+	double t;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "s:a:n:")) != -1) {
+		switch (c) {
+		case 's':
+			file_mb = atoi(optarg);
+			break;
+		case 'a':
+			append_bytes = atoi(optarg);
+			break;
+		case 'n':
+			nr_writes = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || file_mb < 1 || append_bytes < 1 ||
+	    nr_writes < 1)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (append_bytes > page_size)
+		append_bytes = page_size;
+	nr_pages = ((long)file_mb << 20) / page_size;
+	buf = malloc(page_size);
+	check(buf != NULL, "malloc");
+	for (i = 0; i < page_size; i++)
+		buf[i] = i * 7;
+	srand(1);
+
+	snprintf(path, sizeof(path), "%s/ecryptfs-bench.dat", argv[optind]);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	check(fd >= 0, path);
+
+	t = now();
+	for (i = 0; i < nr_writes; i++) {
+		check(write(fd, buf, append_bytes) == append_bytes, "write");
+		check(!fsync(fd), "fsync");
+	}
+	report("append", now() - t, (long long)nr_writes * append_bytes,
+	       nr_writes);
+
+	/* fill the file for the rest */
+	check(!ftruncate(fd, 0), "ftruncate");
+	for (i = 0; i < nr_pages; i++)
+		check(pwrite(fd, buf, page_size, i * page_size) == page_size,
+		      "write");
+	check(!fsync(fd), "fsync");
+
+	t = now();
+	for (i = 0; i < nr_writes; i++) {
+		off_t off = (off_t)(rand() % nr_pages) * page_size;
+
+		check(pwrite(fd, buf, page_size, off) == page_size, "write");
+		check(!fsync(fd), "fsync");
+	}
+	report("scatter", now() - t, (long long)nr_writes * page_size,
+	       nr_writes);
+	close(fd);
+
+	drop_caches();
+	fd = open(path, O_RDONLY);
+	check(fd >= 0, path);
+	t = now();
+	for (i = 0; i < nr_pages; i++)
+		check(read(fd, buf, page_size) == page_size, "read");
+	report("seqread", now() - t, (long long)nr_pages * page_size,
+	       nr_pages);
+	close(fd);
+
+	drop_caches();
+	fd = open(path, O_RDONLY);
+	check(fd >= 0, path);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+	t = now();
+	for (i = 0; i < nr_writes; i++) {
+		off_t off = (off_t)(rand() % nr_pages) * page_size;
+
+		check(pread(fd, buf, page_size, off) == page_size, "read");
+	}
+	report("randread", now() - t, (long long)nr_writes * page_size,
+	       nr_writes);
+	close(fd);
+
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * fat-seek-bench.c - FAT random seek benchmark
+ *
+ * Measures how long a random seek and read takes in a large fragmented
+ * file, which is what the cluster chain cache of fs/fat/cache.c is for.
+ * Mapping a file offset to a cluster costs one FAT entry read for each
+ * cluster that has to be walked.  A cache of a few runs helps sequential
+ * access, but random seeks then mostly walk the chain from its start.
+ *
+ * The program writes a file of -s MB, in -r KB pieces alternated with
+ * pieces of a second file, so that the file has a new run every -r KB.
+ * Then it deletes the second file, drops the caches (so that the chain
+ * cache starts empty) and does two passes of -n reads of one page each
+ * at random offsets.  Between the passes the file's pages are dropped,
+ * but its chain cache is kept.  The first pass shows the cost while the
+ * cache fills and the second the cost once it is full.
+ *
+ * With -b the passes map the offsets with the FIBMAP ioctl instead of
+ * reading them, which leaves out the data I/O and times just the mapping.
+ *
+ * Dropping the caches and FIBMAP need root.
+ *
+ * Build: gcc -O2 -Wall -o fat-seek-bench fat-seek-bench.c
+ *
+ * Usage: fat-seek-bench [-s file MB] [-r run KB] [-n seeks] [-b]
+ *                       <directory on FAT>
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/fs.h>
+
+static int file_mb = 256;
+static int run_kb = 64;
+static int nr_seeks = 2000;
+static int use_fibmap;
+static long page_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check(int ok, const char *what)
+{
+	if (!ok) {
+		perror(what);
+		exit(1);
+	}
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1)
+		fprintf(stderr, "warning: cannot drop the caches\n");
+	if (fd >= 0)
+		close(fd);
+}
+
+/* Returns the seconds -n random seeks took */
+static double seeks(int fd, long nr_pages, char *buf)
+{
+	int i, bsize = 0;
+	double t;
+
+	if (use_fibmap)
+		check(!ioctl(fd, FIGETBSZ, &bsize), "FIGETBSZ");
+
+	t = now();
+	for (i = 0; i < nr_seeks; i++) {
+		off_t off = (off_t)(random() % nr_pages) * page_size;
+
+		if (use_fibmap) {
+			int block = off / bsize;
+
+			check(!ioctl(fd, FIBMAP, &block), "FIBMAP");
+		} else {
+			check(lseek(fd, off, SEEK_SET) == off, "lseek");
+			check(read(fd, buf, page_size) == page_size, "read");
+		}
+	}
+	return now() - t;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-s file MB] [-r run KB] [-n seeks] [-b] "
+		"<directory on FAT>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char path[512], gap[512], *buf;
+	long run, nr_pages, i;
+	double t1, t2;
+	int fd, gfd, c;
+
+	while ((c = getopt(argc, argv, "s:r:n:b")) != -1) {
+		switch (c) {
+		case 's':
+			file_mb = atoi(optarg);
+			break;
+		case 'r':
+			run_kb = atoi(optarg);
+			break;
+		case 'n':
+			nr_seeks = atoi(optarg);
+			break;
+		case 'b':
+			use_fibmap = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || file_mb < 1 || run_kb < 1 || nr_seeks < 1)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	run = (long)run_kb * 1024;
+	nr_pages = ((long)file_mb << 20) / page_size;
+	buf = malloc(run);
+	check(buf != NULL, "malloc");
+	memset(buf, 0x5a, run);
+
+	snprintf(path, sizeof(path), "%s/fsb.dat", argv[optind]);
+	snprintf(gap, sizeof(gap), "%s/fsb-gap.dat", argv[optind]);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	check(fd >= 0, path);
+	gfd = open(gap, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	check(gfd >= 0, gap);
+	/* FAT allocates clusters at write time, so the two interleave */
+	for (i = 0; i < ((long)file_mb << 20); i += run) {
+		check(write(fd, buf, run) == run, path);
+		check(write(gfd, buf, run) == run, gap);
+	}
+	close(gfd);
+	close(fd);
+	unlink(gap);
+
+	drop_caches();
+	fd = open(path, O_RDONLY);
+	check(fd >= 0, path);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+	srandom(1);
+	t1 = seeks(fd, nr_pages, buf);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	t2 = seeks(fd, nr_pages, buf);
+	close(fd);
+	unlink(path);
+
+	printf("%d MB file, a run every %d KB, %d %s\n", file_mb, run_kb,
+	       nr_seeks, use_fibmap ? "FIBMAPs" : "reads");
+	printf("first pass  %9.1f us/seek\n", t1 * 1e6 / nr_seeks);
+	printf("second pass %9.1f us/seek\n", t2 * 1e6 / nr_seeks);
+	return 0;
+}
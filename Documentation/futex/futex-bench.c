@@ -0,0 +1,181 @@
+/*
+ * futex-bench.c - multi-threaded futex benchmark
+ *
+ * Measures the futex hash under many unrelated futexes:
+ *
+ *   pingpong  pairs of threads hand a token back and forth, each pair on
+ *             its own two futexes (FUTEX_WAIT/FUTEX_WAKE), as contended
+ *             pthread mutexes and condition variables do
+ *   wake      every thread calls FUTEX_WAKE on its own futex that has no
+ *             waiters, as an uncontended unlock that still enters the
+ *             kernel does
+ *
+ * Build: gcc -O2 -Wall -o futex-bench futex-bench.c -lpthread -lrt
+ *
+ * Usage: futex-bench [-m pingpong|wake] [-t threads] [-n iterations] [-s]
+ *   -s uses shared instead of private futexes
+ *
+ * With CONFIG_FUTEX_STATS, clear the counters before a run and look at
+ * collisions and wake_nowaiters after it:
+ *
+ *   echo 0 > /sys/kernel/debug/futex_hash
+ *   ./futex-bench -m pingpong -t 64
+ *   head -6 /sys/kernel/debug/futex_hash
+ */
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FUTEX_PRIVATE	128
+
+struct pair {
+	/* one cache line each, so that pairs only meet in the kernel */
+	volatile int turn __attribute__((aligned(64)));
+	volatile int futex[2] __attribute__((aligned(64)));
+};
+
+struct worker {
+	pthread_t thread;
+	struct pair *pair;
+	int side;
+	volatile int *futex;
+};
+
+static int iterations = 100000;
+static int private_flag = FUTEX_PRIVATE;
+static pthread_barrier_t start;
+
+static int futex(volatile int *uaddr, int op, int val)
+{
+	return syscall(SYS_futex, uaddr, op | private_flag, val, NULL, NULL, 0);
+}
+
+static void *pingpong(void *arg)
+{
+	struct worker *w = arg;
+	struct pair *p = w->pair;
+	int other = !w->side;
+	int i;
+
+	pthread_barrier_wait(&start);
+	for (i = 0; i < iterations; i++) {
+		/* wait for our turn */
+		while (p->turn != w->side) {
+			if (futex(&p->futex[w->side], FUTEX_WAIT, 0) &&
+			    errno != EAGAIN && errno != EINTR) {
+				perror("FUTEX_WAIT");
+				exit(1);
+			}
+		}
+		p->futex[w->side] = 0;
+		p->turn = other;
+		p->futex[other] = 1;
+		futex(&p->futex[other], FUTEX_WAKE, 1);
+	}
+	return NULL;
+}
+
+static void *wake(void *arg)
+{
+	struct worker *w = arg;
+	int i;
+
+	pthread_barrier_wait(&start);
+	for (i = 0; i < iterations; i++)
+		futex(w->futex, FUTEX_WAKE, 1);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-m pingpong|wake] [-t threads] "
+		"[-n iterations] [-s]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	void *(*fn)(void *) = pingpong;
+	struct worker *workers;
+	struct pair *pairs;
+	volatile int *futexes;
+	int threads = 16;
+	double t0, t1;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "m:t:n:s")) != -1) {
+		switch (c) {
+		case 'm':
+			if (!strcmp(optarg, "pingpong"))
+				fn = pingpong;
+			else if (!strcmp(optarg, "wake"))
+				fn = wake;
+			else
+				usage(argv[0]);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			private_flag = 0;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (threads < 1 || iterations < 1)
+		usage(argv[0]);
+	if (fn == pingpong && threads & 1)
+		threads++;
+
+	workers = calloc(threads, sizeof(*workers));
+	pairs = calloc(threads / 2 + 1, sizeof(*pairs));
+	futexes = calloc(threads, 64);
+	if (!workers || !pairs || !futexes) {
+		perror("calloc");
+		return 1;
+	}
+
+	pthread_barrier_init(&start, NULL, threads + 1);
+	for (i = 0; i < threads; i++) {
+		workers[i].pair = &pairs[i / 2];
+		workers[i].side = i & 1;
+		workers[i].futex = futexes + i * 64 / sizeof(int);
+		if (pthread_create(&workers[i].thread, NULL, fn, &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	pthread_barrier_wait(&start);
+	t0 = now();
+	for (i = 0; i < threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	t1 = now();
+
+	printf("%s: %d threads, %d iterations, %s futexes\n",
+	       fn == pingpong ? "pingpong" : "wake", threads, iterations,
+	       private_flag ? "private" : "shared");
+	printf("%.3f s, %.0f ops/s, %.2f us/op per thread\n", t1 - t0,
+	       (double)threads * iterations / (t1 - t0),
+	       (t1 - t0) * 1e6 / iterations);
+	return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * pmem-stress.c - allocator stress test for a pmem device
+ *
+ * Allocates and frees buffers of random sizes in random order through a
+ * pmem device, the way camera and video decoder buffers come and go, and
+ * checks that:
+ *
+ *   - no two live allocations overlap (PMEM_GET_PHYS)
+ *   - every allocation is at least as large as asked for
+ *   - the contents of a buffer survive other allocations and frees
+ *   - free_quanta is back to its starting value once all are freed
+ *
+ * It is meant for regions using PMEM_ALLOCATORTYPE_SEGFIT, which no board
+ * selects by default: set .allocator_type in the region's
+ * android_pmem_platform_data to try it.  Other allocators are refused
+ * unless -f is given.
+ *
+ * Build: gcc -O2 -Wall -I<kernel>/include -o pmem-stress pmem-stress.c
+ *
+ * Usage: pmem-stress [-n iterations] [-b buffers] [-p max pages]
+ *                    [-s seed] [-f] /dev/pmem_<name>
+ *
+ * The region's sysfs directory, /sys/kernel/pmem_regions/<name>, is read
+ * for allocator_type and free_quanta, and fragmentation and alloc_stats
+ * are printed at the end.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/android_pmem.h>
+
+#define SYSFS_DIR	"/sys/kernel/pmem_regions"
+
+struct buffer {
+	int fd;			/* -1 when free */
+	unsigned int *map;
+	size_t size;
+	unsigned long offset;	/* from PMEM_GET_PHYS */
+	unsigned long len;
+	unsigned int seed;	/* pattern written to it */
+};
+
+static int iterations = 10000;
+static int nr_buffers = 32;
+static int max_pages = 256;
+static const char *region;
+static long page_size;
+
+static int read_sysfs(const char *attr, char *buf, size_t len)
+{
+	char path[256];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), SYSFS_DIR "/%s/%s", region, attr);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+	buf[n] = 0;
+	return 0;
+}
+
+static long free_quanta(void)
+{
+	char buf[64];
+
+	if (read_sysfs("free_quanta", buf, sizeof(buf)))
+		return -1;
+	return strtol(buf, NULL, 0);
+}
+
+static void fill(struct buffer *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->size / sizeof(*b->map); i += page_size / 4)
+		b->map[i] = b->seed + i;
+}
+
+static int check(struct buffer *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->size / sizeof(*b->map); i += page_size / 4)
+		if (b->map[i] != b->seed + i) {
+			fprintf(stderr, "buffer at %#lx corrupted at %zu\n",
+				b->offset, i * sizeof(*b->map));
+			return -1;
+		}
+	return 0;
+}
+
+/* Returns 1 if the allocation failed for lack of space */
+static int alloc(const char *dev, struct buffer *b, struct buffer *all)
+{
+	struct pmem_region r;
+	int i;
+
+	b->size = (1 + rand() % max_pages) * page_size;
+	b->fd = open(dev, O_RDWR);
+	if (b->fd < 0) {
+		perror(dev);
+		exit(1);
+	}
+
+	/* the first mmap of a pmem file allocates its buffer */
+	b->map = mmap(NULL, b->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      b->fd, 0);
+	if (b->map == MAP_FAILED) {
+		close(b->fd);
+		b->fd = -1;
+		return 1;
+	}
+
+	if (ioctl(b->fd, PMEM_GET_PHYS, &r)) {
+		perror("PMEM_GET_PHYS");
+		exit(1);
+	}
+	b->offset = r.offset;
+	b->len = r.len;
+	if (b->len < b->size) {
+		fprintf(stderr, "asked for %zu bytes, got %lu at %#lx\n",
+			b->size, b->len, b->offset);
+		exit(1);
+	}
+
+	for (i = 0; i < nr_buffers; i++) {
+		struct buffer *o = &all[i];
+
+		if (o == b || o->fd < 0)
+			continue;
+		if (b->offset < o->offset + o->len &&
+		    o->offset < b->offset + b->len) {
+			fprintf(stderr, "%#lx+%lu overlaps %#lx+%lu\n",
+				b->offset, b->len, o->offset, o->len);
+			exit(1);
+		}
+	}
+
+	b->seed = rand();
+	fill(b);
+	return 0;
+}
+
+static void release(struct buffer *b)
+{
+	if (check(b))
+		exit(1);
+	munmap(b->map, b->size);
+	close(b->fd);
+	b->fd = -1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n iterations] [-b buffers] "
+		"[-p max pages] [-s seed] [-f] /dev/pmem_<name>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int seed = time(NULL);
+	struct buffer *buffers;
+	long quanta_before, quanta_after;
+	int failed = 0, allocs = 0;
+	int force = 0;
+	char buf[4096];
+	char *dev;
+	int i, n, c;
+
+	while ((c = getopt(argc, argv, "n:b:p:s:f")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'b':
+			nr_buffers = atoi(optarg);
+			break;
+		case 'p':
+			max_pages = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			force = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || iterations < 1 || nr_buffers < 1 ||
+	    max_pages < 1)
+		usage(argv[0]);
+
+	dev = argv[optind];
+	region = basename(strdup(dev));
+	page_size = sysconf(_SC_PAGESIZE);
+	srand(seed);
+
+	if (read_sysfs("allocator_type", buf, sizeof(buf))) {
+		fprintf(stderr, "no %s/%s\n", SYSFS_DIR, region);
+		return 1;
+	}
+	if (strncmp(buf, "Segregated Fit", 14)) {
+		fprintf(stderr, "%s uses allocator: %s", region, buf);
+		if (!force)
+			return 1;
+	}
+
+	buffers = calloc(nr_buffers, sizeof(*buffers));
+	if (!buffers) {
+		perror("calloc");
+		return 1;
+	}
+	for (i = 0; i < nr_buffers; i++)
+		buffers[i].fd = -1;
+
+	quanta_before = free_quanta();
+
+	for (n = 0; n < iterations; n++) {
+		struct buffer *b = &buffers[rand() % nr_buffers];
+
+		if (b->fd >= 0) {
+			release(b);
+			continue;
+		}
+		if (alloc(dev, b, buffers))
+			failed++;
+		else
+			allocs++;
+	}
+
+	for (i = 0; i < nr_buffers; i++)
+		if (buffers[i].fd >= 0)
+			release(&buffers[i]);
+
+	quanta_after = free_quanta();
+
+	printf("%s: seed %u, %d iterations, %d allocations, "
+	       "%d failed for lack of space\n", region, seed, iterations,
+	       allocs, failed);
+	if (!read_sysfs("fragmentation", buf, sizeof(buf)))
+		printf("%s", buf);
+	if (!read_sysfs("alloc_stats", buf, sizeof(buf)))
+		printf("%s", buf);
+
+	if (quanta_before != quanta_after) {
+		fprintf(stderr, "free_quanta %ld before, %ld after: leak\n",
+			quanta_before, quanta_after);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
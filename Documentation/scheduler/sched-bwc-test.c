@@ -0,0 +1,248 @@
+/*
+ * sched-bwc-test.c - check that CFS bandwidth control enforces the quota
+ *
+ * Creates <mnt>/bwctest, sets its cpu.cfs_period_us and cpu.cfs_quota_us,
+ * moves -t busy looping processes into it and lets them run for -d
+ * seconds.  The cpu and cpuacct controllers must be mounted together on
+ * <mnt>.  The test then checks that:
+ *
+ *   - the group's cpuacct.usage grew by no more than quota / period of
+ *     the elapsed time, plus -e percent for the tick granularity of the
+ *     runtime accounting
+ *   - it grew by at least 100 - e percent of what the quota allows (or of
+ *     what the hogs can use, if that is less), so the group isn't
+ *     throttled more than it should be
+ *   - cpu.stat counted throttled periods, in most periods, if the hogs
+ *     want more than the quota, and none if they want well under it
+ *
+ * Run it on an otherwise idle system, or other load keeps the hogs from
+ * using their quota.
+ *
+ * Build: gcc -O2 -Wall -o sched-bwc-test sched-bwc-test.c
+ *
+ * Usage: sched-bwc-test [-p period us] [-q quota us] [-t tasks]
+ *                       [-d seconds] [-e percent] <cpu,cpuacct mount>
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static long period_us = 100000;
+static long quota_us = 25000;
+static int nr_tasks = 1;
+static int seconds = 10;
+static int error_pct = 10;
+static char dir[256];
+
+static int write_file(const char *name, const char *fmt, ...)
+{
+	char path[512];
+	va_list ap;
+	FILE *f;
+	int ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	va_start(ap, fmt);
+	if (vfprintf(f, fmt, ap) < 0)
+		ret = -1;
+	va_end(ap);
+	if (fclose(f))
+		ret = -1;
+	return ret;
+}
+
+static unsigned long long read_usage(void)
+{
+	unsigned long long val = 0;
+	char path[512];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/cpuacct.usage", dir);
+	f = fopen(path, "r");
+	if (!f || fscanf(f, "%llu", &val) != 1) {
+		fprintf(stderr, "cannot read %s\n", path);
+		exit(1);
+	}
+	fclose(f);
+	return val;
+}
+
+/* Returns the value of "key" in cpu.stat */
+static unsigned long long read_stat(const char *key)
+{
+	unsigned long long val;
+	char path[512], name[64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/cpu.stat", dir);
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "cannot read %s\n", path);
+		exit(1);
+	}
+	while (fscanf(f, "%63s %llu", name, &val) == 2)
+		if (!strcmp(name, key)) {
+			fclose(f);
+			return val;
+		}
+	fclose(f);
+	fprintf(stderr, "no %s in %s\n", key, path);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void hog(void)
+{
+	volatile unsigned long n = 0;
+
+	if (write_file("tasks", "%d", getpid()))
+		_exit(2);
+	for (;;)
+		n++;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-p period us] [-q quota us] [-t tasks] "
+		"[-d seconds] [-e percent] <cpu,cpuacct mount>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long usage0, usage1, periods0, throttled0;
+	unsigned long long periods, throttled, throttled_time0;
+	double t0, elapsed, used, allowed, want, expect;
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int i, c, fail = 0;
+	pid_t *pids;
+
+	while ((c = getopt(argc, argv, "p:q:t:d:e:")) != -1) {
+		switch (c) {
+		case 'p':
+			period_us = atol(optarg);
+			break;
+		case 'q':
+			quota_us = atol(optarg);
+			break;
+		case 't':
+			nr_tasks = atoi(optarg);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		case 'e':
+			error_pct = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || period_us < 1000 || quota_us < 1000 ||
+	    nr_tasks < 1 || seconds < 1 || error_pct < 0 || error_pct >= 100)
+		usage(argv[0]);
+
+	snprintf(dir, sizeof(dir), "%s/bwctest", argv[optind]);
+	if (mkdir(dir, 0755) && errno != EEXIST) {
+		perror(dir);
+		return 1;
+	}
+	if (write_file("cpu.cfs_period_us", "%ld", period_us) ||
+	    write_file("cpu.cfs_quota_us", "%ld", quota_us)) {
+		perror("cpu.cfs_period_us/cpu.cfs_quota_us");
+		return 1;
+	}
+
+	pids = calloc(nr_tasks, sizeof(*pids));
+	for (i = 0; i < nr_tasks; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0)
+			hog();
+	}
+	/* let the hogs join the group */
+	sleep(1);
+
+	usage0 = read_usage();
+	periods0 = read_stat("nr_periods");
+	throttled0 = read_stat("nr_throttled");
+	throttled_time0 = read_stat("throttled_time");
+	t0 = now();
+
+	sleep(seconds);
+
+	usage1 = read_usage();
+	elapsed = now() - t0;
+	periods = read_stat("nr_periods") - periods0;
+	throttled = read_stat("nr_throttled") - throttled0;
+
+	printf("period %ld us, quota %ld us, %d tasks on %ld cpus, %.2f s\n",
+	       period_us, quota_us, nr_tasks, nr_cpus, elapsed);
+	printf("nr_periods %llu nr_throttled %llu throttled_time %llu ns\n",
+	       periods, throttled,
+	       read_stat("throttled_time") - throttled_time0);
+
+	for (i = 0; i < nr_tasks; i++)
+		kill(pids[i], SIGKILL);
+	while (wait(NULL) > 0)
+		;
+
+	/* all in seconds of cpu time */
+	used = (usage1 - usage0) / 1e9;
+	allowed = elapsed * quota_us / period_us;
+	want = elapsed * (nr_tasks < nr_cpus ? nr_tasks : nr_cpus);
+	expect = allowed < want ? allowed : want;
+	printf("used %.3f s of cpu, quota allows %.3f s, tasks want %.3f s\n",
+	       used, allowed, want);
+
+	if (used > allowed * (100 + error_pct) / 100) {
+		fprintf(stderr, "FAIL: usage %.1f%% over the quota\n",
+			(used / allowed - 1) * 100);
+		fail = 1;
+	}
+	if (used < expect * (100 - error_pct) / 100) {
+		fprintf(stderr, "FAIL: usage %.1f%% under the expected\n",
+			(1 - used / expect) * 100);
+		fail = 1;
+	}
+	if (want > allowed && !throttled) {
+		fprintf(stderr, "FAIL: no throttled period\n");
+		fail = 1;
+	}
+	if (want * (100 - error_pct) / 100 > allowed &&
+	    throttled < periods / 2) {
+		fprintf(stderr, "FAIL: only %llu of %llu periods throttled\n",
+			throttled, periods);
+		fail = 1;
+	}
+	if (want * (100 + error_pct) / 100 < allowed && throttled) {
+		fprintf(stderr, "FAIL: %llu periods throttled under the quota\n",
+			throttled);
+		fail = 1;
+	}
+
+	write_file("cpu.cfs_quota_us", "-1");
+	if (rmdir(dir))
+		perror("rmdir");
+
+	if (!fail)
+		printf("OK\n");
+	return fail;
+}
@@ -0,0 +1,240 @@
+/*
+ * prefetch-replay-bench.c - start-up time with and without trace replay
+ *
+ * Runs a start-up command from a cold page cache -n times without and -n
+ * times with a saved trace (as read from /proc/prefetch/trace) replayed
+ * alongside it, alternating, and prints the wall clock time of each run
+ * and the mean of both.  The page cache is dropped before every run, so
+ * it needs root.
+ *
+ * By default the trace is written to /proc/prefetch/replay just before
+ * the command is started, and kprefetchd replays it.  With -u the program
+ * replays it itself instead, from a thread doing readahead(2) on each
+ * range in trace order, which is what kprefetchd does with
+ * force_page_cache_readahead().  That runs on kernels without
+ * CONFIG_PREFETCH_TRACE, to estimate the gain for a start-up before
+ * recording it for real.
+ *
+ * The command's output goes to /dev/null.  For an application launch on
+ * Android, "am start -W -n <component>" waits for the first frame.
+ *
+ * Build: gcc -O2 -Wall -pthread -o prefetch-replay-bench \
+ *            prefetch-replay-bench.c
+ *
+ * Usage: prefetch-replay-bench [-u] [-n runs] <trace> <command> [args...]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct range {
+	unsigned long start;
+	unsigned long nr_pages;
+	char *path;
+};
+
+static struct range *ranges;
+static int nr_ranges;
+static char *trace;
+static size_t trace_len;
+static long page_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1) {
+		perror("/proc/sys/vm/drop_caches");
+		exit(1);
+	}
+	close(fd);
+}
+
+/* Undoes the \ooo escapes of /proc/prefetch/trace, in place */
+static void unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '7' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = (s[1] - '0') << 6 | (s[2] - '0') << 3 |
+			       (s[3] - '0');
+			s += 4;
+		} else {
+			*d++ = *s++;
+		}
+	}
+	*d = 0;
+}
+
+static void read_trace(const char *name)
+{
+	char line[4096], path[4096];
+	struct range *r;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f) {
+		perror(name);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		trace = realloc(trace, trace_len + strlen(line));
+		memcpy(trace + trace_len, line, strlen(line));
+		trace_len += strlen(line);
+
+		ranges = realloc(ranges, (nr_ranges + 1) * sizeof(*ranges));
+		r = &ranges[nr_ranges];
+		if (sscanf(line, "%lu %lu %4095s", &r->start, &r->nr_pages,
+			   path) != 3)
+			continue;
+		unescape(path);
+		r->path = strdup(path);
+		nr_ranges++;
+	}
+	fclose(f);
+	if (!nr_ranges) {
+		fprintf(stderr, "%s: no ranges\n", name);
+		exit(1);
+	}
+}
+
+static void *replay_thread(void *arg)
+{
+	const char *last = NULL;
+	int i, fd = -1;
+
+	for (i = 0; i < nr_ranges; i++) {
+		struct range *r = &ranges[i];
+
+		if (!last || strcmp(last, r->path)) {
+			if (fd >= 0)
+				close(fd);
+			fd = open(r->path, O_RDONLY);
+			last = r->path;
+		}
+		if (fd >= 0)
+			readahead(fd, (off64_t)r->start * page_size,
+				  r->nr_pages * page_size);
+	}
+	if (fd >= 0)
+		close(fd);
+	return NULL;
+}
+
+static void write_proc(const char *name, const char *buf, size_t len)
+{
+	int fd;
+
+	fd = open(name, O_WRONLY);
+	if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+		perror(name);
+		exit(1);
+	}
+	close(fd);
+}
+
+/* Returns the seconds the command took, replaying the trace or not */
+static double run(char **cmd, int replay, int user)
+{
+	pthread_t thread;
+	int status, fd;
+	double t;
+	pid_t pid;
+
+	drop_caches();
+	t = now();
+	if (replay && user)
+		pthread_create(&thread, NULL, replay_thread, NULL);
+	else if (replay)	/* kprefetchd starts when the file is closed */
+		write_proc("/proc/prefetch/replay", trace, trace_len);
+
+	pid = fork();
+	if (pid == 0) {
+		fd = open("/dev/null", O_WRONLY);
+		dup2(fd, 1);
+		dup2(fd, 2);
+		execvp(cmd[0], cmd);
+		_exit(127);
+	}
+	waitpid(pid, &status, 0);
+	t = now() - t;
+
+	/* don't let the replay run on into the next cold run */
+	if (replay && user)
+		pthread_join(thread, NULL);
+	else if (replay)
+		write_proc("/proc/prefetch/control", "abort", 5);
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "%s failed\n", cmd[0]);
+		exit(1);
+	}
+	return t;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-u] [-n runs] <trace> <command> "
+		"[args...]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double t, cold = 0, replayed = 0;
+	int runs = 5, user = 0, i, c;
+	unsigned long pages = 0;
+
+	while ((c = getopt(argc, argv, "+un:")) != -1) {
+		switch (c) {
+		case 'u':
+			user = 1;
+			break;
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind < 2 || runs < 1)
+		usage(argv[0]);
+	page_size = sysconf(_SC_PAGESIZE);
+	read_trace(argv[optind]);
+	for (i = 0; i < nr_ranges; i++)
+		pages += ranges[i].nr_pages;
+
+	printf("%d ranges, %lu pages, replay by %s\n", nr_ranges, pages,
+	       user ? "readahead(2)" : "kprefetchd");
+	for (i = 0; i < runs; i++) {
+		t = run(argv + optind + 1, 0, user);
+		cold += t;
+		printf("cold     %9.1f ms\n", t * 1e3);
+		t = run(argv + optind + 1, 1, user);
+		replayed += t;
+		printf("replayed %9.1f ms\n", t * 1e3);
+	}
+	printf("mean: cold %.1f ms, replayed %.1f ms (%.0f%%)\n",
+	       cold * 1e3 / runs, replayed * 1e3 / runs,
+	       100.0 * replayed / cold);
+	return 0;
+}
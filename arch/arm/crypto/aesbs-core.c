@@ -0,0 +1,421 @@
+/*
+ * Bit sliced AES for ARMv7 NEON
+ *
+ * The bit sliced representation of eight blocks in eight 128 bit
+ * registers, and ShiftRows and MixColumns as byte permutations on it, are
+ * those of E. Kasper and P. Schwabe, "Faster and Timing-Attack Resistant
+ * AES-GCM", CHES 2009.  The S-box circuit is credited at bs_sub_bytes().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Eight blocks are processed in parallel.  After the input transpose,
+ * q-register i holds bit i of every state byte: byte lane j of that
+ * register carries state byte j (column major, as in FIPS-197) and bit b
+ * of the lane belongs to block b.  ShiftRows and the row rotations of
+ * MixColumns then become byte permutations applied identically to all
+ * eight registers, and SubBytes becomes the Boyar-Peralta boolean circuit
+ * evaluated on whole registers.  Nothing depends on table lookups indexed
+ * by secret data, so the code is also free of cache timing leaks.
+ *
+ * This file is built with -mfpu=neon and must only be called between
+ * kernel_neon_begin() and kernel_neon_end().  It deliberately includes
+ * no kernel headers; see aesbs.h for the interface.
+ */
+
+#include <arm_neon.h>
+
+#include "aesbs.h"
+
+typedef uint8x16_t bs_t[8];
+
+static const unsigned char shift_rows[16] = {
+	0x0, 0x5, 0xa, 0xf, 0x4, 0x9, 0xe, 0x3,
+	0x8, 0xd, 0x2, 0x7, 0xc, 0x1, 0x6, 0xb,
+};
+
+static const unsigned char inv_shift_rows[16] = {
+	0x0, 0xd, 0xa, 0x7, 0x4, 0x1, 0xe, 0xb,
+	0x8, 0x5, 0x2, 0xf, 0xc, 0x9, 0x6, 0x3,
+};
+
+#define swapmove(a, b, n, m)						\
+	do {								\
+		uint8x16_t __t;						\
+		__t = vandq_u8(veorq_u8(vshrq_n_u8(b, n), a), m);	\
+		a = veorq_u8(a, __t);					\
+		b = veorq_u8(b, vshlq_n_u8(__t, n));			\
+	} while (0)
+
+/*
+ * 8x8 bit matrix transpose within every byte lane.  It is an involution,
+ * so it converts both to and from the bit sliced representation.  Block b
+ * ends up in bit b of each lane and bit i of the data in register i.
+ */
+static inline void bs_transpose(bs_t x)
+{
+	uint8x16_t m1 = vdupq_n_u8(0x55);
+	uint8x16_t m2 = vdupq_n_u8(0x33);
+	uint8x16_t m4 = vdupq_n_u8(0x0f);
+
+	swapmove(x[1], x[0], 1, m1);
+	swapmove(x[3], x[2], 1, m1);
+	swapmove(x[5], x[4], 1, m1);
+	swapmove(x[7], x[6], 1, m1);
+
+	swapmove(x[2], x[0], 2, m2);
+	swapmove(x[3], x[1], 2, m2);
+	swapmove(x[6], x[4], 2, m2);
+	swapmove(x[7], x[5], 2, m2);
+
+	swapmove(x[4], x[0], 4, m4);
+	swapmove(x[5], x[1], 4, m4);
+	swapmove(x[6], x[2], 4, m4);
+	swapmove(x[7], x[3], 4, m4);
+}
+
+static inline void bs_load(bs_t x, const unsigned char *in, int blocks)
+{
+	static const unsigned char zero[AESBS_BLOCK_SIZE];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = vld1q_u8(i < blocks ? in + i * AESBS_BLOCK_SIZE : zero);
+	bs_transpose(x);
+}
+
+static inline void bs_store(unsigned char *out, bs_t x, int blocks)
+{
+	int i;
+
+	bs_transpose(x);
+	for (i = 0; i < blocks; i++)
+		vst1q_u8(out + i * AESBS_BLOCK_SIZE, x[i]);
+}
+
+static inline void bs_add_round_key(bs_t x, const unsigned char *rk)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = veorq_u8(x[i], vld1q_u8(rk + i * AESBS_BLOCK_SIZE));
+}
+
+static inline uint8x16_t bs_permute(uint8x16_t x, uint8x8_t lo, uint8x8_t hi)
+{
+	uint8x8x2_t t;
+
+	t.val[0] = vget_low_u8(x);
+	t.val[1] = vget_high_u8(x);
+	return vcombine_u8(vtbl2_u8(t, lo), vtbl2_u8(t, hi));
+}
+
+static inline void bs_shift_rows(bs_t x, const unsigned char *perm)
+{
+	uint8x8_t lo = vld1_u8(perm);
+	uint8x8_t hi = vld1_u8(perm + 8);
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = bs_permute(x[i], lo, hi);
+}
+
+/* Rotate every column up by one and two rows respectively. */
+static inline uint8x16_t rot_row1(uint8x16_t x)
+{
+	uint32x4_t w = vreinterpretq_u32_u8(x);
+
+	return vreinterpretq_u8_u32(vsliq_n_u32(vshrq_n_u32(w, 8), w, 24));
+}
+
+static inline uint8x16_t rot_row2(uint8x16_t x)
+{
+	return vreinterpretq_u8_u16(vrev32q_u16(vreinterpretq_u16_u8(x)));
+}
+
+/* Multiply every byte by {02} in GF(2^8). */
+static inline void bs_xtime(bs_t out, const bs_t in)
+{
+	out[0] = in[7];
+	out[1] = veorq_u8(in[0], in[7]);
+	out[2] = in[1];
+	out[3] = veorq_u8(in[2], in[7]);
+	out[4] = veorq_u8(in[3], in[7]);
+	out[5] = in[4];
+	out[6] = in[5];
+	out[7] = in[6];
+}
+
+/*
+ * b = 02.a ^ 03.rot1(a) ^ rot2(a) ^ rot3(a)
+ *   = 02.(a ^ rot1(a)) ^ rot1(a) ^ rot2(a ^ rot1(a))
+ */
+static inline void bs_mix_columns(bs_t x)
+{
+	bs_t r, t, u;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		r[i] = rot_row1(x[i]);
+		t[i] = veorq_u8(x[i], r[i]);
+	}
+	bs_xtime(u, t);
+	for (i = 0; i < 8; i++)
+		x[i] = veorq_u8(veorq_u8(u[i], r[i]), rot_row2(t[i]));
+}
+
+/*
+ * InvMixColumns factors into MixColumns preceded by
+ * a' = a ^ 04.(a ^ rot2(a)).
+ */
+static inline void bs_inv_mix_columns(bs_t x)
+{
+	bs_t t, u;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		t[i] = veorq_u8(x[i], rot_row2(x[i]));
+	bs_xtime(u, t);
+	bs_xtime(t, u);
+	for (i = 0; i < 8; i++)
+		x[i] = veorq_u8(x[i], t[i]);
+	bs_mix_columns(x);
+}
+
+/*
+ * SubBytes, using the 113 gate circuit by Boyar and Peralta,
+ * "A depth-16 circuit for the AES S-box" (2011).  U0/S0 is the most
+ * significant bit.
+ */
+static inline void bs_sub_bytes(bs_t x)
+{
+	uint8x16_t U0 = x[7], U1 = x[6], U2 = x[5], U3 = x[4];
+	uint8x16_t U4 = x[3], U5 = x[2], U6 = x[1], U7 = x[0];
+	uint8x16_t T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13;
+	uint8x16_t T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24;
+	uint8x16_t T25, T26, T27;
+	uint8x16_t M1, M2, M3, M4, M5, M6, M7, M8, M9, M10, M11, M12, M13;
+	uint8x16_t M14, M15, M16, M17, M18, M19, M20, M21, M22, M23, M24;
+	uint8x16_t M25, M26, M27, M28, M29, M30, M31, M32, M33, M34, M35;
+	uint8x16_t M36, M37, M38, M39, M40, M41, M42, M43, M44, M45, M46;
+	uint8x16_t M47, M48, M49, M50, M51, M52, M53, M54, M55, M56, M57;
+	uint8x16_t M58, M59, M60, M61, M62, M63;
+	uint8x16_t L0, L1, L2, L3, L4, L5, L6, L7, L8, L9, L10, L11, L12;
+	uint8x16_t L13, L14, L15, L16, L17, L18, L19, L20, L21, L22, L23;
+	uint8x16_t L24, L25, L26, L27, L28, L29;
+
+#define X(a, b)		veorq_u8(a, b)
+#define A(a, b)		vandq_u8(a, b)
+#define XN(a, b)	vmvnq_u8(veorq_u8(a, b))
+
+	/* top linear transform */
+	T1 = X(U0, U3);
+	T2 = X(U0, U5);
+	T3 = X(U0, U6);
+	T4 = X(U3, U5);
+	T5 = X(U4, U6);
+	T6 = X(T1, T5);
+	T7 = X(U1, U2);
+	T8 = X(U7, T6);
+	T9 = X(U7, T7);
+	T10 = X(T6, T7);
+	T11 = X(U1, U5);
+	T12 = X(U2, U5);
+	T13 = X(T3, T4);
+	T14 = X(T6, T11);
+	T15 = X(T5, T11);
+	T16 = X(T5, T12);
+	T17 = X(T9, T16);
+	T18 = X(U3, U7);
+	T19 = X(T7, T18);
+	T20 = X(T1, T19);
+	T21 = X(U6, U7);
+	T22 = X(T7, T21);
+	T23 = X(T2, T22);
+	T24 = X(T2, T10);
+	T25 = X(T20, T17);
+	T26 = X(T3, T16);
+	T27 = X(T1, T12);
+
+	/* shared non-linear middle: inversion in GF(2^8) */
+	M1 = A(T13, T6);
+	M2 = A(T23, T8);
+	M3 = X(T14, M1);
+	M4 = A(T19, U7);
+	M5 = X(M4, M1);
+	M6 = A(T3, T16);
+	M7 = A(T22, T9);
+	M8 = X(T26, M6);
+	M9 = A(T20, T17);
+	M10 = X(M9, M6);
+	M11 = A(T1, T15);
+	M12 = A(T4, T27);
+	M13 = X(M12, M11);
+	M14 = A(T2, T10);
+	M15 = X(M14, M11);
+	M16 = X(M3, M2);
+	M17 = X(M5, T24);
+	M18 = X(M8, M7);
+	M19 = X(M10, M15);
+	M20 = X(M16, M13);
+	M21 = X(M17, M15);
+	M22 = X(M18, M13);
+	M23 = X(M19, T25);
+	M24 = X(M22, M23);
+	M25 = A(M22, M20);
+	M26 = X(M21, M25);
+	M27 = X(M20, M21);
+	M28 = X(M23, M25);
+	M29 = A(M28, M27);
+	M30 = A(M26, M24);
+	M31 = A(M20, M23);
+	M32 = A(M27, M31);
+	M33 = X(M27, M25);
+	M34 = A(M21, M22);
+	M35 = A(M24, M34);
+	M36 = X(M24, M25);
+	M37 = X(M21, M29);
+	M38 = X(M32, M33);
+	M39 = X(M23, M30);
+	M40 = X(M35, M36);
+	M41 = X(M38, M40);
+	M42 = X(M37, M39);
+	M43 = X(M37, M38);
+	M44 = X(M39, M40);
+	M45 = X(M42, M41);
+	M46 = A(M44, T6);
+	M47 = A(M40, T8);
+	M48 = A(M39, U7);
+	M49 = A(M43, T16);
+	M50 = A(M38, T9);
+	M51 = A(M37, T17);
+	M52 = A(M42, T15);
+	M53 = A(M45, T27);
+	M54 = A(M41, T10);
+	M55 = A(M44, T13);
+	M56 = A(M40, T23);
+	M57 = A(M39, T19);
+	M58 = A(M43, T3);
+	M59 = A(M38, T22);
+	M60 = A(M37, T20);
+	M61 = A(M42, T1);
+	M62 = A(M45, T4);
+	M63 = A(M41, T2);
+
+	/* bottom linear transform, including the affine constant */
+	L0 = X(M61, M62);
+	L1 = X(M50, M56);
+	L2 = X(M46, M48);
+	L3 = X(M47, M55);
+	L4 = X(M54, M58);
+	L5 = X(M49, M61);
+	L6 = X(M62, L5);
+	L7 = X(M46, L3);
+	L8 = X(M51, M59);
+	L9 = X(M52, M53);
+	L10 = X(M53, L4);
+	L11 = X(M60, L2);
+	L12 = X(M48, M51);
+	L13 = X(M50, L0);
+	L14 = X(M52, M61);
+	L15 = X(M55, L1);
+	L16 = X(M56, L0);
+	L17 = X(M57, L1);
+	L18 = X(M58, L8);
+	L19 = X(M63, L4);
+	L20 = X(L0, L1);
+	L21 = X(L1, L7);
+	L22 = X(L3, L12);
+	L23 = X(L18, L2);
+	L24 = X(L15, L9);
+	L25 = X(L6, L10);
+	L26 = X(L7, L9);
+	L27 = X(L8, L10);
+	L28 = X(L11, L14);
+	L29 = X(L11, L17);
+
+	x[7] = X(L6, L24);
+	x[6] = XN(L16, L26);
+	x[5] = XN(L19, L28);
+	x[4] = X(L6, L21);
+	x[3] = X(L20, L22);
+	x[2] = X(L25, L29);
+	x[1] = XN(L13, L27);
+	x[0] = XN(L6, L23);
+
+#undef X
+#undef A
+#undef XN
+}
+
+/*
+ * Inverse of the SubBytes affine transform,
+ * b'[i] = b[i+2] ^ b[i+5] ^ b[i+7] ^ 0x05[i].
+ */
+static inline void bs_inv_affine(bs_t x)
+{
+	bs_t t;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		t[i] = veorq_u8(veorq_u8(x[(i + 2) & 7], x[(i + 5) & 7]),
+				x[(i + 7) & 7]);
+	x[0] = vmvnq_u8(t[0]);
+	x[1] = t[1];
+	x[2] = vmvnq_u8(t[2]);
+	for (i = 3; i < 8; i++)
+		x[i] = t[i];
+}
+
+/*
+ * With S(x) = A(x^-1) we have x^-1 = A^-1(S(x)), and therefore
+ * S^-1(y) = A^-1(S(A^-1(y))), which lets decryption share the forward
+ * circuit at the cost of two extra linear layers.
+ */
+static inline void bs_inv_sub_bytes(bs_t x)
+{
+	bs_inv_affine(x);
+	bs_sub_bytes(x);
+	bs_inv_affine(x);
+}
+
+void aesbs_encrypt8(unsigned char *out, const unsigned char *in,
+		    const unsigned char *rk, int rounds, int blocks)
+{
+	bs_t x;
+	int r;
+
+	bs_load(x, in, blocks);
+	bs_add_round_key(x, rk);
+	for (r = 1; r < rounds; r++) {
+		bs_sub_bytes(x);
+		bs_shift_rows(x, shift_rows);
+		bs_mix_columns(x);
+		bs_add_round_key(x, rk + r * AESBS_RK_SIZE);
+	}
+	bs_sub_bytes(x);
+	bs_shift_rows(x, shift_rows);
+	bs_add_round_key(x, rk + rounds * AESBS_RK_SIZE);
+	bs_store(out, x, blocks);
+}
+
+void aesbs_decrypt8(unsigned char *out, const unsigned char *in,
+		    const unsigned char *rk, int rounds, int blocks)
+{
+	bs_t x;
+	int r;
+
+	bs_load(x, in, blocks);
+	bs_add_round_key(x, rk + rounds * AESBS_RK_SIZE);
+	for (r = rounds - 1; r > 0; r--) {
+		bs_shift_rows(x, inv_shift_rows);
+		bs_inv_sub_bytes(x);
+		bs_add_round_key(x, rk + r * AESBS_RK_SIZE);
+		bs_inv_mix_columns(x);
+	}
+	bs_shift_rows(x, inv_shift_rows);
+	bs_inv_sub_bytes(x);
+	bs_add_round_key(x, rk);
+	bs_store(out, x, blocks);
+}
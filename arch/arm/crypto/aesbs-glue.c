@@ -0,0 +1,560 @@
+/*
+ * Glue code for the bit sliced NEON AES implementation.
+ *
+ * The chaining modes are those of crypto/cbc.c, crypto/ctr.c and
+ * crypto/xts.c, done eight blocks at a time; see aesbs-core.c for the
+ * origin of the cipher core.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The bit sliced core only pays off when it has several independent
+ * blocks to work on, so ECB, CBC decryption, CTR and XTS are provided.
+ * CBC encryption is inherently serial and is done one block at a time
+ * with the generic cipher.  The same cipher is used whenever NEON cannot
+ * be used, i.e. from interrupt context.
+ */
+
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/b128ops.h>
+#include <crypto/gf128mul.h>
+#include <linux/err.h>
+#include <linux/hardirq.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <asm/neon.h>
+
+#include "aesbs.h"
+
+#define AESBS_PRIORITY		300
+
+struct aesbs_ctx {
+	int rounds;
+	u8 rk[(AESBS_MAX_ROUNDS + 1) * AESBS_RK_SIZE];
+	struct crypto_cipher *fallback;
+};
+
+struct aesbs_xts_ctx {
+	struct aesbs_ctx key;
+	struct crypto_cipher *tweak;
+};
+
+/*
+ * Process up to AESBS_BLOCKS blocks.  NEON is claimed for a single batch
+ * at a time: kernel_neon_begin() is cheap once the user VFP state has been
+ * saved, and this keeps the preemption disabled window short.
+ */
+static void aesbs_crypt8(struct aesbs_ctx *ctx, u8 *out, const u8 *in,
+			 unsigned int blocks, int enc)
+{
+	struct crypto_tfm *tfm;
+	void (*fn)(struct crypto_tfm *, u8 *, const u8 *);
+
+	if (likely(!in_interrupt())) {
+		kernel_neon_begin();
+		if (enc)
+			aesbs_encrypt8(out, in, ctx->rk, ctx->rounds, blocks);
+		else
+			aesbs_decrypt8(out, in, ctx->rk, ctx->rounds, blocks);
+		kernel_neon_end();
+		return;
+	}
+
+	tfm = crypto_cipher_tfm(ctx->fallback);
+	fn = enc ? crypto_cipher_alg(ctx->fallback)->cia_encrypt :
+		   crypto_cipher_alg(ctx->fallback)->cia_decrypt;
+	while (blocks--) {
+		fn(tfm, out, in);
+		in += AES_BLOCK_SIZE;
+		out += AES_BLOCK_SIZE;
+	}
+}
+
+static int aesbs_expand_key(struct aesbs_ctx *ctx, const u8 *in_key,
+			    unsigned int key_len, u32 *flags)
+{
+	struct crypto_aes_ctx aes;
+	int r, i, j;
+	int err;
+
+	err = crypto_aes_expand_key(&aes, in_key, key_len);
+	if (err) {
+		*flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return err;
+	}
+
+	/*
+	 * Bit slice the round keys: plane i of round key r holds 0xff in
+	 * lane j if bit i of byte j is set, so that all eight blocks are
+	 * covered by a single XOR.
+	 */
+	ctx->rounds = 6 + key_len / 4;
+	for (r = 0; r <= ctx->rounds; r++) {
+		u8 *rk = ctx->rk + r * AESBS_RK_SIZE;
+
+		for (j = 0; j < AES_BLOCK_SIZE; j++) {
+			u8 b = aes.key_enc[4 * r + j / 4] >> (8 * (j % 4));
+
+			for (i = 0; i < 8; i++)
+				rk[i * AES_BLOCK_SIZE + j] =
+					(b & (1 << i)) ? 0xff : 0x00;
+		}
+	}
+	memset(&aes, 0, sizeof(aes));
+
+	crypto_cipher_clear_flags(ctx->fallback, CRYPTO_TFM_REQ_MASK);
+	crypto_cipher_set_flags(ctx->fallback, *flags & CRYPTO_TFM_REQ_MASK);
+	return crypto_cipher_setkey(ctx->fallback, in_key, key_len);
+}
+
+static int aesbs_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			unsigned int key_len)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	return aesbs_expand_key(ctx, in_key, key_len, &tfm->crt_flags);
+}
+
+static int aesbs_xts_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			    unsigned int key_len)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+	u32 *flags = &tfm->crt_flags;
+	int err;
+
+	/* key consists of keys of equal size concatenated */
+	if (key_len % 2) {
+		*flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+
+	crypto_cipher_clear_flags(ctx->tweak, CRYPTO_TFM_REQ_MASK);
+	crypto_cipher_set_flags(ctx->tweak, *flags & CRYPTO_TFM_REQ_MASK);
+	err = crypto_cipher_setkey(ctx->tweak, in_key + key_len / 2,
+				   key_len / 2);
+	if (err)
+		return err;
+
+	return aesbs_expand_key(&ctx->key, in_key, key_len / 2, flags);
+}
+
+static int aesbs_init_ctx(struct aesbs_ctx *ctx)
+{
+	struct crypto_cipher *cipher;
+
+	cipher = crypto_alloc_cipher("aes", 0, 0);
+	if (IS_ERR(cipher))
+		return PTR_ERR(cipher);
+
+	ctx->fallback = cipher;
+	return 0;
+}
+
+static int aesbs_init_tfm(struct crypto_tfm *tfm)
+{
+	return aesbs_init_ctx(crypto_tfm_ctx(tfm));
+}
+
+static void aesbs_exit_tfm(struct crypto_tfm *tfm)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_cipher(ctx->fallback);
+}
+
+static int aesbs_xts_init_tfm(struct crypto_tfm *tfm)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+	struct crypto_cipher *cipher;
+	int err;
+
+	err = aesbs_init_ctx(&ctx->key);
+	if (err)
+		return err;
+
+	cipher = crypto_alloc_cipher("aes", 0, 0);
+	if (IS_ERR(cipher)) {
+		crypto_free_cipher(ctx->key.fallback);
+		return PTR_ERR(cipher);
+	}
+
+	ctx->tweak = cipher;
+	return 0;
+}
+
+static void aesbs_xts_exit_tfm(struct crypto_tfm *tfm)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_cipher(ctx->tweak);
+	crypto_free_cipher(ctx->key.fallback);
+}
+
+static int aesbs_ecb_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes, int enc)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	while ((nbytes = walk.nbytes)) {
+		unsigned int blocks = nbytes / AES_BLOCK_SIZE;
+		u8 *wsrc = walk.src.virt.addr;
+		u8 *wdst = walk.dst.virt.addr;
+
+		while (blocks) {
+			unsigned int n = min_t(unsigned int, blocks,
+					       AESBS_BLOCKS);
+
+			aesbs_crypt8(ctx, wdst, wsrc, n, enc);
+			wsrc += n * AES_BLOCK_SIZE;
+			wdst += n * AES_BLOCK_SIZE;
+			blocks -= n;
+		}
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+
+	return err;
+}
+
+static int aesbs_ecb_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_ecb_crypt(desc, dst, src, nbytes, 1);
+}
+
+static int aesbs_ecb_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_ecb_crypt(desc, dst, src, nbytes, 0);
+}
+
+static int aesbs_cbc_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	while ((nbytes = walk.nbytes)) {
+		u8 *wsrc = walk.src.virt.addr;
+		u8 *wdst = walk.dst.virt.addr;
+		u8 *iv = walk.iv;
+
+		do {
+			crypto_xor(iv, wsrc, AES_BLOCK_SIZE);
+			crypto_cipher_encrypt_one(ctx->fallback, wdst, iv);
+			memcpy(iv, wdst, AES_BLOCK_SIZE);
+
+			wsrc += AES_BLOCK_SIZE;
+			wdst += AES_BLOCK_SIZE;
+		} while ((nbytes -= AES_BLOCK_SIZE) >= AES_BLOCK_SIZE);
+
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+
+	return err;
+}
+
+static int aesbs_cbc_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	u8 buf[AESBS_BLOCKS * AES_BLOCK_SIZE];
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	while ((nbytes = walk.nbytes)) {
+		unsigned int blocks = nbytes / AES_BLOCK_SIZE;
+		u8 *wsrc = walk.src.virt.addr;
+		u8 *wdst = walk.dst.virt.addr;
+
+		while (blocks) {
+			unsigned int n = min_t(unsigned int, blocks,
+					       AESBS_BLOCKS);
+			unsigned int len = n * AES_BLOCK_SIZE;
+
+			/* keep the ciphertext, the request may be in place */
+			memcpy(buf, wsrc, len);
+			aesbs_crypt8(ctx, wdst, buf, n, 0);
+
+			crypto_xor(wdst, walk.iv, AES_BLOCK_SIZE);
+			crypto_xor(wdst + AES_BLOCK_SIZE, buf,
+				   len - AES_BLOCK_SIZE);
+			memcpy(walk.iv, buf + len - AES_BLOCK_SIZE,
+			       AES_BLOCK_SIZE);
+
+			wsrc += len;
+			wdst += len;
+			blocks -= n;
+		}
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+
+	return err;
+}
+
+static int aesbs_ctr_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	u8 ks[AESBS_BLOCKS * AES_BLOCK_SIZE];
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt_block(desc, &walk, AES_BLOCK_SIZE);
+
+	while ((nbytes = walk.nbytes) >= AES_BLOCK_SIZE) {
+		unsigned int blocks = nbytes / AES_BLOCK_SIZE;
+		u8 *wsrc = walk.src.virt.addr;
+		u8 *wdst = walk.dst.virt.addr;
+
+		while (blocks) {
+			unsigned int n = min_t(unsigned int, blocks,
+					       AESBS_BLOCKS);
+			unsigned int len = n * AES_BLOCK_SIZE;
+			unsigned int i;
+
+			for (i = 0; i < len; i += AES_BLOCK_SIZE) {
+				memcpy(ks + i, walk.iv, AES_BLOCK_SIZE);
+				crypto_inc(walk.iv, AES_BLOCK_SIZE);
+			}
+			aesbs_crypt8(ctx, ks, ks, n, 1);
+
+			if (wdst != wsrc)
+				memcpy(wdst, wsrc, len);
+			crypto_xor(wdst, ks, len);
+
+			wsrc += len;
+			wdst += len;
+			blocks -= n;
+		}
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+
+	/* final partial block */
+	if (walk.nbytes) {
+		aesbs_crypt8(ctx, ks, walk.iv, 1, 1);
+		crypto_xor(ks, walk.src.virt.addr, nbytes);
+		memcpy(walk.dst.virt.addr, ks, nbytes);
+		crypto_inc(walk.iv, AES_BLOCK_SIZE);
+		err = blkcipher_walk_done(desc, &walk, 0);
+	}
+
+	return err;
+}
+
+static int aesbs_xts_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes, int enc)
+{
+	struct aesbs_xts_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	be128 t[AESBS_BLOCKS + 1];
+	u8 buf[AESBS_BLOCKS * AES_BLOCK_SIZE];
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+	if (!walk.nbytes)
+		return err;
+
+	/* calculate first value of T */
+	crypto_cipher_encrypt_one(ctx->tweak, walk.iv, walk.iv);
+
+	while ((nbytes = walk.nbytes)) {
+		unsigned int blocks = nbytes / AES_BLOCK_SIZE;
+		u8 *wsrc = walk.src.virt.addr;
+		u8 *wdst = walk.dst.virt.addr;
+
+		while (blocks) {
+			unsigned int n = min_t(unsigned int, blocks,
+					       AESBS_BLOCKS);
+			unsigned int len = n * AES_BLOCK_SIZE;
+			unsigned int i;
+
+			memcpy(&t[0], walk.iv, AES_BLOCK_SIZE);
+			for (i = 1; i <= n; i++)
+				gf128mul_x_ble(&t[i], &t[i - 1]);
+			memcpy(walk.iv, &t[n], AES_BLOCK_SIZE);
+
+			memcpy(buf, wsrc, len);
+			crypto_xor(buf, (u8 *)t, len);
+			aesbs_crypt8(&ctx->key, buf, buf, n, enc);
+			crypto_xor(buf, (u8 *)t, len);
+			memcpy(wdst, buf, len);
+
+			wsrc += len;
+			wdst += len;
+			blocks -= n;
+		}
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+
+	return err;
+}
+
+static int aesbs_xts_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_xts_crypt(desc, dst, src, nbytes, 1);
+}
+
+static int aesbs_xts_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_xts_crypt(desc, dst, src, nbytes, 0);
+}
+
+static struct crypto_alg aesbs_algs[] = { {
+	.cra_name		= "ecb(aes)",
+	.cra_driver_name	= "ecb-aes-neon",
+	.cra_priority		= AESBS_PRIORITY,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init_tfm,
+	.cra_exit		= aesbs_exit_tfm,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.setkey		= aesbs_setkey,
+			.encrypt	= aesbs_ecb_encrypt,
+			.decrypt	= aesbs_ecb_decrypt,
+		},
+	},
+}, {
+	.cra_name		= "cbc(aes)",
+	.cra_driver_name	= "cbc-aes-neon",
+	.cra_priority		= AESBS_PRIORITY,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init_tfm,
+	.cra_exit		= aesbs_exit_tfm,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_setkey,
+			.encrypt	= aesbs_cbc_encrypt,
+			.decrypt	= aesbs_cbc_decrypt,
+		},
+	},
+}, {
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-neon",
+	.cra_priority		= AESBS_PRIORITY,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init_tfm,
+	.cra_exit		= aesbs_exit_tfm,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_setkey,
+			.encrypt	= aesbs_ctr_crypt,
+			.decrypt	= aesbs_ctr_crypt,
+		},
+	},
+}, {
+	.cra_name		= "xts(aes)",
+	.cra_driver_name	= "xts-aes-neon",
+	.cra_priority		= AESBS_PRIORITY,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_xts_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_xts_init_tfm,
+	.cra_exit		= aesbs_xts_exit_tfm,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+			.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_xts_setkey,
+			.encrypt	= aesbs_xts_encrypt,
+			.decrypt	= aesbs_xts_decrypt,
+		},
+	},
+} };
+
+static int __init aesbs_mod_init(void)
+{
+	int i;
+	int err;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	for (i = 0; i < ARRAY_SIZE(aesbs_algs); i++) {
+		INIT_LIST_HEAD(&aesbs_algs[i].cra_list);
+		err = crypto_register_alg(&aesbs_algs[i]);
+		if (err)
+			goto err_unregister;
+	}
+
+	return 0;
+
+err_unregister:
+	while (--i >= 0)
+		crypto_unregister_alg(&aesbs_algs[i]);
+	return err;
+}
+
+static void __exit aesbs_mod_exit(void)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(aesbs_algs) - 1; i >= 0; i--)
+		crypto_unregister_alg(&aesbs_algs[i]);
+}
+
+/* late, so that vfp_init(), also a late_initcall, has set HWCAP_NEON */
+late_initcall(aesbs_mod_init);
+module_exit(aesbs_mod_exit);
+
+MODULE_DESCRIPTION("Bit sliced AES in ECB/CBC/CTR/XTS modes using NEON");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS("ecb(aes)");
+MODULE_ALIAS("cbc(aes)");
+MODULE_ALIAS("ctr(aes)");
+MODULE_ALIAS("xts(aes)");
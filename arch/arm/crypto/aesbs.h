@@ -0,0 +1,28 @@
+/*
+ * Interface between the bit sliced NEON AES core and its glue code.
+ *
+ * The core is compiled with -mfpu=neon and cannot include kernel headers,
+ * so only plain C types are used here.
+ */
+
+#ifndef _ARM_CRYPTO_AESBS_H
+#define _ARM_CRYPTO_AESBS_H
+
+#define AESBS_BLOCK_SIZE	16
+#define AESBS_BLOCKS		8
+
+/* one bit sliced round key: eight 16 byte bit planes */
+#define AESBS_RK_SIZE		(8 * AESBS_BLOCK_SIZE)
+#define AESBS_MAX_ROUNDS	14
+
+/*
+ * Encrypt or decrypt up to AESBS_BLOCKS blocks.  @rk holds rounds + 1
+ * bit sliced round keys of the encryption schedule; decryption walks it
+ * backwards.
+ */
+void aesbs_encrypt8(unsigned char *out, const unsigned char *in,
+		    const unsigned char *rk, int rounds, int blocks);
+void aesbs_decrypt8(unsigned char *out, const unsigned char *in,
+		    const unsigned char *rk, int rounds, int blocks);
+
+#endif /* _ARM_CRYPTO_AESBS_H */
@@ -0,0 +1,68 @@
+/*
+ * linux/arch/arm/include/asm/lz_copy.h
+ *
+ * ARM helpers for <linux/lz_copy.h>.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_LZ_COPY_H
+#define __ASM_ARM_LZ_COPY_H
+
+#include <linux/types.h>
+
+#if __LINUX_ARM_ARCH__ >= 7
+/*
+ * ARMv7 always runs with CR_U set, and alignment_init() then clears CR_A,
+ * so a single ldr/str copes with any alignment in hardware.  ldm/ldrd do
+ * not, so the accesses are kept out of the compiler's hands.
+ */
+static inline u32 lz_get32(const void *p)
+{
+	u32 v;
+
+	asm("ldr	%0, %1" : "=r" (v) : "m" (*(const u32 *)p));
+	return v;
+}
+
+static inline void __lz_put32(void *p, u32 v)
+{
+	asm("str	%1, %0" : "=m" (*(u32 *)p) : "r" (v));
+}
+
+#define lz_get32		lz_get32
+#define lz_put32(p, v)		__lz_put32((p), (v))
+#endif
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+#include <linux/hardirq.h>
+#include <asm/neon.h>
+
+#define LZ_WIDE_DIST		16
+#define LZ_WIDE_MIN		32
+
+/*
+ * Preemption stays off for the whole NEON section, so only runs of up to
+ * 64KB of output are worth it: that covers LZO pages and zlib streams fed
+ * a block at a time, and keeps the section well under a millisecond.
+ */
+#define LZ_WIDE_MAX_OUTPUT	65536
+
+static inline int lz_wide_begin(size_t out_len)
+{
+	if (out_len > LZ_WIDE_MAX_OUTPUT || !cpu_has_neon() || in_interrupt())
+		return 0;
+	kernel_neon_begin();
+	return 1;
+}
+
+#define lz_wide_end()		kernel_neon_end()
+
+/* arch/arm/lib/lz_copy_neon.c, len >= 16 and out - from >= 16 */
+void lz_copy_neon(unsigned char *out, const unsigned char *from, size_t len);
+
+#define lz_copy_wide(out, from, len)	lz_copy_neon((out), (from), (len))
+#endif
+
+#endif /* __ASM_ARM_LZ_COPY_H */
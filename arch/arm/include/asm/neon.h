@@ -0,0 +1,28 @@
+/*
+ * linux/arch/arm/include/asm/neon.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+/*
+ * NEON code must live in its own compilation unit, built with -mfpu=neon,
+ * and be called from ordinary code between kernel_neon_begin() and
+ * kernel_neon_end(). Otherwise GCC is free to schedule NEON instructions
+ * outside of the protected section.
+ */
+#ifdef __ARM_NEON__
+#error "kernel_neon_begin() must not be called from NEON code"
+#endif
+
+void kernel_neon_begin(void);
+void kernel_neon_end(void);
+
+#endif /* __ASM_ARM_NEON_H */
@@ -0,0 +1,49 @@
+/*
+ * linux/arch/arm/include/asm/neon_copy.h
+ *
+ * NEON versions of memcpy(), copy_page() and copy_from_user().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_COPY_H
+#define __ASM_ARM_NEON_COPY_H
+
+/*
+ * Copies shorter than this stay in the ARM loops: below it, saving the
+ * user VFP state costs more than NEON gains.  Must be an ARM immediate.
+ */
+#define NEON_COPY_MIN		1024
+
+/* Largest copy done between kernel_neon_begin() and kernel_neon_end() */
+#define NEON_COPY_CHUNK		4096
+
+#ifndef __ASSEMBLY__
+#include <linux/types.h>
+#include <linux/compiler.h>
+
+/* bytes prefetched ahead of the source; zero keeps NEON out of copies */
+extern unsigned int neon_copy_prefetch;
+
+/* The ARM loops behind memcpy() etc., never using NEON */
+extern void *__memcpy_arm(void *to, const void *from, size_t n);
+extern void __copy_page_arm(void *to, const void *from);
+extern unsigned long __copy_from_user_arm(void *to,
+					  const void __user *from,
+					  unsigned long n);
+
+/*
+ * arch/arm/lib/copy_neon.S, between kernel_neon_begin() and
+ * kernel_neon_end().  @n is a non-zero multiple of 64 and @to is 16 byte
+ * aligned.  __neon_copy_user() takes faults on either side and returns the
+ * number of bytes not copied; it must run with page faults disabled.
+ */
+extern void __neon_copy(void *to, const void *from, size_t n,
+			unsigned int prefetch);
+extern unsigned long __neon_copy_user(void *to, const void *from, size_t n,
+				      unsigned int prefetch);
+extern int __neon_probe_user_read(const void __user *p, size_t n);
+#endif
+
+#endif /* __ASM_ARM_NEON_COPY_H */
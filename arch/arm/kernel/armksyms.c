@@ -20,6 +20,8 @@
 #include <asm/checksum.h>
 #include <asm/system.h>
 #include <asm/ftrace.h>
+#include <asm/lz_copy.h>
+#include <asm/neon_copy.h>
 
 /*
  * libgcc functions - functions that are used internally by the
@@ -110,6 +112,12 @@ EXPORT_SYMBOL(memcpy);
 EXPORT_SYMBOL(memmove);
 EXPORT_SYMBOL(memchr);
 EXPORT_SYMBOL(__memzero);
+#ifdef CONFIG_KERNEL_MODE_NEON
+EXPORT_SYMBOL(lz_copy_neon);
+#endif
+#ifdef CONFIG_NEON_COPY
+EXPORT_SYMBOL(__memcpy_arm);
+#endif
 
 	/* user mem (segment) */
 EXPORT_SYMBOL(__strnlen_user);
@@ -121,6 +129,10 @@ EXPORT_SYMBOL(copy_page);
 EXPORT_SYMBOL(__copy_from_user);
 EXPORT_SYMBOL(__copy_to_user);
 EXPORT_SYMBOL(__clear_user);
+#ifdef CONFIG_NEON_COPY
+EXPORT_SYMBOL(__copy_page_arm);
+EXPORT_SYMBOL(__copy_from_user_arm);
+#endif
 
 EXPORT_SYMBOL(__get_user_1);
 EXPORT_SYMBOL(__get_user_2);
@@ -0,0 +1,141 @@
+/*
+ *  linux/arch/arm/lib/copy_bench.c
+ *
+ *  Copy bandwidth by size, ARM loops against NEON.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  Loading the module prints one line per copy size for memcpy() and
+ *  __copy_from_user(), and one for copy_page(), with the bandwidth of the
+ *  ARM loops followed by NEON at each prefetch distance.  The user copy
+ *  runs under KERNEL_DS on kernel buffers, so it includes the user access
+ *  checks but no page faults.  The module
+ *  then refuses to stay loaded.
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+#include <asm/neon_copy.h>
+
+#define BENCH_MAX	(1024 * 1024)
+
+static unsigned int msec = 200;
+module_param(msec, uint, 0);
+MODULE_PARM_DESC(msec, "Time spent on each measurement (default 200ms)");
+
+static unsigned int bench_prefetch[8] = { 128, 192, 256, 384, 512 };
+static int bench_prefetch_num = 5;
+module_param_array_named(prefetch, bench_prefetch, uint, &bench_prefetch_num,
+			 0);
+MODULE_PARM_DESC(prefetch, "NEON prefetch distances to try, in bytes");
+
+enum { BENCH_MEMCPY, BENCH_FROM_USER, BENCH_PAGE };
+
+static const char *bench_name[] = {
+	"memcpy", "copy_from_user", "copy_page",
+};
+
+static void bench_copy(int what, char *dst, const char *src, size_t len)
+{
+	switch (what) {
+	case BENCH_MEMCPY:
+		memcpy(dst, src, len);
+		break;
+	case BENCH_FROM_USER:
+		WARN_ON(__copy_from_user(dst, (const void __user *)src, len));
+		break;
+	case BENCH_PAGE:
+		copy_page(dst, src);
+		break;
+	}
+}
+
+/* MB/s with NEON copies at @pf bytes of prefetch, or the ARM loops for 0 */
+static unsigned long bench_one(int what, char *dst, const char *src,
+			       size_t len, unsigned int pf)
+{
+	unsigned long start, end, bytes = 0;
+	unsigned int saved = neon_copy_prefetch;
+
+	neon_copy_prefetch = pf;
+	start = jiffies;
+	end = start + msecs_to_jiffies(msec);
+	while (time_before(jiffies, end)) {
+		bench_copy(what, dst, src, len);
+		bytes += len;
+	}
+	end = jiffies;
+	neon_copy_prefetch = saved;
+	cond_resched();
+
+	return (bytes >> 10) * HZ / ((end - start) ?: 1) >> 10;
+}
+
+static void bench_size(int what, char *dst, const char *src, size_t len)
+{
+	int i;
+
+	printk(KERN_INFO "%-14s %7zu: arm %5lu", bench_name[what], len,
+	       bench_one(what, dst, src, len, 0));
+	for (i = 0; i < bench_prefetch_num; i++)
+		printk(KERN_CONT " neon/%u %5lu", bench_prefetch[i],
+		       bench_one(what, dst, src, len, bench_prefetch[i]));
+	printk(KERN_CONT " MB/s\n");
+}
+
+static int __init copy_bench_init(void)
+{
+	char *src, *dst;
+	mm_segment_t fs;
+	size_t len;
+	int what;
+
+	if (!neon_copy_prefetch) {
+		printk(KERN_ERR "copy_bench: NEON copies are not enabled\n");
+		return -ENODEV;
+	}
+
+	src = vmalloc(BENCH_MAX);
+	dst = vmalloc(BENCH_MAX);
+	if (!src || !dst) {
+		vfree(src);
+		vfree(dst);
+		return -ENOMEM;
+	}
+	memset(src, 0x5a, BENCH_MAX);
+	memset(dst, 0, BENCH_MAX);
+
+	printk(KERN_INFO "copy_bench: boot prefetch %u bytes\n",
+	       neon_copy_prefetch);
+
+	fs = get_fs();
+	set_fs(KERNEL_DS);
+	for (what = BENCH_MEMCPY; what < BENCH_PAGE; what++)
+		for (len = 256; len <= BENCH_MAX; len <<= 1)
+			bench_size(what, dst, src, len);
+	set_fs(fs);
+
+	bench_size(BENCH_PAGE, dst, src, PAGE_SIZE);
+
+	vfree(dst);
+	vfree(src);
+
+	/* nothing to keep around, see tcrypt */
+	return -EAGAIN;
+}
+
+static void __exit copy_bench_exit(void)
+{
+}
+
+module_init(copy_bench_init);
+module_exit(copy_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("ARM and NEON copy bandwidth benchmark");
@@ -0,0 +1,153 @@
+/*
+ *  linux/arch/arm/lib/copy_neon_glue.c
+ *
+ *  Choose between the ARM and the NEON copy loops.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  memcpy(), copy_page() and __copy_from_user() branch here for copies of
+ *  NEON_COPY_MIN bytes or more.  NEON is only used outside interrupt
+ *  context and once neon_copy_init() has found a NEON unit; the head up
+ *  to a 16 byte aligned destination and the tail below a 64 byte block go
+ *  through the ARM loops.  The NEON part runs in chunks of at most
+ *  NEON_COPY_CHUNK bytes, so that preemption is only held off for one
+ *  chunk at a time.
+ *
+ *  __copy_to_user() stays with the ARM loop: ARMv7 lets the kernel write
+ *  through a user read-only pte, so NEON stores would not fault on a page
+ *  that page_mkclean() or KSM write protected during the copy.
+ */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/hardirq.h>
+#include <linux/uaccess.h>
+#include <asm/cputype.h>
+#include <asm/neon.h>
+#include <asm/neon_copy.h>
+
+unsigned int neon_copy_prefetch __read_mostly;
+EXPORT_SYMBOL(neon_copy_prefetch);
+
+/* neoncopy=off or neoncopy=<prefetch distance in bytes> */
+static int neon_copy_param = -1;
+
+static inline int neon_copy_usable(void)
+{
+	return neon_copy_prefetch && !in_interrupt();
+}
+
+void *memcpy_neon(void *to, const void *from, size_t n)
+{
+	size_t head, bulk, chunk;
+
+	if (!neon_copy_usable())
+		return __memcpy_arm(to, from, n);
+
+	head = -(unsigned long)to & 15;
+	bulk = (n - head) & ~63;
+	if (head)
+		__memcpy_arm(to, from, head);
+
+	for (; bulk; bulk -= chunk, head += chunk) {
+		chunk = min_t(size_t, bulk, NEON_COPY_CHUNK);
+		kernel_neon_begin();
+		__neon_copy(to + head, from + head, chunk, neon_copy_prefetch);
+		kernel_neon_end();
+	}
+
+	if (head < n)
+		__memcpy_arm(to + head, from + head, n - head);
+	return to;
+}
+
+void copy_page_neon(void *to, const void *from)
+{
+	if (!neon_copy_usable()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__neon_copy(to, from, PAGE_SIZE, neon_copy_prefetch);
+	kernel_neon_end();
+}
+
+/*
+ * The NEON loop runs with page faults disabled, so a fault just ends it
+ * and the ARM loop carries on from there, faulting pages in (and zeroing
+ * the rest of the kernel buffer) exactly as it would have done anyway.
+ */
+unsigned long
+__copy_from_user_neon(void *to, const void __user *from, unsigned long n)
+{
+	unsigned long head, bulk, chunk, left = 0;
+
+	if (!neon_copy_usable())
+		return __copy_from_user_arm(to, from, n);
+
+	head = -(unsigned long)to & 15;
+	bulk = (n - head) & ~63;
+	if (head && __copy_from_user_arm(to, from, head))
+		return __copy_from_user_arm(to, from, n);
+
+	for (; bulk && !left; bulk -= chunk, head += chunk - left) {
+		chunk = min_t(unsigned long, bulk, NEON_COPY_CHUNK);
+		kernel_neon_begin();
+		pagefault_disable();
+		left = chunk;
+		if (!__neon_probe_user_read(from + head, chunk))
+			left = __neon_copy_user(to + head,
+						(const void __force *)from +
+						head, chunk, neon_copy_prefetch);
+		pagefault_enable();
+		kernel_neon_end();
+	}
+
+	if (head == n)
+		return 0;
+	return __copy_from_user_arm(to + head, from + head, n - head);
+}
+
+static int __init neon_copy_setup(char *str)
+{
+	if (!strcmp(str, "off"))
+		neon_copy_param = 0;
+	else
+		neon_copy_param = simple_strtoul(str, NULL, 0);
+	return 1;
+}
+__setup("neoncopy=", neon_copy_setup);
+
+/*
+ * Scorpion's longer memory pipeline wants the source further ahead than
+ * Cortex-A8 does.  The copy_bench module shows the effect of others.
+ */
+static unsigned int __init neon_copy_default_prefetch(void)
+{
+	/* Qualcomm Scorpion */
+	if ((read_cpuid_id() & 0xff00fff0) == 0x5100f000)
+		return 6 * 64;
+
+	/* Cortex-A8, and a guess for anything else */
+	return 4 * 64;
+}
+
+/* after vfp_init(), also a late_initcall, has set HWCAP_NEON */
+static int __init neon_copy_init(void)
+{
+	unsigned int prefetch;
+
+	if (!cpu_has_neon())
+		return 0;
+
+	prefetch = neon_copy_param < 0 ? neon_copy_default_prefetch() :
+					 neon_copy_param;
+	if (prefetch)
+		printk(KERN_INFO "NEON copies enabled, prefetch %u bytes\n",
+		       prefetch);
+	neon_copy_prefetch = prefetch;
+	return 0;
+}
+late_initcall(neon_copy_init);
@@ -0,0 +1,34 @@
+/*
+ * linux/arch/arm/lib/lz_copy_neon.c
+ *
+ * LZ77 match copies with NEON, see <linux/lz_copy.h>.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Must be called between kernel_neon_begin() and kernel_neon_end().  The
+ * caller guarantees at least 16 bytes and a distance of at least 16, so a
+ * 16 byte load never reads bytes the previous store has not written yet,
+ * and the tail can be done as one last chunk overlapping the one before.
+ */
+#include <stddef.h>
+#include <arm_neon.h>
+
+void lz_copy_neon(unsigned char *out, const unsigned char *from, size_t len)
+{
+	unsigned char *end = out + len;
+	const unsigned char *last = from + len - 16;
+
+	while (len >= 32) {
+		vst1q_u8(out, vld1q_u8(from));
+		vst1q_u8(out + 16, vld1q_u8(from + 16));
+		out += 32;
+		from += 32;
+		len -= 32;
+	}
+	if (len >= 16)
+		vst1q_u8(out, vld1q_u8(from));
+	if (len & 15)
+		vst1q_u8(end - 16, vld1q_u8(last));
+}
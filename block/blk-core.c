@@ -2153,7 +2153,7 @@ EXPORT_SYMBOL(kblockd_schedule_work);
 
 int __init blk_dev_init(void)
 {
-	kblockd_workqueue = create_workqueue("kblockd");
+	kblockd_workqueue = alloc_workqueue("kblockd", WQ_RESCUER, 0);
 	if (!kblockd_workqueue)
 		panic("Failed to create kblockd\n");
 
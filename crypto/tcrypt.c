@@ -26,12 +26,14 @@
 #include <linux/jiffies.h>
 #include <linux/timex.h>
 #include <linux/interrupt.h>
+#include <linux/fs.h>
+#include <linux/vmalloc.h>
 #include "tcrypt.h"
 
 /*
  * Need slab memory for testing (size in number of pages).
  */
-#define TVMEMSIZE	4
+#define TVMEMSIZE	16
 
 /*
 * Used by test_cipher_speed()
@@ -56,6 +58,43 @@ static char *check[] = {
 	"lzo", "cts", NULL
 };
 
+/*
+ * Used by test mode 207: accelerated AES drivers side by side with the
+ * generic code, selected by driver name.
+ */
+static struct {
+	const char *driver;
+	u8 *keysize;
+} aes_driver_speed[] = {
+	{ "ecb(aes-generic)",	speed_template_16_24_32 },
+	{ "ecb-aes-neon",	speed_template_16_24_32 },
+	{ "cbc(aes-generic)",	speed_template_16_24_32 },
+	{ "cbc-aes-neon",	speed_template_16_24_32 },
+	{ "ctr(aes-generic)",	speed_template_16_24_32 },
+	{ "ctr-aes-neon",	speed_template_16_24_32 },
+	{ "xts(aes-generic)",	speed_template_32_48_64 },
+	{ "xts-aes-neon",	speed_template_32_48_64 },
+};
+
+/*
+ * Used by test mode 400: files cut into pages, compressed and then timed
+ * decompressing, like pages coming back from a compressed filesystem or
+ * swap.  Missing files are skipped.
+ */
+#define CORPUS_FILES	8
+#define CORPUS_MAX	(1024 * 1024)
+
+static char *corpus[CORPUS_FILES] = {
+	"/system/lib/libc.so",
+	"/system/lib/libdvm.so",
+	"/system/lib/libwebcore.so",
+	"/system/framework/framework.jar",
+	"/system/framework/core.jar",
+	"/system/build.prop",
+	"/init.rc",
+};
+static int corpus_num;
+
 static int test_cipher_jiffies(struct blkcipher_desc *desc, int enc,
 			       struct scatterlist *sg, int blen, int sec)
 {
@@ -452,6 +491,125 @@ out:
 	crypto_free_hash(tfm);
 }
 
+static int corpus_read(const char *path, char *buf, size_t size)
+{
+	struct file *filp;
+	int len;
+
+	filp = filp_open(path, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(filp))
+		return PTR_ERR(filp);
+	len = kernel_read(filp, 0, buf, size);
+	filp_close(filp, NULL);
+	return len;
+}
+
+/* Compressed pages are stored in slots of twice the page size */
+#define COMP_SLOT	(2 * PAGE_SIZE)
+
+static int test_comp_file(struct crypto_comp *tfm, const char *path,
+			  char *raw, char *packed, unsigned int *plen,
+			  unsigned int sec)
+{
+	char *out = tvmem[0];
+	unsigned long start, end;
+	unsigned long bytes;
+	unsigned int total = 0;
+	unsigned int dlen;
+	int len, nr, i;
+	int ret;
+
+	len = corpus_read(path, raw, CORPUS_MAX);
+	if (len <= 0) {
+		printk("%s: skipped (%d)\n", path, len);
+		return 0;
+	}
+	nr = DIV_ROUND_UP(len, PAGE_SIZE);
+
+	for (i = 0; i < nr; i++) {
+		plen[i] = COMP_SLOT;
+		ret = crypto_comp_compress(tfm, raw + i * PAGE_SIZE,
+					   min_t(int, len - i * PAGE_SIZE,
+						 PAGE_SIZE),
+					   packed + i * COMP_SLOT, &plen[i]);
+		if (ret) {
+			printk("%s: compression failed ret=%d\n", path, ret);
+			return ret;
+		}
+		total += plen[i];
+	}
+
+	for (i = 0; i < nr; i++) {
+		dlen = PAGE_SIZE;
+		ret = crypto_comp_decompress(tfm, packed + i * COMP_SLOT,
+					     plen[i], out, &dlen);
+		if (ret || dlen != min_t(int, len - i * PAGE_SIZE, PAGE_SIZE) ||
+		    memcmp(out, raw + i * PAGE_SIZE, dlen)) {
+			printk("%s: page %d decompressed wrongly ret=%d\n",
+			       path, i, ret);
+			return ret ? ret : -EINVAL;
+		}
+	}
+
+	bytes = 0;
+	start = jiffies;
+	end = start + sec * HZ;
+	while (time_before(jiffies, end)) {
+		for (i = 0; i < nr; i++) {
+			dlen = PAGE_SIZE;
+			crypto_comp_decompress(tfm, packed + i * COMP_SLOT,
+					       plen[i], out, &dlen);
+		}
+		bytes += len;
+	}
+
+	printk("%s: %d bytes in %d pages, %u%% compressed, %lu KB/s\n",
+	       path, len, nr, total * 100 / len,
+	       bytes / 1024 * HZ / (jiffies - start));
+	return 0;
+}
+
+/*
+ * get_cycles() is not available everywhere this is of interest, so the
+ * decompression tests always run against jiffies, for at least a second.
+ */
+static void test_comp_speed(const char *algo, unsigned int sec)
+{
+	struct crypto_comp *tfm;
+	unsigned int *plen;
+	char *raw, *packed;
+	int i;
+
+	printk("\ntesting decompression speed of %s\n", algo);
+
+	tfm = crypto_alloc_comp(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		printk("failed to load transform for %s: %ld\n", algo,
+		       PTR_ERR(tfm));
+		return;
+	}
+
+	raw = vmalloc(CORPUS_MAX);
+	packed = vmalloc(CORPUS_MAX / PAGE_SIZE * COMP_SLOT);
+	plen = kmalloc(CORPUS_MAX / PAGE_SIZE * sizeof(*plen), GFP_KERNEL);
+	if (!raw || !packed || !plen) {
+		printk("out of memory for the corpus\n");
+		goto out;
+	}
+
+	/* a corpus= parameter replaces the whole default list */
+	for (i = 0; i < (corpus_num ?: CORPUS_FILES) && corpus[i]; i++)
+		if (test_comp_file(tfm, corpus[i], raw, packed, plen,
+				   sec ?: 1))
+			break;
+
+out:
+	kfree(plen);
+	vfree(packed);
+	vfree(raw);
+	crypto_free_comp(tfm);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -524,6 +682,7 @@ static void do_test(int m)
 		tcrypt_test("cbc(aes)");
 		tcrypt_test("lrw(aes)");
 		tcrypt_test("xts(aes)");
+		tcrypt_test("ctr(aes)");
 		tcrypt_test("rfc3686(ctr(aes))");
 		break;
 
@@ -780,6 +939,17 @@ static void do_test(int m)
 				  speed_template_16_32);
 		break;
 
+	case 207:
+		for (i = 0; i < ARRAY_SIZE(aes_driver_speed); i++) {
+			test_cipher_speed(aes_driver_speed[i].driver, ENCRYPT,
+					  sec, NULL, 0,
+					  aes_driver_speed[i].keysize);
+			test_cipher_speed(aes_driver_speed[i].driver, DECRYPT,
+					  sec, NULL, 0,
+					  aes_driver_speed[i].keysize);
+		}
+		break;
+
 	case 300:
 		/* fall through */
 
@@ -851,9 +1021,27 @@ static void do_test(int m)
 		test_hash_speed("rmd320", sec, generic_hash_speed_template);
 		if (mode > 300 && mode < 400) break;
 
+	case 318:
+		test_hash_speed("crc32c", sec, crc_speed_template);
+		if (mode > 300 && mode < 400) break;
+
 	case 399:
 		break;
 
+	case 400:
+		/* fall through */
+
+	case 401:
+		test_comp_speed("deflate", sec);
+		if (mode > 400 && mode < 500) break;
+
+	case 402:
+		test_comp_speed("lzo", sec);
+		if (mode > 400 && mode < 500) break;
+
+	case 499:
+		break;
+
 	case 1000:
 		test_available();
 		break;
@@ -901,6 +1089,8 @@ module_param(mode, int, 0);
 module_param(sec, uint, 0);
 MODULE_PARM_DESC(sec, "Length in seconds of speed tests "
 		      "(defaults to zero which uses CPU cycles instead)");
+module_param_array(corpus, charp, &corpus_num, 0);
+MODULE_PARM_DESC(corpus, "Files to decompress in modes 400-402");
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Quick & dirty crypto testing module");
@@ -83,4 +83,21 @@ static struct hash_speed generic_hash_speed_template[] = {
 	{  .blen = 0,	.plen = 0, }
 };
 
+/*
+ * Checksums are used on anything from small headers to whole erase blocks
+ */
+static struct hash_speed crc_speed_template[] = {
+	{ .blen = 64,		.plen = 64, },
+	{ .blen = 256,		.plen = 256, },
+	{ .blen = 1024,		.plen = 1024, },
+	{ .blen = 4096,		.plen = 4096, },
+	{ .blen = 16384,	.plen = 4096, },
+	{ .blen = 16384,	.plen = 16384, },
+	{ .blen = 65536,	.plen = 4096, },
+	{ .blen = 65536,	.plen = 65536, },
+
+	/* End marker */
+	{  .blen = 0,	.plen = 0, }
+};
+
 #endif	/* _CRYPTO_TCRYPT_H */
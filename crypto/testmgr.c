@@ -1206,6 +1206,21 @@ static const struct alg_test_desc alg_test_descs[] = {
 				.count = CRC32C_TEST_VECTORS
 			}
 		}
+	}, {
+		.alg = "ctr(aes)",
+		.test = alg_test_skcipher,
+		.suite = {
+			.cipher = {
+				.enc = {
+					.vecs = aes_ctr_tv_template,
+					.count = AES_CTR_TEST_VECTORS
+				},
+				.dec = {
+					.vecs = aes_ctr_tv_template,
+					.count = AES_CTR_TEST_VECTORS
+				}
+			}
+		}
 	}, {
 		.alg = "cts(cbc(aes))",
 		.test = alg_test_skcipher,
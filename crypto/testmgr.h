@@ -2838,6 +2838,7 @@ static struct cipher_testvec cast6_dec_tv_template[] = {
 #define AES_XTS_DEC_TEST_VECTORS 4
 #define AES_CTR_ENC_TEST_VECTORS 7
 #define AES_CTR_DEC_TEST_VECTORS 6
+#define AES_CTR_TEST_VECTORS 3
 #define AES_GCM_ENC_TEST_VECTORS 9
 #define AES_GCM_DEC_TEST_VECTORS 8
 #define AES_CCM_ENC_TEST_VECTORS 7
@@ -3977,6 +3978,112 @@ static struct cipher_testvec aes_xts_dec_tv_template[] = {
 };
 
 
+static struct cipher_testvec aes_ctr_tv_template[] = {
+	{ /* From NIST SP800-38A F.5.1 */
+		.key	= "\x2b\x7e\x15\x16\x28\xae\xd2\xa6"
+			  "\xab\xf7\x15\x88\x09\xcf\x4f\x3c",
+		.klen	= 16,
+		.iv	= "\xf0\xf1\xf2\xf3\xf4\xf5\xf6\xf7"
+			  "\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xff",
+		.input	= "\x6b\xc1\xbe\xe2\x2e\x40\x9f\x96"
+			  "\xe9\x3d\x7e\x11\x73\x93\x17\x2a"
+			  "\xae\x2d\x8a\x57\x1e\x03\xac\x9c"
+			  "\x9e\xb7\x6f\xac\x45\xaf\x8e\x51"
+			  "\x30\xc8\x1c\x46\xa3\x5c\xe4\x11"
+			  "\xe5\xfb\xc1\x19\x1a\x0a\x52\xef"
+			  "\xf6\x9f\x24\x45\xdf\x4f\x9b\x17"
+			  "\xad\x2b\x41\x7b\xe6\x6c\x37\x10",
+		.ilen	= 64,
+		.result = "\x87\x4d\x61\x91\xb6\x20\xe3\x26"
+			  "\x1b\xef\x68\x64\x99\x0d\xb6\xce"
+			  "\x98\x06\xf6\x6b\x79\x70\xfd\xff"
+			  "\x86\x17\x18\x7b\xb9\xff\xfd\xff"
+			  "\x5a\xe4\xdf\x3e\xdb\xd5\xd3\x5e"
+			  "\x5b\x4f\x09\x02\x0d\xb0\x3e\xab"
+			  "\x1e\x03\x1d\xda\x2f\xbe\x03\xd1"
+			  "\x79\x21\x70\xa0\xf3\x00\x9c\xee",
+		.rlen	= 64,
+	}, { /* From NIST SP800-38A F.5.5 */
+		.key	= "\x60\x3d\xeb\x10\x15\xca\x71\xbe"
+			  "\x2b\x73\xae\xf0\x85\x7d\x77\x81"
+			  "\x1f\x35\x2c\x07\x3b\x61\x08\xd7"
+			  "\x2d\x98\x10\xa3\x09\x14\xdf\xf4",
+		.klen	= 32,
+		.iv	= "\xf0\xf1\xf2\xf3\xf4\xf5\xf6\xf7"
+			  "\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xff",
+		.input	= "\x6b\xc1\xbe\xe2\x2e\x40\x9f\x96"
+			  "\xe9\x3d\x7e\x11\x73\x93\x17\x2a"
+			  "\xae\x2d\x8a\x57\x1e\x03\xac\x9c"
+			  "\x9e\xb7\x6f\xac\x45\xaf\x8e\x51"
+			  "\x30\xc8\x1c\x46\xa3\x5c\xe4\x11"
+			  "\xe5\xfb\xc1\x19\x1a\x0a\x52\xef"
+			  "\xf6\x9f\x24\x45\xdf\x4f\x9b\x17"
+			  "\xad\x2b\x41\x7b\xe6\x6c\x37\x10",
+		.ilen	= 64,
+		.result = "\x60\x1e\xc3\x13\x77\x57\x89\xa5"
+			  "\xb7\xa7\xf5\x04\xbb\xf3\xd2\x28"
+			  "\xf4\x43\xe3\xca\x4d\x62\xb5\x9a"
+			  "\xca\x84\xe9\x90\xca\xca\xf5\xc5"
+			  "\x2b\x09\x30\xda\xa2\x3d\xe9\x4c"
+			  "\xe8\x70\x17\xba\x2d\x84\x98\x8d"
+			  "\xdf\xc9\xc5\x8d\xb6\x7a\xad\xa6"
+			  "\x13\xc2\xdd\x08\x45\x79\x41\xa6",
+		.rlen	= 64,
+	}, { /*
+		 * Generated with OpenSSL: more than eight blocks, a partial
+		 * final block and a wrapping 128 bit counter
+		 */
+		.key	= "\x8e\x73\xb0\xf7\xda\x0e\x64\x52"
+			  "\xc8\x10\xf3\x2b\x80\x90\x79\xe5"
+			  "\x62\xf8\xea\xd2\x52\x2c\x6b\x7b",
+		.klen	= 24,
+		.iv	= "\xff\xff\xff\xff\xff\xff\xff\xff"
+			  "\xff\xff\xff\xff\xff\xff\xff\xfa",
+		.input	= "\x03\x0a\x11\x18\x1f\x26\x2d\x34"
+			  "\x3b\x42\x49\x50\x57\x5e\x65\x6c"
+			  "\x73\x7a\x81\x88\x8f\x96\x9d\xa4"
+			  "\xab\xb2\xb9\xc0\xc7\xce\xd5\xdc"
+			  "\xe3\xea\xf1\xf8\xff\x06\x0d\x14"
+			  "\x1b\x22\x29\x30\x37\x3e\x45\x4c"
+			  "\x53\x5a\x61\x68\x6f\x76\x7d\x84"
+			  "\x8b\x92\x99\xa0\xa7\xae\xb5\xbc"
+			  "\xc3\xca\xd1\xd8\xdf\xe6\xed\xf4"
+			  "\xfb\x02\x09\x10\x17\x1e\x25\x2c"
+			  "\x33\x3a\x41\x48\x4f\x56\x5d\x64"
+			  "\x6b\x72\x79\x80\x87\x8e\x95\x9c"
+			  "\xa3\xaa\xb1\xb8\xbf\xc6\xcd\xd4"
+			  "\xdb\xe2\xe9\xf0\xf7\xfe\x05\x0c"
+			  "\x13\x1a\x21\x28\x2f\x36\x3d\x44"
+			  "\x4b\x52\x59\x60\x67\x6e\x75\x7c"
+			  "\x83\x8a\x91\x98\x9f\xa6\xad\xb4"
+			  "\xbb\xc2\xc9\xd0\xd7\xde\xe5\xec"
+			  "\xf3\xfa\x01\x08\x0f\x16\x1d\x24",
+		.ilen	= 152,
+		.result = "\x7f\xbe\x56\x54\x05\xb4\x94\xf9"
+			  "\x15\xb0\x27\x5a\x77\xac\xe4\xab"
+			  "\x03\x26\x06\x52\xf9\x8c\xb1\x18"
+			  "\xa5\xff\x73\xe6\xe2\x53\xfb\x19"
+			  "\x00\x15\xd0\x69\xf7\xac\x26\x3f"
+			  "\x8a\x78\x86\xfc\xf0\x7c\xcf\xb6"
+			  "\xa4\xd7\xca\x53\x99\x0a\x90\xbb"
+			  "\x23\xc4\x91\xf5\x9e\xef\xa9\xd7"
+			  "\x20\x01\x49\x74\x59\x80\x53\x82"
+			  "\xee\x83\x14\xdd\xbd\xed\x60\xb4"
+			  "\x04\x38\x70\x01\x51\xa0\x6e\x95"
+			  "\x5e\x8d\x19\xea\xf5\x33\x4d\x2e"
+			  "\x81\xef\x9c\x36\xf6\x6e\x68\x47"
+			  "\x44\x91\xc8\x3e\x1d\x93\x54\x47"
+			  "\xed\xa9\xe3\xc6\x8e\xfa\xe0\xbe"
+			  "\x04\x80\xc2\x6d\x59\x9a\x62\x41"
+			  "\x23\x5b\x5b\x58\x82\x13\x19\x71"
+			  "\xd8\x90\xbe\x35\xbc\xe7\x6e\x8f"
+			  "\x43\x8d\x63\x05\x51\x7b\xfd\xd4",
+		.rlen	= 152,
+		.np	= 3,
+		.tap	= { 64, 67, 21 },
+	}
+};
+
 static struct cipher_testvec aes_ctr_enc_tv_template[] = {
 	{ /* From RFC 3686 */
 		.key	= "\xae\x68\x52\xf8\x12\x10\x67\xcc"
@@ -29,6 +29,7 @@
 #include <linux/completion.h>
 #include <linux/mutex.h>
 #include <linux/debugfs.h>
+#include <linux/tick.h>
 
 #define dprintk(msg...) cpufreq_debug_printk(CPUFREQ_DEBUG_CORE, \
 						"cpufreq-core", msg)
@@ -46,6 +47,12 @@ static DEFINE_PER_CPU(struct cpufreq_governor *, cpufreq_cpu_governor);
 #endif
 static DEFINE_SPINLOCK(cpufreq_driver_lock);
 
+#if defined(CONFIG_CPU_FREQ_REPLAY) || defined(CONFIG_CPU_FREQ_REPLAY_MODULE)
+/* see <linux/tick.h> */
+u64 (*replay_cpu_idle_time_us)(int cpu, u64 *last_update_time);
+EXPORT_SYMBOL_GPL(replay_cpu_idle_time_us);
+#endif
+
 /*
  * cpu_policy_rwsem is a per CPU reader-writer semaphore designed to cure
  * all cpufreq/hotplug/workqueue/etc related lock issues.
@@ -0,0 +1,246 @@
+/*
+ * drivers/cpufreq/cpufreq_frame_bench.c
+ *
+ * A frame-like periodic load for comparing cpufreq governors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Loading the module runs, on the current CPU and under whatever governor
+ * it has, a load that wakes every period_us and does a fixed amount of
+ * work, given as a percentage of the period at the top speed.  For each
+ * load it prints the frames that finished after the next frame was due,
+ * the worst lateness and the share of time at each frequency.  The module
+ * then refuses to stay loaded.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/sched.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/spinlock.h>
+
+#define BENCH_MAX_FREQS		32
+
+static unsigned int period_us = 16667;
+module_param(period_us, uint, 0);
+MODULE_PARM_DESC(period_us, "Frame period (default 16667us)");
+
+static unsigned int frames = 300;
+module_param(frames, uint, 0);
+MODULE_PARM_DESC(frames, "Frames per load (default 300)");
+
+static unsigned int load[8] = { 10, 25, 50, 75 };
+static int nr_load = 4;
+module_param_array(load, uint, &nr_load, 0);
+MODULE_PARM_DESC(load, "Work per frame, percent of the period at top speed");
+
+static struct cpufreq_frequency_table *bench_table;
+static unsigned int bench_cpu;
+static u64 bench_in_state[BENCH_MAX_FREQS];
+static u64 bench_last;
+static unsigned int bench_cur;
+static unsigned int bench_transitions;
+static int bench_running;
+static DEFINE_SPINLOCK(bench_lock);
+
+static inline u64 bench_now(void)
+{
+	return ktime_to_us(ktime_get());
+}
+
+static void bench_account(u64 now)
+{
+	int i;
+
+	for (i = 0; i < BENCH_MAX_FREQS &&
+		    bench_table[i].frequency != CPUFREQ_TABLE_END; i++)
+		if (bench_table[i].frequency == bench_cur)
+			bench_in_state[i] += now - bench_last;
+	bench_last = now;
+}
+
+static int bench_transition(struct notifier_block *nb, unsigned long val,
+			    void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+	unsigned long flags;
+
+	if (val != CPUFREQ_POSTCHANGE || freqs->cpu != bench_cpu)
+		return 0;
+
+	spin_lock_irqsave(&bench_lock, flags);
+	if (bench_running) {
+		bench_account(bench_now());
+		bench_transitions++;
+	}
+	bench_cur = freqs->new;
+	spin_unlock_irqrestore(&bench_lock, flags);
+	return 0;
+}
+
+static struct notifier_block bench_nb = {
+	.notifier_call = bench_transition,
+};
+
+static noinline void bench_work(unsigned long loops)
+{
+	volatile unsigned long n = loops;
+
+	while (n)
+		n--;
+}
+
+/*
+ * Loops per millisecond at the top speed: time a run at the current
+ * speed and scale.  Try again if the governor moved meanwhile.
+ */
+static unsigned long bench_calibrate(struct cpufreq_policy *policy)
+{
+	unsigned long loops = 1 << 16;
+	unsigned int cur;
+	u64 start, us;
+	int tries;
+
+	for (tries = 0; tries < 20; tries++) {
+		cur = policy->cur;
+		start = bench_now();
+		bench_work(loops);
+		us = bench_now() - start;
+
+		if (us < 10000) {
+			loops <<= 1;
+			continue;
+		}
+		if (policy->cur == cur)
+			return div64_u64((u64)loops * 1000 *
+					 policy->cpuinfo.max_freq, us * cur);
+	}
+
+	return 0;
+}
+
+static void bench_load(struct cpufreq_policy *policy, unsigned int pct,
+		       unsigned long loops_per_ms)
+{
+	unsigned long loops = div_u64((u64)loops_per_ms * period_us * pct,
+				      100 * 1000);
+	unsigned int missed = 0, i, state;
+	u64 start, due, done, late, worst = 0, total;
+	ktime_t wake;
+
+	spin_lock_irq(&bench_lock);
+	memset(bench_in_state, 0, sizeof(bench_in_state));
+	bench_transitions = 0;
+	bench_cur = policy->cur;
+	start = bench_last = bench_now();
+	bench_running = 1;
+	spin_unlock_irq(&bench_lock);
+
+	for (i = 0; i < frames; i++) {
+		due = start + (u64)i * period_us;
+		wake = ns_to_ktime(due * NSEC_PER_USEC);
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&wake, HRTIMER_MODE_ABS);
+
+		bench_work(loops);
+
+		done = bench_now();
+		if (done > due + period_us) {
+			late = done - due - period_us;
+			if (late > worst)
+				worst = late;
+			missed++;
+			/* the frames it ran into are lost too */
+			i += div64_u64(late, period_us);
+		}
+	}
+
+	spin_lock_irq(&bench_lock);
+	bench_running = 0;
+	bench_account(bench_now());
+	total = bench_last - start;
+	spin_unlock_irq(&bench_lock);
+
+	printk(KERN_INFO "frame_bench: %3u%%: %u/%u late, worst %llu us, "
+	       "%u transitions\n", pct, missed, frames, worst,
+	       bench_transitions);
+	printk(KERN_INFO "frame_bench: %3u%%:", pct);
+	for (state = 0; state < BENCH_MAX_FREQS &&
+		     bench_table[state].frequency != CPUFREQ_TABLE_END;
+	     state++) {
+		if (bench_table[state].frequency == CPUFREQ_ENTRY_INVALID)
+			continue;
+		printk(KERN_CONT " %u:%llu%%", bench_table[state].frequency,
+		       div64_u64(bench_in_state[state] * 100, total ?: 1));
+	}
+	printk(KERN_CONT "\n");
+}
+
+static int __init frame_bench_init(void)
+{
+	struct cpufreq_policy *policy;
+	cpumask_t saved = current->cpus_allowed;
+	unsigned long loops_per_ms;
+	int i, ret;
+
+	bench_cpu = get_cpu();
+	put_cpu();
+	ret = set_cpus_allowed_ptr(current, cpumask_of(bench_cpu));
+	if (ret)
+		return ret;
+
+	ret = -ENODEV;
+	policy = cpufreq_cpu_get(bench_cpu);
+	if (!policy)
+		goto out;
+
+	bench_table = cpufreq_frequency_get_table(bench_cpu);
+	if (!bench_table)
+		goto out_put;
+
+	ret = cpufreq_register_notifier(&bench_nb,
+					CPUFREQ_TRANSITION_NOTIFIER);
+	if (ret)
+		goto out_put;
+
+	loops_per_ms = bench_calibrate(policy);
+	if (!loops_per_ms) {
+		printk(KERN_ERR "frame_bench: calibration failed\n");
+		ret = -EIO;
+		goto out_unregister;
+	}
+
+	printk(KERN_INFO "frame_bench: cpu%u governor %s, period %u us, "
+	       "%lu loops/ms at %u kHz\n", bench_cpu,
+	       policy->governor ? policy->governor->name : "none",
+	       period_us, loops_per_ms, policy->cpuinfo.max_freq);
+
+	for (i = 0; i < nr_load; i++)
+		bench_load(policy, load[i], loops_per_ms);
+
+	/* nothing to keep around, see tcrypt */
+	ret = -EAGAIN;
+out_unregister:
+	cpufreq_unregister_notifier(&bench_nb, CPUFREQ_TRANSITION_NOTIFIER);
+out_put:
+	cpufreq_cpu_put(policy);
+out:
+	set_cpus_allowed_ptr(current, &saved);
+	return ret;
+}
+
+static void __exit frame_bench_exit(void)
+{
+}
+
+module_init(frame_bench_init);
+module_exit(frame_bench_exit);
+
+MODULE_DESCRIPTION("Periodic load benchmark for cpufreq governors");
+MODULE_LICENSE("GPL");
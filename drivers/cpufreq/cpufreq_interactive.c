@@ -25,12 +25,17 @@
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
+#include <linux/input.h>
+#include <linux/slab.h>
+#include <trace/cpufreq_interactive.h>
 
 #include <asm/cputime.h>
 
 static void (*pm_idle_old)(void);
 static atomic_t active_count = ATOMIC_INIT(0);
 
+#define MAX_LOAD_HISTORY 8
+
 struct cpufreq_interactive_cpuinfo {
 	struct timer_list cpu_timer;
 	int timer_idlecancel;
@@ -44,10 +49,17 @@ struct cpufreq_interactive_cpuinfo {
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
 	int governor_enabled;
+	u64 boost_until;
+	unsigned int busy_samples;
+	unsigned int hist_idx;
+	unsigned int hist_demand[MAX_LOAD_HISTORY];
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
 
+DEFINE_TRACE(cpufreq_interactive_boost);
+DEFINE_TRACE(cpufreq_interactive_target);
+
 /* Workqueues handle frequency scaling */
 static struct task_struct *up_task;
 static struct workqueue_struct *down_wq;
@@ -58,10 +70,39 @@ static cpumask_t down_cpumask;
 /*
  * The minimum amount of time to spend at a frequency before we can ramp down.
  */
-#define DEFAULT_MIN_SAMPLE_TIME 80000;
+#define DEFAULT_MIN_SAMPLE_TIME 80000
 static unsigned long min_sample_time;
 
-#define LOAD_SCALE_MAX 85
+/*
+ * Load at or above which the CPU counts as saturated: its demand may be
+ * anything above the current speed.  After load_history saturated samples
+ * in a row go straight to max.
+ */
+#define DEFAULT_GO_MAXSPEED_LOAD 85
+static unsigned long go_maxspeed_load;
+
+/*
+ * Otherwise pick the speed at which the larger of the latest demand and
+ * the mean demand over the last load_history samples would come out at
+ * target_load percent.
+ */
+#define DEFAULT_TARGET_LOAD 80
+static unsigned long target_load;
+
+#define DEFAULT_LOAD_HISTORY 3
+static unsigned long load_history;
+
+/*
+ * Touch and key events hold each CPU at input_boost_freq (kHz, 0 to
+ * disable, policy max until set) for input_boost_time (us).
+ */
+#define DEFAULT_INPUT_BOOST_TIME 80000
+static unsigned long input_boost_freq;
+static unsigned long input_boost_time;
+static unsigned long input_boost_count;
+static int input_boost_set;
+static int input_boost_pending;
+static unsigned long input_boost_refresh;
 
 #define DEBUG 0
 #define BUFSZ 128
@@ -163,6 +204,39 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+/*
+ * Demand is the load scaled by the speed it was measured at, in kHz, so
+ * that samples taken at different speeds can be averaged.
+ */
+static unsigned int cpufreq_interactive_predict(
+	struct cpufreq_interactive_cpuinfo *pcpu, int cpu_load)
+{
+	unsigned int demand = pcpu->policy->cur * cpu_load / 100;
+	unsigned int nr_hist = load_history;
+	unsigned int i, n, sum = 0;
+
+	if (cpu_load >= go_maxspeed_load)
+		pcpu->busy_samples++;
+	else
+		pcpu->busy_samples = 0;
+
+	i = pcpu->hist_idx = (pcpu->hist_idx + 1) % MAX_LOAD_HISTORY;
+	pcpu->hist_demand[i] = demand;
+
+	if (pcpu->busy_samples >= nr_hist)
+		return pcpu->policy->max;
+
+	for (n = 0; n < nr_hist; n++) {
+		sum += pcpu->hist_demand[i];
+		i = (i ? i : MAX_LOAD_HISTORY) - 1;
+	}
+
+	if (sum / nr_hist > demand)
+		demand = sum / nr_hist;
+
+	return demand * 100 / target_load;
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -240,13 +314,15 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (load_since_change > cpu_load)
 		cpu_load = load_since_change;
 
-	if (cpu_load >= LOAD_SCALE_MAX)
-		new_freq = pcpu->policy->max;
-	else
-		new_freq = pcpu->policy->max * cpu_load / 100;
+	new_freq = cpufreq_interactive_predict(pcpu, cpu_load);
+
+	/* Do not drop below the boost frequency while a boost lasts. */
+	if (pcpu->timer_run_time < pcpu->boost_until &&
+	    new_freq < input_boost_freq)
+		new_freq = input_boost_freq;
 
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
-					   new_freq, CPUFREQ_RELATION_H,
+					   new_freq, CPUFREQ_RELATION_L,
 					   &index)) {
 		dbgpr("timer %d: cpufreq_frequency_table_target error\n", (int) data);
 		goto rearm;
@@ -273,6 +349,8 @@ static void cpufreq_interactive_timer(unsigned long data)
 	}
 
 	dbgpr("timer %d: load=%d cur=%d tgt=%d queue\n", (int) data, cpu_load, pcpu->target_freq, new_freq);
+	trace_cpufreq_interactive_target(data, cpu_load, pcpu->target_freq,
+					 new_freq);
 
 	if (new_freq < pcpu->target_freq) {
 		pcpu->target_freq = new_freq;
@@ -411,6 +489,47 @@ static void cpufreq_interactive_idle(void)
 
 }
 
+/*
+ * Called from the up task for a pending input boost: restart the boost
+ * window on every CPU the governor runs and raise those below the boost
+ * frequency.
+ */
+static void cpufreq_interactive_boost(void)
+{
+	unsigned int cpu;
+	unsigned int index;
+	unsigned int freq;
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	u64 until = ktime_to_us(ktime_get()) + input_boost_time;
+
+	for_each_online_cpu(cpu) {
+		pcpu = &per_cpu(cpuinfo, cpu);
+
+		if (!pcpu->governor_enabled)
+			continue;
+
+		pcpu->boost_until = until;
+
+		if (cpufreq_frequency_table_target(pcpu->policy,
+						   pcpu->freq_table,
+						   input_boost_freq,
+						   CPUFREQ_RELATION_L,
+						   &index))
+			continue;
+
+		freq = pcpu->freq_table[index].frequency;
+
+		if (pcpu->target_freq >= freq)
+			continue;
+
+		dbgpr("boost %d: cur=%d tgt=%d\n", cpu, pcpu->target_freq, freq);
+		trace_cpufreq_interactive_boost(cpu, pcpu->target_freq, freq);
+		input_boost_count++;
+		pcpu->target_freq = freq;
+		cpumask_set_cpu(cpu, &up_cpumask);
+	}
+}
+
 static int cpufreq_interactive_up_task(void *data)
 {
 	unsigned int cpu;
@@ -426,13 +545,18 @@ static int cpufreq_interactive_up_task(void *data)
 	while (1) {
 		set_current_state(TASK_INTERRUPTIBLE);
 
-		if (cpumask_empty(&up_cpumask))
+		if (cpumask_empty(&up_cpumask) && !input_boost_pending)
 			schedule();
 
 		set_current_state(TASK_RUNNING);
 
 		if (kthread_should_stop())
 			break;
+
+		if (input_boost_pending) {
+			input_boost_pending = 0;
+			cpufreq_interactive_boost();
+		}
 #if DEBUG
 		then = up_request_time;
 		now = ktime_to_us(ktime_get());
@@ -490,6 +614,106 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 	}
 }
 
+/*
+ * Runs with the input device's event lock held: only note the event and
+ * leave the frequency change to the up task.  A boost is renewed at most
+ * twice per boost window however fast the events come.
+ */
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+					    unsigned int type,
+					    unsigned int code, int value)
+{
+	if (!input_boost_freq || !atomic_read(&active_count))
+		return;
+
+	/* key presses and touch movement, not releases */
+	if (type == EV_ABS ? !handle->private : type != EV_KEY || !value)
+		return;
+
+	if (time_before(jiffies, input_boost_refresh))
+		return;
+
+	input_boost_refresh = jiffies + usecs_to_jiffies(input_boost_time) / 2;
+	input_boost_pending = 1;
+	wake_up_process(up_task);
+}
+
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+					     struct input_dev *dev,
+					     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+	handle->private = (void *)id->driver_info;
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free_handle;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister_handle;
+
+	return 0;
+
+err_unregister_handle:
+	input_unregister_handle(handle);
+err_free_handle:
+	kfree(handle);
+	return error;
+}
+
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/*
+ * Touchscreens (driver_info set) and keys.  Other absolute axis devices,
+ * such as the accelerometer, report all the time and would keep the boost
+ * on.
+ */
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_ABS) | BIT_MASK(EV_KEY) },
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.driver_info = 1,
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) },
+		.driver_info = 1,
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+
 static ssize_t show_min_sample_time(struct cpufreq_policy *policy,
 				char *buf)
 {
@@ -499,14 +723,137 @@ static ssize_t show_min_sample_time(struct cpufreq_policy *policy,
 static ssize_t store_min_sample_time(struct cpufreq_policy *policy,
 				const char *buf, size_t count)
 {
-	return strict_strtoul(buf, 0, &min_sample_time);
+	int ret = strict_strtoul(buf, 0, &min_sample_time);
+
+	return ret ? ret : count;
 }
 
 static struct freq_attr min_sample_time_attr = __ATTR(min_sample_time, 0644,
 		show_min_sample_time, store_min_sample_time);
 
+/* A load percentage, or a history length, within [min, max] */
+static ssize_t store_bounded(const char *buf, size_t count,
+			     unsigned long *val, unsigned long min,
+			     unsigned long max)
+{
+	unsigned long input;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &input);
+	if (ret)
+		return ret;
+	if (input < min || input > max)
+		return -EINVAL;
+
+	*val = input;
+	return count;
+}
+
+static ssize_t show_go_maxspeed_load(struct cpufreq_policy *policy,
+				char *buf)
+{
+	return sprintf(buf, "%lu\n", go_maxspeed_load);
+}
+
+static ssize_t store_go_maxspeed_load(struct cpufreq_policy *policy,
+				const char *buf, size_t count)
+{
+	return store_bounded(buf, count, &go_maxspeed_load, 1, 100);
+}
+
+static struct freq_attr go_maxspeed_load_attr = __ATTR(go_maxspeed_load, 0644,
+		show_go_maxspeed_load, store_go_maxspeed_load);
+
+static ssize_t show_target_load(struct cpufreq_policy *policy,
+				char *buf)
+{
+	return sprintf(buf, "%lu\n", target_load);
+}
+
+static ssize_t store_target_load(struct cpufreq_policy *policy,
+				const char *buf, size_t count)
+{
+	return store_bounded(buf, count, &target_load, 1, 100);
+}
+
+static struct freq_attr target_load_attr = __ATTR(target_load, 0644,
+		show_target_load, store_target_load);
+
+static ssize_t show_load_history(struct cpufreq_policy *policy,
+				char *buf)
+{
+	return sprintf(buf, "%lu\n", load_history);
+}
+
+static ssize_t store_load_history(struct cpufreq_policy *policy,
+				const char *buf, size_t count)
+{
+	return store_bounded(buf, count, &load_history, 1, MAX_LOAD_HISTORY);
+}
+
+static struct freq_attr load_history_attr = __ATTR(load_history, 0644,
+		show_load_history, store_load_history);
+
+static ssize_t show_input_boost_freq(struct cpufreq_policy *policy,
+				char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_freq);
+}
+
+static ssize_t store_input_boost_freq(struct cpufreq_policy *policy,
+				const char *buf, size_t count)
+{
+	int ret = strict_strtoul(buf, 0, &input_boost_freq);
+
+	if (ret)
+		return ret;
+
+	input_boost_set = 1;
+	return count;
+}
+
+static struct freq_attr input_boost_freq_attr = __ATTR(input_boost_freq, 0644,
+		show_input_boost_freq, store_input_boost_freq);
+
+static ssize_t show_input_boost_time(struct cpufreq_policy *policy,
+				char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_time);
+}
+
+static ssize_t store_input_boost_time(struct cpufreq_policy *policy,
+				const char *buf, size_t count)
+{
+	int ret = strict_strtoul(buf, 0, &input_boost_time);
+
+	if (ret)
+		return ret;
+
+	input_boost_refresh = jiffies;
+	return count;
+}
+
+static struct freq_attr input_boost_time_attr = __ATTR(input_boost_time, 0644,
+		show_input_boost_time, store_input_boost_time);
+
+/* Boosts that raised some CPU, see also the cpufreq_interactive_boost trace */
+static ssize_t show_input_boost_count(struct cpufreq_policy *policy,
+				char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_count);
+}
+
+static struct freq_attr input_boost_count_attr = __ATTR(input_boost_count,
+		0444, show_input_boost_count, NULL);
+
 static struct attribute *interactive_attributes[] = {
 	&min_sample_time_attr.attr,
+	&go_maxspeed_load_attr.attr,
+	&target_load_attr.attr,
+	&load_history_attr.attr,
+	&input_boost_freq_attr.attr,
+	&input_boost_time_attr.attr,
+	&input_boost_count_attr.attr,
 	NULL,
 };
 
@@ -533,6 +880,11 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		pcpu->freq_change_time_in_idle =
 			get_cpu_idle_time_us(new_policy->cpu,
 					     &pcpu->freq_change_time);
+		pcpu->boost_until = 0;
+		pcpu->busy_samples = 0;
+		memset(pcpu->hist_demand, 0, sizeof(pcpu->hist_demand));
+		if (!input_boost_set)
+			input_boost_freq = new_policy->max;
 		pcpu->governor_enabled = 1;
 		/*
 		 * Do not register the idle hook and create sysfs
@@ -578,10 +930,16 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 static int __init cpufreq_interactive_init(void)
 {
 	unsigned int i;
+	int rc;
 	struct cpufreq_interactive_cpuinfo *pcpu;
 	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
 
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
+	go_maxspeed_load = DEFAULT_GO_MAXSPEED_LOAD;
+	target_load = DEFAULT_TARGET_LOAD;
+	load_history = DEFAULT_LOAD_HISTORY;
+	input_boost_time = DEFAULT_INPUT_BOOST_TIME;
+	input_boost_refresh = jiffies;
 
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
@@ -615,7 +973,23 @@ static int __init cpufreq_interactive_init(void)
 	dbg_proc->read_proc = dbg_proc_read;
 #endif
 
-	return cpufreq_register_governor(&cpufreq_gov_interactive);
+	rc = input_register_handler(&cpufreq_interactive_input_handler);
+	if (rc)
+		goto err_freewq;
+
+	rc = cpufreq_register_governor(&cpufreq_gov_interactive);
+	if (rc)
+		goto err_unregister_input;
+
+	return 0;
+
+err_unregister_input:
+	input_unregister_handler(&cpufreq_interactive_input_handler);
+err_freewq:
+	destroy_workqueue(down_wq);
+	kthread_stop(up_task);
+	put_task_struct(up_task);
+	return rc;
 
 err_freeuptask:
 	put_task_struct(up_task);
@@ -631,6 +1005,7 @@ module_init(cpufreq_interactive_init);
 static void __exit cpufreq_interactive_exit(void)
 {
 	cpufreq_unregister_governor(&cpufreq_gov_interactive);
+	input_unregister_handler(&cpufreq_interactive_input_handler);
 	kthread_stop(up_task);
 	put_task_struct(up_task);
 	destroy_workqueue(down_wq);
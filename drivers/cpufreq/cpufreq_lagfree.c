@@ -29,6 +29,8 @@
 #include <linux/kernel_stat.h>
 #include <linux/percpu.h>
 #include <linux/mutex.h>
+#include <linux/tick.h>
+#include <linux/math64.h>
 #include <linux/earlysuspend.h>
 /*
  * dbs is used in this file as a shortform for demandbased switching
@@ -110,10 +112,16 @@ static struct dbs_tuners dbs_tuners_ins = {
 static inline unsigned int get_cpu_idle_time(unsigned int cpu)
 {
 	unsigned int add_nice = 0, ret;
+	u64 wall, idle;
 
 	if (dbs_tuners_ins.ignore_nice)
 		add_nice = kstat_cpu(cpu).cpustat.nice;
 
+	/* the replay harness stands in for the idle accounting */
+	if (unlikely(replay_idle_time(cpu, &wall, &idle)))
+		return (unsigned int)div_u64(idle, USEC_PER_SEC / HZ) +
+			add_nice;
+
 	ret = kstat_cpu(cpu).cpustat.idle +
 		kstat_cpu(cpu).cpustat.iowait +
 		add_nice;
@@ -0,0 +1,689 @@
+/*
+ * drivers/cpufreq/cpufreq_replay.c
+ *
+ * Replay recorded load traces through a cpufreq governor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A dummy cpufreq driver with a configurable frequency table stands in
+ * for the hardware, and a synthetic idle time, handed to the governors
+ * through get_cpu_idle_time_us(), stands in for the load.  Whatever
+ * governor is selected in scaling_governor sees the trace as if it were
+ * running on the CPU, so governors can be compared under UML or QEMU.
+ * See Documentation/cpu-freq/replay.txt.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/math64.h>
+#include <linux/rcupdate.h>
+
+#define REPLAY_MAX_FREQS	16
+
+/* Default table and voltages: QSD8x50 at 998MHz */
+static unsigned int freqs[REPLAY_MAX_FREQS] = {
+	245760, 384000, 576000, 768000, 998400,
+};
+static int nr_freqs = 5;
+module_param_array(freqs, uint, &nr_freqs, 0444);
+MODULE_PARM_DESC(freqs, "Frequency table in kHz, ascending");
+
+static unsigned int millivolts[REPLAY_MAX_FREQS] = {
+	1000, 1000, 1050, 1150, 1300,
+};
+static int nr_millivolts = 5;
+module_param_array(millivolts, uint, &nr_millivolts, 0444);
+MODULE_PARM_DESC(millivolts, "Core voltage at each frequency, for the energy model");
+
+/*
+ * Busy power is ceff * f * V^2: microwatts per MHz per volt squared.  The
+ * default puts the top speed of the default table near 500mW.
+ */
+static unsigned int ceff = 300;
+module_param(ceff, uint, 0644);
+MODULE_PARM_DESC(ceff, "Switched capacitance, uW per MHz*V^2 (default 300)");
+
+static unsigned int idle_uw = 10000;
+module_param(idle_uw, uint, 0644);
+MODULE_PARM_DESC(idle_uw, "Idle power in uW, at any frequency (default 10000)");
+
+static unsigned int latency_us = 50;
+module_param(latency_us, uint, 0444);
+MODULE_PARM_DESC(latency_us, "Reported transition latency (default 50us)");
+
+/*
+ * One line of a trace: the CPU does busy_us of work, measured at the top
+ * speed and taking longer at lower ones, then idles for idle_us.
+ */
+struct replay_interval {
+	u32 busy_us;
+	u32 idle_us;
+};
+
+struct replay_cpu {
+	struct replay_interval *trace;
+	unsigned int nr;
+	unsigned int alloc;
+
+	/* replay state */
+	unsigned int pos;
+	int busy;
+	int done;
+	u64 left;		/* busy: kHz * us of work, idle: us */
+	u64 last;		/* us, as ktime_get() */
+	u64 idle_time;		/* what get_cpu_idle_time_us() returns */
+	unsigned int cur;	/* index into replay_table */
+
+	/* results */
+	u64 busy_in_state[REPLAY_MAX_FREQS];
+	u64 idle_in_state[REPLAY_MAX_FREQS];
+	unsigned int trans[REPLAY_MAX_FREQS][REPLAY_MAX_FREQS];
+	u64 work;		/* us of busy time at the top speed */
+	u64 onset;		/* start of a busy interval not yet answered */
+	unsigned int onsets;
+	unsigned int ramps;
+	unsigned int missed;
+	u64 ramp_total;
+	u64 ramp_max;
+};
+
+static struct cpufreq_frequency_table replay_table[REPLAY_MAX_FREQS + 1];
+static unsigned int replay_max;
+
+static struct replay_cpu replay_cpus[NR_CPUS];
+static u64 replay_start, replay_end;
+static int replay_running;
+
+/* replay_lock guards the replay state, replay_mutex the traces and runs */
+static DEFINE_SPINLOCK(replay_lock);
+static DEFINE_MUTEX(replay_mutex);
+
+static struct dentry *replay_dir;
+
+static inline u64 replay_now(void)
+{
+	return ktime_to_us(ktime_get());
+}
+
+static void replay_account(struct replay_cpu *rc, u64 dt)
+{
+	if (rc->busy)
+		rc->busy_in_state[rc->cur] += dt;
+	else
+		rc->idle_in_state[rc->cur] += dt;
+}
+
+static void replay_begin_busy(struct replay_cpu *rc)
+{
+	u32 busy_us = rc->trace[rc->pos].busy_us;
+
+	rc->busy = 1;
+	rc->left = (u64)busy_us * replay_max;
+	rc->work += busy_us;
+	if (!busy_us)
+		return;
+
+	rc->onsets++;
+	if (rc->cur < nr_freqs - 1)
+		rc->onset = rc->last;
+}
+
+static void replay_next_interval(struct replay_cpu *rc)
+{
+	if (rc->busy) {
+		if (rc->onset) {
+			/* the whole interval went by without a raise */
+			if (rc->cur < nr_freqs - 1)
+				rc->missed++;
+			rc->onset = 0;
+		}
+		rc->busy = 0;
+		rc->left = rc->trace[rc->pos].idle_us;
+		return;
+	}
+
+	if (++rc->pos >= rc->nr)
+		rc->done = 1;
+	else
+		replay_begin_busy(rc);
+}
+
+/* Run @rc's trace forwards to @now at its current speed */
+static void replay_advance(struct replay_cpu *rc, u64 now)
+{
+	unsigned int khz = replay_table[rc->cur].frequency;
+	u64 dt, step;
+
+	while (rc->last < now) {
+		dt = now - rc->last;
+
+		if (rc->done) {
+			rc->idle_time += dt;
+			replay_account(rc, dt);
+			rc->last = now;
+			break;
+		}
+
+		if (rc->busy) {
+			if (dt * khz < rc->left) {
+				rc->left -= dt * khz;
+				replay_account(rc, dt);
+				rc->last = now;
+				break;
+			}
+			step = div64_u64(rc->left + khz - 1, khz);
+		} else {
+			if (dt < rc->left) {
+				rc->left -= dt;
+				rc->idle_time += dt;
+				replay_account(rc, dt);
+				rc->last = now;
+				break;
+			}
+			step = rc->left;
+			rc->idle_time += step;
+		}
+
+		replay_account(rc, step);
+		rc->last += step;
+		replay_next_interval(rc);
+	}
+}
+
+/* Stands in for get_cpu_idle_time_us() during a run */
+static u64 replay_idle_time_us(int cpu, u64 *last_update_time)
+{
+	struct replay_cpu *rc = &replay_cpus[cpu];
+	unsigned long flags;
+	u64 now, idle;
+
+	spin_lock_irqsave(&replay_lock, flags);
+	now = replay_now();
+	if (replay_running)
+		replay_advance(rc, now);
+	idle = rc->idle_time;
+	spin_unlock_irqrestore(&replay_lock, flags);
+
+	if (last_update_time)
+		*last_update_time = now;
+	return idle;
+}
+
+static void replay_set_freq(unsigned int cpu, unsigned int index)
+{
+	struct replay_cpu *rc = &replay_cpus[cpu];
+	unsigned long flags;
+	u64 now;
+
+	spin_lock_irqsave(&replay_lock, flags);
+	if (replay_running) {
+		now = replay_now();
+		replay_advance(rc, now);
+		rc->trans[rc->cur][index]++;
+
+		if (rc->onset && index > rc->cur) {
+			now -= rc->onset;
+			rc->ramps++;
+			rc->ramp_total += now;
+			if (now > rc->ramp_max)
+				rc->ramp_max = now;
+			rc->onset = 0;
+		}
+	}
+	rc->cur = index;
+	spin_unlock_irqrestore(&replay_lock, flags);
+}
+
+static int replay_cpufreq_verify(struct cpufreq_policy *policy)
+{
+	return cpufreq_frequency_table_verify(policy, replay_table);
+}
+
+static int replay_cpufreq_target(struct cpufreq_policy *policy,
+				 unsigned int target_freq,
+				 unsigned int relation)
+{
+	struct cpufreq_freqs freqs;
+	unsigned int index;
+
+	if (cpufreq_frequency_table_target(policy, replay_table, target_freq,
+					   relation, &index))
+		return -EINVAL;
+
+	freqs.old = policy->cur;
+	freqs.new = replay_table[index].frequency;
+	freqs.cpu = policy->cpu;
+	if (freqs.old == freqs.new)
+		return 0;
+
+	cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
+	replay_set_freq(policy->cpu, index);
+	cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
+	return 0;
+}
+
+static int replay_cpufreq_init(struct cpufreq_policy *policy)
+{
+	int ret;
+
+	ret = cpufreq_frequency_table_cpuinfo(policy, replay_table);
+	if (ret)
+		return ret;
+
+	replay_cpus[policy->cpu].cur = 0;
+	policy->cur = replay_table[0].frequency;
+	policy->cpuinfo.transition_latency = latency_us * NSEC_PER_USEC;
+	cpufreq_frequency_table_get_attr(replay_table, policy->cpu);
+	return 0;
+}
+
+static int replay_cpufreq_exit(struct cpufreq_policy *policy)
+{
+	cpufreq_frequency_table_put_attr(policy->cpu);
+	return 0;
+}
+
+static struct freq_attr *replay_cpufreq_attr[] = {
+	&cpufreq_freq_attr_scaling_available_freqs,
+	NULL,
+};
+
+/* loops_per_jiffy does not change: nothing really runs any slower */
+static struct cpufreq_driver replay_cpufreq_driver = {
+	.flags		= CPUFREQ_STICKY | CPUFREQ_CONST_LOOPS,
+	.init		= replay_cpufreq_init,
+	.exit		= replay_cpufreq_exit,
+	.verify		= replay_cpufreq_verify,
+	.target		= replay_cpufreq_target,
+	.name		= "replay",
+	.attr		= replay_cpufreq_attr,
+};
+
+static void replay_start_cpu(struct replay_cpu *rc, unsigned int cpu, u64 now)
+{
+	u64 wall;
+
+	memset(rc->busy_in_state, 0, sizeof(rc->busy_in_state));
+	memset(rc->idle_in_state, 0, sizeof(rc->idle_in_state));
+	memset(rc->trans, 0, sizeof(rc->trans));
+	rc->work = 0;
+	rc->onset = 0;
+	rc->onsets = 0;
+	rc->ramps = 0;
+	rc->missed = 0;
+	rc->ramp_total = 0;
+	rc->ramp_max = 0;
+
+	/* carry on from the real idle time, so no governor sees a jump */
+	rc->idle_time = get_cpu_idle_time_us(cpu, &wall);
+	if (rc->idle_time == -1ULL)
+		rc->idle_time = 0;
+
+	rc->last = now;
+	rc->pos = 0;
+	rc->busy = 0;
+	rc->done = !rc->nr;
+	if (!rc->done)
+		replay_begin_busy(rc);
+}
+
+static int replay_finished(void)
+{
+	unsigned int cpu;
+
+	for_each_online_cpu(cpu)
+		if (!replay_cpus[cpu].done)
+			return 0;
+	return 1;
+}
+
+/*
+ * Replay the loaded traces on every online CPU, in real time, until they
+ * have all run out or a signal arrives.
+ */
+static int replay_run(void)
+{
+	unsigned long flags;
+	unsigned int cpu;
+	int done, ret = 0;
+	u64 now;
+
+	spin_lock_irqsave(&replay_lock, flags);
+	now = replay_now();
+	for_each_online_cpu(cpu)
+		replay_start_cpu(&replay_cpus[cpu], cpu, now);
+	replay_start = now;
+	replay_running = 1;
+	rcu_assign_pointer(replay_cpu_idle_time_us, replay_idle_time_us);
+	spin_unlock_irqrestore(&replay_lock, flags);
+
+	do {
+		if (msleep_interruptible(100)) {
+			ret = -EINTR;
+			break;
+		}
+
+		spin_lock_irqsave(&replay_lock, flags);
+		now = replay_now();
+		for_each_online_cpu(cpu)
+			replay_advance(&replay_cpus[cpu], now);
+		done = replay_finished();
+		spin_unlock_irqrestore(&replay_lock, flags);
+	} while (!done);
+
+	spin_lock_irqsave(&replay_lock, flags);
+	now = replay_now();
+	for_each_online_cpu(cpu)
+		replay_advance(&replay_cpus[cpu], now);
+	replay_end = now;
+	replay_running = 0;
+	rcu_assign_pointer(replay_cpu_idle_time_us, NULL);
+	spin_unlock_irqrestore(&replay_lock, flags);
+
+	/* let get_cpu_idle_time_us() callers already in the hook leave it */
+	synchronize_rcu();
+
+	return ret;
+}
+
+static int replay_add(unsigned int cpu, u32 busy_us, u32 idle_us)
+{
+	struct replay_cpu *rc = &replay_cpus[cpu];
+	struct replay_interval *trace;
+
+	if (rc->nr == rc->alloc) {
+		trace = krealloc(rc->trace, (rc->alloc + 256) * sizeof(*trace),
+				 GFP_KERNEL);
+		if (!trace)
+			return -ENOMEM;
+		rc->trace = trace;
+		rc->alloc += 256;
+	}
+
+	rc->trace[rc->nr].busy_us = busy_us;
+	rc->trace[rc->nr].idle_us = idle_us;
+	rc->nr++;
+	return 0;
+}
+
+static void replay_clear(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(replay_cpus[cpu].trace);
+		replay_cpus[cpu].trace = NULL;
+		replay_cpus[cpu].nr = 0;
+		replay_cpus[cpu].alloc = 0;
+	}
+}
+
+static int replay_parse_line(char *line)
+{
+	unsigned int cpu, busy_us, idle_us;
+
+	line = strstrip(line);
+	if (!*line || *line == '#')
+		return 0;
+
+	if (sscanf(line, "%u %u %u", &cpu, &busy_us, &idle_us) != 3 ||
+	    cpu >= NR_CPUS)
+		return -EINVAL;
+
+	return replay_add(cpu, busy_us, idle_us);
+}
+
+/* A partial line left over from the last write to "trace" */
+static char replay_partial[64];
+
+/*
+ * "trace": lines of "<cpu> <busy us> <idle us>".  A write at offset zero
+ * replaces the loaded traces, later ones append.
+ */
+static ssize_t replay_trace_write(struct file *file, const char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	char *buf, *line, *next;
+	size_t partial;
+	int ret;
+
+	mutex_lock(&replay_mutex);
+	if (!*ppos) {
+		replay_clear();
+		replay_partial[0] = '\0';
+	}
+
+	partial = strlen(replay_partial);
+	ret = -ENOMEM;
+	buf = kmalloc(partial + count + 1, GFP_KERNEL);
+	if (!buf)
+		goto out;
+
+	memcpy(buf, replay_partial, partial);
+	ret = -EFAULT;
+	if (copy_from_user(buf + partial, ubuf, count))
+		goto out_free;
+	buf[partial + count] = '\0';
+
+	for (line = buf; (next = strchr(line, '\n')); line = next + 1) {
+		*next = '\0';
+		ret = replay_parse_line(line);
+		if (ret)
+			goto out_free;
+	}
+
+	ret = -EINVAL;
+	if (strlen(line) >= sizeof(replay_partial))
+		goto out_free;
+	strcpy(replay_partial, line);
+
+	*ppos += count;
+	ret = count;
+out_free:
+	kfree(buf);
+out:
+	mutex_unlock(&replay_mutex);
+	return ret;
+}
+
+static int replay_trace_release(struct inode *inode, struct file *file)
+{
+	int ret = 0;
+
+	/* the last line need not end in a newline */
+	mutex_lock(&replay_mutex);
+	if (file->f_mode & FMODE_WRITE)
+		ret = replay_parse_line(replay_partial);
+	replay_partial[0] = '\0';
+	mutex_unlock(&replay_mutex);
+	return ret;
+}
+
+static const struct file_operations replay_trace_fops = {
+	.write		= replay_trace_write,
+	.release	= replay_trace_release,
+};
+
+/* "run": any write replays the traces and returns once they are done */
+static ssize_t replay_run_write(struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	int ret;
+
+	mutex_lock(&replay_mutex);
+	ret = replay_run();
+	mutex_unlock(&replay_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations replay_run_fops = {
+	.write		= replay_run_write,
+};
+
+/* uW at frequency index @i while busy */
+static u64 replay_power(int i)
+{
+	u64 mv = i < nr_millivolts ? millivolts[i] : 1000;
+
+	return (u64)ceff * (replay_table[i].frequency / 1000) * mv * mv /
+		1000000;
+}
+
+static void replay_show_cpu(struct seq_file *m, unsigned int cpu)
+{
+	struct replay_cpu *rc = &replay_cpus[cpu];
+	u64 busy = 0, idle = 0, uj = 0;
+	int i, j;
+
+	for (i = 0; i < nr_freqs; i++) {
+		busy += rc->busy_in_state[i];
+		idle += rc->idle_in_state[i];
+		uj += div64_u64(rc->busy_in_state[i] * replay_power(i) +
+				rc->idle_in_state[i] * idle_uw, 1000000);
+	}
+
+	seq_printf(m, "cpu%u: %u intervals, busy %llu ms, idle %llu ms, "
+		   "energy %llu mJ\n", cpu, rc->nr,
+		   div64_u64(busy, 1000), div64_u64(idle, 1000),
+		   div64_u64(uj, 1000));
+
+	/* how much longer the work took than at the top speed */
+	seq_printf(m, "  work %llu ms, stretch %llu%%\n",
+		   div64_u64(rc->work, 1000),
+		   rc->work ? div64_u64(busy * 100, rc->work) : 100);
+
+	seq_printf(m, "  onsets %u, ramped %u, never ramped %u, "
+		   "ramp latency avg %llu us max %llu us\n",
+		   rc->onsets, rc->ramps, rc->missed,
+		   rc->ramps ? div64_u64(rc->ramp_total, rc->ramps) : 0,
+		   rc->ramp_max);
+
+	/* residency in ms, busy and idle */
+	seq_printf(m, "  time_in_state:\n");
+	for (i = 0; i < nr_freqs; i++)
+		seq_printf(m, "  %9u %8llu %8llu\n", replay_table[i].frequency,
+			   div64_u64(rc->busy_in_state[i], 1000),
+			   div64_u64(rc->idle_in_state[i], 1000));
+
+	/* as cpufreq_stats' trans_table */
+	seq_printf(m, "   From  :    To\n");
+	seq_printf(m, "         : ");
+	for (i = 0; i < nr_freqs; i++)
+		seq_printf(m, "%9u ", replay_table[i].frequency);
+	seq_printf(m, "\n");
+	for (i = 0; i < nr_freqs; i++) {
+		seq_printf(m, "%9u: ", replay_table[i].frequency);
+		for (j = 0; j < nr_freqs; j++)
+			seq_printf(m, "%9u ", rc->trans[i][j]);
+		seq_printf(m, "\n");
+	}
+}
+
+/* "report": the results of the last run */
+static int replay_report_show(struct seq_file *m, void *v)
+{
+	struct cpufreq_policy *policy;
+	unsigned int cpu;
+
+	mutex_lock(&replay_mutex);
+	policy = cpufreq_cpu_get(0);
+	seq_printf(m, "governor %s, %llu ms\n",
+		   policy && policy->governor ? policy->governor->name : "none",
+		   div64_u64(replay_end - replay_start, 1000));
+	if (policy)
+		cpufreq_cpu_put(policy);
+
+	for_each_online_cpu(cpu)
+		replay_show_cpu(m, cpu);
+	mutex_unlock(&replay_mutex);
+	return 0;
+}
+
+static int replay_report_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, replay_report_show, NULL);
+}
+
+static const struct file_operations replay_report_fops = {
+	.open		= replay_report_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cpufreq_replay_init(void)
+{
+	int i, ret;
+
+	if (nr_freqs < 1) {
+		printk(KERN_ERR "cpufreq_replay: empty frequency table\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nr_freqs; i++) {
+		if (i && freqs[i] <= freqs[i - 1]) {
+			printk(KERN_ERR "cpufreq_replay: frequencies must be "
+			       "ascending\n");
+			return -EINVAL;
+		}
+		replay_table[i].index = i;
+		replay_table[i].frequency = freqs[i];
+	}
+	replay_table[i].index = i;
+	replay_table[i].frequency = CPUFREQ_TABLE_END;
+	replay_max = freqs[nr_freqs - 1];
+
+	replay_dir = debugfs_create_dir("cpufreq_replay", NULL);
+	if (!replay_dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("trace", 0200, replay_dir, NULL,
+				 &replay_trace_fops) ||
+	    !debugfs_create_file("run", 0200, replay_dir, NULL,
+				 &replay_run_fops) ||
+	    !debugfs_create_file("report", 0444, replay_dir, NULL,
+				 &replay_report_fops)) {
+		ret = -ENOMEM;
+		goto err_remove;
+	}
+
+	/* fails if the platform has a cpufreq driver of its own */
+	ret = cpufreq_register_driver(&replay_cpufreq_driver);
+	if (ret)
+		goto err_remove;
+
+	return 0;
+
+err_remove:
+	debugfs_remove_recursive(replay_dir);
+	return ret;
+}
+
+static void __exit cpufreq_replay_exit(void)
+{
+	cpufreq_unregister_driver(&replay_cpufreq_driver);
+	debugfs_remove_recursive(replay_dir);
+	replay_clear();
+}
+
+module_init(cpufreq_replay_init);
+module_exit(cpufreq_replay_exit);
+
+MODULE_DESCRIPTION("cpufreq governor replay harness");
+MODULE_LICENSE("GPL");
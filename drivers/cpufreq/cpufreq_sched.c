@@ -0,0 +1,507 @@
+/*
+ * drivers/cpufreq/cpufreq_sched.c
+ *
+ * A cpufreq governor driven by the CFS runqueues.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The sampling governors notice a load one timer period after it starts.
+ * Here the scheduler reports every CFS enqueue, dequeue and tick, see
+ * kernel/sched_fair.c, and the governor keeps a running average of how
+ * busy each CPU is, in units of its top speed.  Each update picks the
+ * speed that would leave target_load percent of it busy; a new speed is
+ * requested at most once per rate_limit_us and set by a real time
+ * kthread, since the scheduler calls in with its runqueue lock held.
+ *
+ * An idle CPU gets no updates, and with NO_HZ no ticks either, so the
+ * speed asked for by its last busy period would stay through the whole
+ * idle period.  A timer takes over from the scheduler while the CPU is
+ * idle and lets the average decay.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+
+/* utilization is kept in 1/1024ths of the top speed */
+#define SCHED_UTIL_SCALE	1024
+
+/* Busy percentage of the chosen speed to aim for */
+#define DEFAULT_TARGET_LOAD	80
+static unsigned long target_load;
+
+/*
+ * Time constants of the utilization average, in us: after a change in
+ * load, this long passes until the average has moved most of the way.
+ * It falls more slowly than it rises so that a CPU woken for the next
+ * frame of a periodic load does not find its speed gone.
+ */
+#define DEFAULT_UP_TAU		4000
+#define DEFAULT_DOWN_TAU	16000
+#define MAX_TAU			100000
+static unsigned long up_tau;
+static unsigned long down_tau;
+
+/*
+ * Changing speed more often than every ten transition latencies would
+ * spend over a tenth of the time switching.  rate_limit_us defaults to
+ * that, but no less than MIN_RATE_LIMIT.
+ */
+#define RATE_LIMIT_LATENCIES	10
+#define MIN_RATE_LIMIT		500
+static unsigned long rate_limit;
+static int rate_limit_set;
+
+struct cpufreq_sched_cpuinfo {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	int enabled;
+	unsigned long nr_running;	/* at the last update */
+	u64 last_update;		/* rq->clock, ns */
+	u64 last_request;		/* rq->clock, ns */
+	unsigned int util;
+	unsigned int requested;		/* kHz, for the kthread */
+	int kick;
+	/* the timer against the scheduler, which holds the runqueue lock */
+	spinlock_t lock;
+	struct timer_list idle_timer;
+};
+
+static DEFINE_PER_CPU(struct cpufreq_sched_cpuinfo, sched_cpuinfo);
+
+static struct task_struct *sched_task;
+static int sched_task_pending;
+
+/* serializes the kthread against governor start and stop */
+static DEFINE_MUTEX(sched_mutex);
+
+static atomic_t active_count = ATOMIC_INIT(0);
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+		unsigned int event);
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+static
+#endif
+struct cpufreq_governor cpufreq_gov_sched = {
+	.name = "sched",
+	.governor = cpufreq_governor_sched,
+	.max_transition_latency = 10000000,
+	.owner = THIS_MODULE,
+};
+
+/*
+ * Fold @delta us at the previous load into the average.  A busy CPU
+ * counts in proportion to its current speed, so that the average says
+ * how much of the top speed is needed whatever speed it was measured at.
+ */
+static void cpufreq_sched_accrue(struct cpufreq_sched_cpuinfo *pcpu,
+				 unsigned int delta)
+{
+	struct cpufreq_policy *policy = pcpu->policy;
+	unsigned int sample = 0;
+	unsigned int tau;
+
+	if (pcpu->nr_running)
+		sample = SCHED_UTIL_SCALE * policy->cur /
+			policy->cpuinfo.max_freq;
+
+	tau = sample > pcpu->util ? up_tau : down_tau;
+
+	if (delta >= 8 * tau)
+		pcpu->util = sample;
+	else
+		pcpu->util = (pcpu->util * tau + sample * delta) /
+			(tau + delta);
+}
+
+/*
+ * Not deferrable: it has to run while the CPU sleeps.  It is armed once
+ * per down_tau_us of idleness at most, and not at all once the lowest
+ * speed has been asked for.
+ */
+static void cpufreq_sched_arm_idle_timer(struct cpufreq_sched_cpuinfo *pcpu)
+{
+	if (pcpu->requested > pcpu->policy->min)
+		mod_timer(&pcpu->idle_timer,
+			  jiffies + usecs_to_jiffies(down_tau));
+}
+
+static void cpufreq_sched_do_update(struct cpufreq_sched_cpuinfo *pcpu,
+				    u64 clock, unsigned long nr_running)
+{
+	struct cpufreq_policy *policy = pcpu->policy;
+	unsigned int delta, target, index;
+	u64 elapsed;
+
+	/* the idle timer reads cpu_clock(), which may lag rq->clock */
+	elapsed = clock > pcpu->last_update ? clock - pcpu->last_update : 0;
+	/* ns to roughly us, the average does not need better */
+	delta = elapsed >> 32 ? UINT_MAX : (u32)elapsed >> 10;
+	pcpu->last_update += elapsed;
+
+	cpufreq_sched_accrue(pcpu, delta);
+	pcpu->nr_running = nr_running;
+
+	target = policy->cpuinfo.max_freq / SCHED_UTIL_SCALE * pcpu->util *
+		100 / target_load;
+
+	if (cpufreq_frequency_table_target(policy, pcpu->freq_table, target,
+					   CPUFREQ_RELATION_L, &index))
+		return;
+
+	target = pcpu->freq_table[index].frequency;
+	if (target == pcpu->requested)
+		return;
+
+	/* a later update retries once the limit has passed */
+	if (pcpu->last_update - pcpu->last_request <
+	    (u64)rate_limit * NSEC_PER_USEC)
+		return;
+
+	pcpu->requested = target;
+	pcpu->last_request = pcpu->last_update;
+	pcpu->kick = 1;
+}
+
+/**
+ * cpufreq_sched_update - CFS load changed
+ * @cpu: runqueue's CPU
+ * @clock: runqueue clock, ns
+ * @nr_running: runnable CFS entities, after the change
+ *
+ * Called with the runqueue lock held and interrupts off.  Anything that
+ * may sleep is left to the kthread, which cpufreq_sched_kick() wakes.
+ */
+void cpufreq_sched_update(int cpu, u64 clock, unsigned long nr_running)
+{
+	struct cpufreq_sched_cpuinfo *pcpu = &per_cpu(sched_cpuinfo, cpu);
+
+	if (!pcpu->enabled)
+		return;
+
+	spin_lock(&pcpu->lock);
+	cpufreq_sched_do_update(pcpu, clock, nr_running);
+	if (!nr_running)
+		cpufreq_sched_arm_idle_timer(pcpu);
+	spin_unlock(&pcpu->lock);
+}
+
+static void cpufreq_sched_wake_thread(struct cpufreq_sched_cpuinfo *pcpu)
+{
+	if (!pcpu->kick)
+		return;
+
+	pcpu->kick = 0;
+	sched_task_pending = 1;
+	wake_up_process(sched_task);
+}
+
+/*
+ * The CPU is still idle down_tau_us after its last update: fold the idle
+ * time into the average, and ask for a lower speed if that is enough.
+ */
+static void cpufreq_sched_idle_timer(unsigned long data)
+{
+	struct cpufreq_sched_cpuinfo *pcpu = &per_cpu(sched_cpuinfo, data);
+	unsigned long flags;
+
+	if (!pcpu->enabled)
+		return;
+
+	spin_lock_irqsave(&pcpu->lock, flags);
+	if (!pcpu->nr_running) {
+		cpufreq_sched_do_update(pcpu, cpu_clock(data), 0);
+		cpufreq_sched_arm_idle_timer(pcpu);
+	}
+	spin_unlock_irqrestore(&pcpu->lock, flags);
+
+	cpufreq_sched_wake_thread(pcpu);
+}
+
+/*
+ * Called on the local CPU after a context switch or a tick, once the
+ * scheduler has dropped its runqueue lock: wake the kthread for a new
+ * request.
+ */
+void cpufreq_sched_kick(void)
+{
+	cpufreq_sched_wake_thread(&__get_cpu_var(sched_cpuinfo));
+}
+
+/* The highest speed any CPU of @policy asks for */
+static unsigned int cpufreq_sched_policy_target(struct cpufreq_policy *policy)
+{
+	unsigned int cpu, target = 0;
+	struct cpufreq_sched_cpuinfo *pcpu;
+
+	for_each_cpu(cpu, policy->cpus) {
+		pcpu = &per_cpu(sched_cpuinfo, cpu);
+		if (pcpu->enabled && pcpu->requested > target)
+			target = pcpu->requested;
+	}
+
+	return target;
+}
+
+static int cpufreq_sched_thread(void *data)
+{
+	unsigned int cpu, target;
+	struct cpufreq_sched_cpuinfo *pcpu;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+
+		if (!sched_task_pending)
+			schedule();
+
+		set_current_state(TASK_RUNNING);
+
+		if (kthread_should_stop())
+			break;
+
+		sched_task_pending = 0;
+
+		mutex_lock(&sched_mutex);
+		for_each_online_cpu(cpu) {
+			pcpu = &per_cpu(sched_cpuinfo, cpu);
+
+			/* each policy once, through its first CPU */
+			if (!pcpu->enabled || pcpu->policy->cpu != cpu)
+				continue;
+
+			target = cpufreq_sched_policy_target(pcpu->policy);
+			if (target && target != pcpu->policy->cur)
+				__cpufreq_driver_target(pcpu->policy, target,
+							CPUFREQ_RELATION_L);
+		}
+		mutex_unlock(&sched_mutex);
+	}
+
+	return 0;
+}
+
+static ssize_t show_target_load(struct cpufreq_policy *policy, char *buf)
+{
+	return sprintf(buf, "%lu\n", target_load);
+}
+
+static ssize_t store_target_load(struct cpufreq_policy *policy,
+				 const char *buf, size_t count)
+{
+	unsigned long input;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &input);
+	if (ret)
+		return ret;
+	if (input < 1 || input > 100)
+		return -EINVAL;
+
+	target_load = input;
+	return count;
+}
+
+static struct freq_attr target_load_attr = __ATTR(target_load, 0644,
+		show_target_load, store_target_load);
+
+static ssize_t store_tau(const char *buf, size_t count, unsigned long *tau)
+{
+	unsigned long input;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &input);
+	if (ret)
+		return ret;
+	if (input < 1 || input > MAX_TAU)
+		return -EINVAL;
+
+	*tau = input;
+	return count;
+}
+
+static ssize_t show_up_tau_us(struct cpufreq_policy *policy, char *buf)
+{
+	return sprintf(buf, "%lu\n", up_tau);
+}
+
+static ssize_t store_up_tau_us(struct cpufreq_policy *policy,
+			       const char *buf, size_t count)
+{
+	return store_tau(buf, count, &up_tau);
+}
+
+static struct freq_attr up_tau_us_attr = __ATTR(up_tau_us, 0644,
+		show_up_tau_us, store_up_tau_us);
+
+static ssize_t show_down_tau_us(struct cpufreq_policy *policy, char *buf)
+{
+	return sprintf(buf, "%lu\n", down_tau);
+}
+
+static ssize_t store_down_tau_us(struct cpufreq_policy *policy,
+				 const char *buf, size_t count)
+{
+	return store_tau(buf, count, &down_tau);
+}
+
+static struct freq_attr down_tau_us_attr = __ATTR(down_tau_us, 0644,
+		show_down_tau_us, store_down_tau_us);
+
+static ssize_t show_rate_limit_us(struct cpufreq_policy *policy, char *buf)
+{
+	return sprintf(buf, "%lu\n", rate_limit);
+}
+
+static ssize_t store_rate_limit_us(struct cpufreq_policy *policy,
+				   const char *buf, size_t count)
+{
+	int ret = strict_strtoul(buf, 0, &rate_limit);
+
+	if (ret)
+		return ret;
+
+	rate_limit_set = 1;
+	return count;
+}
+
+static struct freq_attr rate_limit_us_attr = __ATTR(rate_limit_us, 0644,
+		show_rate_limit_us, store_rate_limit_us);
+
+static struct attribute *sched_attributes[] = {
+	&target_load_attr.attr,
+	&up_tau_us_attr.attr,
+	&down_tau_us_attr.attr,
+	&rate_limit_us_attr.attr,
+	NULL,
+};
+
+static struct attribute_group sched_attr_group = {
+	.attrs = sched_attributes,
+	.name = "sched",
+};
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+		unsigned int event)
+{
+	unsigned int cpu, latency;
+	struct cpufreq_sched_cpuinfo *pcpu;
+	int rc;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(policy->cpu))
+			return -EINVAL;
+
+		if (atomic_inc_return(&active_count) == 1) {
+			rc = sysfs_create_group(&policy->kobj,
+						&sched_attr_group);
+			if (rc) {
+				atomic_dec(&active_count);
+				return rc;
+			}
+		}
+
+		latency = policy->cpuinfo.transition_latency / NSEC_PER_USEC;
+		if (!rate_limit_set)
+			rate_limit = max(latency * RATE_LIMIT_LATENCIES,
+					 (unsigned int)MIN_RATE_LIMIT);
+
+		mutex_lock(&sched_mutex);
+		for_each_cpu(cpu, policy->cpus) {
+			pcpu = &per_cpu(sched_cpuinfo, cpu);
+			pcpu->policy = policy;
+			pcpu->freq_table = cpufreq_frequency_get_table(cpu);
+			pcpu->nr_running = 0;
+			pcpu->util = 0;
+			pcpu->requested = policy->cur;
+			pcpu->last_update = cpu_clock(cpu);
+			pcpu->last_request = 0;
+			pcpu->kick = 0;
+			smp_wmb();
+			pcpu->enabled = 1;
+		}
+		mutex_unlock(&sched_mutex);
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		mutex_lock(&sched_mutex);
+		for_each_cpu(cpu, policy->cpus)
+			per_cpu(sched_cpuinfo, cpu).enabled = 0;
+		mutex_unlock(&sched_mutex);
+
+		/* an update already past the enabled check may re-arm it */
+		synchronize_sched();
+		for_each_cpu(cpu, policy->cpus)
+			del_timer_sync(&per_cpu(sched_cpuinfo, cpu).idle_timer);
+
+		if (atomic_dec_return(&active_count) == 0)
+			sysfs_remove_group(&policy->kobj, &sched_attr_group);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		mutex_lock(&sched_mutex);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->max, CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->min, CPUFREQ_RELATION_L);
+		mutex_unlock(&sched_mutex);
+		break;
+	}
+	return 0;
+}
+
+static int __init cpufreq_sched_init(void)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+	struct cpufreq_sched_cpuinfo *pcpu;
+	unsigned int cpu;
+	int rc;
+
+	target_load = DEFAULT_TARGET_LOAD;
+	up_tau = DEFAULT_UP_TAU;
+	down_tau = DEFAULT_DOWN_TAU;
+	rate_limit = MIN_RATE_LIMIT;
+
+	for_each_possible_cpu(cpu) {
+		pcpu = &per_cpu(sched_cpuinfo, cpu);
+		spin_lock_init(&pcpu->lock);
+		setup_timer(&pcpu->idle_timer, cpufreq_sched_idle_timer, cpu);
+	}
+
+	sched_task = kthread_create(cpufreq_sched_thread, NULL, "kschedfreq");
+	if (IS_ERR(sched_task))
+		return PTR_ERR(sched_task);
+
+	sched_setscheduler_nocheck(sched_task, SCHED_FIFO, &param);
+	get_task_struct(sched_task);
+
+	rc = cpufreq_register_governor(&cpufreq_gov_sched);
+	if (rc) {
+		kthread_stop(sched_task);
+		put_task_struct(sched_task);
+	}
+	return rc;
+}
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+fs_initcall(cpufreq_sched_init);
+#else
+module_init(cpufreq_sched_init);
+#endif
+
+MODULE_DESCRIPTION("'cpufreq_sched' - A cpufreq governor driven by the "
+	"CFS runqueues");
+MODULE_LICENSE("GPL");
@@ -1479,7 +1479,7 @@ static int __init dm_snapshot_init(void)
 		goto bad5;
 	}
 
-	ksnapd = create_singlethread_workqueue("ksnapd");
+	ksnapd = alloc_workqueue("ksnapd", WQ_ORDERED | WQ_RESCUER, 1);
 	if (!ksnapd) {
 		DMERR("Failed to create ksnapd workqueue.");
 		r = -ENOMEM;
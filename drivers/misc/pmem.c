@@ -24,6 +24,8 @@
 #include <linux/android_pmem.h>
 #include <linux/mempolicy.h>
 #include <linux/kobject.h>
+#include <linux/rbtree.h>
+#include <linux/hrtimer.h>
 #ifdef CONFIG_MEMORY_HOTPLUG
 #include <linux/memory.h>
 #include <linux/memory_hotplug.h>
@@ -42,6 +44,9 @@
 
 #define PMEM_INITIAL_NUM_BITMAP_ALLOCATIONS (64)
 
+/* free lists of the segregated fit allocator, by floor(log2(quanta)) */
+#define PMEM_SEGFIT_CLASSES (32)
+
 #define PMEM_1M 	(1 << 20)
 #define PMEM_1M_MASK 	(0xfff00000)
 
@@ -104,6 +109,15 @@ struct pmem_bits {
 	unsigned order:7;		/* size of the region in pmem space */
 };
 
+/* a free or allocated range of the segregated fit allocator */
+struct pmem_segfit_block {
+	struct rb_node addr_node;	/* all blocks, sorted by start */
+	struct rb_node free_node;	/* free blocks, sorted by size, start */
+	unsigned long start;		/* in quanta */
+	unsigned long quanta;
+	unsigned allocated:1;
+};
+
 struct pmem_region_node {
 	struct pmem_region region;
 	struct list_head list;
@@ -203,8 +217,26 @@ struct pmem_info {
 				unsigned short quanta;
 			} *bitm_alloc;
 		} bitmap;
+
+		struct {
+			/* every block of the region, for finding a block
+			 * by index and coalescing with its neighbours */
+			struct rb_root blocks;
+			/* free blocks, segregated by size */
+			struct rb_root free[PMEM_SEGFIT_CLASSES];
+			unsigned long free_quanta;
+			unsigned long free_blocks;
+		} segfit;
 	} allocator;
 
+	/* allocation statistics, protected by arena_mutex */
+	struct {
+		unsigned long allocs;
+		unsigned long failures;
+		u64 total_ns;
+		u64 max_ns;
+	} alloc_stats;
+
 	int id;
 	struct kobject kobj;
 
@@ -353,6 +385,8 @@ static ssize_t show_pmem_allocator_type(int id, char *buf)
 		return scnprintf(buf, PAGE_SIZE, "%s\n", "Buddy Bestfit");
 	case  PMEM_ALLOCATORTYPE_BITMAP:
 		return scnprintf(buf, PAGE_SIZE, "%s\n", "Bitmap");
+	case  PMEM_ALLOCATORTYPE_SEGFIT:
+		return scnprintf(buf, PAGE_SIZE, "%s\n", "Segregated Fit");
 	default:
 		return scnprintf(buf, PAGE_SIZE,
 			"??? Invalid allocator type (%d) for this region! "
@@ -516,6 +550,62 @@ static ssize_t show_pmem_bits_allocated(int id, char *buf)
 }
 RO_PMEM_ATTR(bits_allocated);
 
+static ssize_t pmem_show_fragmentation(char *buf, unsigned long free_quanta,
+		unsigned long free_blocks, unsigned long largest)
+{
+	return scnprintf(buf, PAGE_SIZE,
+		"free quanta: %lu\n"
+		"free blocks: %lu\n"
+		"largest free block (quanta): %lu\n"
+		"external fragmentation: %lu%%\n",
+		free_quanta, free_blocks, largest,
+		free_quanta ? 100 - largest * 100 / free_quanta : 0);
+}
+
+static ssize_t show_pmem_fragmentation(int id, char *buf)
+{
+	uint32_t *bitp = pmem[id].allocator.bitmap.bitmap;
+	unsigned long i, run = 0, largest = 0, free_blocks = 0;
+	ssize_t ret;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	for (i = 0; i < pmem[id].num_entries; i++) {
+		if (bitp[i >> PMEM_32BIT_WORD_ORDER] & (1U << (i & 31))) {
+			run = 0;
+			continue;
+		}
+		if (!run++)
+			free_blocks++;
+		largest = max(largest, run);
+	}
+	ret = pmem_show_fragmentation(buf,
+		pmem[id].allocator.bitmap.bitmap_free, free_blocks, largest);
+	mutex_unlock(&pmem[id].arena_mutex);
+	return ret;
+}
+RO_PMEM_ATTR(fragmentation);
+
+static ssize_t show_pmem_alloc_stats(int id, char *buf)
+{
+	ssize_t ret;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	ret = scnprintf(buf, PAGE_SIZE,
+		"allocations: %lu\n"
+		"failures: %lu\n"
+		"average latency (ns): %llu\n"
+		"max latency (ns): %llu\n",
+		pmem[id].alloc_stats.allocs,
+		pmem[id].alloc_stats.failures,
+		pmem[id].alloc_stats.allocs ?
+			div_u64(pmem[id].alloc_stats.total_ns,
+				pmem[id].alloc_stats.allocs) : 0ULL,
+		pmem[id].alloc_stats.max_ns);
+	mutex_unlock(&pmem[id].arena_mutex);
+	return ret;
+}
+RO_PMEM_ATTR(alloc_stats);
+
 static struct attribute *pmem_bitmap_attrs[] = {
 	PMEM_COMMON_SYSFS_ATTRS,
 
@@ -523,6 +613,8 @@ static struct attribute *pmem_bitmap_attrs[] = {
 
 	&pmem_attr_free_quanta.attr,
 	&pmem_attr_bits_allocated.attr,
+	&pmem_attr_fragmentation.attr,
+	&pmem_attr_alloc_stats.attr,
 
 	NULL
 };
@@ -532,6 +624,89 @@ static struct kobj_type pmem_bitmap_ktype = {
 	.default_attrs = pmem_bitmap_attrs,
 };
 
+static ssize_t show_pmem_segfit_free_quanta(int id, char *buf)
+{
+	ssize_t ret;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	ret = scnprintf(buf, PAGE_SIZE, "%lu\n",
+		pmem[id].allocator.segfit.free_quanta);
+	mutex_unlock(&pmem[id].arena_mutex);
+	return ret;
+}
+static struct pmem_attr pmem_attr_segfit_free_quanta =
+	PMEM_ATTR(free_quanta, S_IRUGO, show_pmem_segfit_free_quanta, NULL);
+
+static ssize_t show_pmem_blocks_allocated(int id, char *buf)
+{
+	struct rb_node *n;
+	ssize_t ret;
+
+	mutex_lock(&pmem[id].arena_mutex);
+
+	ret = scnprintf(buf, PAGE_SIZE,
+		"id: %d\nindex\tquanta allocated\n", id);
+
+	for (n = rb_first(&pmem[id].allocator.segfit.blocks); n;
+			n = rb_next(n)) {
+		struct pmem_segfit_block *blk =
+			rb_entry(n, struct pmem_segfit_block, addr_node);
+
+		if (blk->allocated)
+			ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+				"%lu\t%lu\n", blk->start, blk->quanta);
+	}
+
+	mutex_unlock(&pmem[id].arena_mutex);
+	return ret;
+}
+RO_PMEM_ATTR(blocks_allocated);
+
+static ssize_t show_pmem_segfit_fragmentation(int id, char *buf)
+{
+	unsigned long largest = 0;
+	ssize_t ret;
+	int i;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	for (i = PMEM_SEGFIT_CLASSES - 1; i >= 0; i--) {
+		struct rb_node *n =
+			rb_last(&pmem[id].allocator.segfit.free[i]);
+
+		if (n) {
+			largest = rb_entry(n, struct pmem_segfit_block,
+					free_node)->quanta;
+			break;
+		}
+	}
+	ret = pmem_show_fragmentation(buf,
+		pmem[id].allocator.segfit.free_quanta,
+		pmem[id].allocator.segfit.free_blocks, largest);
+	mutex_unlock(&pmem[id].arena_mutex);
+	return ret;
+}
+static struct pmem_attr pmem_attr_segfit_fragmentation =
+	PMEM_ATTR(fragmentation, S_IRUGO, show_pmem_segfit_fragmentation,
+		NULL);
+
+static struct attribute *pmem_segfit_attrs[] = {
+	PMEM_COMMON_SYSFS_ATTRS,
+
+	PMEM_BITMAP_BUDDY_BESTFIT_COMMON_SYSFS_ATTRS,
+
+	&pmem_attr_segfit_free_quanta.attr,
+	&pmem_attr_blocks_allocated.attr,
+	&pmem_attr_segfit_fragmentation.attr,
+	&pmem_attr_alloc_stats.attr,
+
+	NULL
+};
+
+static struct kobj_type pmem_segfit_ktype = {
+	.sysfs_ops = &pmem_ops,
+	.default_attrs = pmem_segfit_attrs,
+};
+
 static int get_id(struct file *file)
 {
 	return MINOR(file->f_dentry->d_inode->i_rdev);
@@ -1135,6 +1310,306 @@ leave:
 	return bitnum;
 }
 
+static inline int pmem_segfit_class(unsigned long quanta)
+{
+	return min(fls(quanta) - 1, PMEM_SEGFIT_CLASSES - 1);
+}
+
+static void pmem_segfit_link_free(const int id, struct pmem_segfit_block *blk)
+{
+	struct rb_root *root =
+		&pmem[id].allocator.segfit.free[pmem_segfit_class(blk->quanta)];
+	struct rb_node **p = &root->rb_node, *parent = NULL;
+
+	while (*p) {
+		struct pmem_segfit_block *tmp;
+
+		parent = *p;
+		tmp = rb_entry(parent, struct pmem_segfit_block, free_node);
+		if (blk->quanta < tmp->quanta ||
+		    (blk->quanta == tmp->quanta && blk->start < tmp->start))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&blk->free_node, parent, p);
+	rb_insert_color(&blk->free_node, root);
+
+	blk->allocated = 0;
+	pmem[id].allocator.segfit.free_quanta += blk->quanta;
+	pmem[id].allocator.segfit.free_blocks++;
+}
+
+static void pmem_segfit_unlink_free(const int id,
+		struct pmem_segfit_block *blk)
+{
+	rb_erase(&blk->free_node,
+		&pmem[id].allocator.segfit.free[pmem_segfit_class(blk->quanta)]);
+	pmem[id].allocator.segfit.free_quanta -= blk->quanta;
+	pmem[id].allocator.segfit.free_blocks--;
+}
+
+static void pmem_segfit_link_addr(const int id, struct pmem_segfit_block *blk)
+{
+	struct rb_root *root = &pmem[id].allocator.segfit.blocks;
+	struct rb_node **p = &root->rb_node, *parent = NULL;
+
+	while (*p) {
+		parent = *p;
+		if (blk->start < rb_entry(parent, struct pmem_segfit_block,
+					addr_node)->start)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&blk->addr_node, parent, p);
+	rb_insert_color(&blk->addr_node, root);
+}
+
+static struct pmem_segfit_block *pmem_segfit_lookup(const int id, int index)
+{
+	struct rb_node *n = pmem[id].allocator.segfit.blocks.rb_node;
+
+	while (n) {
+		struct pmem_segfit_block *blk =
+			rb_entry(n, struct pmem_segfit_block, addr_node);
+
+		if (index < blk->start)
+			n = n->rb_left;
+		else if (index > blk->start)
+			n = n->rb_right;
+		else
+			return blk;
+	}
+	return NULL;
+}
+
+/* smallest free block of at least quanta_needed quanta */
+static struct pmem_segfit_block *pmem_segfit_find(const int id,
+		unsigned long quanta_needed)
+{
+	struct pmem_segfit_block *best = NULL;
+	struct rb_node *n;
+	int class = pmem_segfit_class(quanta_needed);
+
+	/* in its own class, the block may be too small */
+	n = pmem[id].allocator.segfit.free[class].rb_node;
+	while (n) {
+		struct pmem_segfit_block *blk =
+			rb_entry(n, struct pmem_segfit_block, free_node);
+
+		if (blk->quanta >= quanta_needed) {
+			best = blk;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+	if (best)
+		return best;
+
+	/* any block of a larger class will do */
+	for (class++; class < PMEM_SEGFIT_CLASSES; class++) {
+		n = rb_first(&pmem[id].allocator.segfit.free[class]);
+		if (n)
+			return rb_entry(n, struct pmem_segfit_block,
+					free_node);
+	}
+	return NULL;
+}
+
+/* split the first quanta of blk off, the rest goes into the free lists */
+static void pmem_segfit_split(const int id, struct pmem_segfit_block *blk,
+		struct pmem_segfit_block *rest, unsigned long quanta)
+{
+	rest->start = blk->start + quanta;
+	rest->quanta = blk->quanta - quanta;
+	blk->quanta = quanta;
+	pmem_segfit_link_addr(id, rest);
+	pmem_segfit_link_free(id, rest);
+}
+
+static int pmem_allocator_segfit(const int id,
+		const unsigned long len,
+		const enum pmem_align align)
+{
+	/* caller should hold the lock on arena_mutex! */
+	struct pmem_segfit_block *blk, *spare[2];
+	unsigned long quanta_needed, spacing = 1, head = 0;
+	int nr_spare = 0;
+
+	DLOG("segfit id %d, len %ld, align %d\n", id, len, align);
+
+	quanta_needed = (len + pmem[id].quantum - 1) / pmem[id].quantum;
+	if (!quanta_needed ||
+	    quanta_needed > pmem[id].allocator.segfit.free_quanta)
+		return -1;
+
+	if (align == PMEM_ALIGN_1M && pmem[id].quantum < PMEM_1M)
+		spacing = PMEM_1M / pmem[id].quantum;
+
+	/* with the worst case alignment, any block this big will do */
+	blk = pmem_segfit_find(id, quanta_needed + spacing - 1);
+	if (!blk) {
+#if PMEM_DEBUG
+		printk(KERN_ALERT "pmem: %s: no free block of %lu quanta, "
+			"id %d. Region memory is either too fragmented or "
+			"request is too large for available memory.\n",
+			__func__, quanta_needed, id);
+#endif
+		return -1;
+	}
+
+	if (spacing > 1)
+		head = bit_from_paddr(id, ALIGN(paddr_from_bit(id, blk->start),
+					PMEM_1M)) - blk->start;
+
+	/* get the block descriptors for the split up front */
+	if (head) {
+		spare[nr_spare] = kmalloc(sizeof(*blk), GFP_KERNEL);
+		if (!spare[nr_spare])
+			return -1;
+		nr_spare++;
+	}
+	if (blk->quanta > head + quanta_needed) {
+		spare[nr_spare] = kmalloc(sizeof(*blk), GFP_KERNEL);
+		if (!spare[nr_spare])
+			goto out_nomem;
+		nr_spare++;
+	}
+
+	pmem_segfit_unlink_free(id, blk);
+	if (head) {
+		struct pmem_segfit_block *aligned = spare[--nr_spare];
+
+		/* the head stays free, allocate from the aligned part */
+		aligned->start = blk->start + head;
+		aligned->quanta = blk->quanta - head;
+		blk->quanta = head;
+		pmem_segfit_link_free(id, blk);
+		pmem_segfit_link_addr(id, aligned);
+		blk = aligned;
+	}
+	if (blk->quanta > quanta_needed)
+		pmem_segfit_split(id, blk, spare[--nr_spare], quanta_needed);
+	blk->allocated = 1;
+
+	DLOG("index %lu, quanta %lu\n", blk->start, blk->quanta);
+	return blk->start;
+
+out_nomem:
+	while (nr_spare)
+		kfree(spare[--nr_spare]);
+	return -1;
+}
+
+static void pmem_segfit_merge(const int id, struct pmem_segfit_block *blk,
+		struct pmem_segfit_block *next)
+{
+	blk->quanta += next->quanta;
+	rb_erase(&next->addr_node, &pmem[id].allocator.segfit.blocks);
+	kfree(next);
+}
+
+static int pmem_free_segfit(int id, int index)
+{
+	/* caller should hold the lock on arena_mutex! */
+	struct pmem_segfit_block *blk, *buddy;
+	struct rb_node *n;
+	char currtask_name[FIELD_SIZEOF(struct task_struct, comm) + 1];
+
+	DLOG("index %d\n", index);
+
+	blk = pmem_segfit_lookup(id, index);
+	if (!blk || !blk->allocated) {
+		printk(KERN_ALERT "pmem: %s: Attempt to free unallocated "
+			"index %d, id %d, pid %d(%s)\n", __func__, index, id,
+			current->pid, get_task_comm(currtask_name, current));
+		return -1;
+	}
+
+	/* coalesce with the free neighbours */
+	n = rb_next(&blk->addr_node);
+	if (n) {
+		buddy = rb_entry(n, struct pmem_segfit_block, addr_node);
+		if (!buddy->allocated) {
+			pmem_segfit_unlink_free(id, buddy);
+			pmem_segfit_merge(id, blk, buddy);
+		}
+	}
+	n = rb_prev(&blk->addr_node);
+	if (n) {
+		buddy = rb_entry(n, struct pmem_segfit_block, addr_node);
+		if (!buddy->allocated) {
+			pmem_segfit_unlink_free(id, buddy);
+			pmem_segfit_merge(id, buddy, blk);
+			blk = buddy;
+		}
+	}
+	pmem_segfit_link_free(id, blk);
+	return 0;
+}
+
+static void pmem_segfit_destroy(const int id)
+{
+	struct rb_node *n;
+
+	while ((n = rb_first(&pmem[id].allocator.segfit.blocks))) {
+		rb_erase(n, &pmem[id].allocator.segfit.blocks);
+		kfree(rb_entry(n, struct pmem_segfit_block, addr_node));
+	}
+}
+
+static int pmem_segfit_init(const int id)
+{
+	struct pmem_segfit_block *blk;
+	int i;
+
+	pmem[id].allocator.segfit.blocks = RB_ROOT;
+	for (i = 0; i < PMEM_SEGFIT_CLASSES; i++)
+		pmem[id].allocator.segfit.free[i] = RB_ROOT;
+	pmem[id].allocator.segfit.free_quanta = 0;
+	pmem[id].allocator.segfit.free_blocks = 0;
+
+	blk = kmalloc(sizeof(*blk), GFP_KERNEL);
+	if (!blk)
+		return -ENOMEM;
+	blk->start = 0;
+	blk->quanta = pmem[id].num_entries;
+	pmem_segfit_link_addr(id, blk);
+	pmem_segfit_link_free(id, blk);
+	return 0;
+}
+
+/*
+ * Allocate from the arena of device id, keeping the allocation statistics
+ * shown in sysfs.
+ */
+static int pmem_allocate(const int id, const unsigned long len,
+		const enum pmem_align align)
+{
+	ktime_t start;
+	u64 delta;
+	int index;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	start = ktime_get();
+	index = pmem[id].allocate(id, len, align);
+	delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (index < 0) {
+		pmem[id].alloc_stats.failures++;
+	} else {
+		pmem[id].alloc_stats.allocs++;
+		pmem[id].alloc_stats.total_ns += delta;
+		if (delta > pmem[id].alloc_stats.max_ns)
+			pmem[id].alloc_stats.max_ns = delta;
+	}
+	mutex_unlock(&pmem[id].arena_mutex);
+
+	return index;
+}
+
 static pgprot_t phys_mem_access_prot(struct file *file, pgprot_t vma_prot)
 {
 	int id = get_id(file);
@@ -1206,6 +1681,24 @@ static unsigned long pmem_len_bitmap(int id, struct pmem_data *data)
 	return ret;
 }
 
+static unsigned long pmem_len_segfit(int id, struct pmem_data *data)
+{
+	struct pmem_segfit_block *blk;
+	unsigned long ret = 0;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	blk = pmem_segfit_lookup(id, data->index);
+	if (blk && blk->allocated)
+		ret = blk->quanta * pmem[id].quantum;
+	mutex_unlock(&pmem[id].arena_mutex);
+#if PMEM_DEBUG
+	if (!ret)
+		printk(KERN_ALERT "pmem: %s: can't find index %d in "
+			"allocated blocks!\n", __func__, data->index);
+#endif
+	return ret;
+}
+
 static int pmem_map_garbage(int id, struct vm_area_struct *vma,
 			    struct pmem_data *data, unsigned long offset,
 			    unsigned long len)
@@ -1372,11 +1865,8 @@ static int pmem_mmap(struct file *file, struct vm_area_struct *vma)
 	}
 	/* if file->private_data == unalloced, alloc*/
 	if (data && data->index == -1) {
-		mutex_lock(&pmem[id].arena_mutex);
-		index = pmem[id].allocate(id,
-				vma->vm_end - vma->vm_start,
+		index = pmem_allocate(id, vma->vm_end - vma->vm_start,
 				PMEM_ALIGN_4K);
-		mutex_unlock(&pmem[id].arena_mutex);
 		data->index = index;
 		if (data->index < 0) {
 			printk(KERN_ERR "pmem: mmap unable to allocate memory"
@@ -1785,9 +2275,7 @@ retry_memalloc:
 			pmem[info_id].dev.name);
 #endif
 
-	mutex_lock(&pmem[info_id].arena_mutex);
-	index = pmem[info_id].allocate(info_id, size, align);
-	mutex_unlock(&pmem[info_id].arena_mutex);
+	index = pmem_allocate(info_id, size, align);
 
 	if (index < 0 &&
 		!fallback &&
@@ -1844,8 +2332,14 @@ int pmem_kfree(const int32_t physaddr)
 		}
 
 		index = pmem[id].kapi_free_index(physaddr, id);
-		if (index >= 0)
-			return pmem[id].free(id, index) ?  -EINVAL : 0;
+		if (index >= 0) {
+			int ret;
+
+			mutex_lock(&pmem[id].arena_mutex);
+			ret = pmem[id].free(id, index);
+			mutex_unlock(&pmem[id].arena_mutex);
+			return ret ? -EINVAL : 0;
+		}
 	}
 #if PMEM_DEBUG
 	printk(KERN_ALERT "pmem: %s: Failed to free physaddr %#x, does not "
@@ -2277,11 +2771,7 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 				return -EINVAL;
 			}
 
-			mutex_lock(&pmem[id].arena_mutex);
-			data->index = pmem[id].allocate(id,
-					arg,
-					PMEM_ALIGN_4K);
-			mutex_unlock(&pmem[id].arena_mutex);
+			data->index = pmem_allocate(id, arg, PMEM_ALIGN_4K);
 
 			up_write(&data->sem);
 			break;
@@ -2701,6 +3191,26 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 			pmem[id].size, pmem[id].quantum);
 		break;
 
+	case PMEM_ALLOCATORTYPE_SEGFIT:
+		if (pmem_segfit_init(id)) {
+			printk(KERN_ALERT "pmem: %s: Unable to register pmem "
+				"driver %s - can't allocate free list!\n",
+				__func__, pdata->name);
+			goto err_reset_pmem_info;
+		}
+
+		if (kobject_init_and_add(&pmem[id].kobj,
+				&pmem_segfit_ktype, NULL,
+				"%s", pdata->name))
+			goto out_put_kobj;
+
+		pmem[id].allocate = pmem_allocator_segfit;
+		pmem[id].free = pmem_free_segfit;
+		pmem[id].kapi_free_index = pmem_kapi_free_index_bitmap;
+		pmem[id].len = pmem_len_segfit;
+		pmem[id].start_addr = pmem_start_addr_bitmap;
+		break;
+
 	default:
 		printk(KERN_ALERT "Invalid allocator type (%d) for pmem "
 			"driver\n", pdata->allocator_type);
@@ -2758,7 +3268,8 @@ out_put_kobj:
 	else if (pmem[id].allocator_type == PMEM_ALLOCATORTYPE_BITMAP) {
 		kfree(pmem[id].allocator.bitmap.bitmap);
 		kfree(pmem[id].allocator.bitmap.bitm_alloc);
-	}
+	} else if (pmem[id].allocator_type == PMEM_ALLOCATORTYPE_SEGFIT)
+		pmem_segfit_destroy(id);
 err_reset_pmem_info:
 	pmem[id].allocate = 0;
 	pmem[id].dev.minor = -1;
@@ -16,6 +16,11 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * When a memory cgroup with a limit hits it, the same thresholds, scaled by
+ * the cgroup's share of memory, are applied to the cgroup alone and only its
+ * own processes are killed. Write 0 to
+ * /sys/module/lowmemorykiller/parameters/memcg to turn this off.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +40,9 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/memcontrol.h>
+#include <linux/swap.h>
+#include <linux/math64.h>
 
 #define DEBUG_LEVEL_DEATHPENDING 6
 
@@ -67,6 +75,7 @@ static int lowmem_minfile_size = 6;
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 static uint32_t lowmem_check_filepages = 0;
+static uint32_t lowmem_memcg = 1;
 
 #define lowmem_print(level, x...)			\
 	do {						\
@@ -133,17 +142,89 @@ static void dump_deathpending(struct task_struct *t_deathpending)
 	read_unlock(&tasklist_lock);
 }
 
-static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
+/*
+ * Kill the task with the highest oom_adj at or above min_adj, the largest
+ * one among equals.  With a memory cgroup given, only tasks whose mm is
+ * charged to that cgroup are considered.  Returns the size of the task
+ * killed, 0 if there was none.
+ */
+static int lowmem_kill(int min_adj, struct mem_cgroup *mem)
 {
 	struct task_struct *p;
 	struct task_struct *selected = NULL;
-	int rem = 0;
 	int tasksize;
-	int i;
-	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
-	int selected_oom_adj;
+	int selected_oom_adj = min_adj;
+
+	read_lock(&tasklist_lock);
+	for_each_process(p) {
+		struct mm_struct *mm;
+		struct signal_struct *sig;
+		int oom_adj;
+
+		task_lock(p);
+		mm = p->mm;
+		sig = p->signal;
+		if (!mm || !sig) {
+			task_unlock(p);
+			continue;
+		}
+		if (mem && !mm_match_cgroup(mm, mem)) {
+			task_unlock(p);
+			continue;
+		}
+		oom_adj = sig->oom_adj;
+		if (oom_adj < min_adj) {
+			task_unlock(p);
+			continue;
+		}
+		tasksize = get_mm_rss(mm);
+		task_unlock(p);
+		if (tasksize <= 0)
+			continue;
+		if (selected) {
+			if (oom_adj < selected_oom_adj)
+				continue;
+			if (oom_adj == selected_oom_adj &&
+			    tasksize <= selected_tasksize)
+				continue;
+		}
+		selected = p;
+		selected_tasksize = tasksize;
+		selected_oom_adj = oom_adj;
+		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+			     p->pid, p->comm, oom_adj, tasksize);
+	}
+	if (selected) {
+		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d%s\n",
+			     selected->pid, selected->comm,
+			     selected_oom_adj, selected_tasksize,
+			     mem ? ", in cgroup" : "");
+		lowmem_deathpending = selected;
+		lowmem_deathpending_timeout = jiffies + HZ;
+		force_sig(SIGKILL, selected);
+	}
+	read_unlock(&tasklist_lock);
+	return selected_tasksize;
+}
+
+static int lowmem_array_size(void)
+{
 	int array_size = ARRAY_SIZE(lowmem_adj);
+
+	if (lowmem_adj_size < array_size)
+		array_size = lowmem_adj_size;
+	if (lowmem_minfree_size < array_size)
+		array_size = lowmem_minfree_size;
+	return array_size;
+}
+
+static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	int rem = 0;
+	int i;
+	int min_adj = OOM_ADJUST_MAX + 1;
+	int array_size = lowmem_array_size();
 	int other_free = global_page_state(NR_FREE_PAGES);
 	int other_file = global_page_state(NR_FILE_PAGES) -
 			global_page_state(NR_SHMEM);
@@ -163,10 +244,6 @@ static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 		return 0;
 	}
 
-	if (lowmem_adj_size < array_size)
-		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
-		array_size = lowmem_minfree_size;
 	for (i = 0; i < array_size; i++) {
 		if (other_free < lowmem_minfree[i]) {
 			if (other_file < lowmem_minfree[i] ||
@@ -191,58 +268,65 @@ static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 			     nr_to_scan, gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
-	}
-	if (selected) {
-		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
-			     selected->pid, selected->comm,
-			     selected_oom_adj, selected_tasksize);
-		lowmem_deathpending = selected;
-		lowmem_deathpending_timeout = jiffies + HZ;
-		force_sig(SIGKILL, selected);
-		rem -= selected_tasksize;
-	}
+	rem -= lowmem_kill(min_adj, NULL);
 	lowmem_print(4, "lowmem_shrink %d, %x, return %d\n",
 		     nr_to_scan, gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
+/*
+ * A memory cgroup hit its limit.  The cgroup is treated as a machine of
+ * its own: the minfree thresholds are scaled down by the ratio of its limit
+ * to the total memory, room left below the limit counts as free and the
+ * page cache charged to the cgroup as file pages.  Only tasks of the
+ * cgroup are killed, so a group of background applications held to a
+ * budget is trimmed without touching anything outside it.
+ */
+static int
+lowmem_memcg_notify(struct notifier_block *self, unsigned long val, void *data)
+{
+	struct mem_cgroup *mem = data;
+	unsigned long limit, usage, cache;
+	unsigned long other_free, minfree;
+	int array_size = lowmem_array_size();
+	int min_adj = OOM_ADJUST_MAX + 1;
+	int i;
+
+	if (!lowmem_memcg)
+		return NOTIFY_DONE;
+
+	mem_cgroup_get_pages(mem, &limit, &usage, &cache);
+	/* The global shrinker already covers unlimited cgroups */
+	if (limit >= totalram_pages)
+		return NOTIFY_DONE;
+
+	if (lowmem_deathpending &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout))
+		return NOTIFY_DONE;
+
+	other_free = usage < limit ? limit - usage : 0;
+	for (i = 0; i < array_size; i++) {
+		minfree = div_u64((u64)lowmem_minfree[i] * limit,
+				  totalram_pages);
+		if (other_free < minfree && cache < minfree) {
+			min_adj = lowmem_adj[i];
+			break;
+		}
+	}
+	lowmem_print(3, "lowmem_memcg limit %lu, usage %lu, cache %lu, ma %d\n",
+		     limit, usage, cache, min_adj);
+	if (min_adj == OOM_ADJUST_MAX + 1)
+		return NOTIFY_DONE;
+
+	lowmem_kill(min_adj, mem);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_memcg_nb = {
+	.notifier_call	= lowmem_memcg_notify,
+};
+
 static struct shrinker lowmem_shrinker = {
 	.shrink = lowmem_shrink,
 	.seeks = DEFAULT_SEEKS * 16
@@ -252,11 +336,13 @@ static int __init lowmem_init(void)
 {
 	task_free_register(&task_nb);
 	register_shrinker(&lowmem_shrinker);
+	register_mem_cgroup_pressure_notifier(&lowmem_memcg_nb);
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
+	unregister_mem_cgroup_pressure_notifier(&lowmem_memcg_nb);
 	unregister_shrinker(&lowmem_shrinker);
 	task_free_unregister(&task_nb);
 }
@@ -272,6 +358,7 @@ module_param_named(check_filepages , lowmem_check_filepages, uint,
 		   S_IRUGO | S_IWUSR);
 module_param_array_named(minfile, lowmem_minfile, uint, &lowmem_minfile_size,
 			 S_IRUGO | S_IWUSR);
+module_param_named(memcg, lowmem_memcg, uint, S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
@@ -21,10 +21,10 @@
 #include <linux/string.h>
 #include <linux/uaccess.h>
 #include <linux/io.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
 
-#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
-#include <linux/rslib.h>
-#endif
+#include "ram_console.h"
 
 struct ram_console_buffer {
 	uint32_t    sig;
@@ -34,6 +34,7 @@ struct ram_console_buffer {
 };
 
 #define RAM_CONSOLE_SIG (0x43474244) /* DBGC */
+#define RAM_CONSOLE_BIN_SIG (0x42474244) /* DBGB */
 
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_EARLY_INIT
 static char __initdata
@@ -49,10 +50,9 @@ static char *ram_console_par_buffer;
 static struct rs_control *ram_console_rs_decoder;
 static int ram_console_corrected_bytes;
 static int ram_console_bad_blocks;
-#define ECC_BLOCK_SIZE CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_DATA_SIZE
-#define ECC_SIZE CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_ECC_SIZE
-#define ECC_SYMSIZE CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_SYMBOL_SIZE
-#define ECC_POLY CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_POLYNOMIAL
+#endif
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY
+static struct ram_console_bin ram_console_bin;
 #endif
 
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
@@ -154,6 +154,69 @@ void ram_console_enable_console(int enabled)
 		ram_console.flags &= ~CON_ENABLED;
 }
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY
+static void ram_console_capture(const char *text, size_t len, int flags)
+{
+	unsigned int cpu = smp_processor_id();
+
+	if (ram_console.flags & CON_ENABLED)
+		ram_console_bin_write(&ram_console_bin, cpu,
+				      div_u64(cpu_clock(cpu), 1000),
+				      text, len, flags);
+}
+
+static void __init ram_console_save_old_bin(void)
+{
+	struct ram_console_bin *rcb = &ram_console_bin;
+	char strbuf[80];
+	int strbuf_len = 0, loglevel;
+	ssize_t size;
+	char *dest;
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+	ram_console_bin_correct(rcb);
+	ram_console_corrected_bytes += rcb->corrected_bytes;
+	ram_console_bad_blocks += rcb->bad_blocks;
+	if (ram_console_corrected_bytes || ram_console_bad_blocks)
+		strbuf_len = snprintf(strbuf, sizeof(strbuf),
+			"\n%d Corrected bytes, %d unrecoverable blocks\n",
+			ram_console_corrected_bytes, ram_console_bad_blocks);
+	else
+		strbuf_len = snprintf(strbuf, sizeof(strbuf),
+				      "\nNo errors detected\n");
+	if (strbuf_len >= sizeof(strbuf))
+		strbuf_len = sizeof(strbuf) - 1;
+#endif
+
+	/*
+	 * The text console only got what console_loglevel let through;
+	 * with ENABLE_VERBOSE that was everything.
+	 */
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ENABLE_VERBOSE
+	loglevel = 15;
+#else
+	loglevel = console_loglevel;
+#endif
+
+	size = ram_console_bin_decode(rcb, NULL, 0, loglevel);
+	if (size < 0) {
+		printk(KERN_INFO "ram_console: invalid binary log\n");
+		return;
+	}
+
+	dest = kmalloc(size + strbuf_len, GFP_KERNEL);
+	if (dest == NULL) {
+		printk(KERN_ERR "ram_console: failed to allocate buffer\n");
+		return;
+	}
+	ram_console_bin_decode(rcb, dest, size, loglevel);
+	memcpy(dest + size, strbuf, strbuf_len);
+
+	ram_console_old_log = dest;
+	ram_console_old_log_size = size + strbuf_len;
+}
+#endif
+
 static void __init
 ram_console_save_old(struct ram_console_buffer *buffer, char *dest)
 {
@@ -279,6 +342,15 @@ static int __init ram_console_init(struct ram_console_buffer *buffer,
 	}
 #endif
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY
+	ram_console_bin.data = buffer->data;
+	ram_console_bin.size = ram_console_buffer_size;
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+	ram_console_bin.par = ram_console_par_buffer;
+	ram_console_bin.rs = ram_console_rs_decoder;
+#endif
+#endif
+
 	if (buffer->sig == RAM_CONSOLE_SIG) {
 		if (buffer->size > ram_console_buffer_size
 		    || buffer->start > buffer->size)
@@ -291,6 +363,11 @@ static int __init ram_console_init(struct ram_console_buffer *buffer,
 			       buffer->size, buffer->start);
 			ram_console_save_old(buffer, old_buf);
 		}
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY
+	} else if (buffer->sig == RAM_CONSOLE_BIN_SIG) {
+		printk(KERN_INFO "ram_console: found existing binary buffer\n");
+		ram_console_save_old_bin();
+#endif
 	} else {
 		printk(KERN_INFO "ram_console: no valid data in buffer "
 		       "(sig = 0x%08x)\n", buffer->sig);
@@ -300,6 +377,18 @@ static int __init ram_console_init(struct ram_console_buffer *buffer,
 	buffer->start = 0;
 	buffer->size = 0;
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY
+	if (!ram_console_bin_format(&ram_console_bin, nr_cpu_ids)) {
+		buffer->sig = RAM_CONSOLE_BIN_SIG;
+		ram_console_update_header();
+		printk_set_capture(ram_console_capture);
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ENABLE_VERBOSE
+		console_verbose();
+#endif
+		return 0;
+	}
+	printk(KERN_ERR "ram_console: no binary log, falling back to text\n");
+#endif
 	register_console(&ram_console);
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ENABLE_VERBOSE
 	console_verbose();
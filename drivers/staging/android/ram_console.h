@@ -0,0 +1,62 @@
+/* drivers/android/ram_console.h
+ *
+ * Copyright (C) 2007-2008 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _RAM_CONSOLE_H
+#define _RAM_CONSOLE_H
+
+#include <linux/types.h>
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+#include <linux/rslib.h>
+
+#define ECC_BLOCK_SIZE CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_DATA_SIZE
+#define ECC_SIZE CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_ECC_SIZE
+#define ECC_SYMSIZE CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_SYMBOL_SIZE
+#define ECC_POLY CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_POLYNOMIAL
+#endif
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY
+struct rs_control;
+struct ram_console_bin_cpu;
+
+/*
+ * A binary log in a persistent data area: a region per cpu, each written
+ * only by its cpu, holding printk() records that get LZO compressed a
+ * block at a time.  @par, if set, holds Reed-Solomon parity for every
+ * ECC_BLOCK_SIZE bytes of @data, laid out as ram_console.c does for the
+ * text log.
+ */
+struct ram_console_bin {
+	uint8_t				*data;
+	size_t				size;
+	uint8_t				*par;
+	struct rs_control		*rs;
+	unsigned int			ncpus;
+	struct ram_console_bin_cpu	*cpu;
+	int				corrected_bytes;
+	int				bad_blocks;
+};
+
+int ram_console_bin_format(struct ram_console_bin *rcb, unsigned int ncpus);
+void ram_console_bin_free(struct ram_console_bin *rcb);
+void ram_console_bin_write(struct ram_console_bin *rcb, unsigned int cpu,
+			   u64 ts_usec, const char *text, size_t len,
+			   int flags);
+void ram_console_bin_correct(struct ram_console_bin *rcb);
+ssize_t ram_console_bin_decode(struct ram_console_bin *rcb, char *dest,
+			       size_t size, int loglevel);
+#endif
+
+#endif
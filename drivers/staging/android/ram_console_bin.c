@@ -0,0 +1,913 @@
+/* drivers/android/ram_console_bin.c
+ *
+ * Binary, per-cpu log format for the RAM console.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * The data area starts with a struct rcb_header and is then split into
+ * one region per cpu, aligned to the ECC block size so that no two cpus
+ * ever touch the same ECC block.  A region holds a struct rcb_cpu_header,
+ * an open slot and a ring of blocks.
+ *
+ * Every printk() becomes a record in the open slot of its cpu: an info
+ * byte (level, continuation, timestamp flag), the text length and the
+ * usecs since the previous record, then the text without its level token
+ * or timestamp.  When the slot is full it is LZO compressed, if that helps,
+ * into the next block of the ring, which links back to the block before
+ * it.  Only the owning cpu writes a region, with interrupts off, so there
+ * is no lock.  The header is written last, so a crash at any point leaves
+ * either the old or the new state.
+ *
+ * On the next boot each region is walked back from its newest block for
+ * as long as sequence numbers and magics hold, and the records of all
+ * cpus are merged by timestamp into the text the console would have
+ * shown.  Every printk() is recorded, whatever its level; lines the
+ * console would have dropped for console_loglevel are left out there.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/ctype.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/lzo.h>
+#include <linux/math64.h>
+
+#include "ram_console.h"
+
+#define RCB_MAGIC		0x31424352	/* RCB1 */
+#define RCB_CPU_MAGIC		0x43424352	/* RCBC */
+#define RCB_BLOCK_MAGIC		0x4b424352	/* RCBK */
+
+#define RCB_OPEN_SIZE		2048
+#define RCB_REC_HDR		7
+#define RCB_NO_BLOCK		0xffffffff
+
+/* record info byte */
+#define RCB_LEVEL		0x07
+#define RCB_CONT		0x08
+#define RCB_TIME		0x10
+
+#define RCB_BLOCK_LZO		0x01
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+#define RCB_ALIGN		ECC_BLOCK_SIZE
+#else
+#define RCB_ALIGN		16
+#endif
+
+struct rcb_header {
+	uint32_t	magic;
+	uint32_t	ncpus;
+	uint32_t	cpu_size;
+	uint32_t	open_size;
+};
+
+struct rcb_cpu_header {
+	uint32_t	magic;
+	uint32_t	seq;		/* of the newest block, 0 for none */
+	uint32_t	last;		/* ring offset of the newest block */
+	uint32_t	head;		/* ring offset for the next block */
+	uint32_t	open_len;	/* record bytes in the open slot */
+	uint32_t	reserved;
+	uint64_t	open_base;	/* usecs the first open record counts from */
+};
+
+struct rcb_block {
+	uint32_t	magic;
+	uint32_t	seq;
+	uint32_t	prev;		/* ring offset of the block before */
+	uint16_t	raw_len;
+	uint16_t	len;
+	uint64_t	base;
+	uint32_t	flags;
+};
+
+struct ram_console_bin_cpu {
+	size_t			off;		/* of the region in data */
+	size_t			open_size;
+	size_t			ring_size;
+	struct rcb_cpu_header	hdr;
+	u64			prev_ts;
+	uint8_t			*open;		/* copy of the open slot */
+	uint8_t			*out;
+	void			*wrkmem;
+};
+
+static inline size_t rcb_open(struct ram_console_bin_cpu *c)
+{
+	return c->off + sizeof(struct rcb_cpu_header);
+}
+
+static inline size_t rcb_ring(struct ram_console_bin_cpu *c)
+{
+	return rcb_open(c) + c->open_size;
+}
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+static uint8_t *rcb_par(struct ram_console_bin *rcb, size_t block)
+{
+	return rcb->par + (block / ECC_BLOCK_SIZE) * ECC_SIZE;
+}
+
+static void rcb_encode_rs8(struct ram_console_bin *rcb, size_t block)
+{
+	size_t size = min_t(size_t, ECC_BLOCK_SIZE, rcb->size - block);
+	uint8_t *ecc = rcb_par(rcb, block);
+	uint16_t par[ECC_SIZE];
+	int i;
+
+	memset(par, 0, sizeof(par));
+	encode_rs8(rcb->rs, rcb->data + block, size, par, 0);
+	for (i = 0; i < ECC_SIZE; i++)
+		ecc[i] = par[i];
+}
+
+static int rcb_decode_rs8(struct ram_console_bin *rcb, size_t block)
+{
+	size_t size = min_t(size_t, ECC_BLOCK_SIZE, rcb->size - block);
+	uint8_t *ecc = rcb_par(rcb, block);
+	uint16_t par[ECC_SIZE];
+	int i;
+
+	for (i = 0; i < ECC_SIZE; i++)
+		par[i] = ecc[i];
+	return decode_rs8(rcb->rs, rcb->data + block, par, size,
+			  NULL, 0, NULL, 0, NULL);
+}
+#endif
+
+/* Bring the ECC of a changed range of the data area up to date */
+static void rcb_update(struct ram_console_bin *rcb, size_t off, size_t len)
+{
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+	size_t block;
+
+	if (!rcb->par)
+		return;
+	for (block = off & ~(ECC_BLOCK_SIZE - 1); block < off + len;
+	     block += ECC_BLOCK_SIZE)
+		rcb_encode_rs8(rcb, block);
+#endif
+}
+
+static void rcb_store(struct ram_console_bin *rcb, size_t off,
+		      const void *src, size_t len)
+{
+	memcpy(rcb->data + off, src, len);
+	rcb_update(rcb, off, len);
+}
+
+int ram_console_bin_format(struct ram_console_bin *rcb, unsigned int ncpus)
+{
+	size_t start = ALIGN(sizeof(struct rcb_header), RCB_ALIGN);
+	struct ram_console_bin_cpu *c;
+	size_t cpu_size, open_size;
+	struct rcb_header h;
+	unsigned int i;
+
+	if (!ncpus || rcb->size < start)
+		return -EINVAL;
+	cpu_size = ((rcb->size - start) / ncpus) & ~(RCB_ALIGN - 1);
+	open_size = min_t(size_t, RCB_OPEN_SIZE, cpu_size / 16);
+	if (open_size < 256)
+		return -ENOSPC;
+
+	rcb->cpu = kcalloc(ncpus, sizeof(*rcb->cpu), GFP_KERNEL);
+	if (!rcb->cpu)
+		return -ENOMEM;
+	rcb->ncpus = ncpus;
+
+	/* so that the next boot finds no errors where nothing was written */
+	memset(rcb->data, 0, rcb->size);
+	rcb_update(rcb, 0, rcb->size);
+
+	for (i = 0; i < ncpus; i++) {
+		c = &rcb->cpu[i];
+		c->off = start + i * cpu_size;
+		c->open_size = open_size;
+		c->ring_size = (cpu_size - sizeof(c->hdr) - open_size) & ~3;
+		c->open = kmalloc(open_size, GFP_KERNEL);
+		if (!c->open)
+			goto err;
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY_LZO
+		c->out = kmalloc(lzo1x_worst_compress(open_size), GFP_KERNEL);
+		c->wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+		if (!c->out || !c->wrkmem)
+			goto err;
+#endif
+		c->hdr.magic = RCB_CPU_MAGIC;
+		rcb_store(rcb, c->off, &c->hdr, sizeof(c->hdr));
+	}
+
+	h.magic = RCB_MAGIC;
+	h.ncpus = ncpus;
+	h.cpu_size = cpu_size;
+	h.open_size = open_size;
+	rcb_store(rcb, 0, &h, sizeof(h));
+	return 0;
+
+err:
+	ram_console_bin_free(rcb);
+	return -ENOMEM;
+}
+
+void ram_console_bin_free(struct ram_console_bin *rcb)
+{
+	unsigned int i;
+
+	if (!rcb->cpu)
+		return;
+	for (i = 0; i < rcb->ncpus; i++) {
+		kfree(rcb->cpu[i].open);
+		kfree(rcb->cpu[i].out);
+		vfree(rcb->cpu[i].wrkmem);
+	}
+	kfree(rcb->cpu);
+	rcb->cpu = NULL;
+}
+
+/* Move the open slot into the ring as the next block */
+static void rcb_commit(struct ram_console_bin *rcb,
+		       struct ram_console_bin_cpu *c)
+{
+	const uint8_t *payload = c->open;
+	size_t len = c->hdr.open_len;
+	size_t pos = c->hdr.head;
+	struct rcb_block blk;
+
+	blk.flags = 0;
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY_LZO
+	{
+		size_t clen;
+
+		if (lzo1x_1_compress(c->open, len, c->out, &clen,
+				     c->wrkmem) == LZO_E_OK && clen < len) {
+			payload = c->out;
+			len = clen;
+			blk.flags = RCB_BLOCK_LZO;
+		}
+	}
+#endif
+	if (pos + sizeof(blk) + len > c->ring_size)
+		pos = 0;
+
+	blk.magic = RCB_BLOCK_MAGIC;
+	blk.seq = c->hdr.seq + 1;
+	blk.prev = c->hdr.seq ? c->hdr.last : RCB_NO_BLOCK;
+	blk.raw_len = c->hdr.open_len;
+	blk.len = len;
+	blk.base = c->hdr.open_base;
+	rcb_store(rcb, rcb_ring(c) + pos + sizeof(blk), payload, len);
+	rcb_store(rcb, rcb_ring(c) + pos, &blk, sizeof(blk));
+
+	c->hdr.seq++;
+	c->hdr.last = pos;
+	c->hdr.head = ALIGN(pos + sizeof(blk) + len, 4);
+	c->hdr.open_len = 0;
+	rcb_store(rcb, c->off, &c->hdr, sizeof(c->hdr));
+}
+
+/* Parse the "[%5lu.%06lu] " stamp log_buf lines start with, see printk.c */
+static size_t rcb_parse_time(const char *text, size_t len, u64 *ts_usec)
+{
+	unsigned long sec = 0, usec = 0;
+	size_t i = 1;
+	int digits;
+
+	if (!len || text[0] != '[')
+		return 0;
+	while (i < len && text[i] == ' ')
+		i++;
+	for (digits = 0; i < len && isdigit(text[i]); i++, digits++)
+		sec = sec * 10 + text[i] - '0';
+	if (!digits || i >= len || text[i++] != '.')
+		return 0;
+	for (digits = 0; i < len && isdigit(text[i]); i++, digits++)
+		usec = usec * 10 + text[i] - '0';
+	if (digits != 6 || i + 1 >= len || text[i] != ']' || text[i + 1] != ' ')
+		return 0;
+	*ts_usec = (u64)sec * 1000000 + usec;
+	return i + 2;
+}
+
+/**
+ * ram_console_bin_write - log one printk()
+ * @rcb:	formatted binary log
+ * @cpu:	the calling cpu, which must not be preempted
+ * @ts_usec:	timestamp
+ * @text:	message as printk() got it, level token included
+ * @len:	length of @text
+ * @flags:	PRINTK_CAPTURE_*
+ *
+ * With PRINTK_CAPTURE_REPLAY | PRINTK_CAPTURE_TIME the timestamp is taken
+ * from the text instead of @ts_usec.
+ */
+void ram_console_bin_write(struct ram_console_bin *rcb, unsigned int cpu,
+			   u64 ts_usec, const char *text, size_t len,
+			   int flags)
+{
+	struct ram_console_bin_cpu *c;
+	int level = default_message_loglevel;
+	uint8_t *rec, info = 0;
+	u64 delta;
+
+	if (!rcb->cpu || cpu >= rcb->ncpus)
+		return;
+	c = &rcb->cpu[cpu];
+
+	if (flags & PRINTK_CAPTURE_CONT) {
+		info |= RCB_CONT;
+	} else if (len >= 3 && text[0] == '<' && text[1] >= '0' &&
+		   text[1] <= '7' && text[2] == '>') {
+		level = text[1] - '0';
+		text += 3;
+		len -= 3;
+	} else if (!len) {
+		/* printk() logs nothing for it either */
+		return;
+	}
+	if (flags & PRINTK_CAPTURE_TIME) {
+		info |= RCB_TIME;
+		if ((flags & PRINTK_CAPTURE_REPLAY) && !(info & RCB_CONT)) {
+			size_t n = rcb_parse_time(text, len, &ts_usec);
+
+			/* no stamp: printk.time was off when it was logged */
+			if (n) {
+				text += n;
+				len -= n;
+			} else {
+				info &= ~RCB_TIME;
+			}
+		}
+	}
+	info |= level & RCB_LEVEL;
+	if (len > c->open_size - RCB_REC_HDR)
+		len = c->open_size - RCB_REC_HDR;
+
+	if (ts_usec < c->prev_ts)
+		ts_usec = c->prev_ts;
+	if (c->hdr.open_len &&
+	    (c->hdr.open_len + RCB_REC_HDR + len > c->open_size ||
+	     ts_usec - c->prev_ts > 0xffffffffULL))
+		rcb_commit(rcb, c);
+	if (!c->hdr.open_len) {
+		c->hdr.open_base = ts_usec;
+		c->prev_ts = ts_usec;
+	}
+	delta = ts_usec - c->prev_ts;
+
+	rec = c->open + c->hdr.open_len;
+	rec[0] = info;
+	rec[1] = len;
+	rec[2] = len >> 8;
+	rec[3] = delta;
+	rec[4] = delta >> 8;
+	rec[5] = delta >> 16;
+	rec[6] = delta >> 24;
+	memcpy(rec + RCB_REC_HDR, text, len);
+	rcb_store(rcb, rcb_open(c) + c->hdr.open_len, rec, RCB_REC_HDR + len);
+
+	c->hdr.open_len += RCB_REC_HDR + len;
+	c->prev_ts = ts_usec;
+	rcb_store(rcb, c->off, &c->hdr, sizeof(c->hdr));
+}
+
+/**
+ * ram_console_bin_correct - apply the ECC to the whole data area
+ * @rcb:	binary log with @par and @rs set
+ *
+ * Adds to @corrected_bytes and @bad_blocks.
+ */
+void ram_console_bin_correct(struct ram_console_bin *rcb)
+{
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+	size_t block;
+	int numerr;
+
+	if (!rcb->par)
+		return;
+	for (block = 0; block < rcb->size; block += ECC_BLOCK_SIZE) {
+		numerr = rcb_decode_rs8(rcb, block);
+		if (numerr > 0)
+			rcb->corrected_bytes += numerr;
+		else if (numerr < 0)
+			rcb->bad_blocks++;
+	}
+#endif
+}
+
+/* Where a cpu is in decoding its region */
+struct rcb_cursor {
+	const uint8_t		*region;
+	size_t			open_size;
+	size_t			ring_size;
+	struct rcb_cpu_header	hdr;
+	uint32_t		*blocks;	/* ring offsets, newest first */
+	int			nblocks;
+	int			open_done;
+	uint8_t			*buf;
+	size_t			len;
+	size_t			pos;
+	u64			prev_ts;
+	int			level;		/* of the current line */
+	/* the next record */
+	u64			ts;
+	uint8_t			info;
+	const char		*text;
+	size_t			text_len;
+};
+
+/* Collect the blocks still intact, newest first */
+static int rcb_walk(struct rcb_cursor *cur)
+{
+	const uint8_t *ring = cur->region + sizeof(cur->hdr) + cur->open_size;
+	int max = cur->ring_size / sizeof(struct rcb_block);
+	uint32_t off = cur->hdr.last, seq = cur->hdr.seq;
+	struct rcb_block blk;
+	size_t total = 0;
+
+	cur->blocks = kmalloc(max * sizeof(*cur->blocks), GFP_KERNEL);
+	if (!cur->blocks)
+		return -ENOMEM;
+
+	while (seq && cur->nblocks < max) {
+		if (off > cur->ring_size - sizeof(blk))
+			break;
+		memcpy(&blk, ring + off, sizeof(blk));
+		if (blk.magic != RCB_BLOCK_MAGIC || blk.seq != seq ||
+		    !blk.raw_len || blk.raw_len > cur->open_size ||
+		    blk.len > blk.raw_len ||
+		    blk.len > cur->ring_size - off - sizeof(blk))
+			break;
+		total += sizeof(blk) + blk.len;
+		if (total > cur->ring_size)
+			break;
+		cur->blocks[cur->nblocks++] = off;
+		if (blk.prev == RCB_NO_BLOCK)
+			break;
+		off = blk.prev;
+		seq--;
+	}
+	return 0;
+}
+
+/* Load the next block, then the open slot.  Returns 0 when done */
+static int rcb_load(struct rcb_cursor *cur)
+{
+	const uint8_t *ring = cur->region + sizeof(cur->hdr) + cur->open_size;
+	struct rcb_block blk;
+	size_t len;
+
+	while (cur->nblocks) {
+		memcpy(&blk, ring + cur->blocks[--cur->nblocks], sizeof(blk));
+		len = blk.raw_len;
+		if (blk.flags & RCB_BLOCK_LZO) {
+			if (lzo1x_decompress_safe(ring + cur->blocks[cur->nblocks] +
+						  sizeof(blk), blk.len, cur->buf,
+						  &len) != LZO_E_OK ||
+			    len != blk.raw_len)
+				continue;
+		} else {
+			memcpy(cur->buf, ring + cur->blocks[cur->nblocks] +
+			       sizeof(blk), len);
+		}
+		cur->len = len;
+		cur->pos = 0;
+		cur->prev_ts = blk.base;
+		return 1;
+	}
+
+	if (!cur->open_done) {
+		cur->open_done = 1;
+		memcpy(cur->buf, cur->region + sizeof(cur->hdr),
+		       cur->hdr.open_len);
+		cur->len = cur->hdr.open_len;
+		cur->pos = 0;
+		cur->prev_ts = cur->hdr.open_base;
+		return 1;
+	}
+	return 0;
+}
+
+/* Set up the next record.  Returns 0 when the cpu has no more */
+static int rcb_next(struct rcb_cursor *cur)
+{
+	const uint8_t *rec;
+	size_t len;
+
+	for (;;) {
+		if (cur->pos + RCB_REC_HDR <= cur->len) {
+			rec = cur->buf + cur->pos;
+			len = rec[1] | rec[2] << 8;
+			if (cur->pos + RCB_REC_HDR + len <= cur->len)
+				break;
+		}
+		if (!rcb_load(cur))
+			return 0;
+	}
+
+	cur->info = rec[0];
+	cur->ts = cur->prev_ts + (rec[3] | rec[4] << 8 | rec[5] << 16 |
+				  (u32)rec[6] << 24);
+	cur->text = (const char *)rec + RCB_REC_HDR;
+	cur->text_len = len;
+	cur->prev_ts = cur->ts;
+	cur->pos += RCB_REC_HDR + len;
+	return 1;
+}
+
+struct rcb_out {
+	char		*dest;
+	size_t		size;
+	size_t		len;
+};
+
+static void rcb_putc(struct rcb_out *out, char c)
+{
+	if (out->dest && out->len < out->size)
+		out->dest[out->len] = c;
+	out->len++;
+}
+
+static void rcb_prefix(struct rcb_out *out, uint8_t info, u64 ts)
+{
+	char buf[32];
+	u32 rem;
+	int i, n;
+
+	if (!(info & RCB_TIME))
+		return;
+	ts = div_u64_rem(ts, 1000000, &rem);
+	n = sprintf(buf, "[%5lu.%06lu] ", (unsigned long)ts,
+		    (unsigned long)rem);
+	for (i = 0; i < n; i++)
+		rcb_putc(out, buf[i]);
+}
+
+/*
+ * What vprintk() and the console make of a record, see kernel/printk.c.
+ * Lines of @loglevel or above are dropped, as call_console_drivers() does
+ * for console_loglevel; a continuation goes with the line it continues.
+ */
+static void rcb_emit(struct rcb_out *out, struct rcb_cursor *cur,
+		     int loglevel)
+{
+	const char *p = cur->text;
+	size_t i, n = cur->text_len;
+	int new_line = !(cur->info & RCB_CONT);
+	int first = 1;
+
+	if (new_line)
+		cur->level = cur->info & RCB_LEVEL;
+	if (new_line && !n) {
+		if (cur->level < loglevel)
+			rcb_prefix(out, cur->info, cur->ts);
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		if (new_line) {
+			/* the first token went into the info byte */
+			if (!first && i + 2 < n && p[i] == '<' &&
+			    p[i + 1] >= '0' && p[i + 1] <= '7' &&
+			    p[i + 2] == '>') {
+				cur->level = p[i + 1] - '0';
+				i += 3;
+			}
+			if (cur->level < loglevel)
+				rcb_prefix(out, cur->info, cur->ts);
+			new_line = 0;
+			if (i == n)
+				break;
+		}
+		first = 0;
+		if (cur->level < loglevel)
+			rcb_putc(out, p[i]);
+		if (p[i] == '\n')
+			new_line = 1;
+	}
+}
+
+/**
+ * ram_console_bin_decode - turn a binary log back into console text
+ * @rcb:	binary log, as found in memory; need not be formatted
+ * @dest:	where to put the text, or NULL to only count it
+ * @size:	size of @dest
+ * @loglevel:	console_loglevel to filter the lines with
+ *
+ * Returns the length of the text, which may exceed @size, or a negative
+ * error if the data area holds no binary log.
+ */
+ssize_t ram_console_bin_decode(struct ram_console_bin *rcb, char *dest,
+			       size_t size, int loglevel)
+{
+	size_t start = ALIGN(sizeof(struct rcb_header), RCB_ALIGN);
+	struct rcb_out out = { .dest = dest, .size = size };
+	struct rcb_cursor *cur, *first;
+	struct rcb_header h;
+	unsigned int i;
+	ssize_t ret = -ENOMEM;
+	int active = 0;
+
+	memcpy(&h, rcb->data, sizeof(h));
+	if (h.magic != RCB_MAGIC || !h.ncpus || h.ncpus > NR_CPUS ||
+	    h.cpu_size & (RCB_ALIGN - 1) ||
+	    (size_t)h.cpu_size * h.ncpus > rcb->size - start ||
+	    h.open_size < 256 || h.open_size > h.cpu_size / 16)
+		return -EINVAL;
+
+	cur = kcalloc(h.ncpus, sizeof(*cur), GFP_KERNEL);
+	if (!cur)
+		return -ENOMEM;
+
+	for (i = 0; i < h.ncpus; i++) {
+		cur[i].region = rcb->data + start + i * h.cpu_size;
+		cur[i].open_size = h.open_size;
+		cur[i].ring_size = (h.cpu_size - sizeof(cur[i].hdr) -
+				    h.open_size) & ~3;
+		memcpy(&cur[i].hdr, cur[i].region, sizeof(cur[i].hdr));
+		if (cur[i].hdr.magic != RCB_CPU_MAGIC ||
+		    cur[i].hdr.open_len > h.open_size)
+			continue;
+		cur[i].buf = kmalloc(h.open_size, GFP_KERNEL);
+		if (!cur[i].buf || rcb_walk(&cur[i]))
+			goto out;
+		if (rcb_next(&cur[i]))
+			active++;
+	}
+
+	while (active) {
+		first = NULL;
+		for (i = 0; i < h.ncpus; i++) {
+			if (!cur[i].text)
+				continue;
+			if (!first || cur[i].ts < first->ts)
+				first = &cur[i];
+		}
+		rcb_emit(&out, first, loglevel);
+		if (!rcb_next(first)) {
+			first->text = NULL;
+			active--;
+		}
+	}
+	ret = out.len;
+
+out:
+	for (i = 0; i < h.ncpus; i++) {
+		kfree(cur[i].blocks);
+		kfree(cur[i].buf);
+	}
+	kfree(cur);
+	return ret;
+}
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_BINARY_TEST
+/*
+ * Write a known log from two cpus into a scratch area, enough to wrap the
+ * rings several times, and decode it as the next boot would: once as left
+ * and, with error correction, once more after flipping a byte in some ECC
+ * blocks.  The text must be a tail of what printk() would have given the
+ * console, message for message: KERN_DEBUG lines left out, and the
+ * timestamps of lines replayed from log_buf taken from their text.
+ */
+#define RCB_TEST_SIZE		(64 * 1024)
+#define RCB_TEST_CPUS		2
+#define RCB_TEST_MSGS		8000
+#define RCB_TEST_LOGLEVEL	7
+
+static u64 __init rcb_test_ts(unsigned int i)
+{
+	return 1000000ULL + i * 1234ULL;
+}
+
+/* Log message @i, and return the console text for it in @buf */
+static int __init rcb_test_msg(struct ram_console_bin *rcb, unsigned int i,
+			       char *buf)
+{
+	unsigned int cpu = i % RCB_TEST_CPUS;
+	u64 ts = rcb_test_ts(i);
+	u32 rem;
+	unsigned long sec = div_u64_rem(ts, 1000000, &rem);
+	char text[128];
+	int n;
+
+	switch (i % 7) {
+	case 1:
+		/* as printk_set_capture() replays log_buf */
+		n = sprintf(text, "<6>[%5lu.%06lu] rcb %u: replayed\n",
+			    sec, (unsigned long)rem, i);
+		if (rcb)
+			ram_console_bin_write(rcb, cpu, ts + 7, text, n,
+					      PRINTK_CAPTURE_TIME |
+					      PRINTK_CAPTURE_REPLAY);
+		return sprintf(buf, "[%5lu.%06lu] rcb %u: replayed\n",
+			       sec, (unsigned long)rem, i);
+	case 3:
+		n = sprintf(text, "<6>rcb %u: first\n<4>rcb %u: second\n",
+			    i, i);
+		if (rcb)
+			ram_console_bin_write(rcb, cpu, ts, text, n,
+					      PRINTK_CAPTURE_TIME);
+		return sprintf(buf, "[%5lu.%06lu] rcb %u: first\n"
+			       "[%5lu.%06lu] rcb %u: second\n",
+			       sec, (unsigned long)rem, i,
+			       sec, (unsigned long)rem, i);
+	case 5:
+		n = sprintf(text, "<6>rcb %u: partial", i);
+		if (rcb) {
+			ram_console_bin_write(rcb, cpu, ts, text, n,
+					      PRINTK_CAPTURE_TIME);
+			ram_console_bin_write(rcb, cpu, ts + 1, " done\n", 6,
+					      PRINTK_CAPTURE_TIME |
+					      PRINTK_CAPTURE_CONT);
+		}
+		return sprintf(buf, "[%5lu.%06lu] rcb %u: partial done\n",
+			       sec, (unsigned long)rem, i);
+	case 6:
+		/* below the console loglevel, continued by a shown line */
+		n = sprintf(text, "<7>rcb %u: debug", i);
+		if (rcb) {
+			ram_console_bin_write(rcb, cpu, ts, text, n,
+					      PRINTK_CAPTURE_TIME);
+			n = sprintf(text, " more\n<6>rcb %u: shown\n", i);
+			ram_console_bin_write(rcb, cpu, ts + 1, text, n,
+					      PRINTK_CAPTURE_TIME |
+					      PRINTK_CAPTURE_CONT);
+		}
+		rem++;
+		if (rem == 1000000) {
+			rem = 0;
+			sec++;
+		}
+		return sprintf(buf, "[%5lu.%06lu] rcb %u: shown\n",
+			       sec, (unsigned long)rem, i);
+	default:
+		n = sprintf(text, "<6>rcb %u: the quick brown fox jumps over "
+			    "the lazy dog %u times\n", i, i * 7);
+		if (rcb)
+			ram_console_bin_write(rcb, cpu, ts, text, n,
+					      PRINTK_CAPTURE_TIME);
+		return sprintf(buf, "[%5lu.%06lu] rcb %u: the quick brown fox "
+			       "jumps over the lazy dog %u times\n",
+			       sec, (unsigned long)rem, i, i * 7);
+	}
+}
+
+/*
+ * Check that @text is made of whole messages, in order and ending with the
+ * last one.  Returns the number of messages or -1.
+ */
+static int __init rcb_test_check(const char *text, size_t len)
+{
+	const char *p = text, *end = text + len, *s;
+	char buf[256];
+	int n, found = 0, last = -1;
+	unsigned long i;
+
+	/* the oldest block may start with the end of a message */
+	if (p < end && *p != '[') {
+		p = memchr(p, '\n', end - p);
+		if (!p)
+			return -1;
+		p++;
+	}
+
+	while (p < end) {
+		s = memchr(p, ']', end - p);
+		if (!s || end - s < 6 || memcmp(s, "] rcb ", 6))
+			return -1;
+		i = simple_strtoul(s + 6, NULL, 10);
+		if ((int)i <= last || i >= RCB_TEST_MSGS)
+			return -1;
+		n = rcb_test_msg(NULL, i, buf);
+		if (end - p < n || memcmp(p, buf, n))
+			return -1;
+		p += n;
+		last = i;
+		found++;
+	}
+	return last == RCB_TEST_MSGS - 1 ? found : -1;
+}
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+/* Flip a byte in every fifth ECC block, correct, and decode @text again */
+static int __init rcb_test_ecc(struct ram_console_bin *rcb, const char *text,
+			       ssize_t len)
+{
+	struct ram_console_bin reboot = *rcb;
+	char *text2;
+	size_t i;
+	int ret = -1;
+
+	for (i = 0; i < rcb->size; i += 5 * ECC_BLOCK_SIZE)
+		rcb->data[i + (i / ECC_BLOCK_SIZE) % ECC_BLOCK_SIZE] ^= 0x5a;
+
+	ram_console_bin_correct(&reboot);
+	if (reboot.bad_blocks || !reboot.corrected_bytes)
+		return -1;
+
+	if (ram_console_bin_decode(&reboot, NULL, 0, RCB_TEST_LOGLEVEL) != len)
+		return -1;
+	text2 = vmalloc(len);
+	if (!text2)
+		return -1;
+	if (ram_console_bin_decode(&reboot, text2, len,
+				   RCB_TEST_LOGLEVEL) == len &&
+	    !memcmp(text, text2, len))
+		ret = 0;
+	vfree(text2);
+	return ret;
+}
+#else
+static inline int rcb_test_ecc(struct ram_console_bin *rcb, const char *text,
+			       ssize_t len)
+{
+	return 0;
+}
+#endif
+
+static int __init ram_console_bin_test(void)
+{
+	struct ram_console_bin rcb = { .size = RCB_TEST_SIZE };
+	struct ram_console_bin reboot;
+	char *text = NULL, buf[256];
+	ssize_t len;
+	int i, found, text_mode = 0;
+	size_t bytes = 0;
+	int ret = -ENOMEM;
+
+	rcb.data = vmalloc(RCB_TEST_SIZE);
+	if (!rcb.data)
+		goto out;
+	memset(rcb.data, 0, RCB_TEST_SIZE);
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+	rcb.par = vmalloc(DIV_ROUND_UP(RCB_TEST_SIZE, ECC_BLOCK_SIZE) *
+			  ECC_SIZE);
+	rcb.rs = init_rs(ECC_SYMSIZE, ECC_POLY, 0, 1, ECC_SIZE);
+	if (!rcb.par || !rcb.rs)
+		goto out;
+#endif
+
+	ret = ram_console_bin_format(&rcb, RCB_TEST_CPUS);
+	if (ret)
+		goto out;
+	for (i = 0; i < RCB_TEST_MSGS; i++)
+		rcb_test_msg(&rcb, i, buf);
+	for (i = RCB_TEST_MSGS - 1; i >= 0; i--) {
+		bytes += rcb_test_msg(NULL, i, buf);
+		if (bytes > RCB_TEST_SIZE)
+			break;
+		text_mode++;
+	}
+	ram_console_bin_free(&rcb);
+
+	/* reboot: all there is left is the memory */
+	ret = -EINVAL;
+	reboot = rcb;
+	len = ram_console_bin_decode(&reboot, NULL, 0, RCB_TEST_LOGLEVEL);
+	if (len <= 0)
+		goto fail;
+	text = vmalloc(len);
+	if (!text)
+		goto out;
+	ram_console_bin_decode(&reboot, text, len, RCB_TEST_LOGLEVEL);
+	found = rcb_test_check(text, len);
+	if (found <= 0)
+		goto fail;
+	/* without the filter the debug lines are there too */
+	if (ram_console_bin_decode(&reboot, NULL, 0, 8) <= len)
+		goto fail;
+
+	if (rcb_test_ecc(&rcb, text, len))
+		goto fail;
+
+	printk(KERN_INFO "ram_console_bin: test passed, %d bytes keep the "
+	       "last %d messages, %d as text\n", RCB_TEST_SIZE, found,
+	       text_mode);
+	ret = 0;
+	goto out;
+
+fail:
+	printk(KERN_ERR "ram_console_bin: test FAILED\n");
+out:
+	vfree(text);
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+	if (rcb.rs)
+		free_rs(rcb.rs);
+	vfree(rcb.par);
+#endif
+	vfree(rcb.data);
+	if (ret == -ENOMEM)
+		printk(KERN_ERR "ram_console_bin: no memory for the test\n");
+	return 0;
+}
+late_initcall(ram_console_bin_test);
+#endif
@@ -20,10 +20,11 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/crypto.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
-#include <linux/lzo.h>
+#include <linux/percpu.h>
 #include <linux/string.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
@@ -38,6 +39,7 @@ static unsigned int num_devices;
 static unsigned long disksize_kb;
 static unsigned long memlimit_kb;
 static char backing_swap[MAX_SWAP_NAME_LEN];
+static char compressor[MAX_COMPRESSOR_NAME_LEN];
 
 /* Globals */
 static int ramzswap_major;
@@ -659,31 +661,22 @@ out:
 	rzs->table[index].offset = 0;
 }
 
-static int handle_zero_page(struct bio *bio)
+static void handle_zero_page(struct page *page)
 {
 	void *user_mem;
-	struct page *page = bio->bi_io_vec[0].bv_page;
 
 	user_mem = kmap_atomic(page, KM_USER0);
 	memset(user_mem, 0, PAGE_SIZE);
 	kunmap_atomic(user_mem, KM_USER0);
 
 	ramzswap_flush_dcache_page(page);
-
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
-	return 0;
 }
 
-static int handle_uncompressed_page(struct ramzswap *rzs, struct bio *bio)
+static void handle_uncompressed_page(struct ramzswap *rzs, struct page *page,
+				u32 index)
 {
-	u32 index;
-	struct page *page;
 	unsigned char *user_mem, *cmem;
 
-	page = bio->bi_io_vec[0].bv_page;
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
-
 	user_mem = kmap_atomic(page, KM_USER0);
 	cmem = kmap_atomic(rzs->table[index].page, KM_USER1) +
 			rzs->table[index].offset;
@@ -693,10 +686,6 @@ static int handle_uncompressed_page(struct ramzswap *rzs, struct bio *bio)
 	kunmap_atomic(cmem, KM_USER1);
 
 	ramzswap_flush_dcache_page(page);
-
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
-	return 0;
 }
 
 
@@ -707,26 +696,15 @@ static int handle_uncompressed_page(struct ramzswap *rzs, struct bio *bio)
  * to this location - this happens due to readahead when
  * swap device is read from user-space (e.g. during swapon)
  */
-static int handle_ramzswap_fault(struct ramzswap *rzs, struct bio *bio)
+static int handle_ramzswap_fault(struct ramzswap *rzs, u32 index)
 {
 	/*
 	 * Always forward such requests to backing swap
 	 * device (if present)
 	 */
 	if (rzs->backing_swap) {
-		u32 pagenum;
 		stat64_dec(rzs, &rzs->stats.num_reads);
 		stat64_inc(rzs, &rzs->stats.bdev_num_reads);
-		bio->bi_bdev = rzs->backing_swap;
-
-		/*
-		 * In case backing swap is a file, find the right offset within
-		 * the file corresponding to logical position 'index'. For block
-		 * device, this is a nop.
-		 */
-		pagenum = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
-		bio->bi_sector = map_backing_swap_page(rzs, pagenum)
-					<< SECTORS_PER_PAGE_SHIFT;
 		return 1;
 	}
 
@@ -734,41 +712,40 @@ static int handle_ramzswap_fault(struct ramzswap *rzs, struct bio *bio)
 	 * Its unlikely event in case backing dev is
 	 * not present
 	 */
-	pr_debug("Read before write on swap device: "
-		"sector=%lu, size=%u, offset=%u\n",
-		(ulong)(bio->bi_sector), bio->bi_size,
-		bio->bi_io_vec[0].bv_offset);
+	pr_debug("Read before write on swap device: page=%u\n", index);
 
 	/* Do nothing. Just return success */
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
 	return 0;
 }
 
-static int ramzswap_read(struct ramzswap *rzs, struct bio *bio)
+/*
+ * Read page 'index' into 'page'. Returns 0 on success, 1 if the
+ * page has to be read from the backing swap, or -EIO.
+ */
+static int ramzswap_read(struct ramzswap *rzs, struct page *page, u32 index)
 {
 	int ret;
-	u32 index;
-	size_t clen;
-	struct page *page;
+	unsigned int clen;
 	struct zobj_header *zheader;
+	struct crypto_comp *comp;
 	unsigned char *user_mem, *cmem;
 
 	stat64_inc(rzs, &rzs->stats.num_reads);
 
-	page = bio->bi_io_vec[0].bv_page;
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
-
-	if (rzs_test_flag(rzs, index, RZS_ZERO))
-		return handle_zero_page(bio);
+	if (rzs_test_flag(rzs, index, RZS_ZERO)) {
+		handle_zero_page(page);
+		return 0;
+	}
 
 	/* Requested page is not present in compressed area */
 	if (!rzs->table[index].page)
-		return handle_ramzswap_fault(rzs, bio);
+		return handle_ramzswap_fault(rzs, index);
 
 	/* Page is stored uncompressed since it's incompressible */
-	if (unlikely(rzs_test_flag(rzs, index, RZS_UNCOMPRESSED)))
-		return handle_uncompressed_page(rzs, bio);
+	if (unlikely(rzs_test_flag(rzs, index, RZS_UNCOMPRESSED))) {
+		handle_uncompressed_page(rzs, page, index);
+		return 0;
+	}
 
 	user_mem = kmap_atomic(page, KM_USER0);
 	clen = PAGE_SIZE;
@@ -776,47 +753,44 @@ static int ramzswap_read(struct ramzswap *rzs, struct bio *bio)
 	cmem = kmap_atomic(rzs->table[index].page, KM_USER1) +
 			rzs->table[index].offset;
 
-	ret = lzo1x_decompress_safe(
+	comp = *per_cpu_ptr(rzs->comp, get_cpu());
+	ret = crypto_comp_decompress(comp,
 		cmem + sizeof(*zheader),
 		xv_get_object_size(cmem) - sizeof(*zheader),
 		user_mem, &clen);
+	put_cpu();
 
 	kunmap_atomic(user_mem, KM_USER0);
 	kunmap_atomic(cmem, KM_USER1);
 
 	/* should NEVER happen */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret || clen != PAGE_SIZE)) {
 		pr_err("Decompression failed! err=%d, page=%u\n",
 			ret, index);
 		stat64_inc(rzs, &rzs->stats.failed_reads);
-		goto out;
+		return -EIO;
 	}
 
 	ramzswap_flush_dcache_page(page);
-
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
-	return 0;
-
-out:
-	bio_io_error(bio);
 	return 0;
 }
 
-static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
+/*
+ * Store 'page' as page 'index'. Returns 0 on success, 1 if the
+ * page has to be written to the backing swap, or -EIO.
+ */
+static int ramzswap_write(struct ramzswap *rzs, struct page *page, u32 index)
 {
 	int ret, fwd_write_request = 0;
-	u32 offset, index;
-	size_t clen;
+	u32 offset;
+	unsigned int clen;
 	struct zobj_header *zheader;
-	struct page *page, *page_store;
+	struct crypto_comp *comp;
+	struct page *page_store;
 	unsigned char *user_mem, *cmem, *src;
 
 	stat64_inc(rzs, &rzs->stats.num_writes);
 
-	page = bio->bi_io_vec[0].bv_page;
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
-
 	src = rzs->compress_buffer;
 
 #ifndef CONFIG_SWAP_FREE_NOTIFY
@@ -837,9 +811,6 @@ static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
 		rzs_set_flag(rzs, index, RZS_ZERO);
 		mutex_unlock(&rzs->lock);
 		stat_inc(&rzs->stats.pages_zero);
-
-		set_bit(BIO_UPTODATE, &bio->bi_flags);
-		bio_endio(bio, 0);
 		return 0;
 	}
 
@@ -851,17 +822,20 @@ static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
 		goto out;
 	}
 
-	ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-				rzs->compress_workmem);
+	/* compress_buffer is two pages, enough for any compressor */
+	clen = 2 * PAGE_SIZE;
+	comp = *per_cpu_ptr(rzs->comp, get_cpu());
+	ret = crypto_comp_compress(comp, user_mem, PAGE_SIZE, src, &clen);
+	put_cpu();
 
 	kunmap_atomic(user_mem, KM_USER0);
 
-	if (unlikely(ret != LZO_E_OK)) {
-		mutex_unlock(&rzs->lock);
-		pr_err("Compression failed! err=%d\n", ret);
-		stat64_inc(rzs, &rzs->stats.failed_writes);
-		goto out;
-	}
+	/*
+	 * Some compressors (deflate) fail rather than expand the data,
+	 * treat that like an incompressible page.
+	 */
+	if (unlikely(ret))
+		clen = PAGE_SIZE;
 
 	/*
 	 * Page is incompressible. Forward it to backing swap
@@ -899,7 +873,7 @@ static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
 			GFP_NOIO | __GFP_HIGHMEM)) {
 		mutex_unlock(&rzs->lock);
 		pr_info("Error allocating memory for compressed "
-			"page: %u, size=%zu\n", index, clen);
+			"page: %u, size=%u\n", index, clen);
 		stat64_inc(rzs, &rzs->stats.failed_writes);
 		if (rzs->backing_swap)
 			fwd_write_request = 1;
@@ -934,15 +908,11 @@ memstore:
 		stat_inc(&rzs->stats.good_compress);
 
 	mutex_unlock(&rzs->lock);
-
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
 	return 0;
 
 out:
 	if (fwd_write_request) {
 		stat64_inc(rzs, &rzs->stats.bdev_num_writes);
-		bio->bi_bdev = rzs->backing_swap;
 #if 0
 		/*
 		 * TODO: We currently have linear mapping of ramzswap and
@@ -955,46 +925,280 @@ out:
 		 bio->bi_sector = get_backing_swap_page()
 					<< SECTORS_PER_PAGE_SHIFT;
 #endif
-		/*
-		 * In case backing swap is a file, find the right offset within
-		 * the file corresponding to logical position 'index'. For block
-		 * device, this is a nop.
-		 */
-		bio->bi_sector = map_backing_swap_page(rzs, index)
-					<< SECTORS_PER_PAGE_SHIFT;
 		return 1;
 	}
 
-	bio_io_error(bio);
-	return 0;
+	return -EIO;
 }
 
 
 /*
- * Check if request is within bounds and page aligned.
+ * Check if request is within bounds and consists of whole pages.
  */
 static inline int valid_swap_request(struct ramzswap *rzs, struct bio *bio)
 {
+	struct bio_vec *bvec;
+	int i;
+
 	if (unlikely(
 		(bio->bi_sector >= (rzs->disksize >> SECTOR_SHIFT)) ||
 		(bio->bi_sector & (SECTORS_PER_PAGE - 1)) ||
-		(bio->bi_vcnt != 1) ||
-		(bio->bi_size != PAGE_SIZE) ||
-		(bio->bi_io_vec[0].bv_offset != 0))) {
+		(!bio->bi_size) ||
+		(bio->bi_size & (PAGE_SIZE - 1)) ||
+		(bio->bi_sector + (bio->bi_size >> SECTOR_SHIFT) >
+			(rzs->disksize >> SECTOR_SHIFT)))) {
 
 		return 0;
 	}
 
+	bio_for_each_segment(bvec, bio, i) {
+		if (unlikely(bvec->bv_len != PAGE_SIZE || bvec->bv_offset))
+			return 0;
+	}
+
 	/* swap request is valid */
 	return 1;
 }
 
+/*
+ * Pages of a read request that have to come from the backing swap are
+ * collected into runs which are contiguous on the backing swap, and
+ * each run is submitted as one bio. Pages to be written to the backing
+ * swap go into a batch shared by all requests instead (see below). The
+ * original request completes when the last of its bios does.
+ */
+struct ramzswap_backing_io {
+	struct bio *orig_bio;
+	atomic_t pending;
+	int error;
+};
+
+static void ramzswap_backing_io_put(struct ramzswap_backing_io *io)
+{
+	if (!atomic_dec_and_test(&io->pending))
+		return;
+
+	if (io->error) {
+		bio_io_error(io->orig_bio);
+	} else {
+		set_bit(BIO_UPTODATE, &io->orig_bio->bi_flags);
+		bio_endio(io->orig_bio, 0);
+	}
+	kfree(io);
+}
+
+static void ramzswap_backing_end_io(struct bio *bio, int error)
+{
+	struct ramzswap_backing_io *io = bio->bi_private;
+
+	if (error || !test_bit(BIO_UPTODATE, &bio->bi_flags))
+		io->error = -EIO;
+	bio_put(bio);
+	ramzswap_backing_io_put(io);
+}
+
+static struct ramzswap_backing_io *ramzswap_backing_io_get(
+			struct bio *orig_bio, struct ramzswap_backing_io **iop)
+{
+	struct ramzswap_backing_io *io = *iop;
+
+	if (!io) {
+		io = kmalloc(sizeof(*io), GFP_NOIO);
+		if (!io)
+			return NULL;
+		io->orig_bio = orig_bio;
+		atomic_set(&io->pending, 1);
+		io->error = 0;
+		*iop = io;
+	}
+	return io;
+}
+
+static int ramzswap_submit_backing_run(struct ramzswap *rzs,
+			struct bio *orig_bio, struct ramzswap_backing_io **iop,
+			int seg, int nr_pages, u32 pagenum)
+{
+	struct ramzswap_backing_io *io;
+	struct bio *bio;
+
+	io = ramzswap_backing_io_get(orig_bio, iop);
+	if (!io)
+		return -ENOMEM;
+
+	while (nr_pages) {
+		int added = 0;
+
+		bio = bio_alloc(GFP_NOIO, nr_pages);
+		bio->bi_bdev = rzs->backing_swap;
+		bio->bi_sector = pagenum << SECTORS_PER_PAGE_SHIFT;
+		bio->bi_rw = orig_bio->bi_rw;
+		bio->bi_end_io = ramzswap_backing_end_io;
+		bio->bi_private = io;
+
+		while (added < nr_pages && bio_add_page(bio,
+				orig_bio->bi_io_vec[seg + added].bv_page,
+				PAGE_SIZE, 0))
+			added++;
+		if (!added) {
+			bio_put(bio);
+			return -EIO;
+		}
+
+		atomic_inc(&io->pending);
+		generic_make_request(bio);
+
+		seg += added;
+		pagenum += added;
+		nr_pages -= added;
+	}
+
+	return 0;
+}
+
+/*
+ * Swap writeout sends one page per request, so the pages to be written
+ * to the backing swap are held in a batch across requests, and go out
+ * as one bio when they are contiguous on the backing swap. The batch is
+ * submitted when it is full, when the next page does not follow it, on
+ * a synchronous write, and when the queue is unplugged: by whoever waits
+ * for one of its pages, or by the unplug timer. Until then its pages
+ * stay under writeback, so they are not read back or rewritten before
+ * they reach the backing swap.
+ */
+#define BACKING_BATCH_PAGES	32
+
+struct ramzswap_backing_batch {
+	struct bio *bio;
+	u32 next_pagenum;
+	int nr_pages;
+	struct ramzswap_backing_io *io[BACKING_BATCH_PAGES];	/* per page */
+};
+
+static void ramzswap_backing_batch_end_io(struct bio *bio, int error)
+{
+	struct ramzswap_backing_batch *batch = bio->bi_private;
+	int i;
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		error = -EIO;
+	for (i = 0; i < batch->nr_pages; i++) {
+		if (error)
+			batch->io[i]->error = -EIO;
+		ramzswap_backing_io_put(batch->io[i]);
+	}
+	bio_put(bio);
+	kfree(batch);
+}
+
+static struct ramzswap_backing_batch *ramzswap_backing_batch_alloc(
+			struct ramzswap *rzs, struct page *page, u32 pagenum)
+{
+	struct ramzswap_backing_batch *batch;
+	struct bio *bio;
+
+	batch = kmalloc(sizeof(*batch), GFP_NOIO);
+	if (!batch)
+		return NULL;
+
+	bio = bio_alloc(GFP_NOIO, BACKING_BATCH_PAGES);
+	bio->bi_bdev = rzs->backing_swap;
+	bio->bi_sector = pagenum << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_rw = WRITE;
+	bio->bi_end_io = ramzswap_backing_batch_end_io;
+	bio->bi_private = batch;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		kfree(batch);
+		return NULL;
+	}
+
+	batch->bio = bio;
+	batch->next_pagenum = pagenum + 1;
+	batch->nr_pages = 0;
+	return batch;
+}
+
+/*
+ * Queue 'page' of 'orig_bio' for writing to page 'pagenum' of the
+ * backing swap.
+ */
+static int ramzswap_backing_write(struct ramzswap *rzs, struct bio *orig_bio,
+			struct ramzswap_backing_io **iop, struct page *page,
+			u32 pagenum)
+{
+	struct request_queue *q = rzs->queue;
+	struct ramzswap_backing_batch *batch, *full = NULL;
+	struct ramzswap_backing_io *io;
+
+	io = ramzswap_backing_io_get(orig_bio, iop);
+	if (!io)
+		return -ENOMEM;
+
+	spin_lock_irq(q->queue_lock);
+	batch = rzs->backing_batch;
+	if (batch && batch->next_pagenum == pagenum &&
+			bio_add_page(batch->bio, page, PAGE_SIZE, 0)) {
+		batch->next_pagenum++;
+	} else {
+		/* submit it first, the bio mempool may be waiting for it */
+		rzs->backing_batch = NULL;
+		spin_unlock_irq(q->queue_lock);
+		if (batch)
+			generic_make_request(batch->bio);
+
+		batch = ramzswap_backing_batch_alloc(rzs, page, pagenum);
+		if (!batch)
+			return -EIO;
+		spin_lock_irq(q->queue_lock);
+		full = rzs->backing_batch;	/* started meanwhile */
+		rzs->backing_batch = batch;
+	}
+
+	atomic_inc(&io->pending);
+	batch->io[batch->nr_pages++] = io;
+	if (batch->nr_pages < BACKING_BATCH_PAGES) {
+		blk_plug_device(q);
+		batch = NULL;
+	} else {
+		rzs->backing_batch = NULL;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	if (full)
+		generic_make_request(full->bio);
+	if (batch)
+		generic_make_request(batch->bio);
+	return 0;
+}
+
+static void ramzswap_unplug(struct request_queue *q)
+{
+	struct ramzswap *rzs = q->queuedata;
+	struct ramzswap_backing_batch *batch;
+	unsigned long flags;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	blk_remove_plug(q);
+	batch = rzs->backing_batch;
+	rzs->backing_batch = NULL;
+	spin_unlock_irqrestore(q->queue_lock, flags);
+
+	if (batch)
+		generic_make_request(batch->bio);
+	if (rzs->backing_swap)
+		blk_unplug(bdev_get_queue(rzs->backing_swap));
+}
+
 /*
  * Handler function for all ramzswap I/O requests.
  */
 static int ramzswap_make_request(struct request_queue *queue, struct bio *bio)
 {
-	int ret = 0;
+	int ret, i, error = 0;
+	int run_seg = 0, run_len = 0;
+	u32 index, pagenum = 0, run_pagenum = 0;
+	struct bio_vec *bvec;
+	struct ramzswap_backing_io *io = NULL;
 	struct ramzswap *rzs = queue->queuedata;
 
 	if (unlikely(!rzs->init_done)) {
@@ -1008,17 +1212,126 @@ static int ramzswap_make_request(struct request_queue *queue, struct bio *bio)
 		return 0;
 	}
 
-	switch (bio_data_dir(bio)) {
-	case READ:
-		ret = ramzswap_read(rzs, bio);
-		break;
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	bio_for_each_segment(bvec, bio, i) {
+		if (bio_data_dir(bio) == READ)
+			ret = ramzswap_read(rzs, bvec->bv_page, index);
+		else
+			ret = ramzswap_write(rzs, bvec->bv_page, index);
 
-	case WRITE:
-		ret = ramzswap_write(rzs, bio);
-		break;
+		if (ret < 0) {
+			error = ret;
+		} else if (ret > 0) {
+			/*
+			 * In case backing swap is a file, find the right
+			 * offset within the file corresponding to logical
+			 * position 'index'. For block device, this is a nop.
+			 */
+			pagenum = map_backing_swap_page(rzs, index);
+			if (bio_data_dir(bio) == WRITE) {
+				if (ramzswap_backing_write(rzs, bio, &io,
+						bvec->bv_page, pagenum))
+					error = -EIO;
+				goto next;
+			}
+			if (run_len && pagenum == run_pagenum + run_len) {
+				run_len++;
+				goto next;
+			}
+		}
+
+		if (run_len && ramzswap_submit_backing_run(rzs, bio, &io,
+					run_seg, run_len, run_pagenum))
+			error = -EIO;
+		run_len = 0;
+
+		if (ret > 0) {
+			run_seg = i;
+			run_pagenum = pagenum;
+			run_len = 1;
+		}
+next:
+		index++;
 	}
 
-	return ret;
+	/* Reads only, writes to backing swap are batched */
+	if (run_len) {
+		/* The whole request goes to backing swap, just remap it */
+		if (!io && !error && run_seg == bio->bi_idx) {
+			bio->bi_bdev = rzs->backing_swap;
+			bio->bi_sector = run_pagenum << SECTORS_PER_PAGE_SHIFT;
+			return 1;
+		}
+		if (ramzswap_submit_backing_run(rzs, bio, &io,
+					run_seg, run_len, run_pagenum))
+			error = -EIO;
+	}
+
+	if (io) {
+		if (error)
+			io->error = error;
+		ramzswap_backing_io_put(io);
+		if (bio_data_dir(bio) == WRITE && bio_unplug(bio))
+			ramzswap_unplug(queue);
+		return 0;
+	}
+
+	if (error) {
+		bio_io_error(bio);
+	} else {
+		set_bit(BIO_UPTODATE, &bio->bi_flags);
+		bio_endio(bio, 0);
+	}
+	return 0;
+}
+
+static void ramzswap_free_compressor(struct ramzswap *rzs)
+{
+	int cpu;
+
+	if (!rzs->comp)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *comp = *per_cpu_ptr(rzs->comp, cpu);
+
+		if (comp)
+			crypto_free_comp(comp);
+	}
+	free_percpu(rzs->comp);
+	rzs->comp = NULL;
+}
+
+/*
+ * Each cpu gets its own instance of the compressor, since they keep
+ * their working memory in the transform and reads are not serialized.
+ */
+static int ramzswap_alloc_compressor(struct ramzswap *rzs)
+{
+	int cpu;
+
+	if (!rzs->compressor[0])
+		strlcpy(rzs->compressor, default_compressor,
+			MAX_COMPRESSOR_NAME_LEN);
+
+	rzs->comp = alloc_percpu(struct crypto_comp *);
+	if (!rzs->comp)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *comp;
+
+		comp = crypto_alloc_comp(rzs->compressor, 0, 0);
+		if (IS_ERR(comp)) {
+			pr_err("Error allocating compressor %s\n",
+				rzs->compressor);
+			ramzswap_free_compressor(rzs);
+			return PTR_ERR(comp);
+		}
+		*per_cpu_ptr(rzs->comp, cpu) = comp;
+	}
+
+	return 0;
 }
 
 static void reset_device(struct ramzswap *rzs, struct block_device *bdev)
@@ -1032,6 +1345,7 @@ static void reset_device(struct ramzswap *rzs, struct block_device *bdev)
 		fsync_bdev(bdev);
 
 	rzs->init_done = 0;
+	ramzswap_unplug(rzs->queue);
 
 	if (rzs->backing_swap && !rzs->num_extents)
 		is_backing_blkdev = 1;
@@ -1039,10 +1353,9 @@ static void reset_device(struct ramzswap *rzs, struct block_device *bdev)
 	num_pages = rzs->disksize >> PAGE_SHIFT;
 
 	/* Free various per-device buffers */
-	kfree(rzs->compress_workmem);
+	ramzswap_free_compressor(rzs);
 	free_pages((unsigned long)rzs->compress_buffer, 1);
 
-	rzs->compress_workmem = NULL;
 	rzs->compress_buffer = NULL;
 
 	/* Free all pages that are still in this ramzswap device */
@@ -1101,6 +1414,17 @@ static void reset_device(struct ramzswap *rzs, struct block_device *bdev)
 		rzs->backing_swap = NULL;
 		memset(rzs->backing_swap_name, 0, MAX_SWAP_NAME_LEN);
 	}
+	/*
+	 * A compressor chosen with RZSIO_SET_COMPRESSOR is for this
+	 * initialization only; one given as module parameter stays.
+	 */
+	if (rzs->compressor_ioctl) {
+		memset(rzs->compressor, 0, MAX_COMPRESSOR_NAME_LEN);
+		if (rzs == &devices[0])
+			strlcpy(rzs->compressor, compressor,
+				MAX_COMPRESSOR_NAME_LEN);
+		rzs->compressor_ioctl = 0;
+	}
 
 	/* Reset stats */
 	memset(&rzs->stats, 0, sizeof(rzs->stats));
@@ -1132,12 +1456,9 @@ static int ramzswap_ioctl_init_device(struct ramzswap *rzs)
 	else
 		ramzswap_set_disksize(rzs, totalram_pages << PAGE_SHIFT);
 
-	rzs->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!rzs->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
+	ret = ramzswap_alloc_compressor(rzs);
+	if (ret)
 		goto fail;
-	}
 
 	rzs->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
 	if (!rzs->compress_buffer) {
@@ -1209,11 +1530,13 @@ static int ramzswap_ioctl_init_device(struct ramzswap *rzs)
 
 	if (rzs->backing_swap) {
 		pr_info("/dev/ramzswap%d initialized: "
-			"backing_swap=%s, memlimit_kb=%zu\n",
-			dev_id, rzs->backing_swap_name, rzs->memlimit >> 10);
+			"backing_swap=%s, memlimit_kb=%zu, compressor=%s\n",
+			dev_id, rzs->backing_swap_name, rzs->memlimit >> 10,
+			rzs->compressor);
 	} else {
 		pr_info("/dev/ramzswap%d initialized: "
-			"disksize_kb=%zu", dev_id, rzs->disksize >> 10);
+			"disksize_kb=%zu, compressor=%s\n", dev_id,
+			rzs->disksize >> 10, rzs->compressor);
 	}
 	return 0;
 
@@ -1238,6 +1561,7 @@ static int ramzswap_ioctl(struct block_device *bdev, fmode_t mode,
 {
 	int ret = 0;
 	size_t disksize_kb, memlimit_kb;
+	char name[MAX_COMPRESSOR_NAME_LEN];
 
 	struct ramzswap *rzs = bdev->bd_disk->private_data;
 
@@ -1286,6 +1610,27 @@ static int ramzswap_ioctl(struct block_device *bdev, fmode_t mode,
 		pr_debug("Backing swap set to %s\n", rzs->backing_swap_name);
 		break;
 
+	case RZSIO_SET_COMPRESSOR:
+		if (rzs->init_done) {
+			ret = -EBUSY;
+			goto out;
+		}
+
+		if (copy_from_user(name, (void *)arg, _IOC_SIZE(cmd))) {
+			ret = -EFAULT;
+			goto out;
+		}
+		name[MAX_COMPRESSOR_NAME_LEN - 1] = '\0';
+		if (!crypto_has_comp(name, 0, 0)) {
+			pr_info("Unknown compressor %s\n", name);
+			ret = -EINVAL;
+			goto out;
+		}
+		strcpy(rzs->compressor, name);
+		rzs->compressor_ioctl = 1;
+		pr_debug("Compressor set to %s\n", rzs->compressor);
+		break;
+
 	case RZSIO_GET_STATS:
 	{
 		struct ramzswap_ioctl_stats *stats;
@@ -1368,6 +1713,8 @@ static int create_device(struct ramzswap *rzs, int device_id)
 
 	blk_queue_make_request(rzs->queue, ramzswap_make_request);
 	rzs->queue->queuedata = rzs;
+	rzs->queue->queue_lock = &rzs->queue->__queue_lock;
+	rzs->queue->unplug_fn = ramzswap_unplug;
 
 	 /* gendisk structure */
 	rzs->disk = alloc_disk(1);
@@ -1457,6 +1804,7 @@ static int __init ramzswap_init(void)
 	 * if parameters are provided
 	 */
 	rzs = &devices[0];
+	strlcpy(rzs->compressor, compressor, MAX_COMPRESSOR_NAME_LEN);
 
 	/*
 	 * User specifies either <disksize_kb> or <backing_swap, memlimit_kb>
@@ -1551,6 +1899,10 @@ MODULE_PARM_DESC(memlimit_kb, "Memlimit in KB");
 module_param_string(backing_swap, backing_swap, sizeof(backing_swap), 0);
 MODULE_PARM_DESC(backing_swap, "Backing swap name");
 
+/* Optional: default = lzo */
+module_param_string(compressor, compressor, sizeof(compressor), 0);
+MODULE_PARM_DESC(compressor, "Compression algorithm (lzo, deflate, ...)");
+
 module_init(ramzswap_init);
 module_exit(ramzswap_exit);
 
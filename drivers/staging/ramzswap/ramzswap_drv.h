@@ -42,6 +42,9 @@ struct zobj_header {
 
 /*-- Configurable parameters */
 
+/* Compression algorithm used unless another is selected */
+static const char default_compressor[] = "lzo";
+
 /* Default ramzswap disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 static const unsigned default_memlimit_perc_ram = 15;
@@ -130,7 +133,7 @@ struct ramzswap_stats {
 
 struct ramzswap {
 	struct xv_pool *mem_pool;
-	void *compress_workmem;
+	struct crypto_comp **comp;	/* per-cpu compressor instances */
 	void *compress_buffer;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
@@ -152,6 +155,9 @@ struct ramzswap {
 
 	struct ramzswap_stats stats;
 
+	char compressor[MAX_COMPRESSOR_NAME_LEN];
+	int compressor_ioctl;	/* compressor set by RZSIO_SET_COMPRESSOR */
+
 	/* backing swap device info */
 	struct ramzswap_backing_extent *curr_extent;
 	struct list_head backing_swap_extent_list;
@@ -159,6 +165,8 @@ struct ramzswap {
 	char backing_swap_name[MAX_SWAP_NAME_LEN];
 	struct block_device *backing_swap;
 	struct file *swap_file;
+	/* writes to backing swap not yet submitted, under queue_lock */
+	struct ramzswap_backing_batch *backing_batch;
 };
 
 /*-- */
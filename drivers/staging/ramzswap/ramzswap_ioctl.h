@@ -16,6 +16,7 @@
 #define _RAMZSWAP_IOCTL_H_
 
 #define MAX_SWAP_NAME_LEN 128
+#define MAX_COMPRESSOR_NAME_LEN 64
 
 struct ramzswap_ioctl_stats {
 	char backing_swap_name[MAX_SWAP_NAME_LEN];
@@ -46,5 +47,7 @@ struct ramzswap_ioctl_stats {
 #define RZSIO_GET_STATS		_IOR('z', 3, struct ramzswap_ioctl_stats)
 #define RZSIO_INIT		_IO('z', 4)
 #define RZSIO_RESET		_IO('z', 5)
+#define RZSIO_SET_COMPRESSOR	_IOW('z', 6, \
+					unsigned char[MAX_COMPRESSOR_NAME_LEN])
 
 #endif
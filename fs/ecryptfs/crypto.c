@@ -33,20 +33,10 @@
 #include <linux/crypto.h>
 #include <linux/file.h>
 #include <linux/scatterlist.h>
+#include <linux/completion.h>
 #include <asm/unaligned.h>
 #include "ecryptfs_kernel.h"
 
-static int
-ecryptfs_decrypt_page_offset(struct ecryptfs_crypt_stat *crypt_stat,
-			     struct page *dst_page, int dst_offset,
-			     struct page *src_page, int src_offset, int size,
-			     unsigned char *iv);
-static int
-ecryptfs_encrypt_page_offset(struct ecryptfs_crypt_stat *crypt_stat,
-			     struct page *dst_page, int dst_offset,
-			     struct page *src_page, int src_offset, int size,
-			     unsigned char *iv);
-
 /**
  * ecryptfs_to_hex
  * @dst: Buffer to take hex character representation of contents of
@@ -82,18 +72,19 @@ void ecryptfs_from_hex(char *dst, char *src, int dst_size)
 }
 
 /**
- * ecryptfs_calculate_md5 - calculates the md5 of @src
+ * ecryptfs_calculate_md5_locked - calculates the md5 of @src
  * @dst: Pointer to 16 bytes of allocated memory
  * @crypt_stat: Pointer to crypt_stat struct for the current inode
  * @src: Data to be md5'd
  * @len: Length of @src
  *
  * Uses the allocated crypto context that crypt_stat references to
- * generate the MD5 sum of the contents of src.
+ * generate the MD5 sum of the contents of src. The caller must hold
+ * crypt_stat->cs_hash_tfm_mutex.
  */
-static int ecryptfs_calculate_md5(char *dst,
-				  struct ecryptfs_crypt_stat *crypt_stat,
-				  char *src, int len)
+static int ecryptfs_calculate_md5_locked(char *dst,
+					 struct ecryptfs_crypt_stat *crypt_stat,
+					 char *src, int len)
 {
 	struct scatterlist sg;
 	struct hash_desc desc = {
@@ -102,7 +93,6 @@ static int ecryptfs_calculate_md5(char *dst,
 	};
 	int rc = 0;
 
-	mutex_lock(&crypt_stat->cs_hash_tfm_mutex);
 	sg_init_one(&sg, (u8 *)src, len);
 	if (!desc.tfm) {
 		desc.tfm = crypto_alloc_hash(ECRYPTFS_DEFAULT_HASH, 0,
@@ -138,6 +128,17 @@ static int ecryptfs_calculate_md5(char *dst,
 		goto out;
 	}
 out:
+	return rc;
+}
+
+static int ecryptfs_calculate_md5(char *dst,
+				  struct ecryptfs_crypt_stat *crypt_stat,
+				  char *src, int len)
+{
+	int rc;
+
+	mutex_lock(&crypt_stat->cs_hash_tfm_mutex);
+	rc = ecryptfs_calculate_md5_locked(dst, crypt_stat, src, len);
 	mutex_unlock(&crypt_stat->cs_hash_tfm_mutex);
 	return rc;
 }
@@ -171,12 +172,12 @@ out:
  * @offset: Offset of the extent whose IV we are to derive
  *
  * Generate the initialization vector from the given root IV and page
- * offset.
+ * offset. The caller must hold crypt_stat->cs_hash_tfm_mutex.
  *
  * Returns zero on success; non-zero on error.
  */
-int ecryptfs_derive_iv(char *iv, struct ecryptfs_crypt_stat *crypt_stat,
-		       loff_t offset)
+static int ecryptfs_derive_iv(char *iv, struct ecryptfs_crypt_stat *crypt_stat,
+			      loff_t offset)
 {
 	int rc = 0;
 	char dst[MD5_DIGEST_SIZE];
@@ -197,8 +198,8 @@ int ecryptfs_derive_iv(char *iv, struct ecryptfs_crypt_stat *crypt_stat,
 		ecryptfs_printk(KERN_DEBUG, "source:\n");
 		ecryptfs_dump_hex(src, (crypt_stat->iv_bytes + 16));
 	}
-	rc = ecryptfs_calculate_md5(dst, crypt_stat, src,
-				    (crypt_stat->iv_bytes + 16));
+	rc = ecryptfs_calculate_md5_locked(dst, crypt_stat, src,
+					   (crypt_stat->iv_bytes + 16));
 	if (rc) {
 		ecryptfs_printk(KERN_WARNING, "Error attempting to compute "
 				"MD5 while generating IV for a page\n");
@@ -213,6 +214,69 @@ out:
 	return rc;
 }
 
+/**
+ * ecryptfs_derive_page_ivs
+ * @ivs: destination for the IVs of every extent in the page, iv_bytes
+ *       each
+ * @crypt_stat: Pointer to crypt_stat struct for the current inode
+ * @index: Index of the eCryptfs page
+ *
+ * Derive the IV schedule of a page with a single acquisition of the
+ * hash tfm. The schedule of the most recent page is kept in the
+ * crypt_stat, so the repeated re-encryption of a partially written
+ * page, as done by appending writers, does not hash it again.
+ *
+ * Only that one page is cached. Sequential reads, writers moving
+ * between pages and several writers of one file each miss, and pay
+ * the full MD5 for every extent as before.
+ *
+ * Returns zero on success; non-zero on error.
+ */
+int ecryptfs_derive_page_ivs(char *ivs, struct ecryptfs_crypt_stat *crypt_stat,
+			     pgoff_t index)
+{
+	unsigned int extents_per_page = (PAGE_CACHE_SIZE
+					 / crypt_stat->extent_size);
+	size_t size = extents_per_page * crypt_stat->iv_bytes;
+	loff_t extent_base = ((loff_t)index) * extents_per_page;
+	unsigned int i;
+	int rc = 0;
+
+	mutex_lock(&crypt_stat->cs_hash_tfm_mutex);
+	if (crypt_stat->iv_schedule_size == size
+	    && crypt_stat->iv_schedule_index == index) {
+		memcpy(ivs, crypt_stat->iv_schedule, size);
+		goto out;
+	}
+	for (i = 0; i < extents_per_page; i++) {
+		rc = ecryptfs_derive_iv(&ivs[i * crypt_stat->iv_bytes],
+					crypt_stat, (extent_base + i));
+		if (rc) {
+			ecryptfs_printk(KERN_ERR, "Error attempting to "
+					"derive IV for extent [0x%.16llx]; "
+					"rc = [%d]\n",
+					(unsigned long long)(extent_base + i),
+					rc);
+			goto out;
+		}
+	}
+	if (crypt_stat->iv_schedule_alloc < size) {
+		kfree(crypt_stat->iv_schedule);
+		crypt_stat->iv_schedule_size = 0;
+		crypt_stat->iv_schedule = kmalloc(size, GFP_NOFS);
+		crypt_stat->iv_schedule_alloc =
+			crypt_stat->iv_schedule ? size : 0;
+	}
+	if (crypt_stat->iv_schedule) {
+		memcpy(crypt_stat->iv_schedule, ivs, size);
+		crypt_stat->iv_schedule_index = index;
+		crypt_stat->iv_schedule_size = size;
+	}
+out:
+	mutex_unlock(&crypt_stat->cs_hash_tfm_mutex);
+	return rc;
+}
+
 /**
  * ecryptfs_init_crypt_stat
  * @crypt_stat: Pointer to the crypt_stat struct to initialize.
@@ -242,9 +306,10 @@ void ecryptfs_destroy_crypt_stat(struct ecryptfs_crypt_stat *crypt_stat)
 	struct ecryptfs_key_sig *key_sig, *key_sig_tmp;
 
 	if (crypt_stat->tfm)
-		crypto_free_blkcipher(crypt_stat->tfm);
+		crypto_free_ablkcipher(crypt_stat->tfm);
 	if (crypt_stat->hash_tfm)
 		crypto_free_hash(crypt_stat->hash_tfm);
+	kfree(crypt_stat->iv_schedule);
 	mutex_lock(&crypt_stat->keysig_list_mutex);
 	list_for_each_entry_safe(key_sig, key_sig_tmp,
 				 &crypt_stat->keysig_list, crypt_stat_list) {
@@ -325,132 +390,206 @@ int virt_to_scatterlist(const void *addr, int size, struct scatterlist *sg,
 }
 
 /**
- * encrypt_scatterlist
- * @crypt_stat: Pointer to the crypt_stat struct to initialize.
- * @dest_sg: Destination of encrypted data
- * @src_sg: Data to be encrypted
- * @size: Length of data to be encrypted
- * @iv: iv to use during encryption
+ * ecryptfs_lower_offset_for_extent
  *
- * Returns the number of bytes encrypted; negative value on error
+ * Convert an eCryptfs page index into a lower byte offset
  */
-static int encrypt_scatterlist(struct ecryptfs_crypt_stat *crypt_stat,
-			       struct scatterlist *dest_sg,
-			       struct scatterlist *src_sg, int size,
-			       unsigned char *iv)
+static void ecryptfs_lower_offset_for_extent(loff_t *offset, loff_t extent_num,
+					     struct ecryptfs_crypt_stat *crypt_stat)
+{
+	(*offset) = (crypt_stat->num_header_bytes_at_front
+		     + (crypt_stat->extent_size * extent_num));
+}
+
+/**
+ * ecryptfs_set_key
+ * @crypt_stat: crypt_stat whose tfm is to be keyed
+ *
+ * Set the file encryption key on the shared tfm the first time it is
+ * used. The key does not change for the lifetime of the crypt_stat, so
+ * requests in flight on other pages are not affected.
+ *
+ * Returns zero on success; non-zero on error
+ */
+static int ecryptfs_set_key(struct ecryptfs_crypt_stat *crypt_stat)
 {
-	struct blkcipher_desc desc = {
-		.tfm = crypt_stat->tfm,
-		.info = iv,
-		.flags = CRYPTO_TFM_REQ_MAY_SLEEP
-	};
 	int rc = 0;
 
 	BUG_ON(!crypt_stat || !crypt_stat->tfm
 	       || !(crypt_stat->flags & ECRYPTFS_STRUCT_INITIALIZED));
-	if (unlikely(ecryptfs_verbosity > 0)) {
-		ecryptfs_printk(KERN_DEBUG, "Key size [%d]; key:\n",
-				crypt_stat->key_size);
-		ecryptfs_dump_hex(crypt_stat->key,
-				  crypt_stat->key_size);
-	}
-	/* Consider doing this once, when the file is opened */
 	mutex_lock(&crypt_stat->cs_tfm_mutex);
 	if (!(crypt_stat->flags & ECRYPTFS_KEY_SET)) {
-		rc = crypto_blkcipher_setkey(crypt_stat->tfm, crypt_stat->key,
-					     crypt_stat->key_size);
-		crypt_stat->flags |= ECRYPTFS_KEY_SET;
-	}
-	if (rc) {
-		ecryptfs_printk(KERN_ERR, "Error setting key; rc = [%d]\n",
-				rc);
-		mutex_unlock(&crypt_stat->cs_tfm_mutex);
-		rc = -EINVAL;
-		goto out;
+		if (unlikely(ecryptfs_verbosity > 0)) {
+			ecryptfs_printk(KERN_DEBUG, "Key size [%d]; key:\n",
+					crypt_stat->key_size);
+			ecryptfs_dump_hex(crypt_stat->key,
+					  crypt_stat->key_size);
+		}
+		rc = crypto_ablkcipher_setkey(crypt_stat->tfm, crypt_stat->key,
+					      crypt_stat->key_size);
+		if (rc) {
+			ecryptfs_printk(KERN_ERR, "Error setting key; "
+					"rc = [%d]\n", rc);
+			rc = -EINVAL;
+		} else
+			crypt_stat->flags |= ECRYPTFS_KEY_SET;
 	}
-	ecryptfs_printk(KERN_DEBUG, "Encrypting [%d] bytes.\n", size);
-	crypto_blkcipher_encrypt_iv(&desc, dest_sg, src_sg, size);
 	mutex_unlock(&crypt_stat->cs_tfm_mutex);
-out:
 	return rc;
 }
 
 /**
- * ecryptfs_lower_offset_for_extent
- *
- * Convert an eCryptfs page index into a lower byte offset
+ * struct ecryptfs_extent_req - one in-flight extent of a page
+ * @src_sg: Source of the extent
+ * @dst_sg: Destination of the extent
+ * @iv: IV for the extent; the cipher updates it, so it is per request
+ * @req: Crypto API request; must be last, it is followed by the
+ *       tfm-specific request context
  */
-static void ecryptfs_lower_offset_for_extent(loff_t *offset, loff_t extent_num,
-					     struct ecryptfs_crypt_stat *crypt_stat)
+struct ecryptfs_extent_req {
+	struct scatterlist src_sg;
+	struct scatterlist dst_sg;
+	unsigned char iv[ECRYPTFS_MAX_IV_BYTES];
+	struct ablkcipher_request req;
+};
+
+/**
+ * struct ecryptfs_page_crypt - completion state for the extents of a page
+ * @pending: Requests not yet completed, plus one for the submitter
+ * @rc: First error reported by any request
+ * @completion: Signalled when @pending drops to zero
+ */
+struct ecryptfs_page_crypt {
+	atomic_t pending;
+	int rc;
+	struct completion completion;
+};
+
+static void ecryptfs_extent_done(struct ecryptfs_page_crypt *page_crypt,
+				 int rc)
 {
-	(*offset) = (crypt_stat->num_header_bytes_at_front
-		     + (crypt_stat->extent_size * extent_num));
+	if (rc && !page_crypt->rc)
+		page_crypt->rc = rc;
+	if (atomic_dec_and_test(&page_crypt->pending))
+		complete(&page_crypt->completion);
+}
+
+static void ecryptfs_extent_complete(struct crypto_async_request *req, int rc)
+{
+	/* a backlogged request has been queued; wait for the real result */
+	if (rc == -EINPROGRESS)
+		return;
+	ecryptfs_extent_done(req->data, rc);
 }
 
 /**
- * ecryptfs_encrypt_extent
- * @enc_extent_page: Allocated page into which to encrypt the data in
- *                   @page
+ * ecryptfs_crypt_pages
  * @crypt_stat: crypt_stat containing cryptographic context for the
- *              encryption operation
- * @page: Page containing plaintext data extent to encrypt
- * @extent_offset: Page extent offset for use in generating IV
+ *              operation
+ * @pages: eCryptfs pages; source when encrypting, destination when
+ *         decrypting. Their indices select the extent IVs.
+ * @bounce: Pages holding the lower file's (encrypted) view of @pages
+ * @nr_pages: Number of entries in @pages and @bounce
+ * @encrypt: Non-zero to encrypt, zero to decrypt
  *
- * Encrypts one extent of data.
+ * Submits every extent of every page to the cipher before waiting for
+ * any of them, so that asynchronous implementations can work on all of
+ * them at once. Synchronous implementations simply complete each
+ * request as it is submitted.
  *
- * Return zero on success; non-zero otherwise
+ * Returns zero on success; negative on error
  */
-static int ecryptfs_encrypt_extent(struct page *enc_extent_page,
-				   struct ecryptfs_crypt_stat *crypt_stat,
-				   struct page *page,
-				   unsigned long extent_offset)
+static int ecryptfs_crypt_pages(struct ecryptfs_crypt_stat *crypt_stat,
+				struct page **pages, struct page **bounce,
+				unsigned int nr_pages, int encrypt)
 {
-	loff_t extent_base;
-	char extent_iv[ECRYPTFS_MAX_IV_BYTES];
+	unsigned int extents_per_page = (PAGE_CACHE_SIZE
+					 / crypt_stat->extent_size);
+	unsigned int nr_reqs = nr_pages * extents_per_page;
+	struct ecryptfs_page_crypt page_crypt;
+	size_t req_size;
+	char *reqs;
+	char *ivs;
+	unsigned int i;
 	int rc;
 
-	extent_base = (((loff_t)page->index)
-		       * (PAGE_CACHE_SIZE / crypt_stat->extent_size));
-	rc = ecryptfs_derive_iv(extent_iv, crypt_stat,
-				(extent_base + extent_offset));
-	if (rc) {
-		ecryptfs_printk(KERN_ERR, "Error attempting to "
-				"derive IV for extent [0x%.16x]; "
-				"rc = [%d]\n", (extent_base + extent_offset),
-				rc);
+	BUG_ON(extents_per_page == 0);
+	rc = ecryptfs_set_key(crypt_stat);
+	if (rc)
 		goto out;
-	}
-	if (unlikely(ecryptfs_verbosity > 0)) {
-		ecryptfs_printk(KERN_DEBUG, "Encrypting extent "
-				"with iv:\n");
-		ecryptfs_dump_hex(extent_iv, crypt_stat->iv_bytes);
-		ecryptfs_printk(KERN_DEBUG, "First 8 bytes before "
-				"encryption:\n");
-		ecryptfs_dump_hex((char *)
-				  (page_address(page)
-				   + (extent_offset * crypt_stat->extent_size)),
-				  8);
-	}
-	rc = ecryptfs_encrypt_page_offset(crypt_stat, enc_extent_page, 0,
-					  page, (extent_offset
-						 * crypt_stat->extent_size),
-					  crypt_stat->extent_size, extent_iv);
-	if (rc < 0) {
-		printk(KERN_ERR "%s: Error attempting to encrypt page with "
-		       "page->index = [%ld], extent_offset = [%ld]; "
-		       "rc = [%d]\n", __func__, page->index, extent_offset,
-		       rc);
+	req_size = ALIGN(sizeof(struct ecryptfs_extent_req)
+			 + crypto_ablkcipher_reqsize(crypt_stat->tfm),
+			 crypto_tfm_ctx_alignment());
+	reqs = kmalloc(nr_reqs * (req_size + crypt_stat->iv_bytes), GFP_NOFS);
+	if (!reqs) {
+		rc = -ENOMEM;
 		goto out;
 	}
-	rc = 0;
-	if (unlikely(ecryptfs_verbosity > 0)) {
-		ecryptfs_printk(KERN_DEBUG, "Encrypt extent [0x%.16x]; "
-				"rc = [%d]\n", (extent_base + extent_offset),
-				rc);
-		ecryptfs_printk(KERN_DEBUG, "First 8 bytes after "
-				"encryption:\n");
-		ecryptfs_dump_hex((char *)(page_address(enc_extent_page)), 8);
+	ivs = reqs + nr_reqs * req_size;
+	/* derive every IV first, so that a failure leaves nothing in flight */
+	for (i = 0; i < nr_pages; i++) {
+		rc = ecryptfs_derive_page_ivs(
+			&ivs[i * extents_per_page * crypt_stat->iv_bytes],
+			crypt_stat, pages[i]->index);
+		if (rc) {
+			ecryptfs_printk(KERN_ERR, "Error attempting to derive "
+					"IVs for page [%ld]; rc = [%d]\n",
+					pages[i]->index, rc);
+			goto out_free;
+		}
+	}
+	atomic_set(&page_crypt.pending, nr_reqs + 1);
+	page_crypt.rc = 0;
+	init_completion(&page_crypt.completion);
+	for (i = 0; i < nr_reqs; i++) {
+		struct ecryptfs_extent_req *ext_req;
+		struct page *src_page, *dst_page;
+		unsigned int offset = ((i % extents_per_page)
+				       * crypt_stat->extent_size);
+		int err;
+
+		if (encrypt) {
+			src_page = pages[i / extents_per_page];
+			dst_page = bounce[i / extents_per_page];
+		} else {
+			src_page = bounce[i / extents_per_page];
+			dst_page = pages[i / extents_per_page];
+		}
+		ext_req = (struct ecryptfs_extent_req *)(reqs + i * req_size);
+		memcpy(ext_req->iv, &ivs[i * crypt_stat->iv_bytes],
+		       crypt_stat->iv_bytes);
+		sg_init_table(&ext_req->src_sg, 1);
+		sg_set_page(&ext_req->src_sg, src_page,
+			    crypt_stat->extent_size, offset);
+		sg_init_table(&ext_req->dst_sg, 1);
+		sg_set_page(&ext_req->dst_sg, dst_page,
+			    crypt_stat->extent_size, offset);
+		ablkcipher_request_set_tfm(&ext_req->req, crypt_stat->tfm);
+		ablkcipher_request_set_callback(
+			&ext_req->req,
+			CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+			ecryptfs_extent_complete, &page_crypt);
+		ablkcipher_request_set_crypt(&ext_req->req, &ext_req->src_sg,
+					     &ext_req->dst_sg,
+					     crypt_stat->extent_size,
+					     ext_req->iv);
+		if (encrypt)
+			err = crypto_ablkcipher_encrypt(&ext_req->req);
+		else
+			err = crypto_ablkcipher_decrypt(&ext_req->req);
+		if (err != -EINPROGRESS && err != -EBUSY)
+			ecryptfs_extent_done(&page_crypt, err);
 	}
+	if (!atomic_dec_and_test(&page_crypt.pending))
+		wait_for_completion(&page_crypt.completion);
+	rc = page_crypt.rc;
+	if (rc)
+		printk(KERN_ERR "%s: Error attempting to %s [%d] page(s) "
+		       "starting at page->index = [%ld]; rc = [%d]\n",
+		       __func__, encrypt ? "encrypt" : "decrypt", nr_pages,
+		       pages[0]->index, rc);
+out_free:
+	kfree(reqs);
 out:
 	return rc;
 }
@@ -461,7 +600,9 @@ out:
  *        decrypted content that needs to be encrypted (to a temporary
  *        page; not in place) and written out to the lower file
  *
- * Encrypt an eCryptfs page. This is done on a per-extent basis. Note
+ * Encrypt an eCryptfs page. All extents of the page are handed to the
+ * cipher together and written to the lower file with a single call; the
+ * extents of a page are contiguous in the lower file. Note
  * that eCryptfs pages may straddle the lower pages -- for instance,
  * if the file was created on a machine with an 8K page size
  * (resulting in an 8K header), and then the file is copied onto a
@@ -477,7 +618,7 @@ int ecryptfs_encrypt_page(struct page *page)
 	struct ecryptfs_crypt_stat *crypt_stat;
 	char *enc_extent_virt;
 	struct page *enc_extent_page = NULL;
-	loff_t extent_offset;
+	loff_t offset;
 	int rc = 0;
 
 	ecryptfs_inode = page->mapping->host;
@@ -500,105 +641,41 @@ int ecryptfs_encrypt_page(struct page *page)
 		goto out;
 	}
 	enc_extent_virt = kmap(enc_extent_page);
-	for (extent_offset = 0;
-	     extent_offset < (PAGE_CACHE_SIZE / crypt_stat->extent_size);
-	     extent_offset++) {
-		loff_t offset;
-
-		rc = ecryptfs_encrypt_extent(enc_extent_page, crypt_stat, page,
-					     extent_offset);
-		if (rc) {
-			printk(KERN_ERR "%s: Error encrypting extent; "
-			       "rc = [%d]\n", __func__, rc);
-			goto out;
-		}
-		ecryptfs_lower_offset_for_extent(
-			&offset, ((((loff_t)page->index)
-				   * (PAGE_CACHE_SIZE
-				      / crypt_stat->extent_size))
-				  + extent_offset), crypt_stat);
-		rc = ecryptfs_write_lower(ecryptfs_inode, enc_extent_virt,
-					  offset, crypt_stat->extent_size);
-		if (rc) {
-			ecryptfs_printk(KERN_ERR, "Error attempting "
-					"to write lower page; rc = [%d]"
-					"\n", rc);
-			goto out;
-		}
-	}
-out:
-	if (enc_extent_page) {
-		kunmap(enc_extent_page);
-		__free_page(enc_extent_page);
-	}
-	return rc;
-}
-
-static int ecryptfs_decrypt_extent(struct page *page,
-				   struct ecryptfs_crypt_stat *crypt_stat,
-				   struct page *enc_extent_page,
-				   unsigned long extent_offset)
-{
-	loff_t extent_base;
-	char extent_iv[ECRYPTFS_MAX_IV_BYTES];
-	int rc;
-
-	extent_base = (((loff_t)page->index)
-		       * (PAGE_CACHE_SIZE / crypt_stat->extent_size));
-	rc = ecryptfs_derive_iv(extent_iv, crypt_stat,
-				(extent_base + extent_offset));
+	rc = ecryptfs_crypt_pages(crypt_stat, &page, &enc_extent_page, 1, 1);
 	if (rc) {
-		ecryptfs_printk(KERN_ERR, "Error attempting to "
-				"derive IV for extent [0x%.16x]; "
-				"rc = [%d]\n", (extent_base + extent_offset),
-				rc);
+		printk(KERN_ERR "%s: Error encrypting page; "
+		       "rc = [%d]\n", __func__, rc);
 		goto out;
 	}
-	if (unlikely(ecryptfs_verbosity > 0)) {
-		ecryptfs_printk(KERN_DEBUG, "Decrypting extent "
-				"with iv:\n");
-		ecryptfs_dump_hex(extent_iv, crypt_stat->iv_bytes);
-		ecryptfs_printk(KERN_DEBUG, "First 8 bytes before "
-				"decryption:\n");
-		ecryptfs_dump_hex((char *)
-				  (page_address(enc_extent_page)
-				   + (extent_offset * crypt_stat->extent_size)),
-				  8);
-	}
-	rc = ecryptfs_decrypt_page_offset(crypt_stat, page,
-					  (extent_offset
-					   * crypt_stat->extent_size),
-					  enc_extent_page, 0,
-					  crypt_stat->extent_size, extent_iv);
-	if (rc < 0) {
-		printk(KERN_ERR "%s: Error attempting to decrypt to page with "
-		       "page->index = [%ld], extent_offset = [%ld]; "
-		       "rc = [%d]\n", __func__, page->index, extent_offset,
-		       rc);
+	ecryptfs_lower_offset_for_extent(
+		&offset, (((loff_t)page->index)
+			  * (PAGE_CACHE_SIZE / crypt_stat->extent_size)),
+		crypt_stat);
+	rc = ecryptfs_write_lower(ecryptfs_inode, enc_extent_virt, offset,
+				  PAGE_CACHE_SIZE);
+	if (rc) {
+		ecryptfs_printk(KERN_ERR, "Error attempting "
+				"to write lower page; rc = [%d]"
+				"\n", rc);
 		goto out;
 	}
-	rc = 0;
-	if (unlikely(ecryptfs_verbosity > 0)) {
-		ecryptfs_printk(KERN_DEBUG, "Decrypt extent [0x%.16x]; "
-				"rc = [%d]\n", (extent_base + extent_offset),
-				rc);
-		ecryptfs_printk(KERN_DEBUG, "First 8 bytes after "
-				"decryption:\n");
-		ecryptfs_dump_hex((char *)(page_address(page)
-					   + (extent_offset
-					      * crypt_stat->extent_size)), 8);
-	}
 out:
+	if (enc_extent_page) {
+		kunmap(enc_extent_page);
+		__free_page(enc_extent_page);
+	}
 	return rc;
 }
 
 /**
- * ecryptfs_decrypt_page
- * @page: Page mapped from the eCryptfs inode for the file; data read
- *        and decrypted from the lower file will be written into this
- *        page
+ * ecryptfs_decrypt_pages
+ * @pages: Pages mapped from the same eCryptfs inode; data read and
+ *         decrypted from the lower file will be written into them
+ * @nr_pages: Number of pages, at most ECRYPTFS_MAX_DECRYPT_PAGES
  *
- * Decrypt an eCryptfs page. This is done on a per-extent basis. Note
+ * Decrypt a batch of eCryptfs pages. The extents of each page are read
+ * from the lower file with a single call, and then the extents of all
+ * of the pages are handed to the cipher together. Note
  * that eCryptfs pages may straddle the lower pages -- for instance,
  * if the file was created on a machine with an 8K page size
  * (resulting in an 8K header), and then the file is copied onto a
@@ -606,173 +683,89 @@ out:
  * file, 24K of page 0 of the lower file will be read and decrypted,
  * and then 8K of page 1 of the lower file will be read and decrypted.
  *
- * Returns zero on success; negative on error
+ * Returns zero on success; negative on error, in which case none of
+ * the pages should be considered up to date
  */
-int ecryptfs_decrypt_page(struct page *page)
+int ecryptfs_decrypt_pages(struct page **pages, unsigned int nr_pages)
 {
 	struct inode *ecryptfs_inode;
 	struct ecryptfs_crypt_stat *crypt_stat;
-	char *enc_extent_virt;
-	struct page *enc_extent_page = NULL;
-	unsigned long extent_offset;
+	struct page *enc_extent_pages[ECRYPTFS_MAX_DECRYPT_PAGES];
+	unsigned int nr_allocated = 0;
+	loff_t offset;
+	unsigned int i;
 	int rc = 0;
 
-	ecryptfs_inode = page->mapping->host;
+	BUG_ON(nr_pages == 0 || nr_pages > ECRYPTFS_MAX_DECRYPT_PAGES);
+	ecryptfs_inode = pages[0]->mapping->host;
 	crypt_stat =
 		&(ecryptfs_inode_to_private(ecryptfs_inode)->crypt_stat);
 	if (!(crypt_stat->flags & ECRYPTFS_ENCRYPTED)) {
-		rc = ecryptfs_read_lower_page_segment(page, page->index, 0,
-						      PAGE_CACHE_SIZE,
-						      ecryptfs_inode);
-		if (rc)
-			printk(KERN_ERR "%s: Error attempting to copy "
-			       "page at index [%ld]\n", __func__,
-			       page->index);
-		goto out;
-	}
-	enc_extent_page = alloc_page(GFP_USER);
-	if (!enc_extent_page) {
-		rc = -ENOMEM;
-		ecryptfs_printk(KERN_ERR, "Error allocating memory for "
-				"encrypted extent\n");
+		for (i = 0; i < nr_pages; i++) {
+			rc = ecryptfs_read_lower_page_segment(
+				pages[i], pages[i]->index, 0, PAGE_CACHE_SIZE,
+				ecryptfs_inode);
+			if (rc) {
+				printk(KERN_ERR "%s: Error attempting to copy "
+				       "page at index [%ld]\n", __func__,
+				       pages[i]->index);
+				goto out;
+			}
+		}
 		goto out;
 	}
-	enc_extent_virt = kmap(enc_extent_page);
-	for (extent_offset = 0;
-	     extent_offset < (PAGE_CACHE_SIZE / crypt_stat->extent_size);
-	     extent_offset++) {
-		loff_t offset;
+	for (i = 0; i < nr_pages; i++) {
+		char *enc_extent_virt;
 
+		enc_extent_pages[i] = alloc_page(GFP_USER);
+		if (!enc_extent_pages[i]) {
+			rc = -ENOMEM;
+			ecryptfs_printk(KERN_ERR, "Error allocating memory "
+					"for encrypted extent\n");
+			goto out;
+		}
+		nr_allocated++;
 		ecryptfs_lower_offset_for_extent(
-			&offset, ((page->index * (PAGE_CACHE_SIZE
-						  / crypt_stat->extent_size))
-				  + extent_offset), crypt_stat);
+			&offset, (((loff_t)pages[i]->index)
+				  * (PAGE_CACHE_SIZE / crypt_stat->extent_size)),
+			crypt_stat);
+		enc_extent_virt = kmap(enc_extent_pages[i]);
 		rc = ecryptfs_read_lower(enc_extent_virt, offset,
-					 crypt_stat->extent_size,
-					 ecryptfs_inode);
+					 PAGE_CACHE_SIZE, ecryptfs_inode);
+		kunmap(enc_extent_pages[i]);
 		if (rc) {
 			ecryptfs_printk(KERN_ERR, "Error attempting "
 					"to read lower page; rc = [%d]"
 					"\n", rc);
 			goto out;
 		}
-		rc = ecryptfs_decrypt_extent(page, crypt_stat, enc_extent_page,
-					     extent_offset);
-		if (rc) {
-			printk(KERN_ERR "%s: Error encrypting extent; "
-			       "rc = [%d]\n", __func__, rc);
-			goto out;
-		}
-	}
-out:
-	if (enc_extent_page) {
-		kunmap(enc_extent_page);
-		__free_page(enc_extent_page);
-	}
-	return rc;
-}
-
-/**
- * decrypt_scatterlist
- * @crypt_stat: Cryptographic context
- * @dest_sg: The destination scatterlist to decrypt into
- * @src_sg: The source scatterlist to decrypt from
- * @size: The number of bytes to decrypt
- * @iv: The initialization vector to use for the decryption
- *
- * Returns the number of bytes decrypted; negative value on error
- */
-static int decrypt_scatterlist(struct ecryptfs_crypt_stat *crypt_stat,
-			       struct scatterlist *dest_sg,
-			       struct scatterlist *src_sg, int size,
-			       unsigned char *iv)
-{
-	struct blkcipher_desc desc = {
-		.tfm = crypt_stat->tfm,
-		.info = iv,
-		.flags = CRYPTO_TFM_REQ_MAY_SLEEP
-	};
-	int rc = 0;
-
-	/* Consider doing this once, when the file is opened */
-	mutex_lock(&crypt_stat->cs_tfm_mutex);
-	rc = crypto_blkcipher_setkey(crypt_stat->tfm, crypt_stat->key,
-				     crypt_stat->key_size);
-	if (rc) {
-		ecryptfs_printk(KERN_ERR, "Error setting key; rc = [%d]\n",
-				rc);
-		mutex_unlock(&crypt_stat->cs_tfm_mutex);
-		rc = -EINVAL;
-		goto out;
 	}
-	ecryptfs_printk(KERN_DEBUG, "Decrypting [%d] bytes.\n", size);
-	rc = crypto_blkcipher_decrypt_iv(&desc, dest_sg, src_sg, size);
-	mutex_unlock(&crypt_stat->cs_tfm_mutex);
+	rc = ecryptfs_crypt_pages(crypt_stat, pages, enc_extent_pages,
+				  nr_pages, 0);
 	if (rc) {
-		ecryptfs_printk(KERN_ERR, "Error decrypting; rc = [%d]\n",
-				rc);
+		printk(KERN_ERR "%s: Error decrypting page; "
+		       "rc = [%d]\n", __func__, rc);
 		goto out;
 	}
-	rc = size;
 out:
+	for (i = 0; i < nr_allocated; i++)
+		__free_page(enc_extent_pages[i]);
 	return rc;
 }
 
 /**
- * ecryptfs_encrypt_page_offset
- * @crypt_stat: The cryptographic context
- * @dst_page: The page to encrypt into
- * @dst_offset: The offset in the page to encrypt into
- * @src_page: The page to encrypt from
- * @src_offset: The offset in the page to encrypt from
- * @size: The number of bytes to encrypt
- * @iv: The initialization vector to use for the encryption
+ * ecryptfs_decrypt_page
+ * @page: Page mapped from the eCryptfs inode for the file; data read
+ *        and decrypted from the lower file will be written into this
+ *        page
  *
- * Returns the number of bytes encrypted
- */
-static int
-ecryptfs_encrypt_page_offset(struct ecryptfs_crypt_stat *crypt_stat,
-			     struct page *dst_page, int dst_offset,
-			     struct page *src_page, int src_offset, int size,
-			     unsigned char *iv)
-{
-	struct scatterlist src_sg, dst_sg;
-
-	sg_init_table(&src_sg, 1);
-	sg_init_table(&dst_sg, 1);
-
-	sg_set_page(&src_sg, src_page, size, src_offset);
-	sg_set_page(&dst_sg, dst_page, size, dst_offset);
-	return encrypt_scatterlist(crypt_stat, &dst_sg, &src_sg, size, iv);
-}
-
-/**
- * ecryptfs_decrypt_page_offset
- * @crypt_stat: The cryptographic context
- * @dst_page: The page to decrypt into
- * @dst_offset: The offset in the page to decrypt into
- * @src_page: The page to decrypt from
- * @src_offset: The offset in the page to decrypt from
- * @size: The number of bytes to decrypt
- * @iv: The initialization vector to use for the decryption
+ * Decrypt a single eCryptfs page; see ecryptfs_decrypt_pages().
  *
- * Returns the number of bytes decrypted
+ * Returns zero on success; negative on error
  */
-static int
-ecryptfs_decrypt_page_offset(struct ecryptfs_crypt_stat *crypt_stat,
-			     struct page *dst_page, int dst_offset,
-			     struct page *src_page, int src_offset, int size,
-			     unsigned char *iv)
+int ecryptfs_decrypt_page(struct page *page)
 {
-	struct scatterlist src_sg, dst_sg;
-
-	sg_init_table(&src_sg, 1);
-	sg_set_page(&src_sg, src_page, size, src_offset);
-
-	sg_init_table(&dst_sg, 1);
-	sg_set_page(&dst_sg, dst_page, size, dst_offset);
-
-	return decrypt_scatterlist(crypt_stat, &dst_sg, &src_sg, size, iv);
+	return ecryptfs_decrypt_pages(&page, 1);
 }
 
 #define ECRYPTFS_MAX_SCATTERLIST_LEN 4
@@ -809,17 +802,17 @@ int ecryptfs_init_crypt_ctx(struct ecryptfs_crypt_stat *crypt_stat)
 						    crypt_stat->cipher, "cbc");
 	if (rc)
 		goto out_unlock;
-	crypt_stat->tfm = crypto_alloc_blkcipher(full_alg_name, 0,
-						 CRYPTO_ALG_ASYNC);
+	crypt_stat->tfm = crypto_alloc_ablkcipher(full_alg_name, 0, 0);
 	kfree(full_alg_name);
 	if (IS_ERR(crypt_stat->tfm)) {
 		rc = PTR_ERR(crypt_stat->tfm);
+		crypt_stat->tfm = NULL;
 		ecryptfs_printk(KERN_ERR, "cryptfs: init_crypt_ctx(): "
 				"Error initializing cipher [%s]\n",
 				crypt_stat->cipher);
 		goto out_unlock;
 	}
-	crypto_blkcipher_set_flags(crypt_stat->tfm, CRYPTO_TFM_REQ_WEAK_KEY);
+	crypto_ablkcipher_set_flags(crypt_stat->tfm, CRYPTO_TFM_REQ_WEAK_KEY);
 	rc = 0;
 out_unlock:
 	mutex_unlock(&crypt_stat->cs_tfm_mutex);
@@ -893,6 +886,10 @@ out:
 		memset(crypt_stat->root_iv, 0, crypt_stat->iv_bytes);
 		crypt_stat->flags |= ECRYPTFS_SECURITY_WARNING;
 	}
+	/* IVs derived from the previous root IV are stale now */
+	mutex_lock(&crypt_stat->cs_hash_tfm_mutex);
+	crypt_stat->iv_schedule_size = 0;
+	mutex_unlock(&crypt_stat->cs_hash_tfm_mutex);
 	return rc;
 }
 
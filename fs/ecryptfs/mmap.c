@@ -246,6 +246,81 @@ out:
 	return rc;
 }
 
+/**
+ * ecryptfs_readpages_finish
+ * @pages: Locked pages, already in the page cache
+ * @nr_pages: Number of pages
+ *
+ * Decrypt a batch of readahead pages and hand them back unlocked.
+ */
+static void ecryptfs_readpages_finish(struct page **pages,
+				      unsigned int nr_pages)
+{
+	unsigned int i;
+	int rc;
+
+	rc = ecryptfs_decrypt_pages(pages, nr_pages);
+	if (rc)
+		ecryptfs_printk(KERN_ERR, "Error decrypting pages; "
+				"rc = [%d]\n", rc);
+	for (i = 0; i < nr_pages; i++) {
+		if (rc)
+			ClearPageUptodate(pages[i]);
+		else
+			SetPageUptodate(pages[i]);
+		unlock_page(pages[i]);
+		page_cache_release(pages[i]);
+	}
+}
+
+/**
+ * ecryptfs_readpages
+ * @file: An eCryptfs file
+ * @mapping: The eCryptfs inode mapping
+ * @pages: Readahead pages, not yet in the page cache
+ * @nr_pages: Number of pages on @pages
+ *
+ * Readahead of an encrypted file collects up to
+ * ECRYPTFS_MAX_DECRYPT_PAGES pages and submits all of their extents to
+ * the cipher in one go, rather than decrypting them one page at a
+ * time. Files that are not being decrypted take the readpage path.
+ *
+ * Returns zero on success; non-zero on error.
+ */
+static int ecryptfs_readpages(struct file *file, struct address_space *mapping,
+			      struct list_head *pages, unsigned nr_pages)
+{
+	struct ecryptfs_crypt_stat *crypt_stat =
+		&ecryptfs_inode_to_private(mapping->host)->crypt_stat;
+	struct page *batch[ECRYPTFS_MAX_DECRYPT_PAGES];
+	unsigned int nr_batch = 0;
+
+	if (!(crypt_stat->flags & ECRYPTFS_ENCRYPTED)
+	    || (crypt_stat->flags & (ECRYPTFS_NEW_FILE
+				     | ECRYPTFS_VIEW_AS_ENCRYPTED)))
+		return read_cache_pages(mapping, pages,
+					(int (*)(void *, struct page *))
+					ecryptfs_readpage, file);
+	while (!list_empty(pages)) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					  GFP_KERNEL)) {
+			page_cache_release(page);
+			continue;
+		}
+		batch[nr_batch++] = page;
+		if (nr_batch == ECRYPTFS_MAX_DECRYPT_PAGES) {
+			ecryptfs_readpages_finish(batch, nr_batch);
+			nr_batch = 0;
+		}
+	}
+	if (nr_batch)
+		ecryptfs_readpages_finish(batch, nr_batch);
+	return 0;
+}
+
 /**
  * Called with lower inode mutex held.
  */
@@ -537,6 +612,7 @@ static sector_t ecryptfs_bmap(struct address_space *mapping, sector_t block)
 struct address_space_operations ecryptfs_aops = {
 	.writepage = ecryptfs_writepage,
 	.readpage = ecryptfs_readpage,
+	.readpages = ecryptfs_readpages,
 	.write_begin = ecryptfs_write_begin,
 	.write_end = ecryptfs_write_end,
 	.bmap = ecryptfs_bmap,
@@ -16,8 +16,10 @@
 #include <linux/anon_inodes.h>
 #include <linux/eventfd.h>
 #include <linux/syscalls.h>
+#include <linux/kref.h>
 
 struct eventfd_ctx {
+	struct kref kref;
 	wait_queue_head_t wqh;
 	/*
 	 * Every time that a write(2) is performed on an eventfd, the
@@ -38,9 +40,8 @@ struct eventfd_ctx {
  * to reach the ULLONG_MAX value, and we signal this as overflow
  * condition by returining a POLLERR to poll(2).
  */
-int eventfd_signal(struct file *file, int n)
+int eventfd_ctx_signal(struct eventfd_ctx *ctx, int n)
 {
-	struct eventfd_ctx *ctx = file->private_data;
 	unsigned long flags;
 
 	if (n < 0)
@@ -56,9 +57,35 @@ int eventfd_signal(struct file *file, int n)
 	return n;
 }
 
+int eventfd_signal(struct file *file, int n)
+{
+	return eventfd_ctx_signal(file->private_data, n);
+}
+
+static void eventfd_free(struct kref *kref)
+{
+	kfree(container_of(kref, struct eventfd_ctx, kref));
+}
+
+/**
+ * eventfd_ctx_put - release a reference to the internal eventfd context
+ * @ctx: [in] Pointer to eventfd context.
+ */
+void eventfd_ctx_put(struct eventfd_ctx *ctx)
+{
+	kref_put(&ctx->kref, eventfd_free);
+}
+
+/*
+ * Kernel users holding a context reference see a POLLHUP wakeup when the
+ * last file reference goes away, and can drop their reference then.
+ */
 static int eventfd_release(struct inode *inode, struct file *file)
 {
-	kfree(file->private_data);
+	struct eventfd_ctx *ctx = file->private_data;
+
+	__wake_up(&ctx->wqh, TASK_NORMAL, 0, (void *)POLLHUP);
+	eventfd_ctx_put(ctx);
 	return 0;
 }
 
@@ -198,6 +225,22 @@ struct file *eventfd_fget(int fd)
 	return file;
 }
 
+/**
+ * eventfd_ctx_fileget - acquire a reference to the internal eventfd context
+ * @file: [in] Eventfd file pointer, from eventfd_fget().
+ *
+ * The context stays valid after the file is released, so that a kernel
+ * user need not pin the file itself.  Waiters queued on it through the
+ * file's poll method get a POLLHUP wakeup at that point.
+ */
+struct eventfd_ctx *eventfd_ctx_fileget(struct file *file)
+{
+	struct eventfd_ctx *ctx = file->private_data;
+
+	kref_get(&ctx->kref);
+	return ctx;
+}
+
 SYSCALL_DEFINE2(eventfd2, unsigned int, count, int, flags)
 {
 	int fd;
@@ -214,6 +257,7 @@ SYSCALL_DEFINE2(eventfd2, unsigned int, count, int, flags)
 	if (!ctx)
 		return -ENOMEM;
 
+	kref_init(&ctx->kref);
 	init_waitqueue_head(&ctx->wqh);
 	ctx->count = count;
 
@@ -224,7 +268,7 @@ SYSCALL_DEFINE2(eventfd2, unsigned int, count, int, flags)
 	fd = anon_inode_getfd("[eventfd]", &eventfd_fops, ctx,
 			      flags & (O_CLOEXEC | O_NONBLOCK));
 	if (fd < 0)
-		kfree(ctx);
+		eventfd_ctx_put(ctx);
 	return fd;
 }
 
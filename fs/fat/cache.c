@@ -10,13 +10,25 @@
 
 #include <linux/fs.h>
 #include <linux/buffer_head.h>
+#include <linux/rbtree.h>
 #include "fat.h"
 
+/*
+ * Each inode keeps the contiguous runs of its cluster chain seen so far
+ * in an rbtree keyed by file cluster, so once the chain has been walked
+ * any offset maps in O(log extents).  The extents are also on a per-inode
+ * LRU; inodes with more than FAT_MAX_CACHE extents are on a global list,
+ * and the shrinker trims them back to that from the LRU end.
+ */
+
 /* this must be > 0. */
-#define FAT_MAX_CACHE	8
+#define FAT_MAX_CACHE		8
+/* sanity limit of extents per inode, the shrinker is the real bound */
+#define FAT_MAX_CACHE_EXTENTS	(1 << 16)
 
 struct fat_cache {
 	struct list_head cache_list;
+	struct rb_node rb_node;
 	int nr_contig;	/* number of contiguous clusters */
 	int fcluster;	/* cluster number in the file. */
 	int dcluster;	/* cluster number on disk. */
@@ -31,11 +43,16 @@ struct fat_cache_id {
 
 static inline int fat_max_cache(struct inode *inode)
 {
-	return FAT_MAX_CACHE;
+	return FAT_MAX_CACHE_EXTENTS;
 }
 
 static struct kmem_cache *fat_cache_cachep;
 
+/* inodes which have more than FAT_MAX_CACHE extents, for the shrinker */
+static LIST_HEAD(fat_cache_inodes);
+static DEFINE_SPINLOCK(fat_cache_inodes_lock);
+static atomic_t fat_cache_nr = ATOMIC_INIT(0);
+
 static void init_once(void *foo)
 {
 	struct fat_cache *cache = (struct fat_cache *)foo;
@@ -43,6 +60,13 @@ static void init_once(void *foo)
 	INIT_LIST_HEAD(&cache->cache_list);
 }
 
+static int fat_cache_shrink(int nr_to_scan, gfp_t gfp_mask);
+
+static struct shrinker fat_cache_shrinker = {
+	.shrink = fat_cache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
 int __init fat_cache_init(void)
 {
 	fat_cache_cachep = kmem_cache_create("fat_cache",
@@ -51,11 +75,13 @@ int __init fat_cache_init(void)
 				init_once);
 	if (fat_cache_cachep == NULL)
 		return -ENOMEM;
+	register_shrinker(&fat_cache_shrinker);
 	return 0;
 }
 
 void fat_cache_destroy(void)
 {
+	unregister_shrinker(&fat_cache_shrinker);
 	kmem_cache_destroy(fat_cache_cachep);
 }
 
@@ -77,29 +103,69 @@ static inline void fat_cache_update_lru(struct inode *inode,
 		list_move(&cache->cache_list, &MSDOS_I(inode)->cache_lru);
 }
 
+/* Returns the cache which has the largest fcluster <= fclus, or NULL. */
+static struct fat_cache *fat_cache_find(struct inode *inode, int fclus)
+{
+	struct rb_node *n = MSDOS_I(inode)->cache_tree.rb_node;
+	struct fat_cache *p, *hit = NULL;
+
+	while (n) {
+		p = rb_entry(n, struct fat_cache, rb_node);
+		if (fclus < p->fcluster)
+			n = n->rb_left;
+		else {
+			hit = p;
+			if (fclus == p->fcluster)
+				break;
+			n = n->rb_right;
+		}
+	}
+	return hit;
+}
+
+static void fat_cache_insert(struct inode *inode, struct fat_cache *cache)
+{
+	struct rb_node **p = &MSDOS_I(inode)->cache_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct fat_cache *tmp;
+
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct fat_cache, rb_node);
+		if (cache->fcluster < tmp->fcluster)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&cache->rb_node, parent, p);
+	rb_insert_color(&cache->rb_node, &MSDOS_I(inode)->cache_tree);
+}
+
+/* Unlink a cache from the inode, the caller frees it. */
+static void fat_cache_remove(struct inode *inode, struct fat_cache *cache)
+{
+	rb_erase(&cache->rb_node, &MSDOS_I(inode)->cache_tree);
+	list_del_init(&cache->cache_list);
+	MSDOS_I(inode)->nr_caches--;
+	atomic_dec(&fat_cache_nr);
+}
+
 static int fat_cache_lookup(struct inode *inode, int fclus,
 			    struct fat_cache_id *cid,
 			    int *cached_fclus, int *cached_dclus)
 {
-	static struct fat_cache nohit = { .fcluster = 0, };
-
-	struct fat_cache *hit = &nohit, *p;
+	struct fat_cache *hit;
 	int offset = -1;
 
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
-			hit = p;
-			if ((hit->fcluster + hit->nr_contig) < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
-				break;
-			}
-		}
-	}
-	if (hit != &nohit) {
+	/* Find the cache of "fclus" or nearest cache. */
+	hit = fat_cache_find(inode, fclus);
+	if (hit && hit->fcluster > 0) {
+		if ((hit->fcluster + hit->nr_contig) < fclus)
+			offset = hit->nr_contig;
+		else
+			offset = fclus - hit->fcluster;
+
 		fat_cache_update_lru(inode, hit);
 
 		cid->id = MSDOS_I(inode)->cache_valid_id;
@@ -119,57 +185,73 @@ static struct fat_cache *fat_cache_merge(struct inode *inode,
 {
 	struct fat_cache *p;
 
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
-			BUG_ON(p->dcluster != new->dcluster);
-			if (new->nr_contig > p->nr_contig)
-				p->nr_contig = new->nr_contig;
-			return p;
-		}
+	/* Find the same part as "new" in cluster-chain. */
+	p = fat_cache_find(inode, new->fcluster);
+	if (p && p->fcluster == new->fcluster) {
+		BUG_ON(p->dcluster != new->dcluster);
+		if (new->nr_contig > p->nr_contig)
+			p->nr_contig = new->nr_contig;
+		return p;
 	}
 	return NULL;
 }
 
 static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 {
+	struct msdos_inode_info *i = MSDOS_I(inode);
 	struct fat_cache *cache, *tmp;
+	int over = 0;
 
 	if (new->fcluster == -1) /* dummy cache */
 		return;
 
-	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
+	spin_lock(&i->cache_lru_lock);
 	if (new->id != FAT_CACHE_VALID &&
-	    new->id != MSDOS_I(inode)->cache_valid_id)
+	    new->id != i->cache_valid_id)
 		goto out;	/* this cache was invalidated */
 
 	cache = fat_cache_merge(inode, new);
 	if (cache == NULL) {
-		if (MSDOS_I(inode)->nr_caches < fat_max_cache(inode)) {
-			MSDOS_I(inode)->nr_caches++;
-			spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
-
+		tmp = NULL;
+		if (i->nr_caches < fat_max_cache(inode)) {
+			spin_unlock(&i->cache_lru_lock);
 			tmp = fat_cache_alloc(inode);
-			spin_lock(&MSDOS_I(inode)->cache_lru_lock);
+			spin_lock(&i->cache_lru_lock);
 			cache = fat_cache_merge(inode, new);
 			if (cache != NULL) {
-				MSDOS_I(inode)->nr_caches--;
-				fat_cache_free(tmp);
+				if (tmp)
+					fat_cache_free(tmp);
 				goto out_update_lru;
 			}
+		}
+		if (tmp) {
+			i->nr_caches++;
+			over = i->nr_caches > FAT_MAX_CACHE;
+			atomic_inc(&fat_cache_nr);
 			cache = tmp;
-		} else {
-			struct list_head *p = MSDOS_I(inode)->cache_lru.prev;
+		} else if (!list_empty(&i->cache_lru)) {
+			/* recycle the least recently used extent */
+			struct list_head *p = i->cache_lru.prev;
 			cache = list_entry(p, struct fat_cache, cache_list);
-		}
+			rb_erase(&cache->rb_node, &i->cache_tree);
+		} else
+			goto out;
 		cache->fcluster = new->fcluster;
 		cache->dcluster = new->dcluster;
 		cache->nr_contig = new->nr_contig;
+		fat_cache_insert(inode, cache);
 	}
 out_update_lru:
 	fat_cache_update_lru(inode, cache);
 out:
-	spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
+	spin_unlock(&i->cache_lru_lock);
+
+	if (over && list_empty(&i->cache_inode_list)) {
+		spin_lock(&fat_cache_inodes_lock);
+		if (list_empty(&i->cache_inode_list))
+			list_add_tail(&i->cache_inode_list, &fat_cache_inodes);
+		spin_unlock(&fat_cache_inodes_lock);
+	}
 }
 
 /*
@@ -183,8 +265,7 @@ static void __fat_cache_inval_inode(struct inode *inode)
 
 	while (!list_empty(&i->cache_lru)) {
 		cache = list_entry(i->cache_lru.next, struct fat_cache, cache_list);
-		list_del_init(&cache->cache_list);
-		i->nr_caches--;
+		fat_cache_remove(inode, cache);
 		fat_cache_free(cache);
 	}
 	/* Update. The copy of caches before this id is discarded. */
@@ -195,9 +276,58 @@ static void __fat_cache_inval_inode(struct inode *inode)
 
 void fat_cache_inval_inode(struct inode *inode)
 {
-	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
+	struct msdos_inode_info *i = MSDOS_I(inode);
+
+	spin_lock(&i->cache_lru_lock);
 	__fat_cache_inval_inode(inode);
-	spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
+	spin_unlock(&i->cache_lru_lock);
+
+	if (!list_empty(&i->cache_inode_list)) {
+		spin_lock(&fat_cache_inodes_lock);
+		list_del_init(&i->cache_inode_list);
+		spin_unlock(&fat_cache_inodes_lock);
+	}
+}
+
+/*
+ * Trim inodes down to FAT_MAX_CACHE extents each, which is what the cache
+ * used to be limited to and is enough for sequential access.
+ */
+static int fat_cache_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct msdos_inode_info *i, *next;
+	struct fat_cache *cache;
+	LIST_HEAD(dispose);
+
+	if (nr_to_scan) {
+		spin_lock(&fat_cache_inodes_lock);
+		list_for_each_entry_safe(i, next, &fat_cache_inodes,
+					 cache_inode_list) {
+			if (!nr_to_scan)
+				break;
+
+			spin_lock(&i->cache_lru_lock);
+			while (i->nr_caches > FAT_MAX_CACHE && nr_to_scan) {
+				cache = list_entry(i->cache_lru.prev,
+						   struct fat_cache, cache_list);
+				fat_cache_remove(&i->vfs_inode, cache);
+				list_add(&cache->cache_list, &dispose);
+				nr_to_scan--;
+			}
+			if (i->nr_caches <= FAT_MAX_CACHE)
+				list_del_init(&i->cache_inode_list);
+			spin_unlock(&i->cache_lru_lock);
+		}
+		spin_unlock(&fat_cache_inodes_lock);
+
+		while (!list_empty(&dispose)) {
+			cache = list_entry(dispose.next, struct fat_cache,
+					   cache_list);
+			list_del_init(&cache->cache_list);
+			fat_cache_free(cache);
+		}
+	}
+	return (atomic_read(&fat_cache_nr) / 100) * sysctl_vfs_cache_pressure;
 }
 
 static inline int cache_contiguous(struct fat_cache_id *cid, int dclus)
@@ -263,8 +393,12 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 		}
 		(*fclus)++;
 		*dclus = nr;
-		if (!cache_contiguous(&cid, *dclus))
+		if (!cache_contiguous(&cid, *dclus)) {
+			/* remember the finished extent before the next one */
+			cid.nr_contig--;
+			fat_cache_add(inode, &cid);
 			cache_init(&cid, *fclus, *dclus);
+		}
 	}
 	nr = 0;
 	fat_cache_add(inode, &cid);
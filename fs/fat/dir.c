@@ -19,6 +19,7 @@
 #include <linux/smp_lock.h>
 #include <linux/buffer_head.h>
 #include <linux/compat.h>
+#include <linux/hash.h>
 #include <asm/uaccess.h>
 #include "fat.h"
 
@@ -337,6 +338,590 @@ parse_long:
 #define FAT_MAX_UNI_CHARS	((MSDOS_SLOTS - 1) * 13 + 1)
 #define FAT_MAX_UNI_SIZE	(FAT_MAX_UNI_CHARS * sizeof(wchar_t))
 
+/*
+ * Advance to the next directory record, i.e. the long name slots if any
+ * and the shortname entry *de.  The long name is decoded into *unicode,
+ * and *nr_slots is the number of its slots.
+ * Returns 0 on success, -ENOENT at the end of directory (*bh is NULL
+ * then), or other negative error.
+ */
+static int fat_next_record(struct inode *dir, loff_t *cpos,
+			   struct buffer_head **bh,
+			   struct msdos_dir_entry **de,
+			   wchar_t **unicode, unsigned char *nr_slots)
+{
+	if (fat_get_entry(dir, cpos, bh, de) == -1)
+		return -ENOENT;
+	while (1) {
+		*nr_slots = 0;
+		if ((*de)->name[0] == DELETED_FLAG)
+			goto next;
+		if ((*de)->attr != ATTR_EXT && ((*de)->attr & ATTR_VOLUME))
+			goto next;
+		if ((*de)->attr != ATTR_EXT && IS_FREE((*de)->name))
+			goto next;
+		if ((*de)->attr == ATTR_EXT) {
+			int status = fat_parse_long(dir, cpos, bh, de,
+						    unicode, nr_slots);
+			if (status < 0) {
+				/* fat_parse_long() released the buffer */
+				*bh = NULL;
+				return status;
+			} else if (status == PARSE_INVALID)
+				goto next;
+			else if (status == PARSE_NOT_LONGNAME)
+				continue;
+			else if (status == PARSE_EOF)
+				return -ENOENT;
+		}
+		return 0;
+next:
+		if (fat_get_entry(dir, cpos, bh, de) == -1)
+			return -ENOENT;
+	}
+}
+
+/*
+ * Convert the shortname of "de" to the I/O charset the same way it is
+ * displayed.  Returns the length, or 0 if the shortname is empty.
+ */
+static int fat_shortname_x8(struct msdos_sb_info *sbi,
+			    struct msdos_dir_entry *de, unsigned char *bufname)
+{
+	struct nls_table *nls_disk = sbi->nls_disk;
+	unsigned short opt_shortname = sbi->options.shortname;
+	wchar_t bufuname[14];
+	unsigned char work[MSDOS_NAME];
+	int chl, i, j, last_u;
+
+	memcpy(work, de->name, sizeof(de->name));
+	/* see namei.c, msdos_format_name */
+	if (work[0] == 0x05)
+		work[0] = 0xE5;
+	for (i = 0, j = 0, last_u = 0; i < 8;) {
+		if (!work[i])
+			break;
+		chl = fat_shortname2uni(nls_disk, &work[i], 8 - i,
+					&bufuname[j++], opt_shortname,
+					de->lcase & CASE_LOWER_BASE);
+		if (chl <= 1) {
+			if (work[i] != ' ')
+				last_u = j;
+		} else {
+			last_u = j;
+		}
+		i += chl;
+	}
+	j = last_u;
+	fat_short2uni(nls_disk, ".", 1, &bufuname[j++]);
+	for (i = 8; i < MSDOS_NAME;) {
+		if (!work[i])
+			break;
+		chl = fat_shortname2uni(nls_disk, &work[i],
+					MSDOS_NAME - i,
+					&bufuname[j++], opt_shortname,
+					de->lcase & CASE_LOWER_EXT);
+		if (chl <= 1) {
+			if (work[i] != ' ')
+				last_u = j;
+		} else {
+			last_u = j;
+		}
+		i += chl;
+	}
+	if (!last_u)
+		return 0;
+
+	bufuname[last_u] = 0x0000;
+	return fat_uni_to_x8(sbi, bufuname, bufname, FAT_MAX_SHORT_SIZE);
+}
+
+/* Convert the long name decoded by fat_parse_long() to the I/O charset */
+static inline int fat_longname_x8(struct msdos_sb_info *sbi, wchar_t *unicode,
+				  unsigned char **longname)
+{
+	*longname = (unsigned char *)(unicode + FAT_MAX_UNI_CHARS);
+	return fat_uni_to_x8(sbi, unicode, *longname,
+			     PATH_MAX - FAT_MAX_UNI_SIZE);
+}
+
+/*
+ * In-memory name index of vfat directories.
+ *
+ * Each directory record is hashed by its long name, its displayed
+ * shortname (both as fat_search_long() compares them) and its raw 8.3
+ * name (as fat_scan() compares it).  The index is built by one scan of
+ * the directory on the first lookup, and kept in sync by
+ * fat_add_entries() and fat_remove_entries().  All of this runs under
+ * lock_super(), like the directory updates themselves.
+ *
+ * The indexes are on a global LRU, and the shrinker drops whole indexes
+ * from its cold end; their directories go back to scanning until the
+ * next lookup builds the index again.  ->i_dindex is only set and
+ * cleared under fat_dindex_lock.
+ */
+enum { FAT_DINDEX_LONG, FAT_DINDEX_SHORT, FAT_DINDEX_RAW, FAT_DINDEX_KEYS };
+
+#define FAT_DINDEX_MIN_BITS	5
+#define FAT_DINDEX_MAX_BITS	12
+
+struct fat_dindex_key {
+	struct hlist_node node;
+	unsigned int hash;
+};
+
+struct fat_dindex_ent {
+	struct list_head list;
+	struct fat_dindex_key keys[FAT_DINDEX_KEYS];
+	loff_t de_off;			/* position of the shortname entry */
+	unsigned char nr_slots;		/* including the shortname entry */
+	unsigned char name[MSDOS_NAME];	/* raw 8.3 name */
+};
+
+struct fat_dindex {
+	struct list_head ents;
+	struct list_head lru;		/* on fat_dindex_lru */
+	struct inode *dir;
+	unsigned int count;
+	unsigned int bits;
+	loff_t free_hint;		/* no free entries before this */
+	struct hlist_head *hash;	/* FAT_DINDEX_KEYS << bits heads */
+};
+
+static LIST_HEAD(fat_dindex_lru);
+static DEFINE_SPINLOCK(fat_dindex_lock);
+static atomic_t fat_dindex_nr = ATOMIC_INIT(0);	/* entries of all indexes */
+
+static inline struct hlist_head *fat_dindex_head(struct fat_dindex *idx,
+						 int kind, unsigned int hash)
+{
+	return &idx->hash[(kind << idx->bits) + hash_32(hash, idx->bits)];
+}
+
+static inline struct fat_dindex_ent *fat_dindex_key_ent(
+	struct fat_dindex_key *key, int kind)
+{
+	return container_of(key - kind, struct fat_dindex_ent, keys[0]);
+}
+
+/* Must agree with fat_name_match() */
+static unsigned int fat_dindex_hash(struct msdos_sb_info *sbi,
+				    const unsigned char *name, int len)
+{
+	unsigned long hash = init_name_hash();
+
+	if (sbi->options.name_check != 's') {
+		while (len--)
+			hash = partial_name_hash(nls_tolower(sbi->nls_io,
+							     *name++), hash);
+	} else {
+		while (len--)
+			hash = partial_name_hash(*name++, hash);
+	}
+	return end_name_hash(hash);
+}
+
+static void fat_dindex_hash_ent(struct fat_dindex *idx,
+				struct fat_dindex_ent *ent)
+{
+	int kind;
+
+	for (kind = 0; kind < FAT_DINDEX_KEYS; kind++) {
+		struct fat_dindex_key *key = &ent->keys[kind];
+		/* no long name, or no displayable shortname */
+		if (kind != FAT_DINDEX_RAW && key->hash == 0)
+			continue;
+		hlist_add_head(&key->node,
+			       fat_dindex_head(idx, kind, key->hash));
+	}
+}
+
+static int fat_dindex_resize(struct fat_dindex *idx, unsigned int bits)
+{
+	struct hlist_head *hash;
+	struct fat_dindex_ent *ent;
+	int i;
+
+	hash = kmalloc((sizeof(*hash) * FAT_DINDEX_KEYS) << bits, GFP_NOFS);
+	if (!hash)
+		return -ENOMEM;
+	for (i = 0; i < (FAT_DINDEX_KEYS << bits); i++)
+		INIT_HLIST_HEAD(&hash[i]);
+
+	kfree(idx->hash);
+	idx->hash = hash;
+	idx->bits = bits;
+	list_for_each_entry(ent, &idx->ents, list)
+		fat_dindex_hash_ent(idx, ent);
+	return 0;
+}
+
+static void fat_dindex_destroy(struct fat_dindex *idx)
+{
+	struct fat_dindex_ent *ent, *tmp;
+
+	list_for_each_entry_safe(ent, tmp, &idx->ents, list)
+		kfree(ent);
+	atomic_sub(idx->count, &fat_dindex_nr);
+	kfree(idx->hash);
+	kfree(idx);
+}
+
+void fat_dindex_free(struct inode *dir)
+{
+	struct fat_dindex *idx;
+
+	spin_lock(&fat_dindex_lock);
+	idx = MSDOS_I(dir)->i_dindex;
+	if (idx) {
+		MSDOS_I(dir)->i_dindex = NULL;
+		list_del(&idx->lru);
+	}
+	spin_unlock(&fat_dindex_lock);
+
+	if (idx)
+		fat_dindex_destroy(idx);
+}
+
+/*
+ * Drop the least recently used indexes.  Their users all hold
+ * lock_super(), so an index whose super block lock can't be had right
+ * now is skipped.
+ */
+static int fat_dindex_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct fat_dindex *idx, *next;
+	struct super_block *sb;
+	LIST_HEAD(dispose);
+
+	if (nr_to_scan) {
+		spin_lock(&fat_dindex_lock);
+		list_for_each_entry_safe(idx, next, &fat_dindex_lru, lru) {
+			if (nr_to_scan <= 0)
+				break;
+
+			sb = idx->dir->i_sb;
+			if (!mutex_trylock(&sb->s_lock))
+				continue;
+			MSDOS_I(idx->dir)->i_dindex = NULL;
+			list_move(&idx->lru, &dispose);
+			mutex_unlock(&sb->s_lock);
+			nr_to_scan -= idx->count;
+		}
+		spin_unlock(&fat_dindex_lock);
+
+		list_for_each_entry_safe(idx, next, &dispose, lru)
+			fat_dindex_destroy(idx);
+	}
+	return (atomic_read(&fat_dindex_nr) / 100) * sysctl_vfs_cache_pressure;
+}
+
+static struct shrinker fat_dindex_shrinker = {
+	.shrink = fat_dindex_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+void __init fat_dindex_init(void)
+{
+	register_shrinker(&fat_dindex_shrinker);
+}
+
+void fat_dindex_exit(void)
+{
+	unregister_shrinker(&fat_dindex_shrinker);
+}
+
+/* Add the record whose shortname entry is "de" at position de_off. */
+static int fat_dindex_insert(struct inode *dir, struct fat_dindex *idx,
+			     loff_t de_off, struct msdos_dir_entry *de,
+			     wchar_t *unicode, unsigned char nr_slots)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(dir->i_sb);
+	unsigned char bufname[FAT_MAX_SHORT_SIZE], *longname;
+	struct fat_dindex_ent *ent;
+	int kind, len;
+
+	if (idx->count >= (2U << idx->bits) && idx->bits < FAT_DINDEX_MAX_BITS)
+		fat_dindex_resize(idx, idx->bits + 1);
+
+	ent = kmalloc(sizeof(*ent), GFP_NOFS);
+	if (!ent)
+		return -ENOMEM;
+	ent->de_off = de_off;
+	ent->nr_slots = nr_slots + 1;
+	memcpy(ent->name, de->name, MSDOS_NAME);
+
+	for (kind = 0; kind < FAT_DINDEX_KEYS; kind++)
+		INIT_HLIST_NODE(&ent->keys[kind].node);
+	ent->keys[FAT_DINDEX_LONG].hash = 0;
+	ent->keys[FAT_DINDEX_SHORT].hash = 0;
+	ent->keys[FAT_DINDEX_RAW].hash = full_name_hash(de->name, MSDOS_NAME);
+	len = fat_shortname_x8(sbi, de, bufname);
+	if (len) {
+		/* 0 means "no key", so keep real hashes away from it */
+		ent->keys[FAT_DINDEX_SHORT].hash =
+			fat_dindex_hash(sbi, bufname, len) | 1;
+		if (nr_slots) {
+			len = fat_longname_x8(sbi, unicode, &longname);
+			ent->keys[FAT_DINDEX_LONG].hash =
+				fat_dindex_hash(sbi, longname, len) | 1;
+		}
+	}
+
+	list_add_tail(&ent->list, &idx->ents);
+	idx->count++;
+	atomic_inc(&fat_dindex_nr);
+	fat_dindex_hash_ent(idx, ent);
+	return 0;
+}
+
+static int fat_dindex_build(struct inode *dir)
+{
+	struct fat_dindex *idx;
+	struct buffer_head *bh = NULL;
+	struct msdos_dir_entry *de;
+	wchar_t *unicode = NULL;
+	unsigned char nr_slots;
+	loff_t cpos = 0;
+	int err;
+
+	idx = kmalloc(sizeof(*idx), GFP_NOFS);
+	if (!idx)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&idx->ents);
+	idx->dir = dir;
+	idx->count = 0;
+	idx->free_hint = 0;
+	idx->hash = NULL;
+	err = fat_dindex_resize(idx, FAT_DINDEX_MIN_BITS);
+	if (err)
+		goto error;
+
+	while (!(err = fat_next_record(dir, &cpos, &bh, &de, &unicode,
+				       &nr_slots))) {
+		err = fat_dindex_insert(dir, idx, cpos - sizeof(*de), de,
+					unicode, nr_slots);
+		if (err) {
+			brelse(bh);
+			break;
+		}
+	}
+	if (unicode)
+		__putname(unicode);
+	if (err != -ENOENT)
+		goto error;
+
+	spin_lock(&fat_dindex_lock);
+	MSDOS_I(dir)->i_dindex = idx;
+	list_add_tail(&idx->lru, &fat_dindex_lru);
+	spin_unlock(&fat_dindex_lock);
+	return 0;
+
+error:
+	fat_dindex_destroy(idx);
+	return err;
+}
+
+/*
+ * Re-read the record of an index entry.  A record which isn't where the
+ * index says means the index is out of sync; -ESTALE tells the caller to
+ * drop it and scan.
+ */
+static int fat_dindex_read(struct inode *dir, struct fat_dindex_ent *ent,
+			   loff_t *cpos, struct buffer_head **bh,
+			   struct msdos_dir_entry **de, wchar_t **unicode,
+			   unsigned char *nr_slots)
+{
+	int err;
+
+	*cpos = ent->de_off - (ent->nr_slots - 1) * sizeof(**de);
+	*bh = NULL;
+	err = fat_next_record(dir, cpos, bh, de, unicode, nr_slots);
+	if (err == -ENOENT)
+		return -ESTALE;
+	if (err)
+		return err;
+	if (*cpos - sizeof(**de) != ent->de_off ||
+	    *nr_slots + 1 != ent->nr_slots ||
+	    memcmp((*de)->name, ent->name, MSDOS_NAME)) {
+		brelse(*bh);
+		return -ESTALE;
+	}
+	return 0;
+}
+
+static int fat_dindex_search_long(struct inode *dir, const unsigned char *name,
+				  int name_len, struct fat_slot_info *sinfo)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(dir->i_sb);
+	struct fat_dindex *idx = MSDOS_I(dir)->i_dindex;
+	struct fat_dindex_key *key;
+	struct hlist_node *pos;
+	struct buffer_head *bh;
+	struct msdos_dir_entry *de;
+	wchar_t *unicode = NULL;
+	unsigned char bufname[FAT_MAX_SHORT_SIZE], *longname;
+	unsigned char nr_slots;
+	unsigned int hash;
+	loff_t cpos;
+	int kind, len, err = -ENOENT;
+
+	hash = fat_dindex_hash(sbi, name, name_len) | 1;
+	for (kind = FAT_DINDEX_LONG; kind <= FAT_DINDEX_SHORT; kind++) {
+		hlist_for_each_entry(key, pos, fat_dindex_head(idx, kind, hash),
+				     node) {
+			if (key->hash != hash)
+				continue;
+			err = fat_dindex_read(dir, fat_dindex_key_ent(key, kind),
+					      &cpos, &bh, &de, &unicode,
+					      &nr_slots);
+			if (err)
+				goto out;
+
+			if (kind == FAT_DINDEX_SHORT) {
+				len = fat_shortname_x8(sbi, de, bufname);
+				longname = bufname;
+			} else
+				len = fat_longname_x8(sbi, unicode, &longname);
+			if (fat_name_match(sbi, name, name_len, longname, len))
+				goto found;
+			brelse(bh);
+			err = -ENOENT;
+		}
+	}
+	goto out;
+
+found:
+	nr_slots++;	/* include the de */
+	sinfo->slot_off = cpos - nr_slots * sizeof(*de);
+	sinfo->nr_slots = nr_slots;
+	sinfo->de = de;
+	sinfo->bh = bh;
+	sinfo->i_pos = fat_make_i_pos(dir->i_sb, sinfo->bh, sinfo->de);
+	err = 0;
+out:
+	if (unicode)
+		__putname(unicode);
+	return err;
+}
+
+static int fat_dindex_scan(struct inode *dir, const unsigned char *name,
+			   struct fat_slot_info *sinfo)
+{
+	struct fat_dindex *idx = MSDOS_I(dir)->i_dindex;
+	struct fat_dindex_key *key;
+	struct fat_dindex_ent *ent;
+	struct hlist_node *pos;
+	unsigned int hash;
+
+	hash = full_name_hash(name, MSDOS_NAME);
+	hlist_for_each_entry(key, pos,
+			     fat_dindex_head(idx, FAT_DINDEX_RAW, hash), node) {
+		ent = fat_dindex_key_ent(key, FAT_DINDEX_RAW);
+		if (key->hash != hash || memcmp(ent->name, name, MSDOS_NAME))
+			continue;
+
+		sinfo->slot_off = ent->de_off;
+		sinfo->bh = NULL;
+		if (fat_get_entry(dir, &sinfo->slot_off, &sinfo->bh,
+				  &sinfo->de) < 0)
+			return -ESTALE;
+		if (strncmp(sinfo->de->name, name, MSDOS_NAME)) {
+			brelse(sinfo->bh);
+			return -ESTALE;
+		}
+		sinfo->slot_off -= sizeof(*sinfo->de);
+		sinfo->nr_slots = 1;
+		sinfo->i_pos = fat_make_i_pos(dir->i_sb, sinfo->bh, sinfo->de);
+		return 0;
+	}
+	return -ENOENT;
+}
+
+/* Only vfat directories are indexed. */
+static int fat_dindex_get(struct inode *dir)
+{
+	struct fat_dindex *idx = MSDOS_I(dir)->i_dindex;
+
+	if (idx) {
+		spin_lock(&fat_dindex_lock);
+		list_move_tail(&idx->lru, &fat_dindex_lru);
+		spin_unlock(&fat_dindex_lock);
+		return 1;
+	}
+	if (!MSDOS_SB(dir->i_sb)->options.isvfat)
+		return 0;
+	return !fat_dindex_build(dir);
+}
+
+/* The record at sinfo was just written, add it to the index. */
+static void fat_dindex_add(struct inode *dir, struct fat_slot_info *sinfo)
+{
+	struct fat_dindex *idx = MSDOS_I(dir)->i_dindex;
+	struct buffer_head *bh = NULL;
+	struct msdos_dir_entry *de;
+	wchar_t *unicode = NULL;
+	unsigned char nr_slots;
+	loff_t cpos = sinfo->slot_off;
+	int err;
+
+	if (!idx)
+		return;
+
+	err = fat_next_record(dir, &cpos, &bh, &de, &unicode, &nr_slots);
+	if (!err) {
+		if (cpos - sizeof(*de) == sinfo->slot_off +
+		    (sinfo->nr_slots - 1) * sizeof(*de))
+			err = fat_dindex_insert(dir, idx, cpos - sizeof(*de),
+						de, unicode, nr_slots);
+		else
+			err = -ESTALE;
+		brelse(bh);
+	}
+	if (unicode)
+		__putname(unicode);
+	if (err)
+		fat_dindex_free(dir);
+}
+
+/* The record at sinfo is about to be removed, drop it from the index. */
+static void fat_dindex_remove(struct inode *dir, struct fat_slot_info *sinfo)
+{
+	struct fat_dindex *idx = MSDOS_I(dir)->i_dindex;
+	struct fat_dindex_key *key;
+	struct fat_dindex_ent *ent;
+	struct hlist_node *pos;
+	unsigned int hash;
+	loff_t de_off;
+	int kind;
+
+	if (!idx)
+		return;
+
+	de_off = sinfo->slot_off + (sinfo->nr_slots - 1) * sizeof(*sinfo->de);
+	hash = full_name_hash(sinfo->de->name, MSDOS_NAME);
+	hlist_for_each_entry(key, pos,
+			     fat_dindex_head(idx, FAT_DINDEX_RAW, hash), node) {
+		ent = fat_dindex_key_ent(key, FAT_DINDEX_RAW);
+		if (ent->de_off != de_off)
+			continue;
+
+		for (kind = 0; kind < FAT_DINDEX_KEYS; kind++) {
+			if (!hlist_unhashed(&ent->keys[kind].node))
+				hlist_del(&ent->keys[kind].node);
+		}
+		list_del(&ent->list);
+		idx->count--;
+		atomic_dec(&fat_dindex_nr);
+		kfree(ent);
+		if (sinfo->slot_off < idx->free_hint)
+			idx->free_hint = sinfo->slot_off;
+		return;
+	}
+	/* not indexed?  don't trust the index anymore */
+	fat_dindex_free(dir);
+}
+
 /*
  * Return values: negative -> error, 0 -> not found, positive -> found,
  * value is the total amount of slots, including the shortname entry.
@@ -348,92 +933,36 @@ int fat_search_long(struct inode *inode, const unsigned char *name,
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 	struct buffer_head *bh = NULL;
 	struct msdos_dir_entry *de;
-	struct nls_table *nls_disk = sbi->nls_disk;
 	unsigned char nr_slots;
-	wchar_t bufuname[14];
 	wchar_t *unicode = NULL;
-	unsigned char work[MSDOS_NAME];
-	unsigned char bufname[FAT_MAX_SHORT_SIZE];
-	unsigned short opt_shortname = sbi->options.shortname;
+	unsigned char bufname[FAT_MAX_SHORT_SIZE], *longname;
 	loff_t cpos = 0;
-	int chl, i, j, last_u, err, len;
+	int err, len;
+
+	if (fat_dindex_get(inode)) {
+		err = fat_dindex_search_long(inode, name, name_len, sinfo);
+		if (err != -ESTALE)
+			return err;
+		fat_dindex_free(inode);
+	}
 
-	err = -ENOENT;
 	while (1) {
-		if (fat_get_entry(inode, &cpos, &bh, &de) == -1)
+		err = fat_next_record(inode, &cpos, &bh, &de, &unicode,
+				      &nr_slots);
+		if (err)
 			goto end_of_dir;
-parse_record:
-		nr_slots = 0;
-		if (de->name[0] == DELETED_FLAG)
-			continue;
-		if (de->attr != ATTR_EXT && (de->attr & ATTR_VOLUME))
-			continue;
-		if (de->attr != ATTR_EXT && IS_FREE(de->name))
-			continue;
-		if (de->attr == ATTR_EXT) {
-			int status = fat_parse_long(inode, &cpos, &bh, &de,
-						    &unicode, &nr_slots);
-			if (status < 0) {
-				err = status;
-				goto end_of_dir;
-			} else if (status == PARSE_INVALID)
-				continue;
-			else if (status == PARSE_NOT_LONGNAME)
-				goto parse_record;
-			else if (status == PARSE_EOF)
-				goto end_of_dir;
-		}
 
-		memcpy(work, de->name, sizeof(de->name));
-		/* see namei.c, msdos_format_name */
-		if (work[0] == 0x05)
-			work[0] = 0xE5;
-		for (i = 0, j = 0, last_u = 0; i < 8;) {
-			if (!work[i])
-				break;
-			chl = fat_shortname2uni(nls_disk, &work[i], 8 - i,
-						&bufuname[j++], opt_shortname,
-						de->lcase & CASE_LOWER_BASE);
-			if (chl <= 1) {
-				if (work[i] != ' ')
-					last_u = j;
-			} else {
-				last_u = j;
-			}
-			i += chl;
-		}
-		j = last_u;
-		fat_short2uni(nls_disk, ".", 1, &bufuname[j++]);
-		for (i = 8; i < MSDOS_NAME;) {
-			if (!work[i])
-				break;
-			chl = fat_shortname2uni(nls_disk, &work[i],
-						MSDOS_NAME - i,
-						&bufuname[j++], opt_shortname,
-						de->lcase & CASE_LOWER_EXT);
-			if (chl <= 1) {
-				if (work[i] != ' ')
-					last_u = j;
-			} else {
-				last_u = j;
-			}
-			i += chl;
-		}
-		if (!last_u)
+		len = fat_shortname_x8(sbi, de, bufname);
+		if (!len)
 			continue;
 
 		/* Compare shortname */
-		bufuname[last_u] = 0x0000;
-		len = fat_uni_to_x8(sbi, bufuname, bufname, sizeof(bufname));
 		if (fat_name_match(sbi, name, name_len, bufname, len))
 			goto found;
 
 		if (nr_slots) {
-			void *longname = unicode + FAT_MAX_UNI_CHARS;
-			int size = PATH_MAX - FAT_MAX_UNI_SIZE;
-
 			/* Compare longname */
-			len = fat_uni_to_x8(sbi, unicode, longname, size);
+			len = fat_longname_x8(sbi, unicode, &longname);
 			if (fat_name_match(sbi, name, name_len, longname, len))
 				goto found;
 		}
@@ -939,6 +1468,13 @@ int fat_scan(struct inode *dir, const unsigned char *name,
 {
 	struct super_block *sb = dir->i_sb;
 
+	if (fat_dindex_get(dir)) {
+		int err = fat_dindex_scan(dir, name, sinfo);
+		if (err != -ESTALE)
+			return err;
+		fat_dindex_free(dir);
+	}
+
 	sinfo->slot_off = 0;
 	sinfo->bh = NULL;
 	while (fat_get_short_entry(dir, &sinfo->slot_off, &sinfo->bh,
@@ -996,6 +1532,8 @@ int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo)
 	struct buffer_head *bh;
 	int err = 0, nr_slots;
 
+	fat_dindex_remove(dir, sinfo);
+
 	/*
 	 * First stage: Remove the shortname. By this, the directory
 	 * entry is removed.
@@ -1243,15 +1781,20 @@ int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 	struct buffer_head *bh, *prev, *bhs[3]; /* 32*slots (672bytes) */
 	struct msdos_dir_entry *de = NULL;
+	struct fat_dindex *idx = MSDOS_I(dir)->i_dindex;
 	int err, free_slots, i, nr_bhs;
-	loff_t pos, i_pos;
+	loff_t pos, i_pos, free_hint;
 
 	sinfo->nr_slots = nr_slots;
 
-	/* First stage: search free direcotry entries */
+	/*
+	 * First stage: search free direcotry entries.  The name index
+	 * knows where the first free entry may be.
+	 */
 	free_slots = nr_bhs = 0;
 	bh = prev = NULL;
-	pos = 0;
+	pos = idx ? idx->free_hint : 0;
+	free_hint = -1;
 	err = -ENOSPC;
 	while (fat_get_entry(dir, &pos, &bh, &de) > -1) {
 		/* check the maximum size of directory */
@@ -1259,6 +1802,8 @@ int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 			goto error;
 
 		if (IS_FREE(de->name)) {
+			if (free_hint < 0)
+				free_hint = pos - sizeof(*de);
 			if (prev != bh) {
 				get_bh(bh);
 				bhs[nr_bhs] = prev = bh;
@@ -1274,6 +1819,8 @@ int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 			free_slots = nr_bhs = 0;
 		}
 	}
+	if (free_hint < 0)
+		free_hint = pos;
 	if (dir->i_ino == MSDOS_ROOT_INO) {
 		if (sbi->fat_bits != 32)
 			goto error;
@@ -1355,6 +1902,11 @@ found:
 	sinfo->bh = bh;
 	sinfo->i_pos = fat_make_i_pos(sb, sinfo->bh, sinfo->de);
 
+	if (idx) {
+		idx->free_hint = free_hint;
+		fat_dindex_add(dir, sinfo);
+	}
+
 	return 0;
 
 error:
@@ -6,6 +6,7 @@
 #include <linux/nls.h>
 #include <linux/fs.h>
 #include <linux/mutex.h>
+#include <linux/completion.h>
 #include <linux/msdos_fs.h>
 
 /*
@@ -21,6 +22,9 @@
 #define FAT_ERRORS_PANIC	2      /* panic on error */
 #define FAT_ERRORS_RO		3      /* remount r/o on error */
 
+#define FAT_FREEMAP_LAZY	1      /* build free bitmap on first FAT scan */
+#define FAT_FREEMAP_MOUNT	2      /* build free bitmap in background */
+
 struct fat_mount_options {
 	uid_t fs_uid;
 	gid_t fs_gid;
@@ -44,7 +48,8 @@ struct fat_mount_options {
 		 nocase:1,	  /* Does this need case conversion? 0=need case conversion*/
 		 usefree:1,	  /* Use free_clusters for FAT32 */
 		 tz_utc:1,	  /* Filesystem timestamps are in UTC */
-		 rodir:1;	  /* allow ATTR_RO for directory */
+		 rodir:1,	  /* allow ATTR_RO for directory */
+		 freemap:2;	  /* in-memory free cluster bitmap mode */
 };
 
 #define FAT_HASH_BITS	8
@@ -70,6 +75,12 @@ struct msdos_sb_info {
 	unsigned int prev_free;      /* previously allocated cluster number */
 	unsigned int free_clusters;  /* -1 if undefined */
 	unsigned int free_clus_valid; /* is free_clusters valid? */
+	unsigned long *free_map;     /* bitmap of free clusters, or NULL */
+	unsigned int free_map_valid; /* is free_map complete? */
+	int free_map_abort;          /* stop the background build */
+	struct mutex free_map_lock;  /* serializes free_map builds */
+	struct task_struct *free_map_task;
+	struct completion free_map_done;
 	struct fat_mount_options options;
 	struct nls_table *nls_disk;  /* Codepage used on disk */
 	struct nls_table *nls_io;    /* Charset used for input and display */
@@ -93,6 +104,8 @@ struct msdos_sb_info {
 struct msdos_inode_info {
 	spinlock_t cache_lru_lock;
 	struct list_head cache_lru;
+	struct rb_root cache_tree;	/* cached extents by file cluster */
+	struct list_head cache_inode_list; /* on the cache shrinker list */
 	int nr_caches;
 	/* for avoiding the race between fat_free() and fat_get_cluster() */
 	unsigned int cache_valid_id;
@@ -105,6 +118,7 @@ struct msdos_inode_info {
 	int i_attrs;		/* unused attribute bits */
 	loff_t i_pos;		/* on-disk position of directory entry or 0 */
 	struct hlist_node i_fat_hash;	/* hash by i_location */
+	struct fat_dindex *i_dindex;	/* name index of vfat directory */
 	struct inode vfs_inode;
 };
 
@@ -246,6 +260,9 @@ extern int fat_alloc_new_dir(struct inode *dir, struct timespec *ts);
 extern int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 			   struct fat_slot_info *sinfo);
 extern int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo);
+extern void fat_dindex_free(struct inode *dir);
+extern void fat_dindex_init(void);
+extern void fat_dindex_exit(void);
 
 /* fat/fatent.c */
 struct fat_entry {
@@ -292,6 +309,8 @@ extern int fat_alloc_clusters(struct inode *inode, int *cluster,
 			      int nr_cluster);
 extern int fat_free_clusters(struct inode *inode, int cluster);
 extern int fat_count_free_clusters(struct super_block *sb);
+extern int fat_free_map_init(struct super_block *sb);
+extern void fat_free_map_destroy(struct super_block *sb);
 
 /* fat/file.c */
 extern int fat_generic_ioctl(struct inode *inode, struct file *filp,
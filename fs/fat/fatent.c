@@ -7,6 +7,8 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -449,6 +451,61 @@ static void fat_collect_bhs(struct buffer_head **bhs, int *nr_bhs,
 	}
 }
 
+/*
+ * The in-memory free cluster bitmap ("freemap" option).  A set bit means
+ * the cluster is free.  Every path that turns a FAT entry into or out of
+ * FAT_ENT_FREE updates the bitmap under ->fat_lock, so once the initial
+ * scan has completed (->free_map_valid) it can be used for allocation
+ * and the free count without touching the FAT.
+ */
+static inline void fat_free_map_update(struct msdos_sb_info *sbi, int entry,
+				       int free)
+{
+	if (!sbi->free_map)
+		return;
+	if (free)
+		__set_bit(entry, sbi->free_map);
+	else
+		__clear_bit(entry, sbi->free_map);
+}
+
+/* Returns the next free cluster after "entry", wrapping around once. */
+static int fat_free_map_next(struct msdos_sb_info *sbi, int entry)
+{
+	unsigned long next;
+
+	next = find_next_bit(sbi->free_map, sbi->max_cluster, entry + 1);
+	if (next >= sbi->max_cluster)
+		next = find_next_bit(sbi->free_map, sbi->max_cluster,
+				     FAT_START_ENT);
+	return next < sbi->max_cluster ? next : 0;
+}
+
+static int fat_free_map_build(struct super_block *sb);
+
+/* Link the free entry "fatent" to the end of the chain being allocated. */
+static void fat_alloc_entry(struct super_block *sb, struct fat_entry *fatent,
+			    struct fat_entry *prev_ent,
+			    struct buffer_head **bhs, int *nr_bhs)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct fatent_operations *ops = sbi->fatent_ops;
+	int entry = fatent->entry;
+
+	/* make the cluster chain */
+	ops->ent_put(fatent, FAT_ENT_EOF);
+	if (prev_ent->nr_bhs)
+		ops->ent_put(prev_ent, entry);
+
+	fat_collect_bhs(bhs, nr_bhs, fatent);
+
+	sbi->prev_free = entry;
+	if (sbi->free_clusters != -1)
+		sbi->free_clusters--;
+	fat_free_map_update(sbi, entry, 0);
+	sb->s_dirt = 1;
+}
+
 int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 {
 	struct super_block *sb = inode->i_sb;
@@ -460,6 +517,12 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 
 	BUG_ON(nr_cluster > (MAX_BUF_PER_PAGE / 2));	/* fixed limit */
 
+	if (sbi->options.freemap == FAT_FREEMAP_LAZY && !sbi->free_map_valid) {
+		err = fat_free_map_build(sb);
+		if (err)
+			return err;
+	}
+
 	lock_fat(sbi);
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid &&
 	    sbi->free_clusters < nr_cluster) {
@@ -471,6 +534,36 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	count = FAT_START_ENT;
 	fatent_init(&prev_ent);
 	fatent_init(&fatent);
+
+	if (sbi->free_map_valid) {
+		int entry = fat_free_map_next(sbi, sbi->prev_free);
+
+		while (entry) {
+			err = fat_ent_read(inode, &fatent, entry);
+			if (err < 0)
+				goto out;
+			if (err != FAT_ENT_FREE) {
+				/* Stale bit, the FAT is authoritative */
+				fat_free_map_update(sbi, entry, 0);
+				if (sbi->free_clusters != -1)
+					sbi->free_clusters--;
+				entry = fat_free_map_next(sbi, entry);
+				continue;
+			}
+			err = 0;
+
+			fat_alloc_entry(sb, &fatent, &prev_ent, bhs, &nr_bhs);
+			cluster[idx_clus] = entry;
+			idx_clus++;
+			if (idx_clus == nr_cluster)
+				goto out;
+
+			prev_ent = fatent;
+			entry = fat_free_map_next(sbi, entry);
+		}
+		goto out_nospc;
+	}
+
 	fatent_set_entry(&fatent, sbi->prev_free + 1);
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
@@ -485,17 +578,8 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 			if (ops->ent_get(&fatent) == FAT_ENT_FREE) {
 				int entry = fatent.entry;
 
-				/* make the cluster chain */
-				ops->ent_put(&fatent, FAT_ENT_EOF);
-				if (prev_ent.nr_bhs)
-					ops->ent_put(&prev_ent, entry);
-
-				fat_collect_bhs(bhs, &nr_bhs, &fatent);
-
-				sbi->prev_free = entry;
-				if (sbi->free_clusters != -1)
-					sbi->free_clusters--;
-				sb->s_dirt = 1;
+				fat_alloc_entry(sb, &fatent, &prev_ent,
+						bhs, &nr_bhs);
 
 				cluster[idx_clus] = entry;
 				idx_clus++;
@@ -514,6 +598,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		} while (fat_ent_next(sbi, &fatent));
 	}
 
+out_nospc:
 	/* Couldn't allocate the free entries */
 	sbi->free_clusters = 0;
 	sbi->free_clus_valid = 1;
@@ -576,6 +661,7 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		fat_free_map_update(sbi, fatent.entry, 1);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -638,6 +724,13 @@ int fat_count_free_clusters(struct super_block *sb)
 	unsigned long reada_blocks, reada_mask, cur_block;
 	int err = 0, free;
 
+	if (sbi->free_map) {
+		/* A valid FSINFO count saves the scan, as without freemap */
+		if (sbi->free_clusters != -1 && sbi->free_clus_valid)
+			return 0;
+		return fat_free_map_build(sb);
+	}
+
 	lock_fat(sbi);
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
 		goto out;
@@ -674,3 +767,138 @@ out:
 	unlock_fat(sbi);
 	return err;
 }
+
+/*
+ * Fill in the free cluster bitmap from the FAT.  Unlike
+ * fat_count_free_clusters(), ->fat_lock is only held for one FAT block at
+ * a time, so allocations aren't stalled behind the scan of a large FAT.
+ * That is safe because allocation and freeing keep the bitmap bits of
+ * the already scanned part up to date themselves.
+ */
+static int fat_free_map_build(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct fatent_operations *ops = sbi->fatent_ops;
+	struct fat_entry fatent;
+	unsigned long reada_blocks, reada_mask, cur_block;
+	int err = 0;
+
+	mutex_lock(&sbi->free_map_lock);
+	if (sbi->free_map_valid)
+		goto out;
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+	reada_mask = reada_blocks - 1;
+	cur_block = 0;
+
+	fatent_init(&fatent);
+	fatent_set_entry(&fatent, FAT_START_ENT);
+	while (fatent.entry < sbi->max_cluster) {
+		if (sbi->free_map_abort) {
+			err = -EINTR;
+			break;
+		}
+
+		/* readahead of fat blocks */
+		if ((cur_block & reada_mask) == 0) {
+			unsigned long rest = sbi->fat_length - cur_block;
+			fat_ent_reada(sb, &fatent, min(reada_blocks, rest));
+		}
+		cur_block++;
+
+		lock_fat(sbi);
+		err = fat_ent_read_block(sb, &fatent);
+		if (err) {
+			unlock_fat(sbi);
+			break;
+		}
+		do {
+			int free = ops->ent_get(&fatent) == FAT_ENT_FREE;
+			fat_free_map_update(sbi, fatent.entry, free);
+		} while (fat_ent_next(sbi, &fatent));
+		unlock_fat(sbi);
+
+		cond_resched();
+	}
+	fatent_brelse(&fatent);
+	if (err)
+		goto out;
+
+	lock_fat(sbi);
+	if (sbi->free_clusters == -1 || !sbi->free_clus_valid) {
+		sbi->free_clusters = bitmap_weight(sbi->free_map,
+						   sbi->max_cluster);
+		sbi->free_clus_valid = 1;
+	}
+	sbi->free_map_valid = 1;
+	sb->s_dirt = 1;
+	unlock_fat(sbi);
+out:
+	mutex_unlock(&sbi->free_map_lock);
+	return err;
+}
+
+static int fat_free_map_thread(void *arg)
+{
+	struct super_block *sb = arg;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	fat_free_map_build(sb);
+	complete(&sbi->free_map_done);
+	return 0;
+}
+
+/*
+ * Set up the free cluster bitmap for "freemap" mounts.  Failing to get
+ * the memory isn't fatal, the allocator just keeps scanning the FAT.
+ */
+int fat_free_map_init(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	size_t size;
+
+	mutex_init(&sbi->free_map_lock);
+	init_completion(&sbi->free_map_done);
+	sbi->free_map_valid = 0;
+	sbi->free_map_abort = 0;
+	sbi->free_map_task = NULL;
+
+	if (!sbi->options.freemap)
+		return 0;
+
+	size = BITS_TO_LONGS(sbi->max_cluster) * sizeof(unsigned long);
+	sbi->free_map = vmalloc(size);
+	if (!sbi->free_map) {
+		printk(KERN_WARNING "FAT: not enough memory for free cluster"
+		       " bitmap (%lu clusters), disabled\n", sbi->max_cluster);
+		sbi->options.freemap = 0;
+		return -ENOMEM;
+	}
+	memset(sbi->free_map, 0, size);
+
+	if (sbi->options.freemap == FAT_FREEMAP_MOUNT) {
+		struct task_struct *task;
+
+		task = kthread_run(fat_free_map_thread, sb, "fat-freemap/%s",
+				   sb->s_id);
+		if (!IS_ERR(task))
+			sbi->free_map_task = task;
+		else
+			sbi->options.freemap = FAT_FREEMAP_LAZY;
+	}
+	return 0;
+}
+
+void fat_free_map_destroy(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	if (sbi->free_map_task) {
+		sbi->free_map_abort = 1;
+		wait_for_completion(&sbi->free_map_done);
+		sbi->free_map_task = NULL;
+	}
+	vfree(sbi->free_map);
+	sbi->free_map = NULL;
+	sbi->free_map_valid = 0;
+}
@@ -436,6 +436,7 @@ static void fat_delete_inode(struct inode *inode)
 static void fat_clear_inode(struct inode *inode)
 {
 	fat_cache_inval_inode(inode);
+	fat_dindex_free(inode);
 	fat_detach(inode);
 }
 
@@ -451,6 +452,8 @@ static void fat_put_super(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 
+	fat_free_map_destroy(sb);
+
 	if (sbi->nls_disk) {
 		unload_nls(sbi->nls_disk);
 		sbi->nls_disk = NULL;
@@ -493,7 +496,10 @@ static void init_once(void *foo)
 	ei->nr_caches = 0;
 	ei->cache_valid_id = FAT_CACHE_VALID + 1;
 	INIT_LIST_HEAD(&ei->cache_lru);
+	ei->cache_tree = RB_ROOT;
+	INIT_LIST_HEAD(&ei->cache_inode_list);
 	INIT_HLIST_NODE(&ei->i_fat_hash);
+	ei->i_dindex = NULL;
 	inode_init_once(&ei->vfs_inode);
 }
 
@@ -805,6 +811,10 @@ static int fat_show_options(struct seq_file *m, struct vfsmount *mnt)
 		seq_printf(m, ",check=%c", opts->name_check);
 	if (opts->usefree)
 		seq_puts(m, ",usefree");
+	if (opts->freemap == FAT_FREEMAP_LAZY)
+		seq_puts(m, ",freemap=lazy");
+	else if (opts->freemap == FAT_FREEMAP_MOUNT)
+		seq_puts(m, ",freemap=mount");
 	if (opts->quiet)
 		seq_puts(m, ",quiet");
 	if (opts->showexec)
@@ -849,7 +859,8 @@ enum {
 	Opt_shortname_winnt, Opt_shortname_mixed, Opt_utf8_no, Opt_utf8_yes,
 	Opt_uni_xl_no, Opt_uni_xl_yes, Opt_nonumtail_no, Opt_nonumtail_yes,
 	Opt_obsolate, Opt_flush, Opt_tz_utc, Opt_rodir, Opt_err_cont,
-	Opt_err_panic, Opt_err_ro, Opt_err,
+	Opt_err_panic, Opt_err_ro, Opt_freemap_lazy, Opt_freemap_mount,
+	Opt_err,
 };
 
 static const match_table_t fat_tokens = {
@@ -877,6 +888,9 @@ static const match_table_t fat_tokens = {
 	{Opt_err_cont, "errors=continue"},
 	{Opt_err_panic, "errors=panic"},
 	{Opt_err_ro, "errors=remount-ro"},
+	{Opt_freemap_lazy, "freemap"},
+	{Opt_freemap_lazy, "freemap=lazy"},
+	{Opt_freemap_mount, "freemap=mount"},
 	{Opt_obsolate, "conv=binary"},
 	{Opt_obsolate, "conv=text"},
 	{Opt_obsolate, "conv=auto"},
@@ -956,6 +970,7 @@ static int parse_options(char *options, int is_vfat, int silent, int *debug,
 	opts->utf8 = opts->unicode_xlate = 0;
 	opts->numtail = 1;
 	opts->usefree = opts->nocase = 0;
+	opts->freemap = 0;
 	opts->tz_utc = 0;
 	opts->errors = FAT_ERRORS_RO;
 	*debug = 0;
@@ -1059,6 +1074,12 @@ static int parse_options(char *options, int is_vfat, int silent, int *debug,
 		case Opt_err_ro:
 			opts->errors = FAT_ERRORS_RO;
 			break;
+		case Opt_freemap_lazy:
+			opts->freemap = FAT_FREEMAP_LAZY;
+			break;
+		case Opt_freemap_mount:
+			opts->freemap = FAT_FREEMAP_MOUNT;
+			break;
 
 		/* msdos specific */
 		case Opt_dots:
@@ -1455,6 +1476,8 @@ int fat_fill_super(struct super_block *sb, void *data, int silent,
 		goto out_fail;
 	}
 
+	fat_free_map_init(sb);
+
 	return 0;
 
 out_invalid:
@@ -1541,6 +1564,7 @@ static int __init init_fat_fs(void)
 	if (err)
 		goto failed;
 
+	fat_dindex_init();
 	return 0;
 
 failed:
@@ -1550,6 +1574,7 @@ failed:
 
 static void __exit exit_fat_fs(void)
 {
+	fat_dindex_exit();
 	fat_cache_destroy();
 	fat_destroy_inodecache();
 }
@@ -90,6 +90,7 @@ enum pmem_allocator_type {
 
 	PMEM_ALLOCATORTYPE_ALLORNOTHING,
 	PMEM_ALLOCATORTYPE_BUDDYBESTFIT,
+	PMEM_ALLOCATORTYPE_SEGFIT,
 
 	PMEM_ALLOCATORTYPE_MAX,
 };
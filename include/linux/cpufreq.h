@@ -198,6 +198,21 @@ int lock_policy_rwsem_write(int cpu);
 void unlock_policy_rwsem_read(int cpu);
 void unlock_policy_rwsem_write(int cpu);
 
+/*
+ * The 'sched' governor takes its load from CFS: the scheduler calls
+ * cpufreq_sched_update() with the runqueue lock held whenever CFS
+ * enqueues, dequeues or ticks, and cpufreq_sched_kick() on the local CPU
+ * once no runqueue lock is held.
+ */
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+extern void cpufreq_sched_update(int cpu, u64 clock, unsigned long nr_running);
+extern void cpufreq_sched_kick(void);
+#else
+static inline void cpufreq_sched_update(int cpu, u64 clock,
+					unsigned long nr_running) { }
+static inline void cpufreq_sched_kick(void) { }
+#endif
+
 
 /*********************************************************************
  *                      CPUFREQ DRIVER INTERFACE                     *
@@ -327,6 +342,9 @@ extern struct cpufreq_governor cpufreq_gov_lagfree;
 #elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVE)
 extern struct cpufreq_governor cpufreq_gov_interactive;
 #define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_interactive)
+#elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED)
+extern struct cpufreq_governor cpufreq_gov_sched;
+#define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_sched)
 #endif
 
 
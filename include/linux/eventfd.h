@@ -17,14 +17,27 @@
 #define EFD_CLOEXEC O_CLOEXEC
 #define EFD_NONBLOCK O_NONBLOCK
 
+struct eventfd_ctx;
+
 struct file *eventfd_fget(int fd);
 int eventfd_signal(struct file *file, int n);
+struct eventfd_ctx *eventfd_ctx_fileget(struct file *file);
+void eventfd_ctx_put(struct eventfd_ctx *ctx);
+int eventfd_ctx_signal(struct eventfd_ctx *ctx, int n);
 
 #else /* CONFIG_EVENTFD */
 
+struct eventfd_ctx;
+
 #define eventfd_fget(fd) ERR_PTR(-ENOSYS)
 static inline int eventfd_signal(struct file *file, int n)
 { return 0; }
+static inline struct eventfd_ctx *eventfd_ctx_fileget(struct file *file)
+{ return ERR_PTR(-ENOSYS); }
+static inline void eventfd_ctx_put(struct eventfd_ctx *ctx)
+{ }
+static inline int eventfd_ctx_signal(struct eventfd_ctx *ctx, int n)
+{ return 0; }
 
 #endif /* CONFIG_EVENTFD */
 
@@ -258,6 +258,18 @@ static inline bool printk_timed_ratelimit(unsigned long *caller_jiffies, \
 extern int printk_needs_cpu(int cpu);
 extern void printk_tick(void);
 
+#ifdef CONFIG_PRINTK_CAPTURE
+/*
+ * A capture function gets the text of every printk(), level token
+ * included, on the cpu that printed it and with interrupts off.
+ */
+#define PRINTK_CAPTURE_CONT	0x01	/* the text continues a line */
+#define PRINTK_CAPTURE_TIME	0x02	/* printk.time stamps the lines */
+#define PRINTK_CAPTURE_REPLAY	0x04	/* from log_buf, stamps in the text */
+typedef void (*printk_capture_fn)(const char *text, size_t len, int flags);
+extern void printk_set_capture(printk_capture_fn fn);
+#endif
+
 extern void asmlinkage __attribute__((format(printf, 1, 2)))
 	early_printk(const char *fmt, ...);
 
@@ -0,0 +1,127 @@
+/*
+ * Back-reference copies for the LZ77 family of decompressors (zlib
+ * inflate, LZO).
+ *
+ * A match copies len bytes from dist bytes back in the output, byte by
+ * byte and front to back, so a match longer than its distance repeats a
+ * pattern.  lz_copy() gives the same result while moving a word, or with
+ * architecture help a whole vector, at a time.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _LINUX_LZ_COPY_H
+#define _LINUX_LZ_COPY_H
+
+#include <linux/types.h>
+#include <linux/compiler.h>
+#include <asm/unaligned.h>
+
+/* the pre-boot decompressors (STATIC) run without the kernel around them */
+#if defined(CONFIG_HAVE_ARCH_LZ_COPY) && !defined(STATIC)
+#include <asm/lz_copy.h>
+#endif
+
+/*
+ * Unaligned 32 bit accesses.  The architecture may replace these when its
+ * loads and stores handle misalignment in hardware.
+ */
+#ifndef lz_get32
+#define lz_get32(p)		get_unaligned((const u32 *)(p))
+#define lz_put32(p, v)		put_unaligned((v), (u32 *)(p))
+#endif
+
+/*
+ * Wide copies.  A decompressor brackets its whole run with
+ * lz_wide_begin()/lz_wide_end() when the former returns non-zero, and may
+ * then hand lz_copy_wide() copies of at least LZ_WIDE_MIN bytes with a
+ * distance of at least LZ_WIDE_DIST.  @out_len is the most output the run
+ * may produce, so that the architecture can bound the time spent.
+ */
+#ifndef LZ_WIDE_DIST
+#define LZ_WIDE_DIST		16
+#define LZ_WIDE_MIN		32
+#define lz_wide_begin(out_len)	0
+#define lz_wide_end()		do { } while (0)
+#define lz_copy_wide(out, from, len)	lz_copy_words((out), (from), (len))
+#endif
+
+/* Copy @len bytes forwards; @out - @from must be at least 4 */
+static __always_inline void lz_copy_words(unsigned char *out,
+					  const unsigned char *from,
+					  size_t len)
+{
+	while (len >= 8) {
+		lz_put32(out, lz_get32(from));
+		lz_put32(out + 4, lz_get32(from + 4));
+		out += 8;
+		from += 8;
+		len -= 8;
+	}
+	if (len >= 4) {
+		lz_put32(out, lz_get32(from));
+		out += 4;
+		from += 4;
+		len -= 4;
+	}
+	while (len--)
+		*out++ = *from++;
+}
+
+static __always_inline void lz_copy_short(unsigned char *out,
+					  const unsigned char *from,
+					  size_t len, size_t dist)
+{
+	if (dist >= 4)
+		lz_copy_words(out, from, len);
+	else
+		while (len--)
+			*out++ = *from++;
+}
+
+/**
+ * lz_copy - copy a back-reference
+ * @out: next output byte
+ * @from: first byte of the match, before @out or in a separate window
+ * @len: match length
+ * @wide: non-zero between lz_wide_begin() and lz_wide_end(); must be a
+ *	compile time constant so that each caller gets a specialised copy
+ *
+ * Nothing beyond @out + @len is written.  Returns @out + @len.
+ */
+static __always_inline unsigned char *lz_copy(unsigned char *out,
+					      const unsigned char *from,
+					      size_t len, const int wide)
+{
+	/*
+	 * A source in another buffer (literals, a separate window) does not
+	 * overlap @out, so whatever distance it gives is at least @len or
+	 * wraps to a huge value, and is never doubled below.
+	 */
+	size_t dist = out - from;
+	size_t want = (wide && len >= LZ_WIDE_MIN) ? LZ_WIDE_DIST : 4;
+	unsigned char *end = out + len;
+
+	/*
+	 * A pattern of period dist also repeats at 2 * dist once one more
+	 * period has been written, so the copy can grow its distance until
+	 * whole words (or vectors) never overlap their source.
+	 */
+	while (unlikely(dist < want) && len > dist) {
+		lz_copy_short(out, from, dist, dist);
+		out += dist;
+		len -= dist;
+		dist <<= 1;
+	}
+
+	if (dist < want)
+		lz_copy_short(out, from, len, dist);
+	else if (wide && len >= LZ_WIDE_MIN)
+		lz_copy_wide(out, from, len);
+	else
+		lz_copy_words(out, from, len);
+	return end;
+}
+
+#endif /* _LINUX_LZ_COPY_H */
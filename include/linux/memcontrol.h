@@ -24,6 +24,7 @@ struct mem_cgroup;
 struct page_cgroup;
 struct page;
 struct mm_struct;
+struct notifier_block;
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
 /*
@@ -118,6 +119,15 @@ static inline bool mem_cgroup_disabled(void)
 
 extern bool mem_cgroup_oom_called(struct task_struct *task);
 
+/*
+ * Called with the mem_cgroup as data whenever a charge hits its limit,
+ * at most every MEM_NOTIFY_FREQ per cgroup.
+ */
+extern int register_mem_cgroup_pressure_notifier(struct notifier_block *nb);
+extern int unregister_mem_cgroup_pressure_notifier(struct notifier_block *nb);
+extern void mem_cgroup_get_pages(struct mem_cgroup *mem, unsigned long *limit,
+				 unsigned long *usage, unsigned long *cache);
+
 #else /* CONFIG_CGROUP_MEM_RES_CTLR */
 struct mem_cgroup;
 
@@ -244,6 +254,27 @@ static inline bool mem_cgroup_oom_called(struct task_struct *task)
 	return false;
 }
 
+static inline int
+register_mem_cgroup_pressure_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+
+static inline int
+unregister_mem_cgroup_pressure_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+
+static inline void mem_cgroup_get_pages(struct mem_cgroup *mem,
+					unsigned long *limit,
+					unsigned long *usage,
+					unsigned long *cache)
+{
+	*limit = ULONG_MAX;
+	*usage = *cache = 0;
+}
+
 static inline int
 mem_cgroup_inactive_anon_is_low(struct mem_cgroup *memcg)
 {
@@ -0,0 +1,30 @@
+#ifndef _LINUX_PREFETCH_TRACE_H
+#define _LINUX_PREFETCH_TRACE_H
+/*
+ * Record page cache misses during a window (boot, an application launch)
+ * and replay them as readahead the next time round.
+ * See Documentation/vm/prefetch-trace.txt.
+ */
+
+#include <linux/fs.h>
+
+#ifdef CONFIG_PREFETCH_TRACE
+extern int prefetch_trace_active;
+extern void __prefetch_trace_record(struct file *filp, pgoff_t offset,
+				    unsigned long nr_pages);
+
+/* Called wherever pages are about to be read into the page cache */
+static inline void prefetch_trace_record(struct file *filp, pgoff_t offset,
+					 unsigned long nr_pages)
+{
+	if (unlikely(prefetch_trace_active) && filp)
+		__prefetch_trace_record(filp, offset, nr_pages);
+}
+#else
+static inline void prefetch_trace_record(struct file *filp, pgoff_t offset,
+					 unsigned long nr_pages)
+{
+}
+#endif /* CONFIG_PREFETCH_TRACE */
+
+#endif /* _LINUX_PREFETCH_TRACE_H */
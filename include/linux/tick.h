@@ -7,6 +7,7 @@
 #define _LINUX_TICK_H
 
 #include <linux/clockchips.h>
+#include <linux/rcupdate.h>
 
 #ifdef CONFIG_GENERIC_CLOCKEVENTS
 
@@ -114,6 +115,39 @@ static inline int tick_check_oneshot_change(int allow_nohz) { return 0; }
 static inline void tick_check_idle(int cpu) { }
 #endif /* !CONFIG_GENERIC_CLOCKEVENTS */
 
+/*
+ * Set while drivers/cpufreq/cpufreq_replay.c feeds the governors a
+ * synthetic idle time, which get_cpu_idle_time_us() then returns.
+ */
+#if defined(CONFIG_CPU_FREQ_REPLAY) || defined(CONFIG_CPU_FREQ_REPLAY_MODULE)
+extern u64 (*replay_cpu_idle_time_us)(int cpu, u64 *last_update_time);
+
+/*
+ * Return 1 and the synthetic idle time in @idle while a replay runs.  The
+ * pointer is read once, under rcu_read_lock(): the harness clears it and
+ * then waits for a grace period before the replay data goes away.
+ */
+static inline int replay_idle_time(int cpu, u64 *last_update_time, u64 *idle)
+{
+	u64 (*fn)(int cpu, u64 *last_update_time);
+	int ret = 0;
+
+	rcu_read_lock();
+	fn = rcu_dereference(replay_cpu_idle_time_us);
+	if (unlikely(fn)) {
+		*idle = fn(cpu, last_update_time);
+		ret = 1;
+	}
+	rcu_read_unlock();
+	return ret;
+}
+#else
+static inline int replay_idle_time(int cpu, u64 *last_update_time, u64 *idle)
+{
+	return 0;
+}
+#endif
+
 # ifdef CONFIG_NO_HZ
 extern void tick_nohz_stop_sched_tick(int inidle);
 extern void tick_nohz_restart_sched_tick(void);
@@ -129,7 +163,14 @@ static inline ktime_t tick_nohz_get_sleep_length(void)
 
 	return len;
 }
-static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
+static inline u64 get_cpu_idle_time_us(int cpu, u64 *last_update_time)
+{
+	u64 idle;
+
+	if (unlikely(replay_idle_time(cpu, last_update_time, &idle)))
+		return idle;
+	return -1;
+}
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
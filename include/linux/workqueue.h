@@ -12,6 +12,7 @@
 #include <asm/atomic.h>
 
 struct workqueue_struct;
+struct task_struct;
 
 struct work_struct;
 typedef void (*work_func_t)(struct work_struct *work);
@@ -32,6 +33,9 @@ struct work_struct {
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
+#ifdef CONFIG_WORKQUEUE_STATS
+	u64 queued_at;			/* for the queueing latency */
+#endif
 };
 
 #define WORK_DATA_INIT()	ATOMIC_LONG_INIT(0)
@@ -159,13 +163,43 @@ struct execute_work {
 	clear_bit(WORK_STRUCT_PENDING, work_data_bits(work))
 
 
+/*
+ * Workqueue flags.
+ *
+ * By default the works of a workqueue are run by a pool of worker threads
+ * per cpu, shared by all workqueues.  The pool starts another worker when
+ * the running one blocks, so a work that sleeps does not hold up the works
+ * queued behind it, whichever workqueue they were queued on.
+ *
+ * WQ_ORDERED:		run one work at a time, in queueing order, on one cpu
+ *			(what a single-threaded workqueue used to guarantee).
+ * WQ_NON_REENTRANT:	a work is never run on two cpus at the same time;
+ *			by default this only holds on the same cpu.
+ * WQ_FREEZEABLE:	stop running works while the system is frozen.
+ * WQ_RT:		run the works from SCHED_FIFO threads.
+ * WQ_RESCUER:		the workqueue is needed to free memory, so it must not
+ *			wait for a worker to be created.
+ *
+ * Workqueues with any of the last three flags get dedicated threads, one
+ * per cpu or a single one if WQ_ORDERED, as all workqueues used to.
+ */
+#define WQ_ORDERED		(1 << 0)
+#define WQ_NON_REENTRANT	(1 << 1)
+#define WQ_FREEZEABLE		(1 << 2)
+#define WQ_RT			(1 << 3)
+#define WQ_RESCUER		(1 << 4)
+
+#define WQ_DEDICATED		(WQ_FREEZEABLE | WQ_RT | WQ_RESCUER)
+
+/* Default limit of works of one workqueue running at once on a cpu */
+#define WQ_DFL_ACTIVE		256
+
 extern struct workqueue_struct *
-__create_workqueue_key(const char *name, int singlethread,
-		       int freezeable, int rt, struct lock_class_key *key,
-		       const char *lock_name);
+__create_workqueue_key(const char *name, unsigned int flags, int max_active,
+		       struct lock_class_key *key, const char *lock_name);
 
 #ifdef CONFIG_LOCKDEP
-#define __create_workqueue(name, singlethread, freezeable, rt)	\
+#define __create_workqueue(name, flags, max_active)		\
 ({								\
 	static struct lock_class_key __key;			\
 	const char *__lock_name;				\
@@ -175,20 +209,27 @@ __create_workqueue_key(const char *name, int singlethread,
 	else							\
 		__lock_name = #name;				\
 								\
-	__create_workqueue_key((name), (singlethread),		\
-			       (freezeable), (rt), &__key,	\
-			       __lock_name);			\
+	__create_workqueue_key((name), (flags), (max_active),	\
+			       &__key, __lock_name);		\
 })
 #else
-#define __create_workqueue(name, singlethread, freezeable, rt)	\
-	__create_workqueue_key((name), (singlethread), (freezeable), (rt), \
-			       NULL, NULL)
+#define __create_workqueue(name, flags, max_active)		\
+	__create_workqueue_key((name), (flags), (max_active), NULL, NULL)
 #endif
 
-#define create_workqueue(name) __create_workqueue((name), 0, 0, 0)
-#define create_rt_workqueue(name) __create_workqueue((name), 0, 0, 1)
-#define create_freezeable_workqueue(name) __create_workqueue((name), 1, 1, 0)
-#define create_singlethread_workqueue(name) __create_workqueue((name), 1, 0, 0)
+/*
+ * alloc_workqueue - create a workqueue with WQ_* @flags, running at most
+ * @max_active of its works at once per cpu (0 for the default).
+ */
+#define alloc_workqueue(name, flags, max_active)		\
+	__create_workqueue((name), (flags), (max_active))
+
+#define create_workqueue(name) __create_workqueue((name), 0, 0)
+#define create_rt_workqueue(name) __create_workqueue((name), WQ_RT, 0)
+#define create_freezeable_workqueue(name)			\
+	__create_workqueue((name), WQ_ORDERED | WQ_FREEZEABLE, 0)
+#define create_singlethread_workqueue(name)			\
+	__create_workqueue((name), WQ_ORDERED, 0)
 
 extern void destroy_workqueue(struct workqueue_struct *wq);
 
@@ -213,6 +254,8 @@ extern int current_is_keventd(void);
 extern int keventd_up(void);
 
 extern void init_workqueues(void);
+extern void wq_worker_sleeping(struct task_struct *task);
+extern void wq_worker_running(struct task_struct *task);
 int execute_in_process_context(work_func_t fn, struct execute_work *);
 
 extern int flush_work(struct work_struct *work);
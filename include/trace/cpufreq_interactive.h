@@ -0,0 +1,17 @@
+#ifndef _TRACE_CPUFREQ_INTERACTIVE_H
+#define _TRACE_CPUFREQ_INTERACTIVE_H
+
+#include <linux/tracepoint.h>
+
+/* An input event raised @cpu from @old_freq to @new_freq (kHz) */
+DECLARE_TRACE(cpufreq_interactive_boost,
+	TPPROTO(unsigned int cpu, unsigned int old_freq, unsigned int new_freq),
+		TPARGS(cpu, old_freq, new_freq));
+
+/* The load timer moved @cpu from @old_freq to @new_freq at @load percent */
+DECLARE_TRACE(cpufreq_interactive_target,
+	TPPROTO(unsigned int cpu, int load, unsigned int old_freq,
+		unsigned int new_freq),
+		TPARGS(cpu, load, old_freq, new_freq));
+
+#endif
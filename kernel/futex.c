@@ -55,6 +55,12 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/bootmem.h>
+#include <linux/swap.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 
 #include <asm/futex.h>
 
@@ -62,8 +68,6 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
-
 /*
  * Priority Inheritance state:
  */
@@ -111,17 +115,37 @@ struct futex_q {
 
 	/* Bitset for the optional bitmasked wakeup */
 	u32 bitset;
+
+#ifdef CONFIG_FUTEX_STATS
+	u64 queued_at;
+#endif
 };
 
 /*
  * Split the global futex_lock into every hash list lock.
+ *
+ * waiters counts the futex_qs queued on the chain and those about to be
+ * queued, from queue_lock() on.  futex_wake() reads it without the lock
+ * to skip buckets nobody waits on: a waiter increments it before it
+ * reads the futex value, a waker reads it after it changed the value,
+ * and both sides order that with a full barrier.  So either the waker
+ * sees the waiter, or the waiter sees the new value and does not sleep.
  */
 struct futex_hash_bucket {
+	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
-};
+#ifdef CONFIG_FUTEX_STATS
+	/* waits and collisions are protected by lock */
+	unsigned long waits;
+	unsigned long collisions;
+	atomic_long_t wait_us;
+	unsigned long wait_us_max;
+#endif
+} ____cacheline_aligned_in_smp;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+static struct futex_hash_bucket *futex_queues __read_mostly;
+static unsigned long futex_hashsize __read_mostly;
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
@@ -131,7 +155,35 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	return &futex_queues[hash & (futex_hashsize - 1)];
+}
+
+static inline void hb_waiters_inc(struct futex_hash_bucket *hb)
+{
+	atomic_inc(&hb->waiters);
+	/* order against reading the futex value, see futex_hash_bucket */
+	smp_mb__after_atomic_inc();
+}
+
+static inline void hb_waiters_dec(struct futex_hash_bucket *hb)
+{
+	atomic_dec(&hb->waiters);
+}
+
+/* The futex_q's hash bucket, from its lock_ptr, which must be held */
+static inline struct futex_hash_bucket *futex_q_hb(struct futex_q *q)
+{
+	return container_of(q->lock_ptr, struct futex_hash_bucket, lock);
+}
+
+/*
+ * Remove the futex_q from its hash bucket.  The hash bucket lock must be
+ * held.
+ */
+static void __unqueue_futex(struct futex_q *q)
+{
+	plist_del(&q->list, &q->list.plist);
+	hb_waiters_dec(futex_q_hb(q));
 }
 
 /*
@@ -144,6 +196,57 @@ static inline int match_futex(union futex_key *key1, union futex_key *key2)
 		&& key1->both.offset == key2->both.offset);
 }
 
+#ifdef CONFIG_FUTEX_STATS
+static atomic_long_t futex_wake_nowaiters;
+
+/* Called with hb->lock held, before @q is added to the chain */
+static void futex_stat_queue(struct futex_hash_bucket *hb, struct futex_q *q)
+{
+	struct futex_q *this;
+
+	hb->waits++;
+	plist_for_each_entry(this, &hb->chain, list) {
+		if (!match_futex(&this->key, &q->key)) {
+			hb->collisions++;
+			break;
+		}
+	}
+	q->queued_at = cpu_clock(raw_smp_processor_id());
+}
+
+static void futex_stat_wait_end(struct futex_q *q)
+{
+	struct futex_hash_bucket *hb = hash_futex(&q->key);
+	u64 now = cpu_clock(raw_smp_processor_id());
+	unsigned long us = 0;
+
+	if (now > q->queued_at)
+		us = div_u64(now - q->queued_at, NSEC_PER_USEC);
+	atomic_long_add(us, &hb->wait_us);
+	/* racy, a lost update only understates the maximum */
+	if (us > hb->wait_us_max)
+		hb->wait_us_max = us;
+}
+
+static inline void futex_stat_wake_nowaiters(void)
+{
+	atomic_long_inc(&futex_wake_nowaiters);
+}
+#else
+static inline void futex_stat_queue(struct futex_hash_bucket *hb,
+				    struct futex_q *q)
+{
+}
+
+static inline void futex_stat_wait_end(struct futex_q *q)
+{
+}
+
+static inline void futex_stat_wake_nowaiters(void)
+{
+}
+#endif /* CONFIG_FUTEX_STATS */
+
 /*
  * Take a reference to the resource addressed by a key.
  * Can be called while holding spinlocks.
@@ -613,7 +716,7 @@ lookup_pi_state(u32 uval, struct futex_hash_bucket *hb,
  */
 static void wake_futex(struct futex_q *q)
 {
-	plist_del(&q->list, &q->list.plist);
+	__unqueue_futex(q);
 	/*
 	 * The lock in wake_up_all() is a crucial memory barrier after the
 	 * plist_del() and also before assigning to q->lock_ptr.
@@ -746,6 +849,17 @@ static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 		goto out;
 
 	hb = hash_futex(&key);
+
+	/*
+	 * Nobody waits on this bucket: no need to take the lock.  Pairs
+	 * with the barrier in hb_waiters_inc().
+	 */
+	smp_mb();
+	if (!atomic_read(&hb->waiters)) {
+		futex_stat_wake_nowaiters();
+		goto out_put_key;
+	}
+
 	spin_lock(&hb->lock);
 	head = &hb->chain;
 
@@ -767,6 +881,7 @@ static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 	}
 
 	spin_unlock(&hb->lock);
+out_put_key:
 	put_futex_key(fshared, &key);
 out:
 	return ret;
@@ -941,7 +1056,9 @@ retry:
 			 */
 			if (likely(head1 != &hb2->chain)) {
 				plist_del(&this->list, &hb1->chain);
+				hb_waiters_dec(hb1);
 				plist_add(&this->list, &hb2->chain);
+				hb_waiters_inc(hb2);
 				this->lock_ptr = &hb2->lock;
 #ifdef CONFIG_DEBUG_PI_LIST
 				this->list.plist.lock = &hb2->lock;
@@ -984,6 +1101,7 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 	hb = hash_futex(&q->key);
 	q->lock_ptr = &hb->lock;
 
+	hb_waiters_inc(hb);
 	spin_lock(&hb->lock);
 	return hb;
 }
@@ -1006,6 +1124,7 @@ static inline void queue_me(struct futex_q *q, struct futex_hash_bucket *hb)
 #ifdef CONFIG_DEBUG_PI_LIST
 	q->list.plist.lock = &hb->lock;
 #endif
+	futex_stat_queue(hb, q);
 	plist_add(&q->list, &hb->chain);
 	q->task = current;
 	spin_unlock(&hb->lock);
@@ -1015,6 +1134,7 @@ static inline void
 queue_unlock(struct futex_q *q, struct futex_hash_bucket *hb)
 {
 	spin_unlock(&hb->lock);
+	hb_waiters_dec(hb);
 	drop_futex_key_refs(&q->key);
 }
 
@@ -1053,7 +1173,7 @@ retry:
 			goto retry;
 		}
 		WARN_ON(plist_node_empty(&q->list));
-		plist_del(&q->list, &q->list.plist);
+		__unqueue_futex(q);
 
 		BUG_ON(q->pi_state);
 
@@ -1073,7 +1193,7 @@ retry:
 static void unqueue_me_pi(struct futex_q *q)
 {
 	WARN_ON(plist_node_empty(&q->list));
-	plist_del(&q->list, &q->list.plist);
+	__unqueue_futex(q);
 
 	BUG_ON(!q->pi_state);
 	free_pi_state(q->pi_state);
@@ -1322,8 +1442,10 @@ retry:
 
 	/* If we were woken (and unqueued), we succeeded, whatever. */
 	ret = 0;
-	if (!unqueue_me(&q))
+	if (!unqueue_me(&q)) {
+		futex_stat_wait_end(&q);
 		goto out_put_key;
+	}
 	ret = -ETIMEDOUT;
 	if (rem)
 		goto out_put_key;
@@ -1600,6 +1722,7 @@ retry_locked:
 
 	/* Unqueue and drop the lock */
 	unqueue_me_pi(&q);
+	futex_stat_wait_end(&q);
 
 	if (to)
 		destroy_hrtimer_on_stack(&to->timer);
@@ -2046,10 +2169,92 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
 
+#ifdef CONFIG_FUTEX_STATS
+/*
+ * /sys/kernel/debug/futex_hash: totals, then one line per bucket that
+ * was ever waited on.  Writing anything resets the counters.
+ */
+static int futex_hash_show(struct seq_file *m, void *v)
+{
+	unsigned long waits = 0, collisions = 0, wait_us = 0, used = 0;
+	unsigned long i;
+
+	for (i = 0; i < futex_hashsize; i++) {
+		struct futex_hash_bucket *hb = &futex_queues[i];
+
+		if (!hb->waits)
+			continue;
+		used++;
+		waits += hb->waits;
+		collisions += hb->collisions;
+		wait_us += atomic_long_read(&hb->wait_us);
+	}
+
+	seq_printf(m, "buckets %lu\nused %lu\nwaits %lu\ncollisions %lu\n"
+		   "wait_us %lu\nwake_nowaiters %lu\n\n",
+		   futex_hashsize, used, waits, collisions, wait_us,
+		   atomic_long_read(&futex_wake_nowaiters));
+
+	seq_printf(m, "%-8s %8s %10s %10s %12s %10s\n", "bucket", "waiters",
+		   "waits", "collisions", "wait_us", "max_us");
+	for (i = 0; i < futex_hashsize; i++) {
+		struct futex_hash_bucket *hb = &futex_queues[i];
+
+		if (!hb->waits)
+			continue;
+		seq_printf(m, "%-8lu %8d %10lu %10lu %12lu %10lu\n", i,
+			   atomic_read(&hb->waiters), hb->waits,
+			   hb->collisions, atomic_long_read(&hb->wait_us),
+			   hb->wait_us_max);
+	}
+	return 0;
+}
+
+static int futex_hash_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_hash_show, NULL);
+}
+
+static ssize_t futex_hash_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	unsigned long i;
+
+	for (i = 0; i < futex_hashsize; i++) {
+		struct futex_hash_bucket *hb = &futex_queues[i];
+
+		spin_lock(&hb->lock);
+		hb->waits = 0;
+		hb->collisions = 0;
+		atomic_long_set(&hb->wait_us, 0);
+		hb->wait_us_max = 0;
+		spin_unlock(&hb->lock);
+	}
+	atomic_long_set(&futex_wake_nowaiters, 0);
+	return count;
+}
+
+static const struct file_operations futex_hash_fops = {
+	.open		= futex_hash_open,
+	.read		= seq_read,
+	.write		= futex_hash_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init futex_stats_init(void)
+{
+	debugfs_create_file("futex_hash", 0644, NULL, NULL, &futex_hash_fops);
+	return 0;
+}
+late_initcall(futex_stats_init);
+#endif /* CONFIG_FUTEX_STATS */
+
 static int __init futex_init(void)
 {
+	unsigned int futex_shift;
+	unsigned long i;
 	u32 curval;
-	int i;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2065,7 +2270,25 @@ static int __init futex_init(void)
 	if (curval == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+	/*
+	 * Size the hash for the threads the machine can run: 256 buckets
+	 * per possible cpu, and no fewer than one per megabyte of memory.
+	 */
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = max(256UL * num_possible_cpus(),
+			     totalram_pages >> (20 - PAGE_SHIFT));
+#endif
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL,
+					       roundup_pow_of_two(futex_hashsize));
+	futex_hashsize = 1UL << futex_shift;
+	memset(futex_queues, 0, sizeof(*futex_queues) * futex_hashsize);
+
+	for (i = 0; i < futex_hashsize; i++) {
+		atomic_set(&futex_queues[i].waiters, 0);
 		plist_head_init(&futex_queues[i].chain, &futex_queues[i].lock);
 		spin_lock_init(&futex_queues[i].lock);
 	}
@@ -244,7 +244,12 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 
 		/* didnt get the lock, go to sleep: */
 		spin_unlock_mutex(&lock->wait_lock, flags);
+		/* let the workqueue pool run another worker meanwhile */
+		if (unlikely(task->flags & PF_WQ_WORKER))
+			wq_worker_sleeping(task);
 		__schedule();
+		if (unlikely(task->flags & PF_WQ_WORKER))
+			wq_worker_running(task);
 		spin_lock_mutex(&lock->wait_lock, flags);
 	}
 
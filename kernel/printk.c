@@ -32,6 +32,7 @@
 #include <linux/security.h>
 #include <linux/bootmem.h>
 #include <linux/syscalls.h>
+#include <linux/kthread.h>
 
 #include <asm/uaccess.h>
 
@@ -132,6 +133,11 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/* Work for printk_tick(), which runs where waking a task is safe */
+static DEFINE_PER_CPU(int, printk_pending);
+#define PRINTK_PENDING_KLOGD	0x01
+#define PRINTK_PENDING_CONSOLE	0x02
+
 #ifdef CONFIG_PRINTK
 
 static char __log_buf[__LOG_BUF_LEN];
@@ -139,6 +145,14 @@ static char *log_buf = __log_buf;
 static int log_buf_len = __LOG_BUF_LEN;
 static unsigned logged_chars; /* Number of chars produced since last read+clear operation */
 
+#ifdef CONFIG_PRINTK_DEFERRED
+static void printk_cpu_merge(void);
+#else
+static inline void printk_cpu_merge(void)
+{
+}
+#endif
+
 static int __init log_buf_len_setup(char *str)
 {
 	unsigned size = memparse(str, &str);
@@ -362,6 +376,7 @@ int do_syslog(int type, char __user *buf, int len)
 		if (count > log_buf_len)
 			count = log_buf_len;
 		spin_lock_irq(&logbuf_lock);
+		printk_cpu_merge();
 		if (count > logged_chars)
 			count = logged_chars;
 		if (do_clear)
@@ -419,7 +434,10 @@ int do_syslog(int type, char __user *buf, int len)
 		error = 0;
 		break;
 	case 9:		/* Number of chars in the log buffer */
+		spin_lock_irq(&logbuf_lock);
+		printk_cpu_merge();
 		error = log_end - log_start;
+		spin_unlock_irq(&logbuf_lock);
 		break;
 	case 10:	/* Size of the log buffer */
 		error = log_buf_len;
@@ -571,6 +589,325 @@ static int printk_time = 0;
 #endif
 module_param_named(time, printk_time, bool, S_IRUGO | S_IWUSR);
 
+/* "<6>[4294967295.999999] " */
+#define LOG_PREFIX_MAX	24
+
+/*
+ * Format the level token, followed by the time if printk_time is set,
+ * that starts each line in log_buf.  Returns the length.
+ */
+static unsigned log_line_prefix(char *buf, int level, unsigned int cpu)
+{
+	unsigned long long t;
+	unsigned long nanosec_rem;
+	unsigned len;
+
+	buf[0] = '<';
+	buf[1] = level + '0';
+	buf[2] = '>';
+	len = 3;
+
+	if (printk_time) {
+		t = cpu_clock(cpu);
+		nanosec_rem = do_div(t, 1000000000);
+		len += sprintf(buf + len, "[%5lu.%06lu] ", (unsigned long) t,
+			       nanosec_rem / 1000);
+	}
+	return len;
+}
+
+#ifdef CONFIG_PRINTK_CAPTURE
+static printk_capture_fn printk_capture;
+
+static inline void printk_capture_text(const char *text, int new_line)
+{
+	printk_capture_fn fn = printk_capture;
+	int flags = 0;
+
+	if (!fn)
+		return;
+	if (!new_line)
+		flags |= PRINTK_CAPTURE_CONT;
+	if (printk_time)
+		flags |= PRINTK_CAPTURE_TIME;
+	fn(text, strlen(text), flags);
+}
+
+/**
+ * printk_set_capture - hand every printk() to a function as well
+ * @fn: the capture function
+ *
+ * @fn first gets what log_buf already holds, a line at a time and with
+ * PRINTK_CAPTURE_REPLAY: the timestamps, if any, are already in the text.
+ */
+void printk_set_capture(printk_capture_fn fn)
+{
+	static char line[256];
+	unsigned long flags;
+	unsigned i, n = 0;
+	int new_line = 1, replay = PRINTK_CAPTURE_REPLAY;
+	char c;
+
+	if (printk_time)
+		replay |= PRINTK_CAPTURE_TIME;
+
+	spin_lock_irqsave(&logbuf_lock, flags);
+	printk_cpu_merge();
+	i = log_end > log_buf_len ? log_end - log_buf_len : 0;
+	while (i != log_end) {
+		c = LOG_BUF(i++);
+		line[n++] = c;
+		if (c == '\n' || n == sizeof(line) - 1 || i == log_end) {
+			line[n] = '\0';
+			fn(line, n, new_line ? replay :
+			   replay | PRINTK_CAPTURE_CONT);
+			new_line = c == '\n';
+			n = 0;
+		}
+	}
+	printk_capture = fn;
+	spin_unlock_irqrestore(&logbuf_lock, flags);
+}
+#else
+static inline void printk_capture_text(const char *text, int new_line)
+{
+}
+#endif
+
+#ifdef CONFIG_PRINTK_DEFERRED
+/*
+ * Per-cpu printk buffers.
+ *
+ * With the console thread running, vprintk() takes no lock and calls no
+ * console driver.  It formats the message, level tokens and timestamps
+ * included, as one record in the buffer of the local cpu, which only that
+ * cpu ever writes, and publishes it by advancing ->head.  The record
+ * carries a global sequence number.  printk_cpu_merge() moves records from
+ * all the buffers into log_buf in sequence order under logbuf_lock and
+ * advances their ->tail; the console thread does that, wakes klogd and
+ * then feeds the consoles.
+ *
+ * If the thread falls behind and a buffer fills up, vprintk() merges by
+ * itself when logbuf_lock is free, and otherwise drops the message.  The
+ * next record from that cpu says how many were lost.
+ *
+ * Until the system is running, during an oops or panic, and with
+ * printk.synchronous=1, printk() writes log_buf and the consoles itself as
+ * it always did, after merging what the buffers hold.
+ */
+#define PRINTK_CPU_BUF_LEN	(1 << CONFIG_PRINTK_CPU_BUF_SHIFT)
+#define PRINTK_CPU_BUF_MASK	(PRINTK_CPU_BUF_LEN - 1)
+
+struct printk_cpu_rec {
+	u32		seq;
+	u16		len;		/* of the text that follows */
+	u16		dropped;	/* messages lost just before this one */
+};
+
+struct printk_cpu_buf {
+	unsigned	head;		/* written by the owning cpu only */
+	unsigned	tail;		/* written under logbuf_lock only */
+	unsigned	dropped;
+	int		busy;
+	int		new_text_line;
+	char		text[1024];
+	char		buf[PRINTK_CPU_BUF_LEN];
+};
+
+static DEFINE_PER_CPU(struct printk_cpu_buf, printk_cpu_buf) = {
+	.new_text_line	= 1,
+};
+static atomic_t printk_seq = ATOMIC_INIT(0);
+static struct task_struct *printk_console_task;
+
+static int printk_sync;
+module_param_named(synchronous, printk_sync, bool, S_IRUGO | S_IWUSR);
+
+static inline int printk_deferred(void)
+{
+	return printk_console_task && !printk_sync && !oops_in_progress &&
+		system_state == SYSTEM_RUNNING;
+}
+
+static void printk_cpu_read(struct printk_cpu_buf *b, unsigned pos,
+			    void *dest, unsigned len)
+{
+	char *d = dest;
+
+	while (len--)
+		*d++ = b->buf[pos++ & PRINTK_CPU_BUF_MASK];
+}
+
+static void printk_cpu_write(struct printk_cpu_buf *b, unsigned pos,
+			     const void *src, unsigned len)
+{
+	const char *s = src;
+
+	while (len--)
+		b->buf[pos++ & PRINTK_CPU_BUF_MASK] = *s++;
+}
+
+/*
+ * Append b->text to the buffer of @cpu as one record, inserting the line
+ * prefixes.  Returns the length added to the log, or -ENOSPC with nothing
+ * published if the record does not fit.
+ */
+static int printk_cpu_store(struct printk_cpu_buf *b, unsigned int cpu)
+{
+	unsigned limit = ACCESS_ONCE(b->tail) + PRINTK_CPU_BUF_LEN;
+	unsigned pos = b->head + sizeof(struct printk_cpu_rec);
+	int level = default_message_loglevel;
+	int new_line = b->new_text_line;
+	char prefix[LOG_PREFIX_MAX];
+	struct printk_cpu_rec rec;
+	unsigned len;
+	char *p;
+
+	/* pairs with the barrier before the tail update in the merge */
+	smp_mb();
+	if ((int)(limit - pos) < 0)
+		return -ENOSPC;
+
+	for (p = b->text; *p; p++) {
+		if (new_line) {
+			if (p[0] == '<' && p[1] >= '0' && p[1] <= '7' &&
+			    p[2] == '>') {
+				level = p[1] - '0';
+				p += 3;
+			}
+			len = log_line_prefix(prefix, level, cpu);
+			if (limit - pos < len)
+				return -ENOSPC;
+			printk_cpu_write(b, pos, prefix, len);
+			pos += len;
+			new_line = 0;
+			if (!*p)
+				break;
+		}
+		if (pos == limit)
+			return -ENOSPC;
+		b->buf[pos++ & PRINTK_CPU_BUF_MASK] = *p;
+		if (*p == '\n')
+			new_line = 1;
+	}
+
+	rec.seq = atomic_inc_return(&printk_seq);
+	rec.len = pos - b->head - sizeof(rec);
+	rec.dropped = min(b->dropped, 0xffffU);
+	printk_cpu_write(b, b->head, &rec, sizeof(rec));
+	b->dropped = 0;
+	b->new_text_line = new_line;
+
+	/* the record before the head that publishes it */
+	smp_wmb();
+	b->head = pos;
+	return rec.len;
+}
+
+/*
+ * Move every published record into log_buf, oldest sequence number first.
+ * Called with logbuf_lock held.
+ */
+static void printk_cpu_merge(void)
+{
+	struct printk_cpu_rec rec, first_rec;
+	struct printk_cpu_buf *b, *first;
+	unsigned int cpu, first_cpu = 0;
+	char msg[48];
+	unsigned pos, i;
+
+	for (;;) {
+		first = NULL;
+		for_each_possible_cpu(cpu) {
+			b = &per_cpu(printk_cpu_buf, cpu);
+			if (b->tail == ACCESS_ONCE(b->head))
+				continue;
+			/* the head before the record it publishes */
+			smp_rmb();
+			printk_cpu_read(b, b->tail, &rec, sizeof(rec));
+			if (!first || (s32)(rec.seq - first_rec.seq) < 0) {
+				first = b;
+				first_rec = rec;
+				first_cpu = cpu;
+			}
+		}
+		if (!first)
+			break;
+
+		if (first_rec.dropped) {
+			i = sprintf(msg, "<4>printk: %u messages dropped on "
+				    "cpu%u\n", first_rec.dropped, first_cpu);
+			for (pos = 0; pos < i; pos++)
+				emit_log_char(msg[pos]);
+		}
+
+		pos = first->tail + sizeof(rec);
+		for (i = 0; i < first_rec.len; i++)
+			emit_log_char(first->buf[pos++ & PRINTK_CPU_BUF_MASK]);
+
+		/* done reading the record before the space is reused */
+		smp_mb();
+		first->tail = pos;
+	}
+}
+
+static int printk_cpu_pending(void)
+{
+	struct printk_cpu_buf *b;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		b = &per_cpu(printk_cpu_buf, cpu);
+		if (b->tail != ACCESS_ONCE(b->head))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * The vprintk() fast path: called with interrupts off, so nothing but an
+ * NMI or a printk from vscnprintf() itself can race with us on this cpu.
+ */
+static int vprintk_cpu(unsigned int cpu, const char *fmt, va_list args)
+{
+	struct printk_cpu_buf *b = &per_cpu(printk_cpu_buf, cpu);
+	int len;
+
+	if (unlikely(b->busy)) {
+		b->dropped++;
+		return 0;
+	}
+	b->busy = 1;
+
+	vscnprintf(b->text, sizeof(b->text), fmt, args);
+	printk_capture_text(b->text, b->new_text_line);
+
+#ifdef	CONFIG_DEBUG_LL
+	printascii(b->text);
+#endif
+
+	len = printk_cpu_store(b, cpu);
+	if (len < 0) {
+		lockdep_off();
+		if (spin_trylock(&logbuf_lock)) {
+			printk_cpu_merge();
+			spin_unlock(&logbuf_lock);
+			len = printk_cpu_store(b, cpu);
+		}
+		lockdep_on();
+	}
+	if (len < 0) {
+		b->dropped++;
+		len = 0;
+	}
+
+	/* printk_tick() wakes the thread, we may hold the runqueue lock */
+	per_cpu(printk_pending, cpu) |= PRINTK_PENDING_CONSOLE;
+	b->busy = 0;
+	return len;
+}
+#endif
+
 /* Check if we have any console registered that can be called early in boot. */
 static int have_callable_console(void)
 {
@@ -599,6 +936,10 @@ static int have_callable_console(void)
  * then changes console_loglevel may break. This is because console_loglevel
  * is inspected when the actual printing occurs.
  *
+ * With CONFIG_PRINTK_DEFERRED, once the system is running and unless an
+ * oops is in progress, printk() only stores the message in a per-cpu
+ * buffer; the console thread puts it into the log and on the consoles.
+ *
  * See also:
  * printf(3)
  *
@@ -678,6 +1019,8 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	int current_log_level = default_message_loglevel;
 	unsigned long flags;
 	int this_cpu;
+	char tbuf[LOG_PREFIX_MAX], *tp;
+	unsigned tlen;
 	char *p;
 
 	boot_delay_msec();
@@ -687,6 +1030,13 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	raw_local_irq_save(flags);
 	this_cpu = smp_processor_id();
 
+#ifdef CONFIG_PRINTK_DEFERRED
+	if (printk_deferred()) {
+		printed_len = vprintk_cpu(this_cpu, fmt, args);
+		goto out_restore_irqs;
+	}
+#endif
+
 	/*
 	 * Ouch, printk recursed into itself!
 	 */
@@ -709,6 +1059,9 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	spin_lock(&logbuf_lock);
 	printk_cpu = this_cpu;
 
+	/* Keep the order with whatever was deferred before */
+	printk_cpu_merge();
+
 	if (recursion_bug) {
 		recursion_bug = 0;
 		strcpy(printk_buf, recursion_bug_msg);
@@ -717,7 +1070,7 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	/* Emit the output into the temporary buffer */
 	printed_len += vscnprintf(printk_buf + printed_len,
 				  sizeof(printk_buf) - printed_len, fmt, args);
-
+	printk_capture_text(printk_buf, new_text_line);
 
 #ifdef	CONFIG_DEBUG_LL
 	printascii(printk_buf);
@@ -737,31 +1090,14 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 				printed_len -= 3;
 			}
 
-			/* Always output the token */
-			emit_log_char('<');
-			emit_log_char(current_log_level + '0');
-			emit_log_char('>');
-			printed_len += 3;
+			/* Always output the token, then the time */
+			tlen = log_line_prefix(tbuf, current_log_level,
+					       printk_cpu);
+			for (tp = tbuf; tp < tbuf + tlen; tp++)
+				emit_log_char(*tp);
+			printed_len += tlen;
 			new_text_line = 0;
 
-			if (printk_time) {
-				/* Follow the token with the time */
-				char tbuf[50], *tp;
-				unsigned tlen;
-				unsigned long long t;
-				unsigned long nanosec_rem;
-
-				t = cpu_clock(printk_cpu);
-				nanosec_rem = do_div(t, 1000000000);
-				tlen = sprintf(tbuf, "[%5lu.%06lu] ",
-						(unsigned long) t,
-						nanosec_rem / 1000);
-
-				for (tp = tbuf; tp < tbuf + tlen; tp++)
-					emit_log_char(*tp);
-				printed_len += tlen;
-			}
-
 			if (!*p)
 				break;
 		}
@@ -995,13 +1331,18 @@ int is_console_locked(void)
 	return console_locked;
 }
 
-static DEFINE_PER_CPU(int, printk_pending);
-
 void printk_tick(void)
 {
-	if (__get_cpu_var(printk_pending)) {
+	int pending = __get_cpu_var(printk_pending);
+
+	if (pending) {
 		__get_cpu_var(printk_pending) = 0;
-		wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_KLOGD)
+			wake_up_interruptible(&log_wait);
+#ifdef CONFIG_PRINTK_DEFERRED
+		if (pending & PRINTK_PENDING_CONSOLE)
+			wake_up_process(printk_console_task);
+#endif
 	}
 }
 
@@ -1013,7 +1354,7 @@ int printk_needs_cpu(int cpu)
 void wake_up_klogd(void)
 {
 	if (waitqueue_active(&log_wait))
-		__raw_get_cpu_var(printk_pending) = 1;
+		__raw_get_cpu_var(printk_pending) |= PRINTK_PENDING_KLOGD;
 }
 
 /**
@@ -1065,6 +1406,90 @@ void release_console_sem(void)
 }
 EXPORT_SYMBOL(release_console_sem);
 
+#ifdef CONFIG_PRINTK_DEFERRED
+/* Largest run of log_buf handed to the consoles with interrupts off */
+#define PRINTK_CONSOLE_CHUNK	128
+
+/*
+ * Feed the consoles a line or so at a time: call_console_drivers() runs
+ * with interrupts disabled, and a serial console takes about a millisecond
+ * for every ten characters.  Must be called within acquire_console_sem().
+ */
+static void printk_console_flush(void)
+{
+	unsigned long flags;
+	unsigned start, end, i;
+
+	for ( ; ; ) {
+		spin_lock_irqsave(&logbuf_lock, flags);
+		if (con_start == log_end) {
+			spin_unlock_irqrestore(&logbuf_lock, flags);
+			break;
+		}
+		start = con_start;
+		end = log_end;
+		if (end - start > PRINTK_CONSOLE_CHUNK) {
+			/* call_console_drivers() wants whole lines */
+			for (i = start + PRINTK_CONSOLE_CHUNK; i != start; i--)
+				if (LOG_BUF(i - 1) == '\n')
+					break;
+			end = i != start ? i : start + PRINTK_CONSOLE_CHUNK;
+		}
+		con_start = end;
+		spin_unlock(&logbuf_lock);
+		stop_critical_timings();	/* don't trace print latency */
+		call_console_drivers(start, end);
+		start_critical_timings();
+		local_irq_restore(flags);
+		cond_resched();
+	}
+}
+
+static int printk_console_thread(void *unused)
+{
+	int wake_klogd;
+
+	set_user_nice(current, 19);
+
+	for ( ; ; ) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_cpu_pending() &&
+		    (console_suspended || con_start == log_end))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		spin_lock_irq(&logbuf_lock);
+		printk_cpu_merge();
+		wake_klogd = log_start - log_end;
+		spin_unlock_irq(&logbuf_lock);
+		if (wake_klogd)
+			wake_up_interruptible(&log_wait);
+
+		acquire_console_sem();
+		if (!console_suspended)
+			printk_console_flush();
+		release_console_sem();
+	}
+
+	return 0;
+}
+
+static int __init printk_console_init(void)
+{
+	struct task_struct *p;
+
+	p = kthread_run(printk_console_thread, NULL, "kconsoled");
+	if (IS_ERR(p)) {
+		printk(KERN_ERR "printk: console thread not started, "
+		       "printing synchronously\n");
+		return PTR_ERR(p);
+	}
+	printk_console_task = p;
+	return 0;
+}
+core_initcall(printk_console_init);
+#endif
+
 /**
  * console_conditional_schedule - yield the CPU if required
  *
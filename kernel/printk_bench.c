@@ -0,0 +1,238 @@
+/*
+ * kernel/printk_bench.c
+ *
+ * printk() latency and throughput.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Loading the module times @count printk() calls from process context and
+ * as many from a timer interrupt firing every millisecond, which also gives
+ * how late the timer ran.  It then starts a thread on each online cpu that
+ * prints as fast as it can for @flood_ms and reports the total rate and the
+ * slowest single call.  Messages go out at @level, so whether the consoles
+ * see them depends on the console loglevel.  The module then refuses to
+ * stay loaded.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/hrtimer.h>
+#include <linux/completion.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
+#include <linux/cpumask.h>
+
+static unsigned int count = 1000;
+module_param(count, uint, 0);
+MODULE_PARM_DESC(count, "printk() calls per latency measurement (default 1000)");
+
+static unsigned int flood_ms = 2000;
+module_param(flood_ms, uint, 0);
+MODULE_PARM_DESC(flood_ms, "Length of the flood test (default 2000ms)");
+
+static int level = 6;
+module_param(level, int, 0);
+MODULE_PARM_DESC(level, "Log level of the messages (default 6, KERN_INFO)");
+
+static u32 *bench_ns;
+static unsigned int bench_n;
+
+static unsigned long long bench_clock(void)
+{
+	return cpu_clock(raw_smp_processor_id());
+}
+
+static void bench_print(const char *what, unsigned int i)
+{
+	unsigned long long start;
+
+	start = bench_clock();
+	printk("<%d>printk_bench: %s %u: the quick brown fox jumps over the "
+	       "lazy dog\n", level, what, i);
+	bench_ns[bench_n++] = bench_clock() - start;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void bench_report(const char *what)
+{
+	unsigned long long sum = 0;
+	unsigned int i;
+
+	if (!bench_n)
+		return;
+
+	for (i = 0; i < bench_n; i++)
+		sum += bench_ns[i];
+	sort(bench_ns, bench_n, sizeof(*bench_ns), bench_cmp, NULL);
+
+	printk(KERN_INFO "printk_bench: %-8s %u calls, ns: min %u median %u "
+	       "p99 %u max %u avg %llu\n", what, bench_n, bench_ns[0],
+	       bench_ns[bench_n / 2], bench_ns[bench_n * 99 / 100],
+	       bench_ns[bench_n - 1], div_u64(sum, bench_n));
+	bench_n = 0;
+}
+
+static void bench_process(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		preempt_disable();
+		bench_print("task", i);
+		preempt_enable();
+		cond_resched();
+	}
+	bench_report("task");
+}
+
+static struct hrtimer bench_timer;
+static DECLARE_COMPLETION(bench_timer_done);
+static u32 bench_late_max;
+static unsigned long long bench_late_sum;
+
+static enum hrtimer_restart bench_timer_fn(struct hrtimer *timer)
+{
+	s64 late = ktime_to_ns(ktime_sub(ktime_get(),
+					 hrtimer_get_expires(timer)));
+
+	if (late > bench_late_max)
+		bench_late_max = late;
+	bench_late_sum += late;
+
+	bench_print("irq", bench_n);
+	if (bench_n == count) {
+		complete(&bench_timer_done);
+		return HRTIMER_NORESTART;
+	}
+	hrtimer_forward_now(timer, ktime_set(0, NSEC_PER_MSEC));
+	return HRTIMER_RESTART;
+}
+
+static void bench_irq(void)
+{
+	bench_late_max = 0;
+	bench_late_sum = 0;
+
+	hrtimer_init(&bench_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	bench_timer.function = bench_timer_fn;
+	hrtimer_start(&bench_timer, ktime_set(0, NSEC_PER_MSEC),
+		      HRTIMER_MODE_REL);
+	wait_for_completion(&bench_timer_done);
+
+	printk(KERN_INFO "printk_bench: timer    late ns: max %u avg %llu\n",
+	       bench_late_max, div_u64(bench_late_sum, count));
+	bench_report("irq");
+}
+
+struct bench_flood {
+	struct task_struct	*task;
+	unsigned long		messages;
+	u32			max_ns;
+};
+
+static DEFINE_PER_CPU(struct bench_flood, bench_flood);
+static unsigned long bench_flood_end;
+
+static int bench_flood_thread(void *data)
+{
+	struct bench_flood *f = data;
+	unsigned long long start;
+	u32 ns;
+
+	while (time_before(jiffies, bench_flood_end)) {
+		start = bench_clock();
+		printk("<%d>printk_bench: flood %lu: the quick brown fox jumps "
+		       "over the lazy dog\n", level, f->messages);
+		ns = bench_clock() - start;
+		if (ns > f->max_ns)
+			f->max_ns = ns;
+		f->messages++;
+		cond_resched();
+	}
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+	}
+	return 0;
+}
+
+static void bench_flood_run(void)
+{
+	struct bench_flood *f;
+	unsigned long messages = 0;
+	u32 max_ns = 0;
+	int cpu;
+
+	bench_flood_end = jiffies + msecs_to_jiffies(flood_ms);
+
+	for_each_online_cpu(cpu) {
+		f = &per_cpu(bench_flood, cpu);
+		memset(f, 0, sizeof(*f));
+		f->task = kthread_create(bench_flood_thread, f,
+					 "printk_flood/%d", cpu);
+		if (IS_ERR(f->task)) {
+			f->task = NULL;
+			continue;
+		}
+		kthread_bind(f->task, cpu);
+		wake_up_process(f->task);
+	}
+
+	for_each_online_cpu(cpu) {
+		f = &per_cpu(bench_flood, cpu);
+		if (!f->task)
+			continue;
+		kthread_stop(f->task);
+		messages += f->messages;
+		if (f->max_ns > max_ns)
+			max_ns = f->max_ns;
+	}
+
+	printk(KERN_INFO "printk_bench: flood    %lu messages in %u ms on %u "
+	       "cpus, %lu/s, slowest call %u ns\n", messages, flood_ms,
+	       num_online_cpus(), messages * 1000 / (flood_ms ?: 1), max_ns);
+}
+
+static int __init printk_bench_init(void)
+{
+	if (!count)
+		return -EINVAL;
+
+	bench_ns = vmalloc(count * sizeof(*bench_ns));
+	if (!bench_ns)
+		return -ENOMEM;
+
+	bench_process();
+	bench_irq();
+	bench_flood_run();
+
+	vfree(bench_ns);
+
+	/* nothing to keep around, see tcrypt */
+	return -EAGAIN;
+}
+
+static void __exit printk_bench_exit(void)
+{
+}
+
+module_init(printk_bench_init);
+module_exit(printk_bench_exit);
+
+MODULE_DESCRIPTION("printk latency benchmark and flood test");
+MODULE_LICENSE("GPL");
@@ -474,6 +474,85 @@ __update_curr(struct cfs_rq *cfs_rq, struct sched_entity *curr,
 	update_min_vruntime(cfs_rq);
 }
 
+#ifdef CONFIG_CFS_BANDWIDTH
+static inline struct cfs_bandwidth *tg_cfs_bandwidth(struct task_group *tg)
+{
+	return &tg->cfs_bandwidth;
+}
+
+static inline int cfs_rq_throttled(struct cfs_rq *cfs_rq)
+{
+	return cfs_rq->throttled;
+}
+
+/*
+ * Top cfs_rq->runtime_remaining up to a slice from the global pool, paying
+ * off any overrun first.  Returns whether the cfs_rq has runtime left.
+ */
+static int assign_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
+	u64 amount = 0, min_amount;
+
+	min_amount = sched_cfs_bandwidth_slice() - cfs_rq->runtime_remaining;
+
+	spin_lock(&cfs_b->lock);
+	if (cfs_b->quota == RUNTIME_INF)
+		amount = min_amount;
+	else {
+		/* the timer stops in idle periods, start a new period */
+		if (!cfs_b->timer_active) {
+			cfs_b->runtime = cfs_b->quota;
+			cfs_b->period_seq++;
+			__start_cfs_bandwidth(cfs_b);
+		}
+		cfs_b->idle = 0;
+		amount = min(cfs_b->runtime, min_amount);
+		cfs_b->runtime -= amount;
+	}
+	cfs_rq->runtime_seq = cfs_b->period_seq;
+	spin_unlock(&cfs_b->lock);
+
+	cfs_rq->runtime_remaining += amount;
+
+	return cfs_rq->runtime_remaining > 0;
+}
+
+static void account_cfs_rq_runtime(struct cfs_rq *cfs_rq,
+				   unsigned long delta_exec)
+{
+	if (likely(!cfs_rq->runtime_enabled))
+		return;
+
+	cfs_rq->runtime_remaining -= delta_exec;
+
+	/* runtime left over from an earlier period does not carry over */
+	if (cfs_rq->runtime_seq != tg_cfs_bandwidth(cfs_rq->tg)->period_seq &&
+	    cfs_rq->runtime_remaining > 0)
+		cfs_rq->runtime_remaining = 0;
+
+	if (likely(cfs_rq->runtime_remaining > 0))
+		return;
+
+	/*
+	 * Out of runtime and none left in the pool: have the running entity
+	 * rescheduled, put_prev_entity() throttles the cfs_rq.
+	 */
+	if (!assign_cfs_rq_runtime(cfs_rq) && likely(cfs_rq->curr))
+		resched_task(rq_of(cfs_rq)->curr);
+}
+#else
+static inline int cfs_rq_throttled(struct cfs_rq *cfs_rq)
+{
+	return 0;
+}
+
+static inline void account_cfs_rq_runtime(struct cfs_rq *cfs_rq,
+					  unsigned long delta_exec)
+{
+}
+#endif /* CONFIG_CFS_BANDWIDTH */
+
 static void update_curr(struct cfs_rq *cfs_rq)
 {
 	struct sched_entity *curr = cfs_rq->curr;
@@ -501,6 +580,8 @@ static void update_curr(struct cfs_rq *cfs_rq)
 		cpuacct_charge(curtask, delta_exec);
 		account_group_exec_runtime(curtask, delta_exec);
 	}
+
+	account_cfs_rq_runtime(cfs_rq, delta_exec);
 }
 
 static inline void
@@ -784,6 +865,211 @@ check_preempt_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 	}
 }
 
+#ifdef CONFIG_CFS_BANDWIDTH
+/*
+ * Take the entity of a cfs_rq that ran out of runtime off its parent, and
+ * the parents that are left empty.  Its tasks stay queued on it.
+ */
+static void throttle_cfs_rq(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
+	struct sched_entity *se;
+
+	se = cfs_rq->tg->se[cpu_of(rq)];
+
+	for_each_sched_entity(se) {
+		struct cfs_rq *qcfs_rq = cfs_rq_of(se);
+
+		if (!se->on_rq)
+			break;
+		dequeue_entity(qcfs_rq, se, 1);
+		/* Don't dequeue parent if it has other entities besides us */
+		if (qcfs_rq->load.weight || cfs_rq_throttled(qcfs_rq))
+			break;
+	}
+
+	cfs_rq->throttled = 1;
+	cfs_rq->throttled_timestamp = rq->clock;
+
+	spin_lock(&cfs_b->lock);
+	list_add_tail_rcu(&cfs_rq->throttled_list, &cfs_b->throttled_cfs_rq);
+	spin_unlock(&cfs_b->lock);
+}
+
+static void unthrottle_cfs_rq(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
+	struct sched_entity *se;
+
+	se = cfs_rq->tg->se[cpu_of(rq)];
+
+	cfs_rq->throttled = 0;
+	update_rq_clock(rq);
+
+	spin_lock(&cfs_b->lock);
+	cfs_b->throttled_time += rq->clock - cfs_rq->throttled_timestamp;
+	list_del_rcu(&cfs_rq->throttled_list);
+	spin_unlock(&cfs_b->lock);
+
+	/* nothing queued, the next enqueue puts the entity back */
+	if (!cfs_rq->load.weight)
+		return;
+
+	for_each_sched_entity(se) {
+		if (se->on_rq)
+			break;
+		cfs_rq = cfs_rq_of(se);
+		enqueue_entity(cfs_rq, se, 1);
+		if (cfs_rq_throttled(cfs_rq))
+			break;
+	}
+
+	/* the cpu may have gone idle with only throttled tasks */
+	if (rq->curr == rq->idle && rq->cfs.nr_running)
+		resched_task(rq->curr);
+}
+
+/*
+ * Called when the running entity is put back: throttle its cfs_rq if it
+ * is out of runtime and the pool has none left either.
+ */
+static void check_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+	if (likely(!cfs_rq->runtime_enabled || cfs_rq->runtime_remaining > 0))
+		return;
+
+	if (cfs_rq_throttled(cfs_rq) || assign_cfs_rq_runtime(cfs_rq))
+		return;
+
+	throttle_cfs_rq(cfs_rq);
+}
+
+/*
+ * A group that wakes up must not run on runtime it does not have: it
+ * could run for ticks before update_curr() gets to throttle it.
+ */
+static void check_enqueue_throttle(struct cfs_rq *cfs_rq)
+{
+	if (!cfs_rq->runtime_enabled || cfs_rq->curr)
+		return;
+
+	if (cfs_rq_throttled(cfs_rq))
+		return;
+
+	account_cfs_rq_runtime(cfs_rq, 0);
+	if (cfs_rq->runtime_remaining <= 0)
+		throttle_cfs_rq(cfs_rq);
+}
+
+/*
+ * Hand out up to @remaining runtime to the throttled cfs_rqs, unthrottling
+ * those that get out of debt.  Returns the runtime handed out.
+ */
+static u64 distribute_cfs_runtime(struct cfs_bandwidth *cfs_b, u64 remaining,
+				  unsigned int seq)
+{
+	struct cfs_rq *cfs_rq;
+	u64 runtime, starting_runtime = remaining;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(cfs_rq, &cfs_b->throttled_cfs_rq,
+				throttled_list) {
+		struct rq *rq = rq_of(cfs_rq);
+
+		spin_lock(&rq->lock);
+		if (!cfs_rq_throttled(cfs_rq))
+			goto next;
+
+		runtime = -cfs_rq->runtime_remaining + 1;
+		if (runtime > remaining)
+			runtime = remaining;
+		remaining -= runtime;
+
+		cfs_rq->runtime_remaining += runtime;
+		cfs_rq->runtime_seq = seq;
+
+		if (cfs_rq->runtime_remaining > 0)
+			unthrottle_cfs_rq(cfs_rq);
+next:
+		spin_unlock(&rq->lock);
+
+		if (!remaining)
+			break;
+	}
+	rcu_read_unlock();
+
+	return starting_runtime - remaining;
+}
+
+/*
+ * Refill the pool at the start of a period and unthrottle the cfs_rqs.
+ * Returns 1 when the group was idle for a period and the timer can stop.
+ */
+static int do_sched_cfs_period_timer(struct cfs_bandwidth *cfs_b, int overrun)
+{
+	u64 runtime, runtime_used;
+	unsigned int seq;
+	int throttled;
+
+	spin_lock(&cfs_b->lock);
+	if (cfs_b->quota == RUNTIME_INF)
+		goto out_deactivate;
+
+	throttled = !list_empty(&cfs_b->throttled_cfs_rq);
+	cfs_b->nr_periods += overrun;
+
+	if (cfs_b->idle && !throttled)
+		goto out_deactivate;
+
+	cfs_b->runtime = cfs_b->quota;
+	seq = ++cfs_b->period_seq;
+
+	if (!throttled) {
+		/* cleared again as soon as somebody takes runtime */
+		cfs_b->idle = 1;
+		goto out_unlock;
+	}
+
+	cfs_b->nr_throttled += overrun;
+
+	/*
+	 * Distribution takes the rq locks, which nest outside cfs_b->lock.
+	 * The runtime is handed out as it was at the start of each pass.
+	 */
+	while (throttled && cfs_b->runtime > 0) {
+		runtime = cfs_b->runtime;
+		spin_unlock(&cfs_b->lock);
+
+		runtime_used = distribute_cfs_runtime(cfs_b, runtime, seq);
+
+		spin_lock(&cfs_b->lock);
+		throttled = !list_empty(&cfs_b->throttled_cfs_rq);
+		cfs_b->runtime -= min(runtime_used, cfs_b->runtime);
+		if (!runtime_used)
+			break;
+	}
+	cfs_b->idle = 0;
+out_unlock:
+	spin_unlock(&cfs_b->lock);
+	return 0;
+
+out_deactivate:
+	cfs_b->timer_active = 0;
+	spin_unlock(&cfs_b->lock);
+	return 1;
+}
+#else
+static inline void check_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+}
+
+static inline void check_enqueue_throttle(struct cfs_rq *cfs_rq)
+{
+}
+#endif /* CONFIG_CFS_BANDWIDTH */
+
 static void
 set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
@@ -839,6 +1125,8 @@ static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
 	if (prev->on_rq)
 		update_curr(cfs_rq);
 
+	check_cfs_rq_runtime(cfs_rq);
+
 	check_spread(cfs_rq, prev);
 	if (prev->on_rq) {
 		update_stats_wait_start(cfs_rq, prev);
@@ -937,6 +1225,14 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+/*
+ * Tell the 'sched' cpufreq governor how busy CFS is on this runqueue:
+ */
+static inline void cfs_cpufreq_update(struct rq *rq)
+{
+	cpufreq_sched_update(cpu_of(rq), rq->clock, rq->cfs.nr_running);
+}
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -952,10 +1248,16 @@ static void enqueue_task_fair(struct rq *rq, struct task_struct *p, int wakeup)
 			break;
 		cfs_rq = cfs_rq_of(se);
 		enqueue_entity(cfs_rq, se, wakeup);
+		if (cfs_rq->nr_running == 1)
+			check_enqueue_throttle(cfs_rq);
+		/* a throttled cfs_rq keeps its entity off the parent */
+		if (cfs_rq_throttled(cfs_rq))
+			break;
 		wakeup = 1;
 	}
 
 	hrtick_update(rq);
+	cfs_cpufreq_update(rq);
 }
 
 /*
@@ -972,12 +1274,13 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int sleep)
 		cfs_rq = cfs_rq_of(se);
 		dequeue_entity(cfs_rq, se, sleep);
 		/* Don't dequeue parent if it has other entities besides us */
-		if (cfs_rq->load.weight)
+		if (cfs_rq->load.weight || cfs_rq_throttled(cfs_rq))
 			break;
 		sleep = 1;
 	}
 
 	hrtick_update(rq);
+	cfs_cpufreq_update(rq);
 }
 
 /*
@@ -1649,6 +1952,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	cfs_cpufreq_update(rq);
 }
 
 /*
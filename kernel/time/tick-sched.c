@@ -216,6 +216,10 @@ static ktime_t tick_nohz_start_idle(int cpu, struct tick_sched *ts)
 u64 get_cpu_idle_time_us(int cpu, u64 *last_update_time)
 {
 	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+	u64 idle;
+
+	if (unlikely(replay_idle_time(cpu, last_update_time, &idle)))
+		return idle;
 
 	if (!tick_nohz_enabled)
 		return -1;
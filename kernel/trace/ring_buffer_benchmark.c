@@ -0,0 +1,279 @@
+/*
+ * ring buffer tester and benchmark
+ *
+ * Times the write path of the ring buffer: a producer thread writes
+ * small events as fast as it can for run_time seconds, while a consumer
+ * thread on another cpu reads them back with ring_buffer_consume() or
+ * ring_buffer_read_page(). The result, including the cost of a single
+ * event in nanoseconds, is printed when the run is over.
+ *
+ * The module only uses the ring buffer API, so the same file can be
+ * built against another ring buffer implementation to compare them.
+ */
+#include <linux/ring_buffer.h>
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+/* number of events written between checks of the clock */
+#define BATCH		10000
+
+static unsigned int run_time = 10;
+module_param(run_time, uint, 0444);
+MODULE_PARM_DESC(run_time, "seconds to write events for");
+
+static int disable_reader;
+module_param(disable_reader, int, 0444);
+MODULE_PARM_DESC(disable_reader, "only write, do not read the buffer back");
+
+static int read_pages;
+module_param(read_pages, int, 0444);
+MODULE_PARM_DESC(read_pages, "read whole pages instead of single events");
+
+static struct ring_buffer *buffer;
+static struct task_struct *producer;
+static struct task_struct *consumer;
+static unsigned long read;
+static unsigned long bad;
+
+static DECLARE_COMPLETION(read_start);
+static DECLARE_COMPLETION(read_done);
+static int reader_finish;
+
+static void read_event(int cpu)
+{
+	struct ring_buffer_event *event;
+	int *entry;
+	u64 ts;
+
+	event = ring_buffer_consume(buffer, cpu, &ts);
+	if (!event)
+		return;
+
+	entry = ring_buffer_event_data(event);
+	if (*entry != cpu)
+		bad++;
+	else
+		read++;
+}
+
+static void read_page(int cpu, void **bpage)
+{
+	struct ring_buffer_event *event;
+	unsigned int length, head;
+	unsigned long commit;
+	u64 *time_stamp;
+	void *data;
+	int *entry;
+
+	if (!ring_buffer_read_page(buffer, bpage, cpu, 1))
+		return;
+
+	/* u64 time_stamp, local_t commit, event data */
+	time_stamp = *bpage;
+	commit = *(unsigned long *)(time_stamp + 1);
+	data = time_stamp + 2;
+
+	for (head = 0; head < commit; head += length) {
+		event = data + head;
+		switch (event->type) {
+		case RINGBUF_TYPE_PADDING:
+			/* the rest of the page is unused */
+			return;
+		case RINGBUF_TYPE_TIME_EXTEND:
+			length = ring_buffer_event_length(event);
+			break;
+		case RINGBUF_TYPE_DATA:
+			entry = ring_buffer_event_data(event);
+			length = ring_buffer_event_length(event) +
+				((void *)entry - (void *)event);
+			if (*entry != cpu)
+				bad++;
+			else
+				read++;
+			break;
+		default:
+			/* time stamps are not written by the ring buffer */
+			bad++;
+			return;
+		}
+	}
+}
+
+static void read_buffer(void)
+{
+	void **bpages = NULL;
+	int cpu;
+
+	if (read_pages) {
+		bpages = kzalloc(sizeof(void *) * nr_cpu_ids, GFP_KERNEL);
+		if (!bpages)
+			return;
+		for_each_online_cpu(cpu) {
+			bpages[cpu] = ring_buffer_alloc_read_page(buffer);
+			if (!bpages[cpu])
+				goto out;
+		}
+	}
+
+	while (!ACCESS_ONCE(reader_finish)) {
+		for_each_online_cpu(cpu) {
+			if (read_pages)
+				read_page(cpu, &bpages[cpu]);
+			else
+				read_event(cpu);
+		}
+		cond_resched();
+	}
+
+ out:
+	if (bpages) {
+		for_each_online_cpu(cpu)
+			if (bpages[cpu])
+				ring_buffer_free_read_page(buffer, bpages[cpu]);
+		kfree(bpages);
+	}
+}
+
+static int ring_buffer_consumer_thread(void *arg)
+{
+	while (!kthread_should_stop()) {
+		wait_for_completion(&read_start);
+		if (kthread_should_stop())
+			break;
+		read_buffer();
+		complete(&read_done);
+	}
+	return 0;
+}
+
+static void ring_buffer_producer(void)
+{
+	unsigned long long hit = 0, missed = 0;
+	unsigned long overruns, entries;
+	ktime_t start, end, stop;
+	s64 elapsed;
+	int cpu, i;
+
+	if (consumer) {
+		reader_finish = 0;
+		complete(&read_start);
+	}
+
+	start = ktime_get();
+	stop = ktime_add_ns(start, (u64)run_time * NSEC_PER_SEC);
+	do {
+		for (i = 0; i < BATCH; i++) {
+			struct ring_buffer_event *event;
+			unsigned long flags;
+			int *entry;
+
+			event = ring_buffer_lock_reserve(buffer, sizeof(*entry),
+							 &flags);
+			if (!event) {
+				missed++;
+				continue;
+			}
+			entry = ring_buffer_event_data(event);
+			*entry = smp_processor_id();
+			ring_buffer_unlock_commit(buffer, event, flags);
+			hit++;
+		}
+		end = ktime_get();
+		cond_resched();
+	} while (ktime_to_ns(ktime_sub(stop, end)) > 0 &&
+		 !kthread_should_stop());
+	elapsed = ktime_to_ns(ktime_sub(end, start));
+
+	if (consumer) {
+		reader_finish = 1;
+		wait_for_completion(&read_done);
+	}
+
+	overruns = ring_buffer_overruns(buffer);
+	entries = ring_buffer_entries(buffer);
+
+	printk(KERN_INFO "ring buffer benchmark: %s, %lld ms\n",
+	       !consumer ? "no reader" :
+	       read_pages ? "reading pages" : "consuming events",
+	       (long long)div_s64(elapsed, NSEC_PER_MSEC));
+	printk(KERN_INFO "  hit %llu missed %llu entries %lu overruns %lu "
+	       "read %lu bad %lu\n", hit, missed, entries, overruns, read, bad);
+	if (hit)
+		printk(KERN_INFO "  %llu ns per entry\n",
+		       div64_u64((u64)elapsed, hit));
+
+	for_each_online_cpu(cpu)
+		ring_buffer_reset_cpu(buffer, cpu);
+}
+
+static int ring_buffer_producer_thread(void *arg)
+{
+	ring_buffer_producer();
+
+	/* wait to be stopped by the module unload */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int __init ring_buffer_benchmark_init(void)
+{
+	int ret;
+
+	/* make a one meg buffer in overwrite mode */
+	buffer = ring_buffer_alloc(1000000, RB_FL_OVERWRITE);
+	if (!buffer)
+		return -ENOMEM;
+
+	if (!disable_reader) {
+		consumer = kthread_create(ring_buffer_consumer_thread,
+					  NULL, "rb_consumer");
+		ret = PTR_ERR(consumer);
+		if (IS_ERR(consumer))
+			goto out_fail;
+		wake_up_process(consumer);
+	}
+
+	producer = kthread_run(ring_buffer_producer_thread,
+			       NULL, "rb_producer");
+	ret = PTR_ERR(producer);
+	if (IS_ERR(producer))
+		goto out_kill;
+
+	return 0;
+
+ out_kill:
+	if (consumer) {
+		complete(&read_start);
+		kthread_stop(consumer);
+	}
+
+ out_fail:
+	ring_buffer_free(buffer);
+	return ret;
+}
+
+static void __exit ring_buffer_benchmark_exit(void)
+{
+	kthread_stop(producer);
+	if (consumer) {
+		complete(&read_start);
+		kthread_stop(consumer);
+	}
+	ring_buffer_free(buffer);
+}
+
+module_init(ring_buffer_benchmark_init);
+module_exit(ring_buffer_benchmark_exit);
+
+MODULE_DESCRIPTION("ring_buffer_benchmark");
+MODULE_LICENSE("GPL");
@@ -512,10 +512,11 @@ update_max_tr(struct trace_array *tr, struct task_struct *tsk, int cpu)
 	tr->buffer = max_tr.buffer;
 	max_tr.buffer = buf;
 
-	ftrace_disable_cpu();
-	ring_buffer_reset(tr->buffer);
-	ftrace_enable_cpu();
-
+	/*
+	 * Writers may already be using the old max buffer, so it cannot
+	 * be reset here.  What it still holds from before is older than
+	 * max_tr.time_start and is skipped when the trace is read.
+	 */
 	__update_max_tr(tr, tsk, cpu);
 	__raw_spin_unlock(&ftrace_max_lock);
 }
@@ -537,15 +538,14 @@ update_max_tr_single(struct trace_array *tr, struct task_struct *tsk, int cpu)
 	__raw_spin_lock(&ftrace_max_lock);
 
 	ftrace_disable_cpu();
-
-	ring_buffer_reset(max_tr.buffer);
 	ret = ring_buffer_swap_cpu(max_tr.buffer, tr->buffer, cpu);
-
 	ftrace_enable_cpu();
 
-	WARN_ON_ONCE(ret);
+	/* -EBUSY: we interrupted a writer of this cpu, keep the old max */
+	WARN_ON_ONCE(ret && ret != -EBUSY);
 
-	__update_max_tr(tr, tsk, cpu);
+	if (!ret)
+		__update_max_tr(tr, tsk, cpu);
 	__raw_spin_unlock(&ftrace_max_lock);
 }
 
@@ -671,21 +671,41 @@ void unregister_tracer(struct tracer *type)
 	mutex_unlock(&trace_types_lock);
 }
 
+/*
+ * Writers do not take a lock, so stop recording and wait for the events
+ * in flight to be committed before resetting.  This may sleep; tracers
+ * that need a fresh start in atomic context move tr->time_start instead.
+ */
 void tracing_reset(struct trace_array *tr, int cpu)
 {
+	struct ring_buffer *buffer = tr->buffer;
+
+	ring_buffer_record_disable(buffer);
+	synchronize_sched();
+
 	ftrace_disable_cpu();
-	ring_buffer_reset_cpu(tr->buffer, cpu);
+	ring_buffer_reset_cpu(buffer, cpu);
 	ftrace_enable_cpu();
+
+	ring_buffer_record_enable(buffer);
 }
 
 void tracing_reset_online_cpus(struct trace_array *tr)
 {
+	struct ring_buffer *buffer = tr->buffer;
 	int cpu;
 
+	ring_buffer_record_disable(buffer);
+	synchronize_sched();
+
 	tr->time_start = ftrace_now(tr->cpu);
 
+	ftrace_disable_cpu();
 	for_each_online_cpu(cpu)
-		tracing_reset(tr, cpu);
+		ring_buffer_reset_cpu(buffer, cpu);
+	ftrace_enable_cpu();
+
+	ring_buffer_record_enable(buffer);
 }
 
 #define SAVED_CMDLINES 128
@@ -1426,6 +1446,27 @@ static void *s_next(struct seq_file *m, void *v, loff_t *pos)
 	return ent;
 }
 
+/*
+ * The latency tracers do not reset the buffer when a new section starts,
+ * so skip the events recorded before it, and remember how many there were
+ * for the header.
+ */
+static void tracing_iter_reset(struct trace_iterator *iter, int cpu)
+{
+	struct ring_buffer_iter *buf_iter = iter->buffer_iter[cpu];
+	unsigned long entries = 0;
+	u64 ts;
+
+	ring_buffer_iter_reset(buf_iter);
+	while (ring_buffer_iter_peek(buf_iter, &ts)) {
+		if (ts >= iter->tr->time_start)
+			break;
+		entries++;
+		ring_buffer_read(buf_iter, NULL);
+	}
+	iter->tr->data[cpu]->skipped_entries = entries;
+}
+
 static void *s_start(struct seq_file *m, loff_t *pos)
 {
 	struct trace_iterator *iter = m->private;
@@ -1449,9 +1490,8 @@ static void *s_start(struct seq_file *m, loff_t *pos)
 
 		ftrace_disable_cpu();
 
-		for_each_tracing_cpu(cpu) {
-			ring_buffer_iter_reset(iter->buffer_iter[cpu]);
-		}
+		for_each_tracing_cpu(cpu)
+			tracing_iter_reset(iter, cpu);
 
 		ftrace_enable_cpu();
 
@@ -1647,16 +1687,29 @@ print_trace_header(struct seq_file *m, struct trace_iterator *iter)
 	struct trace_array *tr = iter->tr;
 	struct trace_array_cpu *data = tr->data[tr->cpu];
 	struct tracer *type = current_trace;
-	unsigned long total;
-	unsigned long entries;
+	unsigned long total = 0;
+	unsigned long entries = 0;
+	unsigned long count;
 	const char *name = "preemption";
+	int cpu;
 
 	if (type)
 		name = type->name;
 
-	entries = ring_buffer_entries(iter->tr->buffer);
-	total = entries +
-		ring_buffer_overruns(iter->tr->buffer);
+	for_each_tracing_cpu(cpu) {
+		count = ring_buffer_entries_cpu(tr->buffer, cpu);
+		/*
+		 * A buffer with skipped entries was not reset when the
+		 * trace started, so nothing of this trace was overrun.
+		 */
+		if (tr->data[cpu]->skipped_entries) {
+			count -= tr->data[cpu]->skipped_entries;
+			total += count;
+		} else
+			total += count +
+				ring_buffer_overrun_cpu(tr->buffer, cpu);
+		entries += count;
+	}
 
 	seq_printf(m, "%s latency trace v1.1.5 on %s\n",
 		   name, UTS_RELEASE);
@@ -2467,6 +2520,8 @@ __tracing_open(struct inode *inode, struct file *file, int *ret)
 
 		if (!iter->buffer_iter[cpu])
 			goto fail_buffer;
+
+		tracing_iter_reset(iter, cpu);
 	}
 
 	/* TODO stop tracer */
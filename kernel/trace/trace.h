@@ -203,6 +203,7 @@ struct trace_array_cpu {
 	unsigned long		trace_idx;
 	unsigned long		overrun;
 	unsigned long		saved_latency;
+	unsigned long		skipped_entries;
 	unsigned long		critical_start;
 	unsigned long		critical_end;
 	unsigned long		critical_sequence;
@@ -180,16 +180,13 @@ out:
 	atomic_dec(&wakeup_trace->data[cpu]->disabled);
 }
 
+/*
+ * Called from the probes, so the buffers are left alone: the events from
+ * before the next wakeup are older than max_tr.time_start and skipped
+ * when the max trace is read.
+ */
 static void __wakeup_reset(struct trace_array *tr)
 {
-	struct trace_array_cpu *data;
-	int cpu;
-
-	for_each_possible_cpu(cpu) {
-		data = tr->data[cpu];
-		tracing_reset(tr, cpu);
-	}
-
 	wakeup_cpu = -1;
 	wakeup_prio = -1;
 
@@ -203,6 +200,8 @@ static void wakeup_reset(struct trace_array *tr)
 {
 	unsigned long flags;
 
+	tracing_reset_online_cpus(tr);
+
 	local_irq_save(flags);
 	__raw_spin_lock(&wakeup_lock);
 	__wakeup_reset(tr);
@@ -14,6 +14,18 @@
  *   Theodore Ts'o <tytso@mit.edu>
  *
  * Made to use alloc_percpu by Christoph Lameter.
+ *
+ * Works are run by pools of worker threads.  Every cpu has one pool
+ * shared by all ordinary workqueues; workqueues that need threads with
+ * special properties (freezing, rt priority, guaranteed forward progress)
+ * get pools of their own with a single worker per cpu.
+ *
+ * A shared pool keeps one worker running as long as there is work.  The
+ * scheduler tells the pool when a busy worker blocks (wq_worker_sleeping)
+ * and the pool wakes an idle worker to carry on with the pending works,
+ * creating a new one first if it was the last idle worker.  Workers idle
+ * for a while beyond MAX_IDLE_WORKERS exit again.  If that worker cannot
+ * be created, a timer has a busy worker try again a bit later.
  */
 
 #include <linux/module.h>
@@ -33,6 +45,61 @@
 #include <linux/kallsyms.h>
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
+
+/* Idle workers kept around by a shared pool */
+#define MAX_IDLE_WORKERS	2
+/* How long an idle worker beyond those waits before exiting */
+#define IDLE_WORKER_TIMEOUT	(5 * HZ)
+/* How long to wait before trying again to create a worker that failed */
+#define CREATE_COOLDOWN		(HZ / 10)
+
+/*
+ * A pool of worker threads.  Its lock protects the pool as well as the
+ * lists and counters of all cpu_workqueue_structs served by the pool.
+ */
+struct global_cwq {
+	spinlock_t lock;
+
+	struct list_head pending;	/* cwqs with a work ready to run */
+	struct list_head idle_list;	/* idle workers, last idle first */
+	struct list_head workers;	/* all workers */
+	int nr_workers;
+	int nr_idle;
+	atomic_t nr_running;		/* busy workers not sleeping */
+
+	unsigned int cpu;
+	unsigned int flags;		/* GCWQ_* */
+	unsigned int bind_seq;		/* bumped when the cpu comes up */
+	int next_id;
+	unsigned long nr_created;	/* workers created in total */
+	unsigned long nr_create_failed;
+	struct timer_list retry_timer;	/* after a failed create_worker() */
+
+	/* owner of a dedicated pool, NULL for the shared pools */
+	struct workqueue_struct *wq;
+};
+
+#define GCWQ_MANAGING	(1 << 0)	/* a worker is creating a worker */
+#define GCWQ_UNBOUND	(1 << 1)	/* workers may run on any cpu */
+#define GCWQ_NEED_SPARE	(1 << 2)	/* retry creating a spare worker */
+
+struct wq_worker {
+	struct list_head entry;		/* on gcwq->idle_list while idle */
+	struct list_head node;		/* on gcwq->workers */
+	struct list_head scheduled;	/* barriers to run after current_work */
+	struct work_struct *current_work;
+	struct cpu_workqueue_struct *current_cwq;
+	struct task_struct *task;
+	struct global_cwq *gcwq;
+	unsigned int flags;		/* WORKER_* */
+	unsigned int bind_seq;
+	int id;
+};
+
+#define WORKER_IDLE	(1 << 0)
 
 /*
  * The per-CPU workqueue (if single thread, we always use the first
@@ -40,14 +107,21 @@
  */
 struct cpu_workqueue_struct {
 
-	spinlock_t lock;
+	struct global_cwq *gcwq;
 
 	struct list_head worklist;
-	wait_queue_head_t more_work;
-	struct work_struct *current_work;
+	struct list_head pending_entry;	/* on gcwq->pending */
+	int nr_active;			/* works running or about to */
+	int max_active;
 
 	struct workqueue_struct *wq;
-	struct task_struct *thread;
+
+#ifdef CONFIG_WORKQUEUE_STATS
+	unsigned long nr_queued;
+	unsigned long nr_executed;
+	u64 wait_total, wait_max;	/* ns between queueing and running */
+	u64 run_total, run_max;		/* ns spent running */
+#endif
 } ____cacheline_aligned;
 
 /*
@@ -56,11 +130,10 @@ struct cpu_workqueue_struct {
  */
 struct workqueue_struct {
 	struct cpu_workqueue_struct *cpu_wq;
+	struct global_cwq *pools;	/* dedicated pools, or NULL */
 	struct list_head list;
 	const char *name;
-	int singlethread;
-	int freezeable;		/* Freeze threads during suspend */
-	int rt;
+	unsigned int flags;		/* WQ_* */
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
@@ -70,21 +143,21 @@ struct workqueue_struct {
 static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
 
+static DEFINE_PER_CPU(struct global_cwq, shared_gcwq);
+
 static int singlethread_cpu __read_mostly;
 static const struct cpumask *cpu_singlethread_map __read_mostly;
 /*
- * _cpu_down() first removes CPU from cpu_online_map, then CPU_DEAD
- * flushes cwq->worklist. This means that flush_workqueue/wait_on_work
- * which comes in between can't use for_each_online_cpu(). We could
- * use cpu_possible_map, the cpumask below is more a documentation
- * than optimization.
+ * flush_workqueue() and destroy_workqueue() only have to look at the
+ * cpus that have ever been brought up: no work can be queued on the
+ * others.  Workers of a cpu that goes down keep running on the other
+ * cpus, so a cpu is never removed from this map.
  */
 static cpumask_var_t cpu_populated_map __read_mostly;
 
-/* If it's single threaded, it isn't in the list of workqueues. */
 static inline int is_wq_single_threaded(struct workqueue_struct *wq)
 {
-	return wq->singlethread;
+	return wq->flags & WQ_ORDERED;
 }
 
 static const struct cpumask *wq_cpu_map(struct workqueue_struct *wq)
@@ -123,6 +196,123 @@ struct cpu_workqueue_struct *get_wq_data(struct work_struct *work)
 	return (void *) (atomic_long_read(&work->data) & WORK_STRUCT_WQ_DATA_MASK);
 }
 
+static void wq_barrier_func(struct work_struct *work);
+
+static inline int is_barrier(struct work_struct *work)
+{
+	return work->func == wq_barrier_func;
+}
+
+static inline struct wq_worker *current_wq_worker(void)
+{
+	return (current->flags & PF_WQ_WORKER) ? current->wq_worker : NULL;
+}
+
+/*
+ * Find the worker running @work queued on @cwq, if any.
+ * Called with gcwq->lock held.
+ */
+static struct wq_worker *find_worker_executing_work(struct global_cwq *gcwq,
+					struct cpu_workqueue_struct *cwq,
+					struct work_struct *work)
+{
+	struct wq_worker *worker;
+
+	list_for_each_entry(worker, &gcwq->workers, node)
+		if (worker->current_work == work &&
+		    worker->current_cwq == cwq)
+			return worker;
+	return NULL;
+}
+
+/*
+ * Can the first work on @cwq be started now?  A barrier waits for all
+ * works before it to finish, a work for its previous instance on this
+ * cwq to finish (works are not reentrant on a cpu).
+ */
+static int cwq_can_dispatch(struct cpu_workqueue_struct *cwq)
+{
+	struct work_struct *work;
+
+	if (list_empty(&cwq->worklist))
+		return 0;
+	work = list_first_entry(&cwq->worklist, struct work_struct, entry);
+	if (is_barrier(work))
+		return !cwq->nr_active;
+	if (cwq->nr_active >= cwq->max_active)
+		return 0;
+	return !find_worker_executing_work(cwq->gcwq, cwq, work);
+}
+
+/* Does the pool need a worker it doesn't have running? */
+static inline int need_more_worker(struct global_cwq *gcwq)
+{
+	return !list_empty(&gcwq->pending) &&
+		(gcwq->wq || !atomic_read(&gcwq->nr_running));
+}
+
+/* Should a busy worker go on with the next pending work? */
+static inline int keep_working(struct global_cwq *gcwq)
+{
+	return !list_empty(&gcwq->pending) &&
+		(gcwq->wq || atomic_read(&gcwq->nr_running) <= 1);
+}
+
+static void wake_up_worker(struct global_cwq *gcwq)
+{
+	struct wq_worker *worker;
+
+	if (list_empty(&gcwq->idle_list))
+		return;
+	worker = list_first_entry(&gcwq->idle_list, struct wq_worker, entry);
+	wake_up_process(worker->task);
+}
+
+/*
+ * Put @cwq on the pool's pending list if its first work can run, and
+ * wake a worker if nobody is going to run it.
+ */
+static void cwq_update_pending(struct cpu_workqueue_struct *cwq)
+{
+	struct global_cwq *gcwq = cwq->gcwq;
+
+	if (list_empty(&cwq->pending_entry) && cwq_can_dispatch(cwq))
+		list_add_tail(&cwq->pending_entry, &gcwq->pending);
+	if (need_more_worker(gcwq))
+		wake_up_worker(gcwq);
+}
+
+/**
+ * wq_worker_sleeping - a busy worker is going to sleep
+ * @task: the worker
+ *
+ * Called from schedule() and the mutex slowpath with preemption disabled.  If
+ * this was the last running worker of the pool and there is pending work,
+ * wake an idle one.
+ */
+void wq_worker_sleeping(struct task_struct *task)
+{
+	struct global_cwq *gcwq = task->wq_worker->gcwq;
+	unsigned long flags;
+
+	if (!atomic_dec_and_test(&gcwq->nr_running) || gcwq->wq)
+		return;
+
+	spin_lock_irqsave(&gcwq->lock, flags);
+	if (!list_empty(&gcwq->pending))
+		wake_up_worker(gcwq);
+	spin_unlock_irqrestore(&gcwq->lock, flags);
+}
+
+/**
+ * wq_worker_running - a busy worker woke up again
+ * @task: the worker
+ */
+void wq_worker_running(struct task_struct *task)
+{
+	atomic_inc(&task->wq_worker->gcwq->nr_running);
+}
+
 static void insert_work(struct cpu_workqueue_struct *cwq,
 			struct work_struct *work, struct list_head *head)
 {
@@ -133,17 +323,39 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 	 */
 	smp_wmb();
 	list_add_tail(&work->entry, head);
-	wake_up(&cwq->more_work);
+#ifdef CONFIG_WORKQUEUE_STATS
+	work->queued_at = cpu_clock(raw_smp_processor_id());
+	if (!is_barrier(work))
+		cwq->nr_queued++;
+#endif
+	cwq_update_pending(cwq);
 }
 
 static void __queue_work(struct cpu_workqueue_struct *cwq,
 			 struct work_struct *work)
 {
+	struct cpu_workqueue_struct *last;
 	unsigned long flags;
 
-	spin_lock_irqsave(&cwq->lock, flags);
+	/*
+	 * A non-reentrant workqueue queues a work that is still running
+	 * to the cpu it runs on, where it waits for the running instance.
+	 */
+	last = get_wq_data(work);
+	if ((cwq->wq->flags & WQ_NON_REENTRANT) && last && last != cwq &&
+	    last->wq == cwq->wq) {
+		spin_lock_irqsave(&last->gcwq->lock, flags);
+		if (find_worker_executing_work(last->gcwq, last, work)) {
+			insert_work(last, work, &last->worklist);
+			spin_unlock_irqrestore(&last->gcwq->lock, flags);
+			return;
+		}
+		spin_unlock_irqrestore(&last->gcwq->lock, flags);
+	}
+
+	spin_lock_irqsave(&cwq->gcwq->lock, flags);
 	insert_work(cwq, work, &cwq->worklist);
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	spin_unlock_irqrestore(&cwq->gcwq->lock, flags);
 }
 
 /**
@@ -236,13 +448,21 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 	struct work_struct *work = &dwork->work;
 
 	if (!test_and_set_bit(WORK_STRUCT_PENDING, work_data_bits(work))) {
+		struct cpu_workqueue_struct *cwq = get_wq_data(work);
+
 		BUG_ON(timer_pending(timer));
 		BUG_ON(!list_empty(&work->entry));
 
 		timer_stats_timer_set_start_info(&dwork->timer);
 
-		/* This stores cwq for the moment, for the timer_fn */
-		set_wq_data(work, wq_per_cpu(wq, raw_smp_processor_id()));
+		/*
+		 * This stores cwq for the moment, for the timer_fn.  Keep
+		 * the one the work last ran on, __queue_work() needs it
+		 * for non-reentrant workqueues.
+		 */
+		if (!cwq || cwq->wq != wq)
+			cwq = wq_per_cpu(wq, raw_smp_processor_id());
+		set_wq_data(work, cwq);
 		timer->expires = jiffies + delay;
 		timer->data = (unsigned long)dwork;
 		timer->function = delayed_work_timer_fn;
@@ -257,80 +477,285 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL_GPL(queue_delayed_work_on);
 
-static void run_workqueue(struct cpu_workqueue_struct *cwq)
+/*
+ * Take the next work to run off the pending cwqs of the pool, round
+ * robin between workqueues.  Called with gcwq->lock held.
+ */
+static struct work_struct *grab_next_work(struct global_cwq *gcwq)
 {
-	spin_lock_irq(&cwq->lock);
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
-						struct work_struct, entry);
-		work_func_t f = work->func;
+	struct cpu_workqueue_struct *cwq;
+	struct work_struct *work;
+
+	while (!list_empty(&gcwq->pending)) {
+		cwq = list_first_entry(&gcwq->pending,
+				       struct cpu_workqueue_struct,
+				       pending_entry);
+		list_del_init(&cwq->pending_entry);
+		if (!cwq_can_dispatch(cwq))
+			continue;
+
+		work = list_first_entry(&cwq->worklist,
+					struct work_struct, entry);
+		list_del_init(&work->entry);
+		if (!is_barrier(work))
+			cwq->nr_active++;
+		if (cwq_can_dispatch(cwq))
+			list_add_tail(&cwq->pending_entry, &gcwq->pending);
+		return work;
+	}
+	return NULL;
+}
+
+/*
+ * Run one work.  Called with gcwq->lock held, which is dropped while the
+ * work runs.  Once a barrier has run, its cwq may be gone.
+ */
+static void process_one_work(struct wq_worker *worker,
+			     struct work_struct *work)
+{
+	struct cpu_workqueue_struct *cwq = get_wq_data(work);
+	struct global_cwq *gcwq = worker->gcwq;
+	work_func_t f = work->func;
+	int barrier = is_barrier(work);
 #ifdef CONFIG_LOCKDEP
-		/*
-		 * It is permissible to free the struct work_struct
-		 * from inside the function that is called from it,
-		 * this we need to take into account for lockdep too.
-		 * To avoid bogus "held lock freed" warnings as well
-		 * as problems when looking into work->lockdep_map,
-		 * make a copy and use that here.
-		 */
-		struct lockdep_map lockdep_map = work->lockdep_map;
+	/*
+	 * It is permissible to free the struct work_struct
+	 * from inside the function that is called from it,
+	 * this we need to take into account for lockdep too.
+	 * To avoid bogus "held lock freed" warnings as well
+	 * as problems when looking into work->lockdep_map,
+	 * make a copy and use that here.
+	 */
+	struct lockdep_map lockdep_map = work->lockdep_map;
 #endif
+#ifdef CONFIG_WORKQUEUE_STATS
+	u64 start = cpu_clock(raw_smp_processor_id());
 
-		cwq->current_work = work;
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irq(&cwq->lock);
+	if (!barrier) {
+		u64 wait = start - work->queued_at;
 
-		BUG_ON(get_wq_data(work) != cwq);
-		work_clear_pending(work);
+		cwq->wait_total += wait;
+		if (wait > cwq->wait_max)
+			cwq->wait_max = wait;
+	}
+#endif
+
+	worker->current_work = work;
+	worker->current_cwq = cwq;
+	spin_unlock_irq(&gcwq->lock);
+
+	work_clear_pending(work);
+	if (!barrier)
 		lock_map_acquire(&cwq->wq->lockdep_map);
-		lock_map_acquire(&lockdep_map);
-		f(work);
-		lock_map_release(&lockdep_map);
+	lock_map_acquire(&lockdep_map);
+	f(work);
+	lock_map_release(&lockdep_map);
+	if (!barrier)
 		lock_map_release(&cwq->wq->lockdep_map);
 
-		if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
-			printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
-					"%s/0x%08x/%d\n",
-					current->comm, preempt_count(),
-				       	task_pid_nr(current));
-			printk(KERN_ERR "    last function: ");
-			print_symbol("%s\n", (unsigned long)f);
-			debug_show_held_locks(current);
-			dump_stack();
-		}
+	if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
+		printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
+				"%s/0x%08x/%d\n",
+				current->comm, preempt_count(),
+			       	task_pid_nr(current));
+		printk(KERN_ERR "    last function: ");
+		print_symbol("%s\n", (unsigned long)f);
+		debug_show_held_locks(current);
+		dump_stack();
+	}
 
-		spin_lock_irq(&cwq->lock);
-		cwq->current_work = NULL;
+	spin_lock_irq(&gcwq->lock);
+	worker->current_work = NULL;
+	worker->current_cwq = NULL;
+	if (barrier)
+		return;
+
+#ifdef CONFIG_WORKQUEUE_STATS
+	{
+		u64 run = cpu_clock(raw_smp_processor_id()) - start;
+
+		cwq->nr_executed++;
+		cwq->run_total += run;
+		if (run > cwq->run_max)
+			cwq->run_max = run;
 	}
-	spin_unlock_irq(&cwq->lock);
+#endif
+	cwq->nr_active--;
+	cwq_update_pending(cwq);
 }
 
-static int worker_thread(void *__cwq)
+static struct wq_worker *create_worker(struct global_cwq *gcwq);
+static void start_worker(struct wq_worker *worker);
+
+/*
+ * Called by a worker leaving the idle list as the last idle worker of a
+ * shared pool: create a spare, so that there is somebody to wake should
+ * the works about to run block.  If that fails, typically for lack of
+ * memory, the retry timer asks a busy worker to try again later; the
+ * works themselves keep running on the workers there are.  Workqueues
+ * that reclaim depends on must not rely on this, see WQ_RESCUER.
+ * Called and returns with gcwq->lock held.
+ */
+static void manage_workers(struct global_cwq *gcwq)
 {
-	struct cpu_workqueue_struct *cwq = __cwq;
-	DEFINE_WAIT(wait);
+	struct wq_worker *worker;
 
-	if (cwq->wq->freezeable)
-		set_freezable();
+	if (gcwq->flags & GCWQ_MANAGING)
+		return;
+	gcwq->flags |= GCWQ_MANAGING;
+	gcwq->flags &= ~GCWQ_NEED_SPARE;
+	spin_unlock_irq(&gcwq->lock);
+
+	worker = create_worker(gcwq);
+	if (worker)
+		start_worker(worker);
+
+	spin_lock_irq(&gcwq->lock);
+	gcwq->flags &= ~GCWQ_MANAGING;
+	if (!worker) {
+		gcwq->nr_create_failed++;
+		mod_timer(&gcwq->retry_timer, jiffies + CREATE_COOLDOWN);
+	}
+}
 
-	set_user_nice(current, -5);
+/*
+ * Creating a spare worker failed a while ago.  If the pool still has no
+ * idle worker, flag it for the next busy worker done with a work.
+ */
+static void gcwq_retry_timeout(unsigned long data)
+{
+	struct global_cwq *gcwq = (struct global_cwq *)data;
+
+	spin_lock_irq(&gcwq->lock);
+	if (!gcwq->nr_idle)
+		gcwq->flags |= GCWQ_NEED_SPARE;
+	spin_unlock_irq(&gcwq->lock);
+}
+
+/*
+ * Bind the worker to the cpu of its pool after the cpu came (back) up.
+ * Called and returns with gcwq->lock held.
+ */
+static void worker_maybe_bind(struct wq_worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	if (worker->bind_seq == gcwq->bind_seq ||
+	    (gcwq->flags & GCWQ_UNBOUND))
+		return;
+	worker->bind_seq = gcwq->bind_seq;
+	spin_unlock_irq(&gcwq->lock);
+	/* fails if the cpu went down again, it is rebound on the next up */
+	set_cpus_allowed_ptr(current, cpumask_of(gcwq->cpu));
+	spin_lock_irq(&gcwq->lock);
+}
+
+static void worker_enter_idle(struct wq_worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	current->flags &= ~PF_WQ_WORKER;
+	atomic_dec(&gcwq->nr_running);
+	worker->flags |= WORKER_IDLE;
+	list_add(&worker->entry, &gcwq->idle_list);
+	gcwq->nr_idle++;
+}
+
+static void worker_leave_idle(struct wq_worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	list_del_init(&worker->entry);
+	gcwq->nr_idle--;
+	worker->flags &= ~WORKER_IDLE;
+	atomic_inc(&gcwq->nr_running);
+	current->flags |= PF_WQ_WORKER;
+}
+
+/*
+ * Sleep until there is work for an idle worker.  Returns 0 if the worker
+ * should exit instead: a dedicated worker being stopped, or a shared one
+ * idle for IDLE_WORKER_TIMEOUT while there are enough idle workers left.
+ * Called and returns with gcwq->lock held.
+ */
+static int worker_wait_for_work(struct wq_worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	long timeout;
 
 	for (;;) {
-		prepare_to_wait(&cwq->more_work, &wait, TASK_INTERRUPTIBLE);
-		if (!freezing(current) &&
-		    !kthread_should_stop() &&
-		    list_empty(&cwq->worklist))
-			schedule();
-		finish_wait(&cwq->more_work, &wait);
+		if (gcwq->wq && kthread_should_stop())
+			return 0;
+		worker_maybe_bind(worker);
+		if (freezing(current)) {
+			spin_unlock_irq(&gcwq->lock);
+			try_to_freeze();
+			spin_lock_irq(&gcwq->lock);
+			continue;
+		}
+		if (need_more_worker(gcwq))
+			return 1;
+
+		timeout = MAX_SCHEDULE_TIMEOUT;
+		if (!gcwq->wq && gcwq->nr_idle > MAX_IDLE_WORKERS)
+			timeout = IDLE_WORKER_TIMEOUT;
+
+		__set_current_state(TASK_INTERRUPTIBLE);
+		spin_unlock_irq(&gcwq->lock);
+		timeout = schedule_timeout(timeout);
+		spin_lock_irq(&gcwq->lock);
+
+		if (!timeout && !gcwq->wq &&
+		    gcwq->nr_idle > MAX_IDLE_WORKERS &&
+		    !need_more_worker(gcwq)) {
+			list_del_init(&worker->entry);
+			list_del_init(&worker->node);
+			gcwq->nr_idle--;
+			gcwq->nr_workers--;
+			return 0;
+		}
+	}
+}
+
+static int worker_thread(void *__worker)
+{
+	struct wq_worker *worker = __worker;
+	struct global_cwq *gcwq = worker->gcwq;
+	struct work_struct *work;
+
+	current->wq_worker = worker;
+	if (gcwq->wq && (gcwq->wq->flags & WQ_FREEZEABLE))
+		set_freezable();
 
-		try_to_freeze();
+	set_user_nice(current, -5);
+
+	spin_lock_irq(&gcwq->lock);
+	while (worker_wait_for_work(worker)) {
+		worker_leave_idle(worker);
+		if (!gcwq->wq && !gcwq->nr_idle)
+			manage_workers(gcwq);
 
-		if (kthread_should_stop())
-			break;
+		while ((work = grab_next_work(gcwq))) {
+			process_one_work(worker, work);
+			while (!list_empty(&worker->scheduled)) {
+				work = list_first_entry(&worker->scheduled,
+						struct work_struct, entry);
+				list_del_init(&work->entry);
+				process_one_work(worker, work);
+			}
+			if ((gcwq->flags & GCWQ_NEED_SPARE) && !gcwq->nr_idle)
+				manage_workers(gcwq);
+			if (!keep_working(gcwq))
+				break;
+		}
 
-		run_workqueue(cwq);
+		worker_enter_idle(worker);
 	}
+	spin_unlock_irq(&gcwq->lock);
 
+	/* An exiting shared worker is off all lists, nobody can see it */
+	if (!gcwq->wq)
+		kfree(worker);
 	return 0;
 }
 
@@ -358,17 +783,19 @@ static void insert_wq_barrier(struct cpu_workqueue_struct *cwq,
 
 static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
 {
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct wq_worker *worker = current_wq_worker();
 	int active = 0;
 	struct wq_barrier barr;
 
-	WARN_ON(cwq->thread == current);
+	WARN_ON(worker && worker->current_cwq == cwq);
 
-	spin_lock_irq(&cwq->lock);
-	if (!list_empty(&cwq->worklist) || cwq->current_work != NULL) {
+	spin_lock_irq(&gcwq->lock);
+	if (!list_empty(&cwq->worklist) || cwq->nr_active) {
 		insert_wq_barrier(cwq, &barr, &cwq->worklist);
 		active = 1;
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&gcwq->lock);
 
 	if (active)
 		wait_for_completion(&barr.done);
@@ -415,6 +842,8 @@ EXPORT_SYMBOL_GPL(flush_workqueue);
 int flush_work(struct work_struct *work)
 {
 	struct cpu_workqueue_struct *cwq;
+	struct global_cwq *gcwq;
+	struct wq_worker *worker;
 	struct list_head *prev;
 	struct wq_barrier barr;
 
@@ -422,12 +851,13 @@ int flush_work(struct work_struct *work)
 	cwq = get_wq_data(work);
 	if (!cwq)
 		return 0;
+	gcwq = cwq->gcwq;
 
 	lock_map_acquire(&cwq->wq->lockdep_map);
 	lock_map_release(&cwq->wq->lockdep_map);
 
 	prev = NULL;
-	spin_lock_irq(&cwq->lock);
+	spin_lock_irq(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * See the comment near try_to_grab_pending()->smp_rmb().
@@ -438,13 +868,14 @@ int flush_work(struct work_struct *work)
 			goto out;
 		prev = &work->entry;
 	} else {
-		if (cwq->current_work != work)
+		worker = find_worker_executing_work(gcwq, cwq, work);
+		if (!worker)
 			goto out;
-		prev = &cwq->worklist;
+		prev = &worker->scheduled;
 	}
 	insert_wq_barrier(cwq, &barr, prev->next);
 out:
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&gcwq->lock);
 	if (!prev)
 		return 0;
 
@@ -474,7 +905,7 @@ static int try_to_grab_pending(struct work_struct *work)
 	if (!cwq)
 		return ret;
 
-	spin_lock_irq(&cwq->lock);
+	spin_lock_irq(&cwq->gcwq->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * This work is queued, but perhaps we locked the wrong cwq.
@@ -484,10 +915,12 @@ static int try_to_grab_pending(struct work_struct *work)
 		smp_rmb();
 		if (cwq == get_wq_data(work)) {
 			list_del_init(&work->entry);
+			/* the next work may have been waiting behind it */
+			cwq_update_pending(cwq);
 			ret = 1;
 		}
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&cwq->gcwq->lock);
 
 	return ret;
 }
@@ -495,15 +928,18 @@ static int try_to_grab_pending(struct work_struct *work)
 static void wait_on_cpu_work(struct cpu_workqueue_struct *cwq,
 				struct work_struct *work)
 {
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct wq_worker *worker;
 	struct wq_barrier barr;
 	int running = 0;
 
-	spin_lock_irq(&cwq->lock);
-	if (unlikely(cwq->current_work == work)) {
-		insert_wq_barrier(cwq, &barr, cwq->worklist.next);
+	spin_lock_irq(&gcwq->lock);
+	worker = find_worker_executing_work(gcwq, cwq, work);
+	if (unlikely(worker)) {
+		insert_wq_barrier(cwq, &barr, worker->scheduled.next);
 		running = 1;
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&gcwq->lock);
 
 	if (unlikely(running))
 		wait_for_completion(&barr.done);
@@ -719,41 +1155,80 @@ int keventd_up(void)
 
 int current_is_keventd(void)
 {
-	struct cpu_workqueue_struct *cwq;
-	int cpu = raw_smp_processor_id(); /* preempt-safe: keventd is per-cpu */
-	int ret = 0;
+	struct wq_worker *worker = current_wq_worker();
 
 	BUG_ON(!keventd_wq);
 
-	cwq = per_cpu_ptr(keventd_wq->cpu_wq, cpu);
-	if (current == cwq->thread)
-		ret = 1;
-
-	return ret;
+	return worker && worker->current_cwq &&
+		worker->current_cwq->wq == keventd_wq;
+}
 
+static void init_global_cwq(struct global_cwq *gcwq, unsigned int cpu,
+			    struct workqueue_struct *wq)
+{
+	spin_lock_init(&gcwq->lock);
+	INIT_LIST_HEAD(&gcwq->pending);
+	INIT_LIST_HEAD(&gcwq->idle_list);
+	INIT_LIST_HEAD(&gcwq->workers);
+	atomic_set(&gcwq->nr_running, 0);
+	gcwq->cpu = cpu;
+	gcwq->wq = wq;
+	setup_timer(&gcwq->retry_timer, gcwq_retry_timeout,
+		    (unsigned long)gcwq);
+	/* a single thread need not stay on singlethread_cpu */
+	if (wq && is_wq_single_threaded(wq))
+		gcwq->flags |= GCWQ_UNBOUND;
 }
 
 static struct cpu_workqueue_struct *
-init_cpu_workqueue(struct workqueue_struct *wq, int cpu)
+init_cpu_workqueue(struct workqueue_struct *wq, int cpu, int max_active)
 {
 	struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
 
 	cwq->wq = wq;
-	spin_lock_init(&cwq->lock);
 	INIT_LIST_HEAD(&cwq->worklist);
-	init_waitqueue_head(&cwq->more_work);
+	INIT_LIST_HEAD(&cwq->pending_entry);
+	cwq->max_active = max_active;
+	if (wq->pools) {
+		cwq->gcwq = per_cpu_ptr(wq->pools, cpu);
+		init_global_cwq(cwq->gcwq, cpu, wq);
+	} else
+		cwq->gcwq = &per_cpu(shared_gcwq, cpu);
 
 	return cwq;
 }
 
-static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
+/*
+ * Create a worker for @gcwq.  It is not running until start_worker().
+ */
+static struct wq_worker *create_worker(struct global_cwq *gcwq)
 {
 	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
-	struct workqueue_struct *wq = cwq->wq;
-	const char *fmt = is_wq_single_threaded(wq) ? "%s" : "%s/%d";
+	struct workqueue_struct *wq = gcwq->wq;
+	struct wq_worker *worker;
 	struct task_struct *p;
+	int id;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return NULL;
+	INIT_LIST_HEAD(&worker->entry);
+	INIT_LIST_HEAD(&worker->node);
+	INIT_LIST_HEAD(&worker->scheduled);
+	worker->gcwq = gcwq;
+
+	spin_lock_irq(&gcwq->lock);
+	id = worker->id = gcwq->next_id++;
+	spin_unlock_irq(&gcwq->lock);
 
-	p = kthread_create(worker_thread, cwq, fmt, wq->name, cpu);
+	if (!wq)
+		p = kthread_create(worker_thread, worker, "kworker/%u:%d",
+				   gcwq->cpu, id);
+	else if (is_wq_single_threaded(wq))
+		p = kthread_create(worker_thread, worker, "%s", wq->name);
+	else
+		p = kthread_create(worker_thread, worker, "%s/%d",
+				   wq->name, gcwq->cpu);
 	/*
 	 * Nobody can add the work_struct to this cwq,
 	 *	if (caller is __create_workqueue)
@@ -762,37 +1237,71 @@ static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
 	 *		cpu is not on cpu_online_map
 	 * so we can abort safely.
 	 */
-	if (IS_ERR(p))
-		return PTR_ERR(p);
-	if (cwq->wq->rt)
+	if (IS_ERR(p)) {
+		kfree(worker);
+		return NULL;
+	}
+	if (wq && (wq->flags & WQ_RT))
 		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
-	cwq->thread = p;
+	worker->task = p;
 
-	return 0;
+	return worker;
 }
 
-static void start_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
+/* Add a new worker to its pool, idle */
+static void attach_worker(struct wq_worker *worker)
 {
-	struct task_struct *p = cwq->thread;
+	struct global_cwq *gcwq = worker->gcwq;
+
+	spin_lock_irq(&gcwq->lock);
+	worker->flags |= WORKER_IDLE;
+	list_add(&worker->node, &gcwq->workers);
+	list_add(&worker->entry, &gcwq->idle_list);
+	gcwq->nr_workers++;
+	gcwq->nr_idle++;
+	gcwq->nr_created++;
+	spin_unlock_irq(&gcwq->lock);
+}
 
-	if (p != NULL) {
-		if (cpu >= 0)
-			kthread_bind(p, cpu);
-		wake_up_process(p);
+/*
+ * Add a new worker to its pool and let it run.  It binds itself to the
+ * cpu of the pool, if the cpu is up.
+ */
+static void start_worker(struct wq_worker *worker)
+{
+	attach_worker(worker);
+	wake_up_process(worker->task);
+}
+
+/* Stop and free the workers of a dedicated pool */
+static void destroy_dedicated_workers(struct global_cwq *gcwq)
+{
+	struct wq_worker *worker, *tmp;
+
+	list_for_each_entry_safe(worker, tmp, &gcwq->workers, node) {
+		kthread_stop(worker->task);
+		list_del(&worker->node);
+		kfree(worker);
 	}
+	gcwq->nr_workers = 0;
 }
 
 struct workqueue_struct *__create_workqueue_key(const char *name,
-						int singlethread,
-						int freezeable,
-						int rt,
+						unsigned int flags,
+						int max_active,
 						struct lock_class_key *key,
 						const char *lock_name)
 {
 	struct workqueue_struct *wq;
 	struct cpu_workqueue_struct *cwq;
+	struct wq_worker *worker;
 	int err = 0, cpu;
 
+	if (flags & WQ_ORDERED)
+		max_active = 1;
+	else if (max_active <= 0)
+		max_active = WQ_DFL_ACTIVE;
+
 	wq = kzalloc(sizeof(*wq), GFP_KERNEL);
 	if (!wq)
 		return NULL;
@@ -802,29 +1311,40 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 		kfree(wq);
 		return NULL;
 	}
+	if (flags & WQ_DEDICATED) {
+		wq->pools = alloc_percpu(struct global_cwq);
+		if (!wq->pools) {
+			free_percpu(wq->cpu_wq);
+			kfree(wq);
+			return NULL;
+		}
+	}
 
 	wq->name = name;
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
-	wq->singlethread = singlethread;
-	wq->freezeable = freezeable;
-	wq->rt = rt;
+	wq->flags = flags;
 	INIT_LIST_HEAD(&wq->list);
 
-	if (singlethread) {
-		cwq = init_cpu_workqueue(wq, singlethread_cpu);
-		err = create_workqueue_thread(cwq, singlethread_cpu);
-		start_workqueue_thread(cwq, -1);
+	cpu_maps_update_begin();
+	/*
+	 * We must place this wq on list even if the code below fails.
+	 * cpu_up(cpu) can create the workers of cpu before
+	 * destroy_workqueue() takes the lock.
+	 */
+	spin_lock(&workqueue_lock);
+	list_add(&wq->list, &workqueues);
+	spin_unlock(&workqueue_lock);
+
+	if (is_wq_single_threaded(wq)) {
+		cwq = init_cpu_workqueue(wq, singlethread_cpu, max_active);
+		if (wq->pools) {
+			worker = create_worker(cwq->gcwq);
+			if (worker)
+				start_worker(worker);
+			else
+				err = -ENOMEM;
+		}
 	} else {
-		cpu_maps_update_begin();
-		/*
-		 * We must place this wq on list even if the code below fails.
-		 * cpu_down(cpu) can remove cpu from cpu_populated_map before
-		 * destroy_workqueue() takes the lock, in that case we leak
-		 * cwq[cpu]->thread.
-		 */
-		spin_lock(&workqueue_lock);
-		list_add(&wq->list, &workqueues);
-		spin_unlock(&workqueue_lock);
 		/*
 		 * We must initialize cwqs for each possible cpu even if we
 		 * are going to call destroy_workqueue() finally. Otherwise
@@ -832,14 +1352,18 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 		 * lock.
 		 */
 		for_each_possible_cpu(cpu) {
-			cwq = init_cpu_workqueue(wq, cpu);
-			if (err || !cpu_online(cpu))
+			cwq = init_cpu_workqueue(wq, cpu, max_active);
+			if (err || !wq->pools || !cpu_online(cpu))
 				continue;
-			err = create_workqueue_thread(cwq, cpu);
-			start_workqueue_thread(cwq, cpu);
+			cwq->gcwq->bind_seq = 1;
+			worker = create_worker(cwq->gcwq);
+			if (worker)
+				start_worker(worker);
+			else
+				err = -ENOMEM;
 		}
-		cpu_maps_update_done();
 	}
+	cpu_maps_update_done();
 
 	if (err) {
 		destroy_workqueue(wq);
@@ -849,33 +1373,6 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 }
 EXPORT_SYMBOL_GPL(__create_workqueue_key);
 
-static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
-{
-	/*
-	 * Our caller is either destroy_workqueue() or CPU_POST_DEAD,
-	 * cpu_add_remove_lock protects cwq->thread.
-	 */
-	if (cwq->thread == NULL)
-		return;
-
-	lock_map_acquire(&cwq->wq->lockdep_map);
-	lock_map_release(&cwq->wq->lockdep_map);
-
-	flush_cpu_workqueue(cwq);
-	/*
-	 * If the caller is CPU_POST_DEAD and cwq->worklist was not empty,
-	 * a concurrent flush_workqueue() can insert a barrier after us.
-	 * However, in that case run_workqueue() won't return and check
-	 * kthread_should_stop() until it flushes all work_struct's.
-	 * When ->worklist becomes empty it is safe to exit because no
-	 * more work_structs can be queued on this cwq: flush_workqueue
-	 * checks list_empty(), and a "normal" queue_work() can't use
-	 * a dead CPU.
-	 */
-	kthread_stop(cwq->thread);
-	cwq->thread = NULL;
-}
-
 /**
  * destroy_workqueue - safely terminate a workqueue
  * @wq: target workqueue
@@ -885,6 +1382,7 @@ static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
 void destroy_workqueue(struct workqueue_struct *wq)
 {
 	const struct cpumask *cpu_map = wq_cpu_map(wq);
+	struct cpu_workqueue_struct *cwq;
 	int cpu;
 
 	cpu_maps_update_begin();
@@ -892,21 +1390,87 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	list_del(&wq->list);
 	spin_unlock(&workqueue_lock);
 
-	for_each_cpu_mask_nr(cpu, *cpu_map)
-		cleanup_workqueue_thread(per_cpu_ptr(wq->cpu_wq, cpu));
+	lock_map_acquire(&wq->lockdep_map);
+	lock_map_release(&wq->lockdep_map);
+
+	for_each_cpu_mask_nr(cpu, *cpu_map) {
+		cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+		flush_cpu_workqueue(cwq);
+		/*
+		 * The cwq is idle now, but a worker of a shared pool may
+		 * still find it on the pending list.
+		 */
+		spin_lock_irq(&cwq->gcwq->lock);
+		list_del_init(&cwq->pending_entry);
+		spin_unlock_irq(&cwq->gcwq->lock);
+	}
+	if (wq->pools) {
+		for_each_possible_cpu(cpu)
+			if (per_cpu_ptr(wq->cpu_wq, cpu)->gcwq)
+				destroy_dedicated_workers(
+					per_cpu_ptr(wq->pools, cpu));
+	}
  	cpu_maps_update_done();
 
+	if (wq->pools)
+		free_percpu(wq->pools);
 	free_percpu(wq->cpu_wq);
 	kfree(wq);
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
 
+/*
+ * Give the pool of a cpu coming up its first worker.  The worker is
+ * started by workqueue_cpu_online().
+ */
+static int workqueue_cpu_prepare(struct global_cwq *gcwq)
+{
+	struct wq_worker *worker;
+
+	if (!list_empty(&gcwq->workers))
+		return 0;
+	worker = create_worker(gcwq);
+	if (!worker)
+		return -ENOMEM;
+	attach_worker(worker);
+	return 0;
+}
+
+/*
+ * Wake the idle workers, which starts those created by
+ * workqueue_cpu_prepare(), and have them (re)bind to the cpu if it came up.
+ * Busy workers rebind when they go idle.
+ */
+static void workqueue_cpu_online(struct global_cwq *gcwq, int online)
+{
+	struct wq_worker *worker;
+
+	spin_lock_irq(&gcwq->lock);
+	if (online)
+		gcwq->bind_seq++;
+	list_for_each_entry(worker, &gcwq->idle_list, entry)
+		wake_up_process(worker->task);
+	spin_unlock_irq(&gcwq->lock);
+}
+
+static int workqueue_cpu_action(struct global_cwq *gcwq, unsigned long action)
+{
+	switch (action) {
+	case CPU_UP_PREPARE:
+		return workqueue_cpu_prepare(gcwq);
+	case CPU_ONLINE:
+	case CPU_UP_CANCELED:
+		workqueue_cpu_online(gcwq, action == CPU_ONLINE);
+		break;
+	}
+	return 0;
+}
+
 static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 						unsigned long action,
 						void *hcpu)
 {
 	unsigned int cpu = (unsigned long)hcpu;
-	struct cpu_workqueue_struct *cwq;
 	struct workqueue_struct *wq;
 	int ret = NOTIFY_OK;
 
@@ -917,38 +1481,25 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 		cpumask_set_cpu(cpu, cpu_populated_map);
 	}
 undo:
+	if (workqueue_cpu_action(&per_cpu(shared_gcwq, cpu), action)) {
+		printk(KERN_ERR "workqueue pool for %i failed\n", cpu);
+		goto cancel;
+	}
 	list_for_each_entry(wq, &workqueues, list) {
-		cwq = per_cpu_ptr(wq->cpu_wq, cpu);
-
-		switch (action) {
-		case CPU_UP_PREPARE:
-			if (!create_workqueue_thread(cwq, cpu))
-				break;
+		if (!wq->pools || is_wq_single_threaded(wq))
+			continue;
+		if (workqueue_cpu_action(per_cpu_ptr(wq->pools, cpu), action)) {
 			printk(KERN_ERR "workqueue [%s] for %i failed\n",
 				wq->name, cpu);
-			action = CPU_UP_CANCELED;
-			ret = NOTIFY_BAD;
-			goto undo;
-
-		case CPU_ONLINE:
-			start_workqueue_thread(cwq, cpu);
-			break;
-
-		case CPU_UP_CANCELED:
-			start_workqueue_thread(cwq, -1);
-		case CPU_POST_DEAD:
-			cleanup_workqueue_thread(cwq);
-			break;
+			goto cancel;
 		}
 	}
-
-	switch (action) {
-	case CPU_UP_CANCELED:
-	case CPU_POST_DEAD:
-		cpumask_clear_cpu(cpu, cpu_populated_map);
-	}
-
 	return ret;
+
+cancel:
+	action = CPU_UP_CANCELED;
+	ret = NOTIFY_BAD;
+	goto undo;
 }
 
 #ifdef CONFIG_SMP
@@ -998,13 +1549,121 @@ long work_on_cpu(unsigned int cpu, long (*fn)(void *), void *arg)
 EXPORT_SYMBOL_GPL(work_on_cpu);
 #endif /* CONFIG_SMP */
 
+
+static const char *wq_flag_names = "ONFRM";	/* in WQ_* bit order */
+
+static int workqueue_stats_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+	struct global_cwq *gcwq;
+	int cpu, i;
+
+	seq_printf(m, "%-8s %7s %4s %7s %7s %6s\n",
+		   "pool", "workers", "idle", "running", "created", "failed");
+	for_each_possible_cpu(cpu) {
+		gcwq = &per_cpu(shared_gcwq, cpu);
+		if (!gcwq->nr_created)
+			continue;
+		spin_lock_irq(&gcwq->lock);
+		seq_printf(m, "cpu%-5d %7d %4d %7d %7lu %6lu\n", cpu,
+			   gcwq->nr_workers, gcwq->nr_idle,
+			   atomic_read(&gcwq->nr_running), gcwq->nr_created,
+			   gcwq->nr_create_failed);
+		spin_unlock_irq(&gcwq->lock);
+	}
+
+	seq_printf(m, "\n%-16s %-5s", "workqueue", "flags");
+#ifdef CONFIG_WORKQUEUE_STATS
+	seq_printf(m, " %10s %10s %9s %9s %9s %9s", "queued", "executed",
+		   "wait_avg", "wait_max", "run_avg", "run_max");
+#endif
+	seq_putc(m, '\n');
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list) {
+		char flags[6];
+#ifdef CONFIG_WORKQUEUE_STATS
+		unsigned long queued = 0, executed = 0;
+		u64 wait_total = 0, wait_max = 0, run_total = 0, run_max = 0;
+		const struct cpumask *cpu_map = wq_cpu_map(wq);
+		struct cpu_workqueue_struct *cwq;
+
+		for_each_cpu_mask_nr(cpu, *cpu_map) {
+			cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+			spin_lock_irq(&cwq->gcwq->lock);
+			queued += cwq->nr_queued;
+			executed += cwq->nr_executed;
+			wait_total += cwq->wait_total;
+			wait_max = max(wait_max, cwq->wait_max);
+			run_total += cwq->run_total;
+			run_max = max(run_max, cwq->run_max);
+			spin_unlock_irq(&cwq->gcwq->lock);
+		}
+		if (executed) {
+			wait_total = div_u64(wait_total, executed);
+			run_total = div_u64(run_total, executed);
+		}
+#endif
+		for (i = 0; wq_flag_names[i]; i++)
+			flags[i] = (wq->flags & (1 << i)) ? wq_flag_names[i] : '-';
+		flags[i] = '\0';
+
+		seq_printf(m, "%-16s %-5s", wq->name, flags);
+#ifdef CONFIG_WORKQUEUE_STATS
+		/* times in microseconds */
+		seq_printf(m, " %10lu %10lu %9llu %9llu %9llu %9llu", queued,
+			   executed,
+			   (unsigned long long)div_u64(wait_total, 1000),
+			   (unsigned long long)div_u64(wait_max, 1000),
+			   (unsigned long long)div_u64(run_total, 1000),
+			   (unsigned long long)div_u64(run_max, 1000));
+#endif
+		seq_putc(m, '\n');
+	}
+	spin_unlock(&workqueue_lock);
+	return 0;
+}
+
+static int workqueue_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, workqueue_stats_show, NULL);
+}
+
+static const struct file_operations workqueue_stats_fops = {
+	.open		= workqueue_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init init_workqueue_procfs(void)
+{
+	proc_create("workqueues", 0444, NULL, &workqueue_stats_fops);
+	return 0;
+}
+__initcall(init_workqueue_procfs);
+
 void __init init_workqueues(void)
 {
+	struct global_cwq *gcwq;
+	struct wq_worker *worker;
+	int cpu;
+
 	alloc_cpumask_var(&cpu_populated_map, GFP_KERNEL);
 
 	cpumask_copy(cpu_populated_map, cpu_online_mask);
 	singlethread_cpu = cpumask_first(cpu_possible_mask);
 	cpu_singlethread_map = cpumask_of(singlethread_cpu);
+	for_each_possible_cpu(cpu) {
+		gcwq = &per_cpu(shared_gcwq, cpu);
+		init_global_cwq(gcwq, cpu, NULL);
+		if (!cpu_online(cpu))
+			continue;
+		gcwq->bind_seq = 1;
+		worker = create_worker(gcwq);
+		BUG_ON(!worker);
+		start_worker(worker);
+	}
 	hotcpu_notifier(workqueue_cpu_callback, 0);
 	keventd_wq = create_workqueue("events");
 	BUG_ON(!keventd_wq);
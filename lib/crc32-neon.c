@@ -0,0 +1,131 @@
+/*
+ * CRC32 and CRC32c folding for ARMv7 NEON
+ *
+ * The folding scheme is the one of V. Gopal et al., "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction", Intel, 2009, with
+ * the carry-less multiply built from vmull.p8 as described below.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A CRC only needs the message modulo the polynomial P, so a 128 bit
+ * chunk of the message can be replaced by any value congruent to it once
+ * it has been moved ("folded") further down the message:
+ *
+ *	A * x^N == Alo * (x^(N+64) mod P) + Ahi * (x^N mod P)	(mod P)
+ *
+ * Four chunks are folded 512 bits ahead at a time, and at the end the
+ * four are folded onto the last one.  The 128 bit result is handed back
+ * to the table driven code in lib/crc32.c to be reduced to 32 bits.
+ *
+ * ARMv7 has no 64 bit carry-less multiply, so the 64x32 bit products are
+ * assembled from vmull.p8 partial products: each 8x8 bit multiply of a
+ * data byte and a constant byte yields a 16 bit result whose low and
+ * high bytes are separated with vuzp and added in at the right byte
+ * offset.  Both halves of a chunk land at the same offsets and are
+ * summed before that step.
+ *
+ * All of this happens in the bit-reflected domain of crc32_le(), where a
+ * raw product lands 33 bits above where it belongs; the constants
+ * account for that (x^(N+64-33) and x^(N-33)).
+ *
+ * This file is built with -mfpu=neon and must only be called between
+ * kernel_neon_begin() and kernel_neon_end().  It deliberately includes
+ * no kernel headers; see crc32-neon.h for the interface.
+ */
+
+#include <arm_neon.h>
+
+#include "crc32-neon.h"
+
+struct fold_k {
+	poly8x8_t lo[4];	/* bytes of the constant for the low half */
+	poly8x8_t hi[4];	/* bytes of the constant for the high half */
+};
+
+static inline void fold_k_init(struct fold_k *fk, unsigned int klo,
+			       unsigned int khi)
+{
+	int j;
+
+	for (j = 0; j < 4; j++) {
+		fk->lo[j] = vdup_n_p8((poly8_t)(klo >> (8 * j)));
+		fk->hi[j] = vdup_n_p8((poly8_t)(khi >> (8 * j)));
+	}
+}
+
+static inline uint8x16_t shl8(uint8x16_t x)
+{
+	return vextq_u8(vdupq_n_u8(0), x, 15);
+}
+
+/*
+ * Returns a value congruent to @x moved by the distance @fk was built for.
+ * The result is at most 96 bits wide.
+ */
+static inline uint8x16_t fold(uint8x16_t x, const struct fold_k *fk)
+{
+	poly8x8_t lo = vreinterpret_p8_u8(vget_low_u8(x));
+	poly8x8_t hi = vreinterpret_p8_u8(vget_high_u8(x));
+	uint8x16_t p[4];
+	uint8x16x2_t u01, u23;
+	uint8x8_t s1, s2, s3;
+	uint8x16_t r;
+	int j;
+
+	/* p[j], 16 bit lane i: data byte i times constant byte j */
+	for (j = 0; j < 4; j++)
+		p[j] = veorq_u8(vreinterpretq_u8_p16(vmull_p8(lo, fk->lo[j])),
+				vreinterpretq_u8_p16(vmull_p8(hi, fk->hi[j])));
+
+	/* low bytes go to byte i + j, high bytes to byte i + j + 1 */
+	u01 = vuzpq_u8(p[0], p[1]);
+	u23 = vuzpq_u8(p[2], p[3]);
+	s1 = veor_u8(vget_high_u8(u01.val[0]), vget_low_u8(u01.val[1]));
+	s2 = veor_u8(vget_low_u8(u23.val[0]), vget_high_u8(u01.val[1]));
+	s3 = veor_u8(vget_high_u8(u23.val[0]), vget_low_u8(u23.val[1]));
+
+	r = vcombine_u8(vget_high_u8(u23.val[1]), vdup_n_u8(0));
+	r = veorq_u8(shl8(r), vcombine_u8(s3, vdup_n_u8(0)));
+	r = veorq_u8(shl8(r), vcombine_u8(s2, vdup_n_u8(0)));
+	r = veorq_u8(shl8(r), vcombine_u8(s1, vdup_n_u8(0)));
+	r = veorq_u8(shl8(r), vcombine_u8(vget_low_u8(u01.val[0]),
+					  vdup_n_u8(0)));
+	return r;
+}
+
+void crc32_neon_fold(unsigned char *rem, unsigned int crc,
+		     const unsigned char *p, unsigned long len,
+		     const unsigned int *k)
+{
+	struct fold_k fk;
+	uint8x16_t x0, x1, x2, x3;
+
+	x0 = vld1q_u8(p);
+	x1 = vld1q_u8(p + 16);
+	x2 = vld1q_u8(p + 32);
+	x3 = vld1q_u8(p + 48);
+	x0 = veorq_u8(x0, vreinterpretq_u8_u32(
+			      vsetq_lane_u32(crc, vdupq_n_u32(0), 0)));
+	p += CRC32_NEON_BLOCK;
+	len -= CRC32_NEON_BLOCK;
+
+	fold_k_init(&fk, k[0], k[1]);
+	while (len) {
+		x0 = veorq_u8(fold(x0, &fk), vld1q_u8(p));
+		x1 = veorq_u8(fold(x1, &fk), vld1q_u8(p + 16));
+		x2 = veorq_u8(fold(x2, &fk), vld1q_u8(p + 32));
+		x3 = veorq_u8(fold(x3, &fk), vld1q_u8(p + 48));
+		p += CRC32_NEON_BLOCK;
+		len -= CRC32_NEON_BLOCK;
+	}
+
+	fold_k_init(&fk, k[2], k[3]);
+	x3 = veorq_u8(x3, fold(x0, &fk));
+	fold_k_init(&fk, k[4], k[5]);
+	x3 = veorq_u8(x3, fold(x1, &fk));
+	fold_k_init(&fk, k[6], k[7]);
+	x3 = veorq_u8(x3, fold(x2, &fk));
+	vst1q_u8(rem, x3);
+}
@@ -0,0 +1,28 @@
+/*
+ * Interface between lib/crc32.c and the NEON CRC folding code.
+ *
+ * The folding code is compiled with -mfpu=neon and cannot include kernel
+ * headers, so only plain C types are used here.
+ */
+
+#ifndef _LIB_CRC32_NEON_H
+#define _LIB_CRC32_NEON_H
+
+/* the input is consumed in blocks of this many bytes */
+#define CRC32_NEON_BLOCK	64
+
+/* number of folding constants, see crc32_neon_fold() */
+#define CRC32_NEON_CONSTS	8
+
+/*
+ * Fold @len bytes at @p, a non-zero multiple of CRC32_NEON_BLOCK, into the
+ * 16 byte remainder @rem, after xoring the running bit-reflected @crc into
+ * the first four bytes.  A zero-seeded CRC of @rem equals the @crc-seeded
+ * CRC of the input.  @k holds x^n mod P, bit-reflected, for
+ * n = 543, 479, 415, 351, 287, 223, 159 and 95.
+ */
+void crc32_neon_fold(unsigned char *rem, unsigned int crc,
+		     const unsigned char *p, unsigned long len,
+		     const unsigned int *k);
+
+#endif /* _LIB_CRC32_NEON_H */
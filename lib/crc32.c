@@ -29,132 +29,252 @@
 #include <linux/init.h>
 #include <asm/atomic.h>
 #include "crc32defs.h"
-#if CRC_LE_BITS == 8
+#if CRC_LE_BITS >= 8
 #define tole(x) __constant_cpu_to_le32(x)
-#define tobe(x) __constant_cpu_to_be32(x)
 #else
 #define tole(x) (x)
+#endif
+#if CRC_BE_BITS >= 8
+#define tobe(x) __constant_cpu_to_be32(x)
+#else
 #define tobe(x) (x)
 #endif
 #include "crc32table.h"
+#if CRC_LE_BITS == 1
+/* the bit-at-a-time code needs no table */
+#define crc32table_le NULL
+#define crc32ctable_le NULL
+#endif
+
+#ifdef CONFIG_CRC32_NEON
+#include <linux/hardirq.h>
+#include <linux/jiffies.h>
+#include <asm/neon.h>
+#include "crc32-neon.h"
+#endif
 
 MODULE_AUTHOR("Matt Domsch <Matt_Domsch@dell.com>");
 MODULE_DESCRIPTION("Ethernet CRC32 calculations");
 MODULE_LICENSE("GPL");
 
-/**
- * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
- * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
- *	other uses, or the previous crc32 value if computing incrementally.
- * @p: pointer to buffer over which CRC is run
- * @len: length of buffer @p
- */
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len);
-
-#if CRC_LE_BITS == 1
+#if CRC_LE_BITS >= 8 || CRC_BE_BITS >= 8
 /*
- * In fact, the table-based code will work in this case, but it can be
- * simplified by inlining the table in ?: form.
+ * Table-based core shared by both bit orders; @tab holds byte-swapped
+ * entries when the CRC register is kept in the other byte order than the
+ * CPU's.  With @bits > 8, each step looks up every byte of one (32) or
+ * two (64) words in its own table, which breaks the dependency of each
+ * lookup on the previous one.
  */
-
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+static inline u32
+crc32_body(u32 crc, unsigned char const *buf, size_t len,
+	   const u32 (*tab)[256], const int bits)
 {
-	int i;
-	while (len--) {
-		crc ^= *p++;
-		for (i = 0; i < 8; i++)
-			crc = (crc >> 1) ^ ((crc & 1) ? CRCPOLY_LE : 0);
-	}
-	return crc;
-}
-#else				/* Table-based approach */
-
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
-{
-# if CRC_LE_BITS == 8
-	const u32      *b =(u32 *)p;
-	const u32      *tab = crc32table_le;
-
 # ifdef __LITTLE_ENDIAN
-#  define DO_CRC(x) crc = tab[ (crc ^ (x)) & 255 ] ^ (crc>>8)
+#  define DO_CRC(x) crc = t0[(crc ^ (x)) & 255] ^ (crc >> 8)
+#  define DO_CRC4(q) (t3[(q) & 255] ^ t2[((q) >> 8) & 255] ^ \
+		      t1[((q) >> 16) & 255] ^ t0[((q) >> 24) & 255])
+#  define DO_CRC8(q) (t7[(q) & 255] ^ t6[((q) >> 8) & 255] ^ \
+		      t5[((q) >> 16) & 255] ^ t4[((q) >> 24) & 255])
 # else
-#  define DO_CRC(x) crc = tab[ ((crc >> 24) ^ (x)) & 255] ^ (crc<<8)
+#  define DO_CRC(x) crc = t0[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
+#  define DO_CRC4(q) (t0[(q) & 255] ^ t1[((q) >> 8) & 255] ^ \
+		      t2[((q) >> 16) & 255] ^ t3[((q) >> 24) & 255])
+#  define DO_CRC8(q) (t4[(q) & 255] ^ t5[((q) >> 8) & 255] ^ \
+		      t6[((q) >> 16) & 255] ^ t7[((q) >> 24) & 255])
 # endif
+	const u32 *t0 = tab[0];
+	const u32 *b;
+	size_t rem_len;
+	u32 q;
 
-	crc = __cpu_to_le32(crc);
 	/* Align it */
-	if(unlikely(((long)b)&3 && len)){
+	if (unlikely((long)buf & 3 && len)) {
 		do {
-			u8 *p = (u8 *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while ((--len) && ((long)b)&3 );
+			DO_CRC(*buf++);
+		} while ((--len) && ((long)buf) & 3);
 	}
-	if(likely(len >= 4)){
+
+	b = (const u32 *)buf;
+	if (bits == 64) {
+		const u32 *t1 = tab[1], *t2 = tab[2], *t3 = tab[3];
+		const u32 *t4 = tab[4], *t5 = tab[5], *t6 = tab[6];
+		const u32 *t7 = tab[7];
+
+		rem_len = len & 7;
+		for (len >>= 3; len; len--) {
+			q = crc ^ *b++;
+			crc = DO_CRC8(q);
+			q = *b++;
+			crc ^= DO_CRC4(q);
+		}
+	} else if (bits == 32) {
+		const u32 *t1 = tab[1], *t2 = tab[2], *t3 = tab[3];
+
+		rem_len = len & 3;
+		for (len >>= 2; len; len--) {
+			q = crc ^ *b++;
+			crc = DO_CRC4(q);
+		}
+	} else {
 		/* load data 32 bits wide, xor data 32 bits wide. */
-		size_t save_len = len & 3;
-	        len = len >> 2;
-		--b; /* use pre increment below(*++b) for speed */
-		do {
-			crc ^= *++b;
+		rem_len = len & 3;
+		for (len >>= 2; len; len--) {
+			crc ^= *b++;
 			DO_CRC(0);
 			DO_CRC(0);
 			DO_CRC(0);
 			DO_CRC(0);
-		} while (--len);
-		b++; /* point to next byte(s) */
-		len = save_len;
+		}
 	}
+
 	/* And the last few bytes */
-	if(len){
-		do {
-			u8 *p = (u8 *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while (--len);
-	}
+	buf = (unsigned char const *)b;
+	while (rem_len--)
+		DO_CRC(*buf++);
 
-	return __le32_to_cpu(crc);
-#undef ENDIAN_SHIFT
+	return crc;
 #undef DO_CRC
+#undef DO_CRC4
+#undef DO_CRC8
+}
+#endif
 
-# elif CRC_LE_BITS == 4
+/*
+ * Little-endian CRC with the given polynomial and its table; crc32_le()
+ * and __crc32c_le() differ only in those.
+ */
+static inline u32 __pure
+crc32_le_generic(u32 crc, unsigned char const *p, size_t len,
+		 const u32 (*tab)[LE_TABLE_SIZE], u32 polynomial)
+{
+#if CRC_LE_BITS == 1
+	/*
+	 * In fact, the table-based code will work in this case, but it can
+	 * be simplified by inlining the table in ?: form.
+	 */
+	int i;
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+	}
+#elif CRC_LE_BITS == 2
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 4) ^ crc32table_le[crc & 15];
-		crc = (crc >> 4) ^ crc32table_le[crc & 15];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
 	}
-	return crc;
-# elif CRC_LE_BITS == 2
+#elif CRC_LE_BITS == 4
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
+		crc = (crc >> 4) ^ tab[0][crc & 15];
+		crc = (crc >> 4) ^ tab[0][crc & 15];
 	}
+#else
+	crc = __cpu_to_le32(crc);
+	crc = crc32_body(crc, p, len, tab, CRC_LE_BITS);
+	crc = __le32_to_cpu(crc);
+#endif
 	return crc;
-# endif
+}
+
+#ifdef CONFIG_CRC32_NEON
+/*
+ * Buffers shorter than this are not worth saving the VFP state for; the
+ * tail that does not fill a whole block is always done by the tables.
+ */
+#define CRC32_NEON_MIN		256
+
+/* Bound the time spent with preemption disabled */
+#define CRC32_NEON_CHUNK	4096
+
+/* Benchmark each implementation for 2^CRC32_TIME_JIFFIES_LG2 jiffies */
+#define CRC32_TIME_JIFFIES_LG2	3
+
+static int crc32_use_neon __read_mostly;
+static u32 crc32_neon_k[CRC32_NEON_CONSTS] __read_mostly;
+static u32 crc32c_neon_k[CRC32_NEON_CONSTS] __read_mostly;
+
+static u32 __pure
+crc32_le_neon(u32 crc, unsigned char const *p, size_t len,
+	      const u32 (*tab)[LE_TABLE_SIZE], u32 polynomial, const u32 *k)
+{
+	unsigned char rem[16];
+	size_t chunk;
+
+	while (len >= CRC32_NEON_BLOCK) {
+		chunk = min_t(size_t, len & ~(CRC32_NEON_BLOCK - 1),
+			      CRC32_NEON_CHUNK);
+		kernel_neon_begin();
+		crc32_neon_fold(rem, crc, p, chunk, k);
+		kernel_neon_end();
+		crc = crc32_le_generic(0, rem, sizeof(rem), tab, polynomial);
+		p += chunk;
+		len -= chunk;
+	}
+	return crc32_le_generic(crc, p, len, tab, polynomial);
+}
+
+/* NEON may not be used from interrupt context, see kernel_neon_begin() */
+static inline int crc32_neon_usable(size_t len)
+{
+	return crc32_use_neon && len >= CRC32_NEON_MIN && !in_interrupt();
 }
 #endif
 
 /**
- * crc32_be() - Calculate bitwise big-endian Ethernet AUTODIN II CRC32
+ * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
  * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
  *	other uses, or the previous crc32 value if computing incrementally.
  * @p: pointer to buffer over which CRC is run
  * @len: length of buffer @p
  */
-u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len);
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+#ifdef CONFIG_CRC32_NEON
+	if (crc32_neon_usable(len))
+		return crc32_le_neon(crc, p, len, crc32table_le, CRCPOLY_LE,
+				     crc32_neon_k);
+#endif
+	return crc32_le_generic(crc, p, len, crc32table_le, CRCPOLY_LE);
+}
 
-#if CRC_BE_BITS == 1
-/*
- * In fact, the table-based code will work in this case, but it can be
- * simplified by inlining the table in ?: form.
+/**
+ * __crc32c_le() - Calculate bitwise little-endian CRC32c (Castagnoli)
+ * @crc: seed value for computation.  ~0 for iSCSI and ext4/btrfs, or
+ *	the previous crc32c value if computing incrementally.
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ *
+ * Most users want the "crc32c" crypto API algorithm or crc32c() from
+ * libcrc32c instead, which may be backed by hardware.
  */
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+#ifdef CONFIG_CRC32_NEON
+	if (crc32_neon_usable(len))
+		return crc32_le_neon(crc, p, len, crc32ctable_le,
+				     CRC32C_POLY_LE, crc32c_neon_k);
+#endif
+	return crc32_le_generic(crc, p, len, crc32ctable_le, CRC32C_POLY_LE);
+}
 
+/**
+ * crc32_be() - Calculate bitwise big-endian Ethernet AUTODIN II CRC32
+ * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
+ *	other uses, or the previous crc32 value if computing incrementally.
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ */
 u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
 {
+#if CRC_BE_BITS == 1
+	/*
+	 * In fact, the table-based code will work in this case, but it can
+	 * be simplified by inlining the table in ?: form.
+	 */
 	int i;
 	while (len--) {
 		crc ^= *p++ << 24;
@@ -163,80 +283,282 @@ u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
 			    (crc << 1) ^ ((crc & 0x80000000) ? CRCPOLY_BE :
 					  0);
 	}
+#elif CRC_BE_BITS == 2
+	while (len--) {
+		crc ^= *p++ << 24;
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+	}
+#elif CRC_BE_BITS == 4
+	while (len--) {
+		crc ^= *p++ << 24;
+		crc = (crc << 4) ^ crc32table_be[0][crc >> 28];
+		crc = (crc << 4) ^ crc32table_be[0][crc >> 28];
+	}
+#else
+	crc = __cpu_to_be32(crc);
+	crc = crc32_body(crc, p, len, crc32table_be, CRC_BE_BITS);
+	crc = __be32_to_cpu(crc);
+#endif
 	return crc;
 }
 
-#else				/* Table-based approach */
-u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
+EXPORT_SYMBOL(crc32_le);
+EXPORT_SYMBOL(__crc32c_le);
+EXPORT_SYMBOL(crc32_be);
+
+#ifdef CONFIG_CRC32_NEON
+/* x^n mod P, bit-reflected like the polynomial */
+static u32 __init crc32_xpow_mod(unsigned int n, u32 polynomial)
 {
-# if CRC_BE_BITS == 8
-	const u32      *b =(u32 *)p;
-	const u32      *tab = crc32table_be;
+	u32 r = 0x80000000;
 
-# ifdef __LITTLE_ENDIAN
-#  define DO_CRC(x) crc = tab[ (crc ^ (x)) & 255 ] ^ (crc>>8)
-# else
-#  define DO_CRC(x) crc = tab[ ((crc >> 24) ^ (x)) & 255] ^ (crc<<8)
-# endif
+	while (n--)
+		r = (r >> 1) ^ ((r & 1) ? polynomial : 0);
+	return r;
+}
 
-	crc = __cpu_to_be32(crc);
-	/* Align it */
-	if(unlikely(((long)b)&3 && len)){
-		do {
-			u8 *p = (u8 *)b;
-			DO_CRC(*p++);
-			b = (u32 *)p;
-		} while ((--len) && ((long)b)&3 );
-	}
-	if(likely(len >= 4)){
-		/* load data 32 bits wide, xor data 32 bits wide. */
-		size_t save_len = len & 3;
-	        len = len >> 2;
-		--b; /* use pre increment below(*++b) for speed */
-		do {
-			crc ^= *++b;
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-		} while (--len);
-		b++; /* point to next byte(s) */
-		len = save_len;
+static void __init crc32_neon_init_k(u32 *k, u32 polynomial)
+{
+	/* see crc32-neon.h */
+	static const unsigned int n[CRC32_NEON_CONSTS] __initdata = {
+		543, 479, 415, 351, 287, 223, 159, 95
+	};
+	int i;
+
+	for (i = 0; i < CRC32_NEON_CONSTS; i++)
+		k[i] = crc32_xpow_mod(n[i], polynomial);
+}
+
+static unsigned long __init crc32_speed(u32 (*fn)(u32, unsigned char const *,
+						  size_t),
+					const unsigned char *buf, size_t len)
+{
+	unsigned long j0, j1, count = 0;
+
+	preempt_disable();
+	j0 = jiffies;
+	while ((j1 = jiffies) == j0)
+		cpu_relax();
+	while (time_before(jiffies, j1 + (1 << CRC32_TIME_JIFFIES_LG2))) {
+		fn(0, buf, len);
+		count++;
 	}
-	/* And the last few bytes */
-	if(len){
-		do {
-			u8 *p = (u8 *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while (--len);
+	preempt_enable();
+
+	/* MB/s */
+	return (count * len * HZ) >> (20 + CRC32_TIME_JIFFIES_LG2);
+}
+
+static u32 __init crc32_le_table(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, crc32table_le, CRCPOLY_LE);
+}
+
+/*
+ * Decide at boot whether crc32_le() and __crc32c_le() use NEON: the folding
+ * code must agree with the tables, and must be faster than them.
+ */
+static void __init crc32_neon_select(void)
+{
+	unsigned long table_speed, neon_speed;
+	unsigned char *buf;
+	size_t len;
+	int i, off;
+
+	if (!cpu_has_neon())
+		return;
+
+	crc32_neon_init_k(crc32_neon_k, CRCPOLY_LE);
+	crc32_neon_init_k(crc32c_neon_k, CRC32C_POLY_LE);
+
+	buf = kmalloc(CRC32_NEON_CHUNK + 2 * CRC32_NEON_BLOCK, GFP_KERNEL);
+	if (!buf)
+		return;
+	for (i = 0; i < CRC32_NEON_CHUNK + 2 * CRC32_NEON_BLOCK; i++)
+		buf[i] = i * 131 + (i >> 8);
+
+	for (len = CRC32_NEON_MIN; len <= CRC32_NEON_CHUNK + CRC32_NEON_BLOCK;
+	     len += len / 2 + 1) {
+		for (off = 0; off < 4; off++) {
+			u32 crc = ~len + off;
+
+			if (crc32_le_neon(crc, buf + off, len, crc32table_le,
+					  CRCPOLY_LE, crc32_neon_k) !=
+			    crc32_le_generic(crc, buf + off, len,
+					     crc32table_le, CRCPOLY_LE) ||
+			    crc32_le_neon(crc, buf + off, len, crc32ctable_le,
+					  CRC32C_POLY_LE, crc32c_neon_k) !=
+			    crc32_le_generic(crc, buf + off, len,
+					     crc32ctable_le, CRC32C_POLY_LE)) {
+				printk(KERN_ERR "crc32: NEON result mismatch "
+				       "for %zu bytes at offset %d, not "
+				       "using it\n", len, off);
+				goto out;
+			}
+		}
 	}
-	return __be32_to_cpu(crc);
-#undef ENDIAN_SHIFT
-#undef DO_CRC
 
-# elif CRC_BE_BITS == 4
+	table_speed = crc32_speed(crc32_le_table, buf, CRC32_NEON_CHUNK);
+	crc32_use_neon = 1;
+	neon_speed = crc32_speed(crc32_le, buf, CRC32_NEON_CHUNK);
+	if (neon_speed <= table_speed)
+		crc32_use_neon = 0;
+	printk(KERN_INFO "crc32: table %lu MB/s, neon %lu MB/s, using %s\n",
+	       table_speed, neon_speed, crc32_use_neon ? "neon" : "table");
+out:
+	kfree(buf);
+}
+#endif
+
+#ifdef CONFIG_CRC32_SELFTEST
+#include <linux/math64.h>
+#include <linux/time.h>
+#include <linux/vmalloc.h>
+
+#define CRC32_TEST_MAX	65536
+
+/* The bit-at-a-time definitions everything else is checked against */
+static u32 __init crc32_le_bitwise(u32 crc, unsigned char const *p,
+				   size_t len, u32 polynomial)
+{
+	int i;
+
 	while (len--) {
-		crc ^= *p++ << 24;
-		crc = (crc << 4) ^ crc32table_be[crc >> 28];
-		crc = (crc << 4) ^ crc32table_be[crc >> 28];
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
 	}
 	return crc;
-# elif CRC_BE_BITS == 2
+}
+
+static u32 __init crc32_be_bitwise(u32 crc, unsigned char const *p,
+				   size_t len)
+{
+	int i;
+
 	while (len--) {
 		crc ^= *p++ << 24;
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^
+			      ((crc & 0x80000000) ? CRCPOLY_BE : 0);
 	}
 	return crc;
-# endif
+}
+
+static u32 __init crc32c_le_test(u32 crc, unsigned char const *p, size_t len)
+{
+	return __crc32c_le(crc, p, len);
+}
+
+static unsigned long __init crc32_test_speed(u32 (*fn)(u32,
+							unsigned char const *,
+							size_t),
+					     const unsigned char *buf,
+					     size_t len)
+{
+	struct timespec start, end;
+	unsigned long iters = (4 * CRC32_TEST_MAX) / len;
+	unsigned long i;
+	u64 ns;
+
+	getnstimeofday(&start);
+	for (i = 0; i < iters; i++)
+		fn(0, buf, len);
+	getnstimeofday(&end);
+	ns = timespec_to_ns(&end) - timespec_to_ns(&start);
+	if (!ns)
+		ns = 1;
+
+	/* bytes per microsecond == MB/s */
+	ns = div64_u64((u64)iters * len * 1000, ns);
+	return (unsigned long)ns;
+}
+
+/*
+ * Check crc32_le(), __crc32c_le() and crc32_be() against the bitwise
+ * definitions for 64B to 64KB at every word alignment and with a split
+ * in the middle, then report their throughput at each size.
+ */
+static void __init crc32_selftest(void)
+{
+	unsigned char *buf;
+	unsigned int seed = 0x12345678;
+	size_t len;
+	int i, off, errors = 0;
+
+	buf = vmalloc(CRC32_TEST_MAX + 4);
+	if (!buf) {
+		printk(KERN_ERR "crc32: no memory for the self test\n");
+		return;
+	}
+	for (i = 0; i < CRC32_TEST_MAX + 4; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+
+	for (len = 64; len <= CRC32_TEST_MAX; len <<= 2) {
+		for (off = 0; off < 4; off++) {
+			unsigned char const *p = buf + off;
+			size_t half = len / 2 + off;
+			u32 crc = seed ^ len ^ off;
+			u32 want;
+
+			want = crc32_le_bitwise(crc, p, len, CRCPOLY_LE);
+			if (crc32_le(crc, p, len) != want ||
+			    crc32_le(crc32_le(crc, p, half), p + half,
+				     len - half) != want)
+				errors++;
+			want = crc32_le_bitwise(crc, p, len, CRC32C_POLY_LE);
+			if (__crc32c_le(crc, p, len) != want ||
+			    __crc32c_le(__crc32c_le(crc, p, half), p + half,
+					len - half) != want)
+				errors++;
+			want = crc32_be_bitwise(crc, p, len);
+			if (crc32_be(crc, p, len) != want ||
+			    crc32_be(crc32_be(crc, p, half), p + half,
+				     len - half) != want)
+				errors++;
+		}
+	}
+	if (errors) {
+		printk(KERN_ERR "crc32: self test failed, %d errors\n",
+		       errors);
+		goto out;
+	}
+	printk(KERN_INFO "crc32: self test passed\n");
+
+	for (len = 64; len <= CRC32_TEST_MAX; len <<= 2)
+		printk(KERN_INFO "crc32: %5zu bytes: crc32_le %lu MB/s, "
+		       "crc32c %lu MB/s, crc32_be %lu MB/s\n", len,
+		       crc32_test_speed(crc32_le, buf, len),
+		       crc32_test_speed(crc32c_le_test, buf, len),
+		       crc32_test_speed(crc32_be, buf, len));
+out:
+	vfree(buf);
 }
 #endif
 
-EXPORT_SYMBOL(crc32_le);
-EXPORT_SYMBOL(crc32_be);
+static int __init crc32_init(void)
+{
+#ifdef CONFIG_CRC32_NEON
+	crc32_neon_select();
+#endif
+#ifdef CONFIG_CRC32_SELFTEST
+	crc32_selftest();
+#endif
+	return 0;
+}
+
+static void __exit crc32_exit(void)
+{
+}
+
+/* late, so that vfp_init(), also a late_initcall, has set HWCAP_NEON */
+late_initcall(crc32_init);
+module_exit(crc32_exit);
 
 /*
  * A brief CRC tutorial.
@@ -14,6 +14,7 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/lzo.h>
+#include <linux/lz_copy.h>
 #include <asm/byteorder.h>
 #include <asm/unaligned.h>
 #include "lzodefs.h"
@@ -22,11 +23,13 @@
 #define HAVE_OP(x, op_end, op) ((size_t)(op_end - op) < (x))
 #define HAVE_LB(m_pos, out, op) (m_pos < out || m_pos >= op)
 
-#define COPY4(dst, src)	\
-		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
-
-int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
-			unsigned char *out, size_t *out_len)
+/*
+ * Literal runs and matches are copied with lz_copy(); @wide is a constant
+ * in each of the two instances below.
+ */
+static __always_inline int __lzo1x_decompress_safe(const unsigned char *in,
+			size_t in_len, unsigned char *out, size_t *out_len,
+			const int wide)
 {
 	const unsigned char * const ip_end = in + in_len;
 	unsigned char * const op_end = out + *out_len;
@@ -44,9 +47,8 @@ int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 			goto output_overrun;
 		if (HAVE_IP(t + 1, ip_end, ip))
 			goto input_overrun;
-		do {
-			*op++ = *ip++;
-		} while (--t > 0);
+		op = lz_copy(op, ip, t, wide);
+		ip += t;
 		goto first_literal_run;
 	}
 
@@ -70,28 +72,8 @@ int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 		if (HAVE_IP(t + 4, ip_end, ip))
 			goto input_overrun;
 
-		COPY4(op, ip);
-		op += 4;
-		ip += 4;
-		if (--t > 0) {
-			if (t >= 4) {
-				do {
-					COPY4(op, ip);
-					op += 4;
-					ip += 4;
-					t -= 4;
-				} while (t >= 4);
-				if (t > 0) {
-					do {
-						*op++ = *ip++;
-					} while (--t > 0);
-				}
-			} else {
-				do {
-					*op++ = *ip++;
-				} while (--t > 0);
-			}
-		}
+		op = lz_copy(op, ip, t + 3, wide);
+		ip += t + 3;
 
 first_literal_run:
 		t = *ip++;
@@ -180,30 +162,8 @@ match:
 				goto lookbehind_overrun;
 			if (HAVE_OP(t + 3 - 1, op_end, op))
 				goto output_overrun;
-
-			if (t >= 2 * 4 - (3 - 1) && (op - m_pos) >= 4) {
-				COPY4(op, m_pos);
-				op += 4;
-				m_pos += 4;
-				t -= 4 - (3 - 1);
-				do {
-					COPY4(op, m_pos);
-					op += 4;
-					m_pos += 4;
-					t -= 4;
-				} while (t >= 4);
-				if (t > 0)
-					do {
-						*op++ = *m_pos++;
-					} while (--t > 0);
-			} else {
 copy_match:
-				*op++ = *m_pos++;
-				*op++ = *m_pos++;
-				do {
-					*op++ = *m_pos++;
-				} while (--t > 0);
-			}
+			op = lz_copy(op, m_pos, t + 2, wide);
 match_done:
 			t = ip[-2] & 3;
 			if (t == 0)
@@ -245,6 +205,20 @@ lookbehind_overrun:
 	return LZO_E_LOOKBEHIND_OVERRUN;
 }
 
+int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
+			unsigned char *out, size_t *out_len)
+{
+	int ret;
+
+	if (lz_wide_begin(*out_len)) {
+		ret = __lzo1x_decompress_safe(in, in_len, out, out_len, 1);
+		lz_wide_end();
+	} else {
+		ret = __lzo1x_decompress_safe(in, in_len, out, out_len, 0);
+	}
+	return ret;
+}
+
 EXPORT_SYMBOL_GPL(lzo1x_decompress_safe);
 
 MODULE_LICENSE("GPL");
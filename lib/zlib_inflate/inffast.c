@@ -4,6 +4,7 @@
  */
 
 #include <linux/zutil.h>
+#include <linux/lz_copy.h>
 #include "inftrees.h"
 #include "inflate.h"
 #include "inffast.h"
@@ -29,6 +30,10 @@
 #  define PUP(a) *++(a)
 #endif
 
+/* Copy len bytes of a match to out, see <linux/lz_copy.h> */
+#define LZCOPY(out, from, len) \
+    ((out) = lz_copy((out) + OFF, (from) + OFF, (len), wide) - OFF)
+
 /*
    Decode literal, length, and distance codes and write out the resulting
    literal and match bytes until either not enough input or output is
@@ -65,8 +70,12 @@
       output space.
 
     - @start:	inflate()'s starting value for strm->avail_out
+
+    - Matches are copied with lz_copy(); @wide is a constant in each of the
+      two instances inflate_fast() expands to.
  */
-void inflate_fast(z_streamp strm, unsigned start)
+static __always_inline void inflate_fast_body(z_streamp strm, unsigned start,
+                                              const int wide)
 {
     struct inflate_state *state;
     const unsigned char *in;    /* local strm->next_in */
@@ -191,9 +200,7 @@ void inflate_fast(z_streamp strm, unsigned start)
                         from += wsize - op;
                         if (op < len) {         /* some from window */
                             len -= op;
-                            do {
-                                PUP(out) = PUP(from);
-                            } while (--op);
+                            LZCOPY(out, from, op);
                             from = out - dist;  /* rest from output */
                         }
                     }
@@ -202,16 +209,12 @@ void inflate_fast(z_streamp strm, unsigned start)
                         op -= write;
                         if (op < len) {         /* some from end of window */
                             len -= op;
-                            do {
-                                PUP(out) = PUP(from);
-                            } while (--op);
+                            LZCOPY(out, from, op);
                             from = window - OFF;
                             if (write < len) {  /* some from start of window */
                                 op = write;
                                 len -= op;
-                                do {
-                                    PUP(out) = PUP(from);
-                                } while (--op);
+                                LZCOPY(out, from, op);
                                 from = out - dist;      /* rest from output */
                             }
                         }
@@ -220,37 +223,15 @@ void inflate_fast(z_streamp strm, unsigned start)
                         from += write - op;
                         if (op < len) {         /* some from window */
                             len -= op;
-                            do {
-                                PUP(out) = PUP(from);
-                            } while (--op);
+                            LZCOPY(out, from, op);
                             from = out - dist;  /* rest from output */
                         }
                     }
-                    while (len > 2) {
-                        PUP(out) = PUP(from);
-                        PUP(out) = PUP(from);
-                        PUP(out) = PUP(from);
-                        len -= 3;
-                    }
-                    if (len) {
-                        PUP(out) = PUP(from);
-                        if (len > 1)
-                            PUP(out) = PUP(from);
-                    }
+                    LZCOPY(out, from, len);
                 }
                 else {
                     from = out - dist;          /* copy direct from output */
-                    do {                        /* minimum length is three */
-                        PUP(out) = PUP(from);
-                        PUP(out) = PUP(from);
-                        PUP(out) = PUP(from);
-                        len -= 3;
-                    } while (len > 2);
-                    if (len) {
-                        PUP(out) = PUP(from);
-                        if (len > 1)
-                            PUP(out) = PUP(from);
-                    }
+                    LZCOPY(out, from, len);
                 }
             }
             else if ((op & 64) == 0) {          /* 2nd level distance code */
@@ -295,6 +276,16 @@ void inflate_fast(z_streamp strm, unsigned start)
     return;
 }
 
+void inflate_fast(z_streamp strm, unsigned start)
+{
+    if (lz_wide_begin(strm->avail_out)) {
+        inflate_fast_body(strm, start, 1);
+        lz_wide_end();
+    }
+    else
+        inflate_fast_body(strm, start, 0);
+}
+
 /*
    inflate_fast() speedups that turned out slower (on a PowerPC G3 750CXe):
    - Using bit fields for code structure
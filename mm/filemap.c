@@ -34,6 +34,7 @@
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
 #include <linux/mm_inline.h> /* for page_is_file_cache() */
+#include <linux/prefetch_trace.h>
 #include "internal.h"
 
 /*
@@ -506,10 +507,14 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 
 	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
 	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
+		if (!page_is_file_cache(page))
 			lru_cache_add_active_anon(page);
+		else if (workingset_refault(mapping, offset)) {
+			/* Evicted while still part of the working set */
+			workingset_activation(page);
+			lru_cache_add_active_file(page);
+		} else
+			lru_cache_add_file(page);
 	}
 	return ret;
 }
@@ -1198,6 +1203,7 @@ no_cached_page:
 			desc->error = error;
 			goto out;
 		}
+		prefetch_trace_record(filp, index, 1);
 		goto readpage;
 	}
 
@@ -1555,6 +1561,8 @@ no_cached_page:
 	 * effect.
 	 */
 	error = page_cache_read(file, vmf->pgoff);
+	if (!error)
+		prefetch_trace_record(file, vmf->pgoff, 1);
 
 	/*
 	 * The page we want has now been added to the page cache.
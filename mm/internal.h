@@ -51,6 +51,7 @@ extern void putback_lru_page(struct page *page);
  */
 extern unsigned long highest_memmap_pfn;
 extern void __free_pages_bootmem(struct page *page, unsigned int order);
+extern int split_free_page(struct page *page);
 
 /*
  * function for dealing with page's order in buddy system.
@@ -36,6 +36,12 @@
 #include <linux/vmalloc.h>
 #include <linux/mm_inline.h>
 #include <linux/page_cgroup.h>
+#include <linux/eventfd.h>
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/workqueue.h>
+#include <linux/notifier.h>
+#include <linux/mem_notify.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -166,6 +172,14 @@ struct mem_cgroup {
 
 	unsigned int	swappiness;
 
+	/*
+	 * eventfds signalled when a charge hits the limit, see
+	 * mem_cgroup_pressure_notify(). Protected by pressure_lock.
+	 */
+	spinlock_t	pressure_lock;
+	struct list_head pressure_eventfds;
+	unsigned long	last_pressure_jiffies;
+
 	/*
 	 * statistics. This must be placed at the end of memcg.
 	 */
@@ -813,6 +827,264 @@ bool mem_cgroup_oom_called(struct task_struct *task)
 	rcu_read_unlock();
 	return ret;
 }
+/*
+ * Limit pressure notification.
+ *
+ * A charge that hits the limit of a cgroup is about to reclaim from it.
+ * That is the cgroup's equivalent of a zone falling below its watermarks,
+ * so listeners are told in the same way and at the same rate as
+ * /dev/mem_notify: eventfds registered through "pressure_eventfd" are
+ * signalled, and in-kernel users (the Android low memory killer) are
+ * called through a notifier chain with the cgroup as argument.
+ */
+struct mem_cgroup_eventfd {
+	struct list_head list;		/* on pressure_eventfds, or empty */
+	struct mem_cgroup *mem;
+	struct eventfd_ctx *ctx;
+	/* queued on the eventfd to learn when userspace closes it */
+	poll_table pt;
+	wait_queue_head_t *wqh;
+	wait_queue_t wait;
+	struct work_struct remove;
+};
+
+static BLOCKING_NOTIFIER_HEAD(memcg_pressure_chain);
+
+int register_mem_cgroup_pressure_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&memcg_pressure_chain, nb);
+}
+EXPORT_SYMBOL_GPL(register_mem_cgroup_pressure_notifier);
+
+int unregister_mem_cgroup_pressure_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&memcg_pressure_chain, nb);
+}
+EXPORT_SYMBOL_GPL(unregister_mem_cgroup_pressure_notifier);
+
+/**
+ * mem_cgroup_get_pages - report the size of a cgroup in pages
+ * @mem: the cgroup
+ * @limit: filled with the limit, ULONG_MAX if the cgroup is unlimited
+ * @usage: filled with the current usage
+ * @cache: filled with the page cache charged to the cgroup
+ */
+void mem_cgroup_get_pages(struct mem_cgroup *mem, unsigned long *limit,
+			  unsigned long *usage, unsigned long *cache)
+{
+	u64 val;
+	s64 nr;
+
+	val = res_counter_read_u64(&mem->res, RES_LIMIT) >> PAGE_SHIFT;
+	*limit = min_t(u64, val, ULONG_MAX);
+	val = res_counter_read_u64(&mem->res, RES_USAGE) >> PAGE_SHIFT;
+	*usage = min_t(u64, val, ULONG_MAX);
+	nr = mem_cgroup_read_stat(&mem->stat, MEM_CGROUP_STAT_CACHE);
+	*cache = nr > 0 ? nr : 0;
+}
+EXPORT_SYMBOL_GPL(mem_cgroup_get_pages);
+
+static void mem_cgroup_pressure_notify(struct mem_cgroup *mem)
+{
+	struct mem_cgroup_eventfd *ev;
+	unsigned long target;
+
+	target = mem->last_pressure_jiffies + MEM_NOTIFY_FREQ;
+	if (time_before(jiffies, target))
+		return;
+
+	spin_lock(&mem->pressure_lock);
+	target = mem->last_pressure_jiffies + MEM_NOTIFY_FREQ;
+	if (time_before(jiffies, target)) {
+		spin_unlock(&mem->pressure_lock);
+		return;
+	}
+	mem->last_pressure_jiffies = jiffies;
+	list_for_each_entry(ev, &mem->pressure_eventfds, list)
+		eventfd_ctx_signal(ev->ctx, 1);
+	spin_unlock(&mem->pressure_lock);
+
+	blocking_notifier_call_chain(&memcg_pressure_chain, 0, mem);
+}
+
+/* Take @ev off the cgroup's list; returns 0 if someone else already did */
+static int mem_cgroup_eventfd_unlink(struct mem_cgroup_eventfd *ev)
+{
+	struct mem_cgroup *mem = ev->mem;
+	int ret = 0;
+
+	spin_lock(&mem->pressure_lock);
+	if (!list_empty(&ev->list)) {
+		list_del_init(&ev->list);
+		ret = 1;
+	}
+	spin_unlock(&mem->pressure_lock);
+	return ret;
+}
+
+static void mem_cgroup_eventfd_free(struct mem_cgroup_eventfd *ev)
+{
+	eventfd_ctx_put(ev->ctx);
+	mem_cgroup_put(ev->mem);
+	kfree(ev);
+}
+
+/* Free an unlinked registration that may still get a POLLHUP */
+static void mem_cgroup_eventfd_destroy(struct mem_cgroup_eventfd *ev)
+{
+	remove_wait_queue(ev->wqh, &ev->wait);
+	cancel_work_sync(&ev->remove);
+	mem_cgroup_eventfd_free(ev);
+}
+
+static void mem_cgroup_eventfd_remove(struct work_struct *work)
+{
+	struct mem_cgroup_eventfd *ev =
+		container_of(work, struct mem_cgroup_eventfd, remove);
+
+	/* unregistered or cgroup removed meanwhile: they free it */
+	if (!mem_cgroup_eventfd_unlink(ev))
+		return;
+	remove_wait_queue(ev->wqh, &ev->wait);
+	mem_cgroup_eventfd_free(ev);
+}
+
+/*
+ * Called with the eventfd's wait queue lock held.  POLLHUP means the last
+ * file reference is gone, so nobody can read the eventfd any more.
+ */
+static int mem_cgroup_eventfd_wake(wait_queue_t *wait, unsigned mode,
+				   int sync, void *key)
+{
+	struct mem_cgroup_eventfd *ev =
+		container_of(wait, struct mem_cgroup_eventfd, wait);
+
+	if ((unsigned long)key & POLLHUP)
+		schedule_work(&ev->remove);
+	return 0;
+}
+
+static void mem_cgroup_eventfd_queue(struct file *file, wait_queue_head_t *wqh,
+				     poll_table *pt, int exclusive)
+{
+	struct mem_cgroup_eventfd *ev =
+		container_of(pt, struct mem_cgroup_eventfd, pt);
+
+	ev->wqh = wqh;
+	add_wait_queue(wqh, &ev->wait);
+}
+
+/*
+ * Writing "<fd>" registers an eventfd, "-<fd>" unregisters it again.  A
+ * registration also goes away when the eventfd is closed for good.
+ * Reading returns the number of registered eventfds.
+ */
+static int mem_cgroup_pressure_write(struct cgroup *cont, struct cftype *cft,
+				     const char *buffer)
+{
+	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
+	struct mem_cgroup_eventfd *ev, *new;
+	struct eventfd_ctx *ctx;
+	struct file *file;
+	long fd;
+	int ret;
+
+	ret = strict_strtol(buffer, 10, &fd);
+	if (ret)
+		return ret;
+
+	file = eventfd_fget(fd < 0 ? -fd : fd);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+	ctx = eventfd_ctx_fileget(file);
+
+	if (fd < 0) {
+		ret = -ENOENT;
+		spin_lock(&mem->pressure_lock);
+		list_for_each_entry(ev, &mem->pressure_eventfds, list) {
+			if (ev->ctx == ctx) {
+				list_del_init(&ev->list);
+				ret = 0;
+				break;
+			}
+		}
+		spin_unlock(&mem->pressure_lock);
+		if (!ret)
+			mem_cgroup_eventfd_destroy(ev);
+		goto out;
+	}
+
+	ret = -ENOMEM;
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		goto out;
+	new->mem = mem;
+	new->ctx = ctx;
+	INIT_WORK(&new->remove, mem_cgroup_eventfd_remove);
+	init_waitqueue_func_entry(&new->wait, mem_cgroup_eventfd_wake);
+	init_poll_funcptr(&new->pt, mem_cgroup_eventfd_queue);
+
+	/*
+	 * Queue on the eventfd before anyone can find the entry.  We hold
+	 * the file, so its POLLHUP cannot come before the entry is listed.
+	 */
+	file->f_op->poll(file, &new->pt);
+
+	spin_lock(&mem->pressure_lock);
+	list_for_each_entry(ev, &mem->pressure_eventfds, list) {
+		if (ev->ctx == ctx) {
+			spin_unlock(&mem->pressure_lock);
+			remove_wait_queue(new->wqh, &new->wait);
+			kfree(new);
+			ret = -EBUSY;
+			goto out;
+		}
+	}
+	/* the entry owns the context reference and one on the cgroup */
+	mem_cgroup_get(mem);
+	list_add_tail(&new->list, &mem->pressure_eventfds);
+	spin_unlock(&mem->pressure_lock);
+	fput(file);
+	return 0;
+
+out:
+	eventfd_ctx_put(ctx);
+	fput(file);
+	return ret;
+}
+
+static u64 mem_cgroup_pressure_read(struct cgroup *cont, struct cftype *cft)
+{
+	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
+	struct mem_cgroup_eventfd *ev;
+	u64 nr = 0;
+
+	spin_lock(&mem->pressure_lock);
+	list_for_each_entry(ev, &mem->pressure_eventfds, list)
+		nr++;
+	spin_unlock(&mem->pressure_lock);
+	return nr;
+}
+
+static void mem_cgroup_pressure_release(struct mem_cgroup *mem)
+{
+	struct mem_cgroup_eventfd *ev;
+
+	for (;;) {
+		spin_lock(&mem->pressure_lock);
+		if (list_empty(&mem->pressure_eventfds)) {
+			spin_unlock(&mem->pressure_lock);
+			break;
+		}
+		ev = list_first_entry(&mem->pressure_eventfds,
+				      struct mem_cgroup_eventfd, list);
+		list_del_init(&ev->list);
+		spin_unlock(&mem->pressure_lock);
+
+		mem_cgroup_eventfd_destroy(ev);
+	}
+}
+
 /*
  * Unlike exported interface, "oom" parameter is added. if oom==true,
  * oom-killer can be invoked.
@@ -874,6 +1146,8 @@ static int __mem_cgroup_try_charge(struct mm_struct *mm,
 		if (!(gfp_mask & __GFP_WAIT))
 			goto nomem;
 
+		mem_cgroup_pressure_notify(mem_over_limit);
+
 		ret = mem_cgroup_hierarchical_reclaim(mem_over_limit, gfp_mask,
 							noswap);
 		if (ret)
@@ -2063,6 +2337,11 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "pressure_eventfd",
+		.read_u64 = mem_cgroup_pressure_read,
+		.write_string = mem_cgroup_pressure_write,
+	},
 };
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_SWAP
@@ -2262,6 +2541,10 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	}
 	mem->last_scanned_child = NULL;
 	spin_lock_init(&mem->reclaim_param_lock);
+	spin_lock_init(&mem->pressure_lock);
+	INIT_LIST_HEAD(&mem->pressure_eventfds);
+	/* jiffies starts at INITIAL_JIFFIES: do not hold off the first one */
+	mem->last_pressure_jiffies = jiffies - MEM_NOTIFY_FREQ;
 
 	if (parent)
 		mem->swappiness = get_swappiness(parent);
@@ -2289,6 +2572,7 @@ static void mem_cgroup_destroy(struct cgroup_subsys *ss,
 		VM_BUG_ON(!mem_cgroup_is_obsolete(last_scanned_child));
 		mem_cgroup_put(last_scanned_child);
 	}
+	mem_cgroup_pressure_release(mem);
 	mem_cgroup_put(mem);
 }
 
@@ -0,0 +1,656 @@
+/*
+ * mm/prefetch_trace.c - record page cache misses and replay them
+ *
+ * Boot and application start-up read the same file ranges in the same
+ * order every time, but readahead only sees one file at a time and only
+ * reacts to sequential access.  Here the ranges read into the page cache
+ * during a window are recorded as (file, offset, length) and exported
+ * through /proc/prefetch/trace.  Writing a saved trace to
+ * /proc/prefetch/replay reads it all back in ahead of time from a kernel
+ * thread, before the readers get to it.
+ *
+ * See Documentation/vm/prefetch-trace.txt.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/path.h>
+#include <linux/namei.h>
+#include <linux/hash.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/vmalloc.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/prefetch_trace.h>
+
+#define PREFETCH_MAX_RECORDS	16384
+#define PREFETCH_MAX_FILES	2048
+#define PREFETCH_HASH_BITS	8
+
+/*
+ * A file seen during recording.  Its path is pinned while the window is
+ * open, so that the inode cannot be reused for another file; when the
+ * window closes it is turned into a name, and the mount is free to go.
+ */
+struct prefetch_file {
+	struct hlist_node link;
+	struct inode *inode;
+	struct path path;
+	char *name;			/* NULL if it had none */
+	int last;			/* index of its latest record */
+};
+
+/* One contiguous range of a file, in the order it was first read */
+struct prefetch_record {
+	unsigned int file;
+	pgoff_t start;
+	unsigned long nr_pages;
+};
+
+/* One line of a trace written to /proc/prefetch/replay */
+struct prefetch_replay {
+	struct list_head list;
+	pgoff_t start;
+	unsigned long nr_pages;
+	char path[0];
+};
+
+int prefetch_trace_active;
+
+/* Serializes control commands, trace readers and replay startup */
+static DEFINE_MUTEX(prefetch_mutex);
+/* Protects the recording state below against concurrent misses */
+static DEFINE_SPINLOCK(prefetch_lock);
+
+static struct hlist_head prefetch_hash[1 << PREFETCH_HASH_BITS];
+static struct prefetch_file *prefetch_files;
+static struct prefetch_record *prefetch_records;
+static unsigned int nr_prefetch_files;
+static unsigned int nr_prefetch_records;
+static unsigned long prefetch_dropped;
+static unsigned long prefetch_missed_pages;
+static pid_t prefetch_tgid;
+static unsigned long record_start;
+static unsigned long record_end;
+
+static LIST_HEAD(replay_list);
+static struct task_struct *replay_task;
+static DECLARE_COMPLETION(replay_done);
+static int replay_running;		/* replay_done still to be reaped */
+static int replay_abort;
+static unsigned long replay_entries;
+static unsigned long replay_pages;
+static unsigned long replay_failed;
+static unsigned long replay_pressure;
+static unsigned long replay_start;
+static unsigned long replay_end;
+
+static int __initdata prefetch_record_boot;
+
+static int __init prefetch_record_setup(char *str)
+{
+	prefetch_record_boot = 1;
+	return 1;
+}
+__setup("prefetch_record", prefetch_record_setup);
+
+static struct prefetch_file *prefetch_lookup_file(struct file *filp)
+{
+	struct inode *inode = filp->f_mapping->host;
+	struct hlist_head *head;
+	struct hlist_node *node;
+	struct prefetch_file *file;
+
+	head = &prefetch_hash[hash_ptr(inode, PREFETCH_HASH_BITS)];
+	hlist_for_each_entry(file, node, head, link)
+		if (file->inode == inode)
+			return file;
+
+	if (nr_prefetch_files == PREFETCH_MAX_FILES)
+		return NULL;
+
+	file = &prefetch_files[nr_prefetch_files++];
+	file->inode = inode;
+	file->path = filp->f_path;
+	path_get(&file->path);
+	file->name = NULL;
+	file->last = -1;
+	hlist_add_head(&file->link, head);
+	return file;
+}
+
+void __prefetch_trace_record(struct file *filp, pgoff_t offset,
+			     unsigned long nr_pages)
+{
+	struct prefetch_file *file;
+	struct prefetch_record *rec;
+
+	if (!nr_pages || current == replay_task)
+		return;
+	if (prefetch_tgid && current->tgid != prefetch_tgid)
+		return;
+	if (!S_ISREG(filp->f_mapping->host->i_mode))
+		return;
+
+	spin_lock(&prefetch_lock);
+	if (!prefetch_trace_active)
+		goto out;
+
+	prefetch_missed_pages += nr_pages;
+
+	file = prefetch_lookup_file(filp);
+	if (!file) {
+		prefetch_dropped++;
+		goto out;
+	}
+
+	/* Extend the file's latest range if this read continues it */
+	if (file->last >= 0) {
+		rec = &prefetch_records[file->last];
+		if (offset >= rec->start &&
+		    offset <= rec->start + rec->nr_pages) {
+			if (offset + nr_pages > rec->start + rec->nr_pages)
+				rec->nr_pages = offset + nr_pages - rec->start;
+			goto out;
+		}
+	}
+
+	if (nr_prefetch_records == PREFETCH_MAX_RECORDS) {
+		prefetch_dropped++;
+		goto out;
+	}
+
+	rec = &prefetch_records[nr_prefetch_records];
+	rec->file = file - prefetch_files;
+	rec->start = offset;
+	rec->nr_pages = nr_pages;
+	file->last = nr_prefetch_records++;
+out:
+	spin_unlock(&prefetch_lock);
+}
+
+/* Drop the recorded trace.  Called with prefetch_mutex held, not recording */
+static void prefetch_clear_trace(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_prefetch_files; i++)
+		kfree(prefetch_files[i].name);
+	for (i = 0; i < ARRAY_SIZE(prefetch_hash); i++)
+		INIT_HLIST_HEAD(&prefetch_hash[i]);
+	nr_prefetch_files = 0;
+	nr_prefetch_records = 0;
+	prefetch_dropped = 0;
+	prefetch_missed_pages = 0;
+}
+
+static void prefetch_free_trace(void)
+{
+	prefetch_clear_trace();
+	vfree(prefetch_files);
+	vfree(prefetch_records);
+	prefetch_files = NULL;
+	prefetch_records = NULL;
+}
+
+static int prefetch_start_recording(pid_t tgid)
+{
+	if (prefetch_trace_active)
+		return -EBUSY;
+
+	prefetch_clear_trace();
+	if (!prefetch_files)
+		prefetch_files = vmalloc(PREFETCH_MAX_FILES *
+					 sizeof(struct prefetch_file));
+	if (!prefetch_records)
+		prefetch_records = vmalloc(PREFETCH_MAX_RECORDS *
+					   sizeof(struct prefetch_record));
+	if (!prefetch_files || !prefetch_records) {
+		prefetch_free_trace();
+		return -ENOMEM;
+	}
+
+	spin_lock(&prefetch_lock);
+	prefetch_tgid = tgid;
+	record_start = jiffies;
+	record_end = 0;
+	prefetch_trace_active = 1;
+	spin_unlock(&prefetch_lock);
+	return 0;
+}
+
+/*
+ * Name the files of the trace and drop their paths.  A file that was
+ * deleted meanwhile, or whose name does not fit, is left out of the
+ * trace; replay looks the names up again anyway.
+ */
+static void prefetch_name_files(void)
+{
+	struct prefetch_file *file;
+	char *buf, *name;
+	unsigned int i;
+
+	buf = (char *)__get_free_page(GFP_KERNEL);
+	for (i = 0; i < nr_prefetch_files; i++) {
+		file = &prefetch_files[i];
+		if (buf && !d_unhashed(file->path.dentry)) {
+			name = d_path(&file->path, buf, PAGE_SIZE);
+			if (!IS_ERR(name))
+				file->name = kstrdup(name, GFP_KERNEL);
+		}
+		path_put(&file->path);
+	}
+	free_page((unsigned long)buf);
+}
+
+static void prefetch_stop_recording(void)
+{
+	int was_active;
+
+	spin_lock(&prefetch_lock);
+	was_active = prefetch_trace_active;
+	if (was_active) {
+		prefetch_trace_active = 0;
+		record_end = jiffies;
+	}
+	spin_unlock(&prefetch_lock);
+
+	/* nobody records into the trace any more */
+	if (was_active)
+		prefetch_name_files();
+}
+
+/*
+ * Replay must not push out memory that is in use: stop as soon as free
+ * memory gets close to the reserves, as mem_notify would report it.
+ */
+static int prefetch_memory_tight(unsigned long nr_pages)
+{
+	unsigned long free = global_page_state(NR_FREE_PAGES);
+
+	return free < 2 * totalreserve_pages + nr_pages;
+}
+
+static int prefetch_replay_thread(void *unused)
+{
+	struct prefetch_replay *entry, *next;
+	struct file *filp = NULL;
+	const char *path = NULL;
+
+	list_for_each_entry(entry, &replay_list, list) {
+		int ret;
+
+		if (replay_abort)
+			break;
+		if (prefetch_memory_tight(entry->nr_pages)) {
+			replay_pressure++;
+			break;
+		}
+
+		if (!path || strcmp(path, entry->path)) {
+			if (filp)
+				filp_close(filp, NULL);
+			path = entry->path;
+			filp = filp_open(path, O_RDONLY | O_LARGEFILE, 0);
+			if (IS_ERR(filp)) {
+				filp = NULL;
+				replay_failed++;
+			}
+		}
+		if (!filp)
+			continue;
+
+		ret = force_page_cache_readahead(filp->f_mapping, filp,
+					entry->start, entry->nr_pages);
+		if (ret > 0)
+			replay_pages += ret;
+		replay_entries++;
+		cond_resched();
+	}
+	if (filp)
+		filp_close(filp, NULL);
+
+	list_for_each_entry_safe(entry, next, &replay_list, list) {
+		list_del(&entry->list);
+		kfree(entry);
+	}
+
+	replay_end = jiffies;
+	replay_task = NULL;
+	complete(&replay_done);
+	return 0;
+}
+
+/*
+ * Stop a running replay, or reap one that has finished on its own.
+ * Called with prefetch_mutex held.
+ */
+static void prefetch_stop_replay(void)
+{
+	if (!replay_running)
+		return;
+	replay_abort = 1;
+	wait_for_completion(&replay_done);
+	replay_running = 0;
+}
+
+static int prefetch_start_replay(struct list_head *entries)
+{
+	struct task_struct *task;
+
+	prefetch_stop_replay();
+
+	list_splice_init(entries, &replay_list);
+	replay_abort = 0;
+	replay_entries = 0;
+	replay_pages = 0;
+	replay_failed = 0;
+	replay_pressure = 0;
+	replay_start = jiffies;
+	replay_end = 0;
+	INIT_COMPLETION(replay_done);
+
+	task = kthread_create(prefetch_replay_thread, NULL, "kprefetchd");
+	if (IS_ERR(task)) {
+		list_splice_init(&replay_list, entries);
+		return PTR_ERR(task);
+	}
+	replay_task = task;
+	replay_running = 1;
+	wake_up_process(task);
+	return 0;
+}
+
+static unsigned long prefetch_elapsed_ms(unsigned long start,
+					 unsigned long end, int running)
+{
+	if (!start)
+		return 0;
+	return jiffies_to_msecs((running ? jiffies : end) - start);
+}
+
+static int prefetch_control_show(struct seq_file *m, void *v)
+{
+	int running;
+
+	mutex_lock(&prefetch_mutex);
+	seq_printf(m, "recording:      %d\n", prefetch_trace_active);
+	seq_printf(m, "tgid:           %d\n", prefetch_tgid);
+	seq_printf(m, "record_ms:      %lu\n",
+		   prefetch_elapsed_ms(record_start, record_end,
+				       prefetch_trace_active));
+	seq_printf(m, "missed_pages:   %lu\n", prefetch_missed_pages);
+	seq_printf(m, "records:        %u\n", nr_prefetch_records);
+	seq_printf(m, "files:          %u\n", nr_prefetch_files);
+	seq_printf(m, "dropped:        %lu\n", prefetch_dropped);
+	running = replay_running && !completion_done(&replay_done);
+	seq_printf(m, "replaying:      %d\n", running);
+	seq_printf(m, "replay_ms:      %lu\n",
+		   prefetch_elapsed_ms(replay_start, replay_end, running));
+	seq_printf(m, "replay_entries: %lu\n", replay_entries);
+	seq_printf(m, "replay_pages:   %lu\n", replay_pages);
+	seq_printf(m, "replay_failed:  %lu\n", replay_failed);
+	seq_printf(m, "replay_pressure: %lu\n", replay_pressure);
+	mutex_unlock(&prefetch_mutex);
+	return 0;
+}
+
+static int prefetch_control_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, prefetch_control_show, NULL);
+}
+
+/*
+ * Commands: "start [tgid]" begins a window, recording the misses of the
+ * whole system or of one thread group only; "stop" ends it; "clear"
+ * drops the trace; "abort" stops a running replay.
+ */
+static ssize_t prefetch_control_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	char cmd[32];
+	size_t len = min(count, sizeof(cmd) - 1);
+	int tgid = 0;
+	int err = 0;
+
+	if (copy_from_user(cmd, buf, len))
+		return -EFAULT;
+	cmd[len] = '\0';
+
+	mutex_lock(&prefetch_mutex);
+	if (!strncmp(cmd, "start", 5)) {
+		if (cmd[5] && cmd[5] != '\n' &&
+		    (sscanf(cmd + 5, "%d", &tgid) != 1 || tgid < 0))
+			err = -EINVAL;
+		else
+			err = prefetch_start_recording(tgid);
+	} else if (!strncmp(cmd, "stop", 4)) {
+		prefetch_stop_recording();
+	} else if (!strncmp(cmd, "clear", 5)) {
+		prefetch_stop_recording();
+		prefetch_free_trace();
+	} else if (!strncmp(cmd, "abort", 5)) {
+		prefetch_stop_replay();
+	} else
+		err = -EINVAL;
+	mutex_unlock(&prefetch_mutex);
+
+	return err ? err : count;
+}
+
+static const struct file_operations prefetch_control_fops = {
+	.open		= prefetch_control_open,
+	.read		= seq_read,
+	.write		= prefetch_control_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* The trace can only be read once the window is closed */
+static void *prefetch_trace_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&prefetch_mutex);
+	if (prefetch_trace_active)
+		return ERR_PTR(-EBUSY);
+	if (*pos >= nr_prefetch_records)
+		return NULL;
+	return &prefetch_records[*pos];
+}
+
+static void *prefetch_trace_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	if (*pos >= nr_prefetch_records)
+		return NULL;
+	return &prefetch_records[*pos];
+}
+
+static void prefetch_trace_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&prefetch_mutex);
+}
+
+/* "<start> <pages> <path>", the path escaped so that replay can parse it */
+static int prefetch_trace_show(struct seq_file *m, void *v)
+{
+	struct prefetch_record *rec = v;
+	const char *name = prefetch_files[rec->file].name;
+
+	if (!name)
+		return SEQ_SKIP;
+	seq_printf(m, "%lu %lu ", rec->start, rec->nr_pages);
+	seq_escape(m, name, " \t\n\\");
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static const struct seq_operations prefetch_trace_op = {
+	.start	= prefetch_trace_start,
+	.next	= prefetch_trace_next,
+	.stop	= prefetch_trace_stop,
+	.show	= prefetch_trace_show,
+};
+
+static int prefetch_trace_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &prefetch_trace_op);
+}
+
+static const struct file_operations prefetch_trace_fops = {
+	.open		= prefetch_trace_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+/* A trace being written to /proc/prefetch/replay */
+struct prefetch_replay_buf {
+	struct list_head entries;
+	size_t len;
+	char line[PATH_MAX + 48];
+};
+
+/* Undo the octal escapes of seq_escape() in place */
+static void prefetch_unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '7' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) |
+				(s[3] - '0');
+			s += 4;
+		} else
+			*d++ = *s++;
+	}
+	*d = '\0';
+}
+
+static int prefetch_parse_line(struct prefetch_replay_buf *rb, char *line)
+{
+	struct prefetch_replay *entry;
+	unsigned long start, nr_pages;
+	char *path;
+	int n = 0;
+
+	line = strstrip(line);
+	if (!*line)
+		return 0;
+	if (sscanf(line, "%lu %lu %n", &start, &nr_pages, &n) < 2 || !n)
+		return -EINVAL;
+	path = line + n;
+	prefetch_unescape(path);
+	if (path[0] != '/' || !nr_pages)
+		return -EINVAL;
+
+	entry = kmalloc(sizeof(*entry) + strlen(path) + 1, GFP_KERNEL);
+	if (!entry)
+		return -ENOMEM;
+	entry->start = start;
+	entry->nr_pages = nr_pages;
+	strcpy(entry->path, path);
+	list_add_tail(&entry->list, &rb->entries);
+	return 0;
+}
+
+static int prefetch_replay_open(struct inode *inode, struct file *file)
+{
+	struct prefetch_replay_buf *rb;
+
+	rb = kmalloc(sizeof(*rb), GFP_KERNEL);
+	if (!rb)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&rb->entries);
+	rb->len = 0;
+	file->private_data = rb;
+	return 0;
+}
+
+static ssize_t prefetch_replay_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct prefetch_replay_buf *rb = file->private_data;
+	size_t done = 0;
+
+	while (done < count) {
+		size_t len = min(count - done, sizeof(rb->line) - 1 - rb->len);
+		char *nl;
+		int err;
+
+		if (!len)
+			return -EINVAL;		/* line too long */
+		if (copy_from_user(rb->line + rb->len, buf + done, len))
+			return -EFAULT;
+		rb->len += len;
+		rb->line[rb->len] = '\0';
+		done += len;
+
+		/* Parse the complete lines, keep the partial one for later */
+		while ((nl = strchr(rb->line, '\n'))) {
+			*nl = '\0';
+			err = prefetch_parse_line(rb, rb->line);
+			if (err)
+				return err;
+			rb->len -= nl + 1 - rb->line;
+			memmove(rb->line, nl + 1, rb->len + 1);
+		}
+	}
+	return count;
+}
+
+/* The whole trace is in: start replaying it */
+static int prefetch_replay_release(struct inode *inode, struct file *file)
+{
+	struct prefetch_replay_buf *rb = file->private_data;
+	struct prefetch_replay *entry, *next;
+	int err = 0;
+
+	if (rb->len)
+		err = prefetch_parse_line(rb, rb->line);
+
+	if (!err && !list_empty(&rb->entries)) {
+		mutex_lock(&prefetch_mutex);
+		err = prefetch_start_replay(&rb->entries);
+		mutex_unlock(&prefetch_mutex);
+	}
+
+	list_for_each_entry_safe(entry, next, &rb->entries, list)
+		kfree(entry);
+	kfree(rb);
+	return err;
+}
+
+static const struct file_operations prefetch_replay_fops = {
+	.open		= prefetch_replay_open,
+	.write		= prefetch_replay_write,
+	.release	= prefetch_replay_release,
+};
+
+static int __init prefetch_trace_init(void)
+{
+	struct proc_dir_entry *dir;
+
+	dir = proc_mkdir("prefetch", NULL);
+	if (!dir)
+		return -ENOMEM;
+	proc_create("control", S_IRUGO | S_IWUSR, dir, &prefetch_control_fops);
+	proc_create("trace", S_IRUSR, dir, &prefetch_trace_fops);
+	proc_create("replay", S_IWUSR, dir, &prefetch_replay_fops);
+
+	if (prefetch_record_boot) {
+		mutex_lock(&prefetch_mutex);
+		if (prefetch_start_recording(0))
+			printk(KERN_WARNING "prefetch: cannot record boot\n");
+		mutex_unlock(&prefetch_mutex);
+	}
+	return 0;
+}
+module_init(prefetch_trace_init);
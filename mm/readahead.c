@@ -16,6 +16,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/prefetch_trace.h>
 
 void default_unplug_io_fn(struct backing_dev_info *bdi, struct page *page)
 {
@@ -132,6 +133,8 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	int page_idx;
 	int ret = 0;
 	loff_t isize = i_size_read(inode);
+	pgoff_t run_start = 0;		/* run of pages to be read, */
+	unsigned long run_len = 0;	/* for prefetch_trace_record() */
 
 	if (isize == 0)
 		goto out;
@@ -150,8 +153,12 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page) {
+			/* cached, no I/O: not part of the trace */
+			prefetch_trace_record(filp, run_start, run_len);
+			run_len = 0;
 			continue;
+		}
 
 		page = page_cache_alloc_cold(mapping);
 		if (!page)
@@ -160,8 +167,11 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
+		if (!run_len++)
+			run_start = page_offset;
 		ret++;
 	}
+	prefetch_trace_record(filp, run_start, run_len);
 
 	/*
 	 * Now start the IO.  We ignore I/O errors - if the page is not
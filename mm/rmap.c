@@ -50,6 +50,7 @@
 #include <linux/memcontrol.h>
 #include <linux/mmu_notifier.h>
 #include <linux/migrate.h>
+#include <linux/ksm.h>
 
 #include <asm/tlbflush.h>
 
@@ -707,7 +708,7 @@ void page_add_file_rmap(struct page *page)
  */
 void page_dup_rmap(struct page *page, struct vm_area_struct *vma, unsigned long address)
 {
-	if (PageAnon(page))
+	if (PageAnon(page) && !PageKsm(page))
 		__page_check_anon_rmap(page, vma, address);
 	atomic_inc(&page->_mapcount);
 }
@@ -815,6 +816,20 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 				spin_unlock(&mmlist_lock);
 			}
 			dec_mm_counter(mm, anon_rss);
+		} else if (!migration && !PageSwapBacked(page)) {
+			/*
+			 * Lazily freed by MADV_FREE: drop the page, unless
+			 * it was written to since.  Then it is ordinary
+			 * anonymous memory again and the pte goes back.
+			 */
+			if (PageDirty(page)) {
+				SetPageSwapBacked(page);
+				set_pte_at(mm, address, pte, pteval);
+				ret = SWAP_FAIL;
+				goto out_unmap;
+			}
+			dec_mm_counter(mm, anon_rss);
+			goto discard;
 		} else if (PAGE_MIGRATION) {
 			/*
 			 * Store the pfn of the page in a special migration
@@ -834,7 +849,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, file_rss);
 
-
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
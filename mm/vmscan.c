@@ -465,6 +465,7 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		spin_unlock_irq(&mapping->tree_lock);
 		swap_free(swap);
 	} else {
+		workingset_eviction(mapping, page);
 		__remove_from_page_cache(page);
 		spin_unlock_irq(&mapping->tree_lock);
 	}
@@ -640,6 +641,31 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 					referenced && page_mapping_inuse(page))
 			goto activate_locked;
 
+		/*
+		 * Anonymous memory lazily freed with MADV_FREE needs no
+		 * backing store: unmap it and drop it.  try_to_unmap()
+		 * fails if it was written to in the meantime.
+		 */
+		if (PageAnon(page) && !PageSwapBacked(page)) {
+			if (page_mapped(page)) {
+				switch (try_to_unmap(page, 0)) {
+				case SWAP_FAIL:
+					goto activate_locked;
+				case SWAP_AGAIN:
+					goto keep_locked;
+				case SWAP_MLOCK:
+					goto cull_mlocked;
+				case SWAP_SUCCESS:
+					; /* try to free the page below */
+				}
+			}
+			if (!page_freeze_refs(page, 1))
+				goto keep_locked;
+			count_vm_event(PGLAZYFREED);
+			__clear_page_locked(page);
+			goto free_it;
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -790,11 +816,6 @@ keep:
 	return nr_reclaimed;
 }
 
-/* LRU Isolation modes. */
-#define ISOLATE_INACTIVE 0	/* Isolate inactive pages. */
-#define ISOLATE_ACTIVE 1	/* Isolate active pages. */
-#define ISOLATE_BOTH 2		/* Isolate both active and inactive pages. */
-
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
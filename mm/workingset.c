@@ -0,0 +1,163 @@
+/*
+ * mm/workingset.c - working set detection for the file LRU
+ *
+ * A page that enters the inactive file list either gets referenced twice
+ * and is activated, or it reaches the tail and is evicted.  Reclaim cannot
+ * tell a page that is evicted and read right back (the working set
+ * outgrew the inactive list) from a page read once by a streaming reader:
+ * both enter the inactive list and compete only with each other, while
+ * the active list keeps whatever was hot some time ago.
+ *
+ * Every zone counts evictions and activations in zone->inactive_age.
+ * When a file page is evicted, the current value is remembered for it.
+ * If the page is faulted back in, the difference to the then current
+ * value, its refault distance, is the number of inactive slots the page
+ * was short of to stay in memory.  The active list could have given it
+ * that many: if the distance is no larger than the active file list,
+ * the page is activated at once and competes with the active pages
+ * rather than being thrown out again by the next streaming read.
+ *
+ * The evicted pages are remembered in a fixed-size table hashed by
+ * (mapping, index), sized at boot like the other large system hashes.
+ * A slot holds the eviction time, the zone and a few more bits of the
+ * hash to weed out most collisions.  New evictions overwrite old ones,
+ * which bounds the memory used and ages out stale entries.  A false hit
+ * only activates one page.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/hash.h>
+#include <linux/bootmem.h>
+#include <linux/init.h>
+#include <linux/vmstat.h>
+
+#define SHADOW_ZONE_BITS	(ZONES_SHIFT + NODES_SHIFT)
+#define SHADOW_COOKIE_BITS	8
+#define SHADOW_COOKIE_MASK	((1UL << SHADOW_COOKIE_BITS) - 1)
+#define EVICTION_SHIFT		(1 + SHADOW_ZONE_BITS + SHADOW_COOKIE_BITS)
+#define EVICTION_MASK		(~0UL >> EVICTION_SHIFT)
+
+static unsigned long *shadow_table __read_mostly;
+static unsigned int shadow_shift __read_mostly;
+
+static unsigned long *shadow_slot(struct address_space *mapping,
+				  pgoff_t index, unsigned long *cookie)
+{
+	unsigned long hash;
+
+	hash = hash_long((unsigned long)mapping ^
+			 hash_long(index, BITS_PER_LONG), BITS_PER_LONG);
+	*cookie = (hash >> (BITS_PER_LONG - shadow_shift -
+			    SHADOW_COOKIE_BITS)) & SHADOW_COOKIE_MASK;
+	return &shadow_table[hash >> (BITS_PER_LONG - shadow_shift)];
+}
+
+/* Bit 0 marks a used slot */
+static unsigned long pack_shadow(unsigned long eviction, struct zone *zone,
+				 unsigned long cookie)
+{
+	eviction = (eviction << SHADOW_COOKIE_BITS) | cookie;
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	return (eviction << 1) | 1;
+}
+
+static void unpack_shadow(unsigned long entry, struct zone **zone,
+			  unsigned long *cookie, unsigned long *eviction)
+{
+	int zid, nid;
+
+	entry >>= 1;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	*cookie = entry & SHADOW_COOKIE_MASK;
+	*eviction = entry >> SHADOW_COOKIE_BITS;
+	*zone = NODE_DATA(nid)->node_zones + zid;
+}
+
+/**
+ * workingset_eviction - note the eviction of a file page
+ * @mapping: address space the page was cached in
+ * @page: the page being evicted
+ *
+ * Called by reclaim just before the page leaves the page cache.
+ */
+void workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction, cookie, *slot;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	if (!shadow_table)
+		return;
+
+	slot = shadow_slot(mapping, page->index, &cookie);
+	*slot = pack_shadow(eviction & EVICTION_MASK, zone, cookie);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @mapping: address space the page is read into
+ * @index: its offset in @mapping
+ *
+ * Returns 1 if the page should be activated right away, 0 otherwise.
+ */
+int workingset_refault(struct address_space *mapping, pgoff_t index)
+{
+	unsigned long entry, cookie, shadow_cookie, eviction;
+	unsigned long refault, distance, *slot;
+	struct zone *zone;
+
+	if (!shadow_table)
+		return 0;
+
+	slot = shadow_slot(mapping, index, &cookie);
+	entry = *slot;
+	if (!(entry & 1))
+		return 0;
+	unpack_shadow(entry, &zone, &shadow_cookie, &eviction);
+	if (shadow_cookie != cookie)
+		return 0;
+	*slot = 0;
+
+	refault = atomic_long_read(&zone->inactive_age);
+	distance = (refault - eviction) & EVICTION_MASK;
+
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+	if (distance > zone_page_state(zone, NR_ACTIVE_FILE))
+		return 0;
+
+	inc_zone_state(zone, WORKINGSET_ACTIVATE);
+	return 1;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+static int __init workingset_init(void)
+{
+	unsigned long entries = max(totalram_pages / 2, 4096UL);
+	unsigned long *table;
+	unsigned int shift;
+
+	/* One slot for every two pages of memory */
+	table = alloc_large_system_hash("Workingset", sizeof(unsigned long),
+					entries, 0, 0, &shift, NULL, 0);
+	memset(table, 0, sizeof(unsigned long) << shift);
+
+	shadow_shift = shift;
+	smp_wmb();
+	shadow_table = table;
+	return 0;
+}
+module_init(workingset_init);